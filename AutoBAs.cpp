@@ -6,134 +6,1553 @@
 #include <map>
 #include <cmath>     // For std::fabs, std::sqrt, std::pow
 #include <cfloat>    // For FLT_MAX, FLT_MIN
+#include <climits>   // For INT_MAX, INT_MIN
 #include <string>    // For std::to_string, std::string
 #include <functional> // For std::reference_wrapper
 #include <initializer_list> // For std::max/min with {}
 #include <numeric>   // For std::accumulate
+#include <cstdint>   // For fixed-width types in the profile cache file
+#include <cstdio>    // For FILE*, std::rename, std::remove
+#include <cstring>   // For std::memcpy (export and journal encoding)
+#include <thread>    // For the worker pool
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>    // For std::shared_ptr
+#include <chrono>    // For the time-sliced recalculation budget
+#include <cstdlib>   // For std::strtof (parameter sweep grid)
+#include <tuple>     // For the event journal's probe and PBAL keys
+#include <cstdarg>   // For FormatKey
+
+#ifndef _WIN32
+#include <sys/mman.h> // For mmap/munmap (profile cache)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // --- Undefine potential conflicting macros ---
 #undef max
 #undef min
 // -----------------------------------------
 
-SCDLLName("AUTO BAs")
+#include "AutoBAsCore.h" // Formation, activation and cut rules, shared with the offline tools
+
+SCDLLName("AUTO BAs")
+
+// --- Allocation Counting Hook ---
+// Test builds only: with AUTOBAS_COUNT_ALLOCATIONS defined, every heap allocation made by this DLL is counted
+// (tests/LiveUpdateAllocationTest.cpp checks that live updates at known prices do not allocate).
+#ifdef AUTOBAS_COUNT_ALLOCATIONS
+#include <new>
+std::atomic<unsigned long long> g_HeapAllocationCount(0);
+
+void* operator new(std::size_t size) {
+    g_HeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* block = std::malloc(size ? size : 1);
+    if (block == nullptr) throw std::bad_alloc();
+    return block;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, std::size_t) noexcept { std::free(block); }
+void operator delete[](void* block, std::size_t) noexcept { std::free(block); }
+#endif
+
+// --- Profile Disk Cache ---
+
+// A completed session fetched from the VbP study, waiting to be written to the cache file
+struct s_ProfileCacheRecord {
+    double StartDateTime = 0.0;
+    double EndDateTime = 0.0;
+    int32_t BaseTick = 0;
+    std::vector<s_ProfileCacheLevel> Levels;
+};
+
+// Read-only memory mapping of a profile cache file. Path stays set while the mapping is closed.
+struct s_ProfileDiskCache {
+    std::string Path;
+    const uint8_t* Data = nullptr;
+    size_t Size = 0;
+    bool WriteFailed = false; // Stop retrying writes for this path after a failure
+#ifdef _WIN32
+    HANDLE FileHandle = INVALID_HANDLE_VALUE;
+    HANDLE MappingHandle = NULL;
+#endif
+
+    ~s_ProfileDiskCache() { Close(); }
+
+    bool IsOpen() const { return Data != nullptr; }
+
+    const s_ProfileCacheHeader* GetHeader() const {
+        return reinterpret_cast<const s_ProfileCacheHeader*>(Data);
+    }
+
+    const s_ProfileCacheIndexEntry* GetIndex() const {
+        return reinterpret_cast<const s_ProfileCacheIndexEntry*>(Data + sizeof(s_ProfileCacheHeader));
+    }
+
+    uint32_t GetSessionCount() const { return IsOpen() ? GetHeader()->SessionCount : 0; }
+
+    const s_ProfileCacheLevel* GetLevels(const s_ProfileCacheIndexEntry& entry) const {
+        return reinterpret_cast<const s_ProfileCacheLevel*>(Data + entry.LevelOffset);
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (Data != nullptr) UnmapViewOfFile(Data);
+        if (MappingHandle != NULL) CloseHandle(MappingHandle);
+        if (FileHandle != INVALID_HANDLE_VALUE) CloseHandle(FileHandle);
+        MappingHandle = NULL;
+        FileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (Data != nullptr) munmap(const_cast<uint8_t*>(Data), Size);
+#endif
+        Data = nullptr;
+        Size = 0;
+    }
+
+    // Maps the file and validates header and index. Returns false (and stays closed) on any mismatch.
+    bool Open(const std::string& path, float tickSize, int tickMultiplier) {
+        Close();
+        Path = path;
+#ifdef _WIN32
+        FileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (FileHandle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(FileHandle, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(s_ProfileCacheHeader)) { Close(); return false; }
+        MappingHandle = CreateFileMappingA(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (MappingHandle == NULL) { Close(); return false; }
+        Data = reinterpret_cast<const uint8_t*>(MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (Data == nullptr) { Close(); return false; }
+        Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(s_ProfileCacheHeader)) { close(fd); return false; }
+        void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) return false;
+        Data = reinterpret_cast<const uint8_t*>(mapped);
+        Size = static_cast<size_t>(st.st_size);
+#endif
+        const s_ProfileCacheHeader* header = GetHeader();
+        bool valid = header->Magic == PROFILE_CACHE_MAGIC && header->Version == PROFILE_CACHE_VERSION &&
+                     header->TickMultiplier == tickMultiplier && std::fabs(header->TickSize - tickSize) < tickSize * 0.001f &&
+                     sizeof(s_ProfileCacheHeader) + (uint64_t)header->SessionCount * sizeof(s_ProfileCacheIndexEntry) <= Size;
+        for (uint32_t i = 0; valid && i < header->SessionCount; ++i) {
+            const s_ProfileCacheIndexEntry& entry = GetIndex()[i];
+            // Offset first, then the count against the bytes left after it, so a corrupt offset cannot wrap the sum
+            if (entry.NumLevels > PROFILE_CACHE_MAX_LEVELS || entry.LevelOffset > Size ||
+                entry.NumLevels > (Size - entry.LevelOffset) / sizeof(s_ProfileCacheLevel)) valid = false;
+            if (i > 0 && !(GetIndex()[i - 1].StartDateTime < entry.StartDateTime)) valid = false;
+        }
+        if (!valid) { Close(); return false; }
+        return true;
+    }
+
+    // Binary search by session start; the end time must also match so a changed session definition misses.
+    const s_ProfileCacheIndexEntry* Find(double startDateTime, double endDateTime) const {
+        if (!IsOpen()) return nullptr;
+        const s_ProfileCacheIndexEntry* first = GetIndex();
+        const s_ProfileCacheIndexEntry* last = first + GetSessionCount();
+        const s_ProfileCacheIndexEntry* it = std::lower_bound(first, last, startDateTime,
+            [](const s_ProfileCacheIndexEntry& e, double value) { return e.StartDateTime < value; });
+        if (it == last || it->StartDateTime != startDateTime || it->EndDateTime != endDateTime) return nullptr;
+        return it;
+    }
+};
+
+// Keeps the cache file mapped for one study call at most. Windows cannot replace a mapped file, so a chart that holds
+// its mapping between calls would stop every other chart on the symbol from writing; this way the file is only
+// mapped while a load or rehydration reads it.
+struct s_ProfileCacheMapping {
+    s_ProfileDiskCache& Cache;
+    float TickSize;
+    int TickMultiplier;
+    bool Enabled;
+
+    s_ProfileCacheMapping(s_ProfileDiskCache& cache, float tickSize, int tickMultiplier, bool enabled)
+        : Cache(cache), TickSize(tickSize), TickMultiplier(tickMultiplier), Enabled(enabled) {}
+    ~s_ProfileCacheMapping() { Cache.Close(); }
+
+    // Maps the file on first use in the call, picking up whatever another chart last wrote
+    void Map() {
+        if (Enabled && !Cache.IsOpen() && !Cache.Path.empty()) Cache.Open(Cache.Path, TickSize, TickMultiplier);
+    }
+};
+
+// Builds the dense level array for one session from raw VbP levels. Returns false if the session is not cacheable.
+bool BuildProfileCacheRecord(const std::vector<s_VolumeAtPriceV2>& rawLevels, double startDateTime, double endDateTime, s_ProfileCacheRecord& record) {
+    if (rawLevels.empty()) return false;
+    int minTick = rawLevels[0].PriceInTicks;
+    int maxTick = rawLevels[0].PriceInTicks;
+    for (const auto& vap : rawLevels) {
+        minTick = std::min(minTick, vap.PriceInTicks);
+        maxTick = std::max(maxTick, vap.PriceInTicks);
+    }
+    int64_t span = static_cast<int64_t>(maxTick) - minTick + 1;
+    if (span <= 0 || span > PROFILE_CACHE_MAX_LEVELS) return false;
+
+    record.StartDateTime = startDateTime;
+    record.EndDateTime = endDateTime;
+    record.BaseTick = minTick;
+    record.Levels.assign(static_cast<size_t>(span), s_ProfileCacheLevel());
+    for (const auto& vap : rawLevels) {
+        s_ProfileCacheLevel& level = record.Levels[vap.PriceInTicks - minTick];
+        level.Volume += vap.Volume;
+        level.NumberOfTrades += vap.NumberOfTrades;
+    }
+    return true;
+}
+
+// Replaces path with a fully written temporary file; the temporary is removed on failure.
+// busy, when given, is set if path could not be replaced only because another process has it open, locked or
+// mapped (Windows keeps such a file from being replaced), which is worth retrying later rather than a write failure.
+// A rename on POSIX never fails for that reason.
+bool CommitTempFile(const std::string& tempPath, const std::string& path, bool* busy = nullptr) {
+#ifdef _WIN32
+    bool ok = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+    if (!ok && busy != nullptr) {
+        DWORD error = GetLastError();
+        *busy = error == ERROR_SHARING_VIOLATION || error == ERROR_LOCK_VIOLATION || error == ERROR_USER_MAPPED_FILE;
+    }
+#else
+    bool ok = std::rename(tempPath.c_str(), path.c_str()) == 0;
+    if (busy != nullptr) *busy = false;
+#endif
+    if (!ok) std::remove(tempPath.c_str());
+    return ok;
+}
+
+// Rewrites the cache file with the sessions already mapped plus the newly fetched ones. Sessions that start before
+// keepFromDateTime (the oldest loaded session) are left out, so the file never holds more than the loaded window.
+// Writes to a temporary file first so a concurrent reader never sees a partial file. busy is set when the file
+// could not be replaced because another chart was reading it; the cache is left closed either way.
+bool WriteProfileCacheFile(s_ProfileDiskCache& cache, const std::string& path, const std::string& tempPath, float tickSize, int tickMultiplier, const std::vector<s_ProfileCacheRecord>& newRecords, double keepFromDateTime, bool& busy) {
+    busy = false;
+    struct s_SourceSession {
+        s_ProfileCacheIndexEntry Entry;
+        const s_ProfileCacheLevel* Levels;
+    };
+    std::vector<s_SourceSession> sessions;
+    sessions.reserve(cache.GetSessionCount() + newRecords.size());
+    for (const auto& record : newRecords) {
+        if (record.StartDateTime < keepFromDateTime) continue;
+        s_SourceSession source;
+        source.Entry.StartDateTime = record.StartDateTime;
+        source.Entry.EndDateTime = record.EndDateTime;
+        source.Entry.BaseTick = record.BaseTick;
+        source.Entry.NumLevels = static_cast<uint32_t>(record.Levels.size());
+        source.Levels = record.Levels.data();
+        sessions.push_back(source);
+    }
+    for (uint32_t i = 0; i < cache.GetSessionCount(); ++i) {
+        const s_ProfileCacheIndexEntry& entry = cache.GetIndex()[i];
+        if (entry.StartDateTime < keepFromDateTime) continue; // Rolled out of the loaded window
+        bool replaced = false;
+        for (const auto& record : newRecords) {
+            if (record.StartDateTime == entry.StartDateTime) { replaced = true; break; }
+        }
+        if (!replaced) sessions.push_back({entry, cache.GetLevels(entry)});
+    }
+    std::sort(sessions.begin(), sessions.end(), [](const s_SourceSession& a, const s_SourceSession& b) {
+        return a.Entry.StartDateTime < b.Entry.StartDateTime;
+    });
+
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    s_ProfileCacheHeader header;
+    header.TickSize = tickSize;
+    header.TickMultiplier = tickMultiplier;
+    header.SessionCount = static_cast<uint32_t>(sessions.size());
+    uint64_t offset = sizeof(s_ProfileCacheHeader) + sessions.size() * sizeof(s_ProfileCacheIndexEntry);
+    for (auto& session : sessions) {
+        session.Entry.LevelOffset = offset;
+        offset += (uint64_t)session.Entry.NumLevels * sizeof(s_ProfileCacheLevel);
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < sessions.size(); ++i) {
+        ok = fwrite(&sessions[i].Entry, sizeof(s_ProfileCacheIndexEntry), 1, file) == 1;
+    }
+    for (size_t i = 0; ok && i < sessions.size(); ++i) {
+        if (sessions[i].Entry.NumLevels > 0) {
+            ok = fwrite(sessions[i].Levels, sizeof(s_ProfileCacheLevel), sessions[i].Entry.NumLevels, file) == sessions[i].Entry.NumLevels;
+        }
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    // The old mapping is still referenced above, so only release it once the new file is complete
+    cache.Close();
+    return CommitTempFile(tempPath, path, &busy);
+}
+
+// Formats into key without truncation. key keeps its capacity, so a key formatted on every call only
+// allocates when it grows.
+void FormatKey(std::string& key, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list sizing;
+    va_copy(sizing, args);
+    int length = std::vsnprintf(nullptr, 0, format, sizing);
+    va_end(sizing);
+    key.resize(length > 0 ? static_cast<size_t>(length) : 0);
+    if (length > 0) std::vsnprintf(&key[0], key.size() + 1, format, args);
+    va_end(args);
+}
+
+// Chart symbol with everything but letters, digits, '-', '_' and '.' replaced, for file and segment names
+std::string SafeSymbolName(SCStudyInterfaceRef sc) {
+    std::string symbol = sc.Symbol.GetChars();
+    for (auto& ch : symbol) {
+        bool safe = (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '-' || ch == '_' || ch == '.';
+        if (!safe) ch = '_';
+    }
+    return symbol;
+}
+
+// Data-folder path prefix shared by all per-symbol files this study writes
+std::string BuildStudyFilePrefix(SCStudyInterfaceRef sc) {
+    std::string symbol = SafeSymbolName(sc);
+    std::string folder = sc.DataFilesFolder().GetChars();
+#ifdef _WIN32
+    const char separator = '\\';
+#else
+    const char separator = '/';
+#endif
+    if (!folder.empty() && folder.back() != '\\' && folder.back() != '/') folder += separator;
+    return folder + "AutoBAs_" + symbol;
+}
+
+std::string BuildProfileCachePath(SCStudyInterfaceRef sc, int tickMultiplier) {
+    return BuildStudyFilePrefix(sc) + "_x" + std::to_string(tickMultiplier) + ".abpc";
+}
+
+// --- Bar Volume at Price Profiles ---
+// NEW: Alternative to the VbP study: session profiles folded bar by bar from the chart's own volume at price
+// (sc.VolumeAtPriceForBars), with sessions split where the chart's trading day changes.
+
+// NEW: Where session profiles come from (IN_PROFILE_SOURCE)
+enum e_ProfileSource {
+    PROFILE_SOURCE_VBP_STUDY = 0,
+    PROFILE_SOURCE_BAR_VAP   = 1
+};
+
+struct s_BarProfileSession {
+    SCDateTime StartDateTime;                // Trading day start
+    SCDateTime EndDateTime;                  // Last bar folded in so far
+    int BeginIndex = 0;
+    int EndIndex = 0;
+    int BaseTick = 0;                        // In VbP ticks (tick size x multiplier), as in the profile cache
+    std::vector<s_ProfileCacheLevel> Levels; // Index = tick - BaseTick
+};
+
+// A level of the still-open last bar, as folded in on the previous call
+struct s_ProvisionalBarLevel {
+    int Tick = 0;
+    uint32_t Volume = 0;
+    uint32_t NumberOfTrades = 0;
+};
+
+struct s_BarProfileBuilder {
+    std::vector<s_BarProfileSession> Sessions; // Chronological
+    int TickMultiplier = 0;
+    int NextBarIndex = 0;                      // Bars before this are closed and folded in for good
+    int ProvisionalSessionIndex = -1;          // Session the open last bar was folded into, or -1
+    std::vector<s_ProvisionalBarLevel> ProvisionalLevels;
+
+    void Reset() {
+        Sessions.clear();
+        NextBarIndex = 0;
+        ProvisionalSessionIndex = -1;
+        ProvisionalLevels.clear();
+    }
+
+    void AddLevel(s_BarProfileSession& session, int tick, int64_t volume, int64_t numberOfTrades) {
+        if (session.Levels.empty()) {
+            session.BaseTick = tick;
+            session.Levels.resize(1);
+        } else if (tick < session.BaseTick) {
+            session.Levels.insert(session.Levels.begin(), static_cast<size_t>(session.BaseTick - tick), s_ProfileCacheLevel());
+            session.BaseTick = tick;
+        } else if (tick - session.BaseTick >= static_cast<int>(session.Levels.size())) {
+            session.Levels.resize(static_cast<size_t>(tick - session.BaseTick + 1));
+        }
+        s_ProfileCacheLevel& level = session.Levels[tick - session.BaseTick];
+        level.Volume = static_cast<uint32_t>(level.Volume + volume);
+        level.NumberOfTrades = static_cast<uint32_t>(level.NumberOfTrades + numberOfTrades);
+    }
+
+    // Folds one bar's levels into its session. The open last bar is recorded so the next call can take it out again.
+    void FoldBar(SCStudyInterfaceRef sc, int barIndex, bool provisional) {
+        SCDateTime tradingDayStart = sc.GetTradingDayStartDateTimeOfBar(sc.BaseDateTimeIn[barIndex]);
+        if (Sessions.empty() || Sessions.back().StartDateTime.GetAsDouble() != tradingDayStart.GetAsDouble()) {
+            Sessions.emplace_back();
+            Sessions.back().StartDateTime = tradingDayStart;
+            Sessions.back().BeginIndex = barIndex;
+        }
+        s_BarProfileSession& session = Sessions.back();
+        session.EndIndex = barIndex;
+        session.EndDateTime = sc.BaseDateTimeIn[barIndex];
+        if (provisional) ProvisionalSessionIndex = static_cast<int>(Sessions.size()) - 1;
+        int numLevels = sc.VolumeAtPriceForBars->GetSizeAtBarIndex(barIndex);
+        for (int levelIndex = 0; levelIndex < numLevels; ++levelIndex) {
+            s_VolumeAtPriceV2* vap = nullptr;
+            if (!sc.VolumeAtPriceForBars->GetVAPElementAtIndex(barIndex, levelIndex, &vap) || vap == nullptr || vap->Volume == 0) continue;
+            int tick = FloorDiv(vap->PriceInTicks, TickMultiplier);
+            AddLevel(session, tick, vap->Volume, vap->NumberOfTrades);
+            if (provisional) ProvisionalLevels.push_back({tick, vap->Volume, vap->NumberOfTrades});
+        }
+    }
+
+    // Brings the sessions up to the current bars. Closed bars are folded in once; the open last bar is taken out
+    // and folded in again on every call, so an update costs in proportion to the levels of the bars it touches.
+    void Update(SCStudyInterfaceRef sc, int tickMultiplier) {
+        if (sc.VolumeAtPriceForBars == nullptr) return;
+        if (sc.IsFullRecalculation || TickMultiplier != tickMultiplier || sc.UpdateStartIndex < NextBarIndex || sc.ArraySize < NextBarIndex) Reset();
+        TickMultiplier = tickMultiplier;
+        if (ProvisionalSessionIndex >= 0) {
+            s_BarProfileSession& session = Sessions[ProvisionalSessionIndex];
+            for (const auto& level : ProvisionalLevels) AddLevel(session, level.Tick, -static_cast<int64_t>(level.Volume), -static_cast<int64_t>(level.NumberOfTrades));
+            ProvisionalLevels.clear();
+            ProvisionalSessionIndex = -1;
+        }
+        const int lastBarIndex = sc.ArraySize - 1;
+        for (int barIndex = NextBarIndex; barIndex < lastBarIndex; ++barIndex) FoldBar(sc, barIndex, false);
+        NextBarIndex = std::max(NextBarIndex, lastBarIndex);
+        if (lastBarIndex >= 0) FoldBar(sc, lastBarIndex, true);
+    }
+
+    // fetchIndex counts back from the latest session, as for the VbP study (0 = developing)
+    const s_BarProfileSession* FindSession(int fetchIndex) const {
+        if (fetchIndex < 0 || fetchIndex >= static_cast<int>(Sessions.size())) return nullptr;
+        return &Sessions[Sessions.size() - 1 - fetchIndex];
+    }
+};
+
+// NEW: Profile information for fetchIndex from the selected source (barProfiles = nullptr for the VbP study)
+bool GetSessionProfileInfo(SCStudyInterfaceRef sc, const s_BarProfileBuilder* barProfiles, int referenceStudyID, int fetchIndex, n_ACSIL::s_StudyProfileInformation& info) {
+    if (barProfiles == nullptr) return sc.GetStudyProfileInformation(referenceStudyID, fetchIndex, info) != 0;
+    const s_BarProfileSession* session = barProfiles->FindSession(fetchIndex);
+    if (session == nullptr) return false;
+    info.m_StartDateTime = session->StartDateTime;
+    info.m_EndDateTime = session->EndDateTime;
+    info.m_BeginIndex = session->BeginIndex;
+    info.m_EndIndex = session->EndIndex;
+    return true;
+}
+
+// NEW: Pipeline phases. An input only invalidates the phase it feeds plus everything downstream,
+// so e.g. a colour change re-emits drawings without re-forming any BA.
+enum e_BAPhase {
+    BA_PHASE_LOAD        = 1 << 0, // Session profiles from the profile source
+    BA_PHASE_METRICS     = 1 << 1, // Per-session and adjacent-pair metrics
+    BA_PHASE_FORMATION   = 1 << 2, // BA initiation/extension and normality filter
+    BA_PHASE_PROBES      = 1 << 3, // Probe lines (detected during formation)
+    BA_PHASE_COMPOSITE   = 1 << 4, // HLH/LHL composite detection
+    BA_PHASE_ACTIVATION  = 1 << 5, // Breakouts, extensions, cuts and PBAH/Ls
+    BA_PHASE_DRAWING     = 1 << 6  // Formation, probe and composite drawings
+};
+
+// Direct dependents of each phase; InvalidateBAPhase follows them transitively
+int GetBAPhaseDependents(int phase) {
+    switch (phase) {
+        case BA_PHASE_LOAD:       return BA_PHASE_METRICS;
+        case BA_PHASE_METRICS:    return BA_PHASE_FORMATION;
+        case BA_PHASE_FORMATION:  return BA_PHASE_PROBES | BA_PHASE_COMPOSITE | BA_PHASE_ACTIVATION;
+        case BA_PHASE_PROBES:     return BA_PHASE_DRAWING;
+        case BA_PHASE_COMPOSITE:  return BA_PHASE_DRAWING;
+        case BA_PHASE_ACTIVATION: return BA_PHASE_DRAWING;
+        default:                  return 0;
+    }
+}
+
+int InvalidateBAPhase(int phase) {
+    int dirty = phase;
+    for (int bit = 1; bit <= BA_PHASE_DRAWING; bit <<= 1) {
+        if (dirty & bit) dirty |= GetBAPhaseDependents(bit); // Dependents always have higher bits
+    }
+    return dirty;
+}
+
+// NEW: One worker pool per thread count for every AutoBAs instance in the process, so a chartbook full of
+// instances shares a single set of threads. Like the shared profile sets, the registry only holds a weak_ptr:
+// the pool and its threads go when the last instance using it releases it.
+std::shared_ptr<s_WorkerPool> AcquireSharedWorkerPool(int requestedThreads) {
+    static std::mutex registryMutex;
+    static std::map<int, std::weak_ptr<s_WorkerPool>> registry;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::shared_ptr<s_WorkerPool> pool = registry[requestedThreads].lock();
+    if (!pool) {
+        pool = std::make_shared<s_WorkerPool>();
+        pool->EnsureThreads(requestedThreads);
+        registry[requestedThreads] = pool;
+    }
+    return pool;
+}
+
+// NEW: Runs formation + composite detection on a dedicated thread. The finished run is handed back
+// through an atomically swapped pointer; the study thread picks it up on its next call.
+struct s_BackgroundFormation {
+    std::thread Thread;
+    std::atomic<bool> Cancel{false};
+    std::shared_ptr<s_BAFormationRun> Published; // Only accessed through std::atomic_load/store/exchange
+    bool AwaitingResult = false;                 // Study thread only: a started run has not been picked up yet
+
+    ~s_BackgroundFormation() { Stop(); }
+
+    // Cancels any run in flight and starts a new one over its own copy of the sessions
+    void Start(std::shared_ptr<s_BAFormationRun> run, std::shared_ptr<const std::vector<s_SessionProfile>> sessions);
+
+    void Stop() {
+        Cancel.store(true);
+        if (Thread.joinable()) Thread.join();
+        AwaitingResult = false;
+    }
+
+    std::shared_ptr<s_BAFormationRun> TakePublished() {
+        std::shared_ptr<s_BAFormationRun> run = std::atomic_exchange(&Published, std::shared_ptr<s_BAFormationRun>());
+        if (run) AwaitingResult = false;
+        return run;
+    }
+};
+
+struct s_SweepBars;
+
+// NEW: What the sweep thread hands back once the CSV is written
+struct s_SweepReport {
+    int Combinations = 0;
+    int Sessions = 0;
+    long long ElapsedMs = 0;
+    std::string Path;
+    bool Written = false;
+};
+
+// NEW: Runs a parameter sweep on a dedicated thread over its own copy of the sessions, the same way as
+// s_BackgroundFormation, so the chart keeps updating meanwhile. The thread writes the CSV; the study thread
+// reports the outcome when it picks up the report on a later call.
+struct s_BackgroundSweep {
+    std::thread Thread;
+    std::atomic<bool> Cancel{false};
+    std::shared_ptr<s_SweepReport> Published;    // Only accessed through std::atomic_load/store/exchange
+    bool AwaitingResult = false;                 // Study thread only: a started sweep has not been reported yet
+
+    ~s_BackgroundSweep() { Stop(); }
+
+    // Cancels any sweep in flight and starts one over the given sessions and bars
+    void Start(std::shared_ptr<s_WorkerPool> pool, std::shared_ptr<const std::vector<s_SessionProfile>> sessions, std::shared_ptr<const s_SweepBars> bars,
+               std::vector<s_BAFormationParams> combinations, const std::string& path);
+
+    void Stop() {
+        Cancel.store(true);
+        if (Thread.joinable()) Thread.join();
+        AwaitingResult = false;
+    }
+
+    std::shared_ptr<s_SweepReport> TakePublished() {
+        std::shared_ptr<s_SweepReport> report = std::atomic_exchange(&Published, std::shared_ptr<s_SweepReport>());
+        if (report) AwaitingResult = false;
+        return report;
+    }
+};
+
+// NEW: Runs formation on the study thread in slices: each call continues the run for at most a time
+// budget, suspending at session boundaries. The partial result is kept here and only applied once complete.
+struct s_SlicedFormation {
+    std::shared_ptr<s_BAFormationRun> Run;
+    std::shared_ptr<const std::vector<s_SessionProfile>> Sessions; // Copy taken when the run started
+
+    bool IsActive() const { return Run != nullptr; }
+
+    void Start(std::shared_ptr<s_BAFormationRun> run, std::shared_ptr<const std::vector<s_SessionProfile>> sessions) {
+        Run = run;
+        Sessions = sessions;
+    }
+
+    void Cancel() {
+        Run.reset();
+        Sessions.reset();
+    }
+
+    // Returns the finished run once complete, otherwise nullptr (budget <= 0 runs to completion)
+    std::shared_ptr<s_BAFormationRun> Continue(int budgetMicroseconds);
+};
+
+// --- Result Export ---
+// NEW: Streams BAs (with their activations and cuts), PBALs, probe lines and composites to files for research.
+// Each export is compared with what was already written: only new or changed rows are appended, and a row
+// that disappeared gets a removal row. Every row starts with the export Sequence and a Removed flag, so a
+// reader keeps the last row per key. The chart thread only builds the batch; a writer thread appends it to
+// one CSV file per table and to a columnar binary file.
+
+enum e_ExportColumnType : uint8_t {
+    EXPORT_UINT8 = 1,
+    EXPORT_INT32 = 2,
+    EXPORT_FLOAT32 = 3,
+    EXPORT_FLOAT64 = 4
+};
+
+struct s_ExportColumn {
+    const char* Name;
+    e_ExportColumnType Type;
+};
+
+// Key columns come first; rows are kept as doubles, which hold every column type exactly
+struct s_ExportTable {
+    const char* Name;
+    const s_ExportColumn* Columns;
+    int NumColumns;
+    int NumKeyColumns;
+};
+
+const s_ExportColumn EXPORT_BA_COLUMNS[] = {
+    { "StartDateTime", EXPORT_FLOAT64 }, { "EndDateTime", EXPORT_FLOAT64 },
+    { "StartBarIndex", EXPORT_INT32 }, { "EndBarIndex", EXPORT_INT32 }, { "NumSessions", EXPORT_INT32 },
+    { "POC", EXPORT_FLOAT32 }, { "ValueAreaHigh", EXPORT_FLOAT32 }, { "ValueAreaLow", EXPORT_FLOAT32 },
+    { "HighestPrice", EXPORT_FLOAT32 }, { "LowestPrice", EXPORT_FLOAT32 }, { "TotalVolume", EXPORT_FLOAT32 },
+    { "IsActivated", EXPORT_UINT8 }, { "ActivatedHigh", EXPORT_UINT8 }, { "ActivationBarIndex", EXPORT_INT32 },
+    { "ActivationDateTime", EXPORT_FLOAT64 }, { "ActivationPrice", EXPORT_FLOAT32 }, { "ActivationTradeDateTime", EXPORT_FLOAT64 },
+    { "ExtensionEndIndex", EXPORT_INT32 }, { "WasCut", EXPORT_UINT8 },
+    { "CutByStartProfileIndex", EXPORT_INT32 }, { "CutByEndProfileIndex", EXPORT_INT32 }
+};
+const s_ExportColumn EXPORT_PBAL_COLUMNS[] = {
+    { "StartBarIndex", EXPORT_INT32 }, { "IsHigh", EXPORT_UINT8 },
+    { "EndBarIndex", EXPORT_INT32 }, { "Price", EXPORT_FLOAT32 }, { "WasCut", EXPORT_UINT8 },
+    { "OriginStartProfileIndex", EXPORT_INT32 }, { "OriginEndProfileIndex", EXPORT_INT32 }
+};
+const s_ExportColumn EXPORT_PROBE_COLUMNS[] = {
+    { "StartBarIndex", EXPORT_INT32 }, { "IsHighProbe", EXPORT_UINT8 }, { "Price", EXPORT_FLOAT32 },
+    { "EndBarIndexOfProfile", EXPORT_INT32 }, { "BAStartProfileIndex", EXPORT_INT32 }
+};
+const s_ExportColumn EXPORT_COMPOSITE_COLUMNS[] = {
+    { "StartDateTime", EXPORT_FLOAT64 }, { "EndDateTime", EXPORT_FLOAT64 },
+    { "StartBarIndex", EXPORT_INT32 }, { "EndBarIndex", EXPORT_INT32 },
+    { "HighestPrice", EXPORT_FLOAT32 }, { "LowestPrice", EXPORT_FLOAT32 },
+    { "FirstBAIndex", EXPORT_INT32 }, { "SecondBAIndex", EXPORT_INT32 }, { "ThirdBAIndex", EXPORT_INT32 }
+};
+
+enum e_ExportTableIndex {
+    EXPORT_TABLE_BAS = 0,
+    EXPORT_TABLE_PBALS,
+    EXPORT_TABLE_PROBES,
+    EXPORT_TABLE_COMPOSITES,
+    EXPORT_TABLE_COUNT
+};
+
+const s_ExportTable EXPORT_TABLES[EXPORT_TABLE_COUNT] = {
+    { "bas", EXPORT_BA_COLUMNS, sizeof(EXPORT_BA_COLUMNS) / sizeof(s_ExportColumn), 2 },
+    { "pbals", EXPORT_PBAL_COLUMNS, sizeof(EXPORT_PBAL_COLUMNS) / sizeof(s_ExportColumn), 2 },
+    { "probes", EXPORT_PROBE_COLUMNS, sizeof(EXPORT_PROBE_COLUMNS) / sizeof(s_ExportColumn), 3 },
+    { "composites", EXPORT_COMPOSITE_COLUMNS, sizeof(EXPORT_COMPOSITE_COLUMNS) / sizeof(s_ExportColumn), 2 }
+};
+
+// Columnar file: "ABCX" header with the schema of every table, then one block per table and export, holding
+// each column's values contiguously: Sequence (int32), Removed (uint8), then the table's columns.
+const uint32_t RESULT_EXPORT_MAGIC = 0x58434241;  // "ABCX"
+const uint32_t RESULT_EXPORT_BLOCK_MAGIC = 0x42434241; // "ABCB"
+const uint32_t RESULT_EXPORT_VERSION = 1;
+
+// Rows of one export that differ from what the files already hold
+struct s_ExportBatch {
+    uint32_t Sequence = 0;
+    std::vector<double> Rows[EXPORT_TABLE_COUNT];       // Row-major, the table's columns
+    std::vector<uint8_t> Removed[EXPORT_TABLE_COUNT];   // Per row
+};
+
+struct s_ResultExporter {
+    std::string BasePath;
+    unsigned int ExportedVersion = UINT_MAX;    // StateVersion of the last export
+    uint32_t Sequence = 0;
+    std::map<std::vector<double>, std::vector<double>> WrittenRows[EXPORT_TABLE_COUNT]; // Key -> row as last written
+    std::vector<s_ExportBatch> Pending;         // Built but not handed to the writer yet
+    bool ReportedFailure = false;
+
+    // Writer thread; Queue is the only state shared with it
+    std::thread Thread;
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    std::vector<s_ExportBatch> Queue;
+    bool Stopping = false;
+    std::atomic<bool> WriteFailed{false};
+
+    ~s_ResultExporter() { Stop(); }
+
+    bool IsRunning() const { return Thread.joinable(); }
+
+    // Starts a fresh export to basePath_<table>.csv and basePath.abcx, replacing earlier files
+    void Start(const std::string& basePath) {
+        Stop();
+        BasePath = basePath;
+        ExportedVersion = UINT_MAX;
+        Sequence = 0;
+        for (auto& written : WrittenRows) written.clear();
+        ReportedFailure = false;
+        WriteFailed.store(false);
+        Stopping = false;
+        Thread = std::thread([this]() { WriterLoop(); });
+    }
+
+    // Writes out everything built so far, then ends the thread
+    void Stop() {
+        if (!IsRunning()) return;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            for (auto& batch : Pending) Queue.push_back(std::move(batch));
+            Pending.clear();
+            Stopping = true;
+        }
+        WorkAvailable.notify_all();
+        Thread.join();
+    }
+
+    // Appends the rows of one table that are new or changed since the last export, and removal rows for keys that are gone
+    void DiffTable(int table, const std::vector<double>& rows, s_ExportBatch& batch) {
+        const s_ExportTable& definition = EXPORT_TABLES[table];
+        std::map<std::vector<double>, std::vector<double>>& written = WrittenRows[table];
+        std::set<std::vector<double>> present;
+        for (size_t offset = 0; offset + definition.NumColumns <= rows.size(); offset += definition.NumColumns) {
+            std::vector<double> key(rows.begin() + offset, rows.begin() + offset + definition.NumKeyColumns);
+            if (!present.insert(key).second) continue; // Duplicate key; the first row stands for it
+            std::vector<double> row(rows.begin() + offset, rows.begin() + offset + definition.NumColumns);
+            auto found = written.find(key);
+            if (found != written.end() && found->second == row) continue;
+            batch.Rows[table].insert(batch.Rows[table].end(), row.begin(), row.end());
+            batch.Removed[table].push_back(0);
+            written[key] = std::move(row);
+        }
+        for (auto it = written.begin(); it != written.end();) {
+            if (present.count(it->first)) { ++it; continue; }
+            batch.Rows[table].insert(batch.Rows[table].end(), it->second.begin(), it->second.end());
+            batch.Removed[table].push_back(1);
+            it = written.erase(it);
+        }
+    }
+
+    // Chart thread: builds the batch for the current results and hands it to the writer if that does not have to wait
+    void Export(const std::vector<s_BalanceArea>& balanceAreas, const std::vector<s_PBALDrawingInfo>& pbals,
+                const std::vector<s_ProbeLineDrawingInfo>& probes, const std::vector<s_CompositeBalanceArea>& composites) {
+        std::vector<double> rows[EXPORT_TABLE_COUNT];
+        for (const auto& ba : balanceAreas) {
+            rows[EXPORT_TABLE_BAS].insert(rows[EXPORT_TABLE_BAS].end(), {
+                ba.StartDateTime.GetAsDouble(), ba.EndDateTime.GetAsDouble(),
+                (double)ba.StartBarIndex, (double)ba.EndBarIndex, (double)ba.IncludedProfileIndices.size(),
+                ba.POC, ba.ValueAreaHigh, ba.ValueAreaLow, ba.HighestPrice, ba.LowestPrice, ba.TotalVolume,
+                ba.IsActivated ? 1.0 : 0.0, ba.ActivatedHigh ? 1.0 : 0.0, (double)ba.ActivationBarIndex,
+                ba.ActivationDateTime.GetAsDouble(), ba.ActivationPrice, ba.ActivationTradeDateTime.GetAsDouble(),
+                (double)ba.ExtensionEndIndex, ba.WasCut ? 1.0 : 0.0,
+                (double)ba.CutByStartProfileIndex, (double)ba.CutByEndProfileIndex });
+        }
+        for (const auto& pbal : pbals) {
+            rows[EXPORT_TABLE_PBALS].insert(rows[EXPORT_TABLE_PBALS].end(), {
+                (double)pbal.StartBarIndex, pbal.IsHigh ? 1.0 : 0.0,
+                (double)pbal.EndBarIndex, pbal.Price, pbal.WasCut ? 1.0 : 0.0,
+                (double)pbal.OriginStartProfileIndex, (double)pbal.OriginEndProfileIndex });
+        }
+        for (const auto& probe : probes) {
+            rows[EXPORT_TABLE_PROBES].insert(rows[EXPORT_TABLE_PROBES].end(), {
+                (double)probe.StartBarIndex, probe.IsHighProbe ? 1.0 : 0.0, probe.Price,
+                (double)probe.EndBarIndexOfProfile, (double)probe.BAStartProfileIndex });
+        }
+        for (const auto& composite : composites) {
+            rows[EXPORT_TABLE_COMPOSITES].insert(rows[EXPORT_TABLE_COMPOSITES].end(), {
+                composite.StartDateTime.GetAsDouble(), composite.EndDateTime.GetAsDouble(),
+                (double)composite.StartBarIndex, (double)composite.EndBarIndex,
+                composite.HighestPrice, composite.LowestPrice,
+                (double)composite.FirstBAIndex, (double)composite.SecondBAIndex, (double)composite.ThirdBAIndex });
+        }
+
+        s_ExportBatch batch;
+        bool anyRows = false;
+        for (int table = 0; table < EXPORT_TABLE_COUNT; ++table) {
+            DiffTable(table, rows[table], batch);
+            anyRows = anyRows || !batch.Removed[table].empty();
+        }
+        if (anyRows) {
+            batch.Sequence = ++Sequence;
+            Pending.push_back(std::move(batch));
+        }
+        HandOver();
+    }
+
+    // Chart thread: moves pending batches to the writer unless it holds the lock right now (then next call)
+    void HandOver() {
+        if (Pending.empty()) return;
+        std::unique_lock<std::mutex> lock(Mutex, std::try_to_lock);
+        if (!lock.owns_lock()) return;
+        for (auto& batch : Pending) Queue.push_back(std::move(batch));
+        Pending.clear();
+        lock.unlock();
+        WorkAvailable.notify_one();
+    }
+
+    void WriterLoop();
+};
+
+// Writer thread: opens the files once, then appends each batch through the stdio buffers and flushes it
+void s_ResultExporter::WriterLoop() {
+    FILE* csvFiles[EXPORT_TABLE_COUNT] = {};
+    bool ok = true;
+    for (int table = 0; table < EXPORT_TABLE_COUNT; ++table) {
+        const s_ExportTable& definition = EXPORT_TABLES[table];
+        csvFiles[table] = fopen((BasePath + "_" + definition.Name + ".csv").c_str(), "w");
+        if (!csvFiles[table]) { ok = false; continue; }
+        setvbuf(csvFiles[table], nullptr, _IOFBF, 1 << 16);
+        fprintf(csvFiles[table], "Sequence,Removed");
+        for (int column = 0; column < definition.NumColumns; ++column) fprintf(csvFiles[table], ",%s", definition.Columns[column].Name);
+        fprintf(csvFiles[table], "\n");
+    }
+    FILE* binaryFile = fopen((BasePath + ".abcx").c_str(), "wb");
+    if (binaryFile) {
+        setvbuf(binaryFile, nullptr, _IOFBF, 1 << 16);
+        uint32_t fileHeader[3] = { RESULT_EXPORT_MAGIC, RESULT_EXPORT_VERSION, EXPORT_TABLE_COUNT };
+        fwrite(fileHeader, sizeof(fileHeader), 1, binaryFile);
+        for (const auto& definition : EXPORT_TABLES) {
+            uint8_t nameLength = static_cast<uint8_t>(std::strlen(definition.Name));
+            uint16_t numColumns = static_cast<uint16_t>(definition.NumColumns);
+            fwrite(&nameLength, 1, 1, binaryFile);
+            fwrite(definition.Name, 1, nameLength, binaryFile);
+            fwrite(&numColumns, sizeof(numColumns), 1, binaryFile);
+            for (int column = 0; column < definition.NumColumns; ++column) {
+                uint8_t type = definition.Columns[column].Type;
+                uint8_t columnNameLength = static_cast<uint8_t>(std::strlen(definition.Columns[column].Name));
+                fwrite(&type, 1, 1, binaryFile);
+                fwrite(&columnNameLength, 1, 1, binaryFile);
+                fwrite(definition.Columns[column].Name, 1, columnNameLength, binaryFile);
+            }
+        }
+    } else {
+        ok = false;
+    }
+    if (!ok) WriteFailed.store(true);
+
+    std::vector<s_ExportBatch> batches;
+    std::vector<uint8_t> columnBytes;
+    std::unique_lock<std::mutex> lock(Mutex);
+    for (;;) {
+        WorkAvailable.wait(lock, [&]() { return Stopping || !Queue.empty(); });
+        batches.swap(Queue);
+        bool stopping = Stopping;
+        lock.unlock();
+
+        for (const auto& batch : batches) {
+            for (int table = 0; table < EXPORT_TABLE_COUNT; ++table) {
+                const s_ExportTable& definition = EXPORT_TABLES[table];
+                const uint32_t numRows = static_cast<uint32_t>(batch.Removed[table].size());
+                if (numRows == 0) continue;
+                const double* rows = batch.Rows[table].data();
+                if (FILE* csv = csvFiles[table]) {
+                    for (uint32_t row = 0; row < numRows; ++row) {
+                        fprintf(csv, "%u,%d", batch.Sequence, batch.Removed[table][row]);
+                        for (int column = 0; column < definition.NumColumns; ++column) {
+                            double value = rows[row * definition.NumColumns + column];
+                            switch (definition.Columns[column].Type) {
+                                case EXPORT_FLOAT64: fprintf(csv, ",%.15g", value); break;
+                                case EXPORT_FLOAT32: fprintf(csv, ",%.9g", value); break;
+                                default: fprintf(csv, ",%d", static_cast<int>(value)); break;
+                            }
+                        }
+                        fprintf(csv, "\n");
+                    }
+                    if (fflush(csv) != 0) WriteFailed.store(true);
+                }
+                if (binaryFile) {
+                    uint32_t blockHeader[3] = { RESULT_EXPORT_BLOCK_MAGIC, static_cast<uint32_t>(table), numRows };
+                    fwrite(blockHeader, sizeof(blockHeader), 1, binaryFile);
+                    std::vector<int32_t> sequences(numRows, static_cast<int32_t>(batch.Sequence));
+                    fwrite(sequences.data(), sizeof(int32_t), numRows, binaryFile);
+                    fwrite(batch.Removed[table].data(), 1, numRows, binaryFile);
+                    for (int column = 0; column < definition.NumColumns; ++column) {
+                        e_ExportColumnType type = definition.Columns[column].Type;
+                        size_t width = (type == EXPORT_UINT8) ? 1 : (type == EXPORT_FLOAT64) ? 8 : 4;
+                        columnBytes.resize(numRows * width);
+                        for (uint32_t row = 0; row < numRows; ++row) {
+                            double value = rows[row * definition.NumColumns + column];
+                            uint8_t* out = columnBytes.data() + row * width;
+                            if (type == EXPORT_UINT8) { *out = static_cast<uint8_t>(value); }
+                            else if (type == EXPORT_INT32) { int32_t v = static_cast<int32_t>(value); std::memcpy(out, &v, 4); }
+                            else if (type == EXPORT_FLOAT32) { float v = static_cast<float>(value); std::memcpy(out, &v, 4); }
+                            else { std::memcpy(out, &value, 8); }
+                        }
+                        fwrite(columnBytes.data(), 1, columnBytes.size(), binaryFile);
+                    }
+                }
+            }
+        }
+        if (binaryFile && !batches.empty() && fflush(binaryFile) != 0) WriteFailed.store(true);
+        batches.clear();
+
+        lock.lock();
+        if (stopping && Queue.empty()) break;
+    }
+    lock.unlock();
+    for (FILE* csv : csvFiles) {
+        if (csv && fclose(csv) != 0) WriteFailed.store(true);
+    }
+    if (binaryFile && fclose(binaryFile) != 0) WriteFailed.store(true);
+}
+
+// --- Level Publishing ---
+// NEW: Publishes the open levels for other studies and processes. Other studies read fixed subgraph slots
+// with sc.GetStudyArrayUsingID; external processes map a shared memory segment guarded by a seqlock.
+// Both are only written when a level changed.
+//
+// Segment layout (little endian, named Local\AutoBAs_<symbol>_c<chart>_s<study>_levels on Windows and
+// /AutoBAs_<symbol>_c<chart>_s<study>_levels as POSIX shared memory):
+//   0  uint32 Magic "ABLV"        4  uint32 Version (1)      8  uint32 Sequence (odd while being written)
+//   12 uint32 SlotsPerType (64)   16 uint32 TypeCount (6)    20 uint32 TypeCounts[6]
+//   44 uint32 Reserved            48 uint64 PublishCount     56 float64 PublishedDateTime (last bar)
+//   64 records: TypeCount blocks of SlotsPerType records, block t holding the levels of type t, newest first:
+//      float64 SinceDateTime (activation, cut BA activation or probe bar), float32 Price, int32 SinceBarIndex
+// Types: 0 active VAH, 1 active VAL, 2 PBAH, 3 PBAL, 4 high probe, 5 low probe. A reader loads Sequence
+// (acquire), retries while it is odd, copies what it needs, and retries if Sequence changed meanwhile.
+
+enum e_PublishedLevelType {
+    LEVEL_ACTIVE_VAH = 0,
+    LEVEL_ACTIVE_VAL,
+    LEVEL_PBAH,
+    LEVEL_PBAL,
+    LEVEL_PROBE_HIGH,
+    LEVEL_PROBE_LOW,
+    LEVEL_TYPE_COUNT
+};
+
+const char* const LEVEL_TYPE_NAMES[LEVEL_TYPE_COUNT] = { "Active VAH", "Active VAL", "PBAH", "PBAL", "Probe High", "Probe Low" };
+const int LEVEL_SUBGRAPH_SLOTS = 4;         // Subgraph LEVEL_SUBGRAPH_SLOTS * type + n is the type's n-th newest level
+const int LEVEL_SUBGRAPH_COUNT = LEVEL_TYPE_COUNT * LEVEL_SUBGRAPH_SLOTS;
+const uint32_t LEVEL_SEGMENT_MAGIC = 0x564C4241; // "ABLV"
+const uint32_t LEVEL_SEGMENT_VERSION = 1;
+const uint32_t LEVEL_SEGMENT_SLOTS = 64;
+
+struct s_LevelRecord {
+    double SinceDateTime = 0.0;
+    float Price = 0.0f;
+    int32_t SinceBarIndex = -1;
+
+    bool operator==(const s_LevelRecord& other) const {
+        return SinceDateTime == other.SinceDateTime && Price == other.Price && SinceBarIndex == other.SinceBarIndex;
+    }
+};
+
+struct s_LevelSegmentHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    std::atomic<uint32_t> Sequence;
+    uint32_t SlotsPerType;
+    uint32_t TypeCount;
+    uint32_t TypeCounts[LEVEL_TYPE_COUNT];
+    uint32_t Reserved;
+    uint64_t PublishCount;
+    double PublishedDateTime;
+};
+
+static_assert(sizeof(s_LevelRecord) == 16, "Level record layout is part of the segment format");
+static_assert(sizeof(s_LevelSegmentHeader) == 64, "Segment header layout is part of the segment format");
+
+const size_t LEVEL_SEGMENT_SIZE = sizeof(s_LevelSegmentHeader) + sizeof(s_LevelRecord) * LEVEL_SEGMENT_SLOTS * LEVEL_TYPE_COUNT;
+
+struct s_LevelPublisher {
+    std::string SegmentName;
+    uint8_t* Segment = nullptr;
+#ifdef _WIN32
+    HANDLE MappingHandle = NULL;
+#endif
+    bool OpenFailed = false;                    // Reported once; publishing to the subgraphs goes on
+    unsigned int PublishedVersion = UINT_MAX;   // StateVersion the levels were last collected for
+    uint64_t PublishCount = 0;
+    std::vector<s_LevelRecord> Levels[LEVEL_TYPE_COUNT];     // Newest first, as last published
+    std::vector<s_LevelRecord> Collected[LEVEL_TYPE_COUNT];  // Reused for each collection
+    std::vector<int> Order;
+    int SubgraphFilledSize = 0;                 // Bars below this hold the published values
+
+    s_LevelPublisher() = default;
+    s_LevelPublisher(const s_LevelPublisher&) = delete;
+    s_LevelPublisher& operator=(const s_LevelPublisher&) = delete;
+    ~s_LevelPublisher() { Close(); }
+
+    bool IsOpen() const { return Segment != nullptr; }
+
+    s_LevelSegmentHeader* GetHeader() const { return reinterpret_cast<s_LevelSegmentHeader*>(Segment); }
+    s_LevelRecord* GetRecords(int type) const {
+        return reinterpret_cast<s_LevelRecord*>(Segment + sizeof(s_LevelSegmentHeader)) + static_cast<size_t>(type) * LEVEL_SEGMENT_SLOTS;
+    }
+
+    // Creates (or attaches to) the named segment and writes the current levels into it
+    bool Open(const std::string& name) {
+        Close();
+        SegmentName = name;
+#ifdef _WIN32
+        MappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, static_cast<DWORD>(LEVEL_SEGMENT_SIZE), name.c_str());
+        if (MappingHandle == NULL) return false;
+        Segment = reinterpret_cast<uint8_t*>(MapViewOfFile(MappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, LEVEL_SEGMENT_SIZE));
+        if (Segment == nullptr) { Close(); return false; }
+#else
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) return false;
+        void* mapped = (ftruncate(fd, static_cast<off_t>(LEVEL_SEGMENT_SIZE)) == 0) ? mmap(nullptr, LEVEL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapped == MAP_FAILED) { shm_unlink(name.c_str()); return false; }
+        Segment = reinterpret_cast<uint8_t*>(mapped);
+#endif
+        s_LevelSegmentHeader* header = GetHeader();
+        uint32_t sequence = header->Sequence.load(std::memory_order_relaxed);
+        if (sequence & 1) sequence++; // A previous writer stopped halfway
+        header->Sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->Magic = LEVEL_SEGMENT_MAGIC;
+        header->Version = LEVEL_SEGMENT_VERSION;
+        header->SlotsPerType = LEVEL_SEGMENT_SLOTS;
+        header->TypeCount = LEVEL_TYPE_COUNT;
+        header->Reserved = 0;
+        header->PublishCount = PublishCount;
+        for (int type = 0; type < LEVEL_TYPE_COUNT; ++type) {
+            header->TypeCounts[type] = static_cast<uint32_t>(Levels[type].size());
+            std::copy(Levels[type].begin(), Levels[type].end(), GetRecords(type));
+        }
+        header->Sequence.store(sequence + 2, std::memory_order_release);
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (Segment != nullptr) UnmapViewOfFile(Segment);
+        if (MappingHandle != NULL) CloseHandle(MappingHandle);
+        MappingHandle = NULL;
+#else
+        if (Segment != nullptr) {
+            munmap(Segment, LEVEL_SEGMENT_SIZE);
+            shm_unlink(SegmentName.c_str()); // Readers keep their mappings; new ones find no segment
+        }
+#endif
+        Segment = nullptr;
+    }
+
+    // Collects the levels newest first and publishes the types that changed. Returns true if any did.
+    template <typename DateTimeArrayT>
+    bool Update(const std::vector<s_BalanceArea>& activeBAs, const std::vector<s_PBALDrawingInfo>& pbals, const std::vector<s_ProbeLineDrawingInfo>& probes,
+                DateTimeArrayT& dateTimes, int arraySize) {
+        auto record = [&](float price, int barIndex) {
+            s_LevelRecord level;
+            level.Price = price;
+            level.SinceBarIndex = barIndex;
+            level.SinceDateTime = (barIndex >= 0 && barIndex < arraySize) ? dateTimes[barIndex].GetAsDouble() : 0.0;
+            return level;
+        };
+        for (auto& levels : Collected) levels.clear();
+        auto newestFirst = [this](int count, const auto& barOf) {
+            Order.resize(count);
+            std::iota(Order.begin(), Order.end(), 0);
+            std::sort(Order.begin(), Order.end(), [&barOf](int a, int b) { return barOf(a) != barOf(b) ? barOf(a) > barOf(b) : a < b; });
+        };
+        newestFirst(static_cast<int>(activeBAs.size()), [&activeBAs](int n) { return activeBAs[n].ActivationBarIndex; });
+        for (int n : Order) {
+            const s_BalanceArea& ba = activeBAs[n];
+            if (!ba.IsExtending) continue;
+            Collected[LEVEL_ACTIVE_VAH].push_back(record(ba.ValueAreaHigh, ba.ActivationBarIndex));
+            Collected[LEVEL_ACTIVE_VAL].push_back(record(ba.ValueAreaLow, ba.ActivationBarIndex));
+        }
+        for (auto pbal = pbals.rbegin(); pbal != pbals.rend(); ++pbal) { // Created in cut order
+            Collected[pbal->IsHigh ? LEVEL_PBAH : LEVEL_PBAL].push_back(record(pbal->Price, pbal->StartBarIndex));
+        }
+        newestFirst(static_cast<int>(probes.size()), [&probes](int n) { return probes[n].StartBarIndex; });
+        for (int n : Order) {
+            const s_ProbeLineDrawingInfo& probe = probes[n];
+            Collected[probe.IsHighProbe ? LEVEL_PROBE_HIGH : LEVEL_PROBE_LOW].push_back(record(probe.Price, probe.StartBarIndex));
+        }
+
+        bool changed = false;
+        for (int type = 0; type < LEVEL_TYPE_COUNT; ++type) {
+            if (Collected[type].size() > LEVEL_SEGMENT_SLOTS) Collected[type].resize(LEVEL_SEGMENT_SLOTS);
+            if (Collected[type] != Levels[type]) changed = true;
+        }
+        if (!changed) return false;
+
+        s_LevelSegmentHeader* header = IsOpen() ? GetHeader() : nullptr;
+        uint32_t sequence = header ? header->Sequence.load(std::memory_order_relaxed) : 0;
+        if (header) {
+            header->Sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        PublishCount++;
+        for (int type = 0; type < LEVEL_TYPE_COUNT; ++type) {
+            if (header) { // Only the records that differ are rewritten
+                s_LevelRecord* records = GetRecords(type);
+                for (size_t n = 0; n < Collected[type].size(); ++n) {
+                    if (n >= Levels[type].size() || !(Levels[type][n] == Collected[type][n])) records[n] = Collected[type][n];
+                }
+                header->TypeCounts[type] = static_cast<uint32_t>(Collected[type].size());
+            }
+            Levels[type].swap(Collected[type]);
+        }
+        if (header) {
+            header->PublishCount = PublishCount;
+            header->PublishedDateTime = arraySize > 0 ? dateTimes[arraySize - 1].GetAsDouble() : 0.0;
+            header->Sequence.store(sequence + 2, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Back to nothing published, with the segment removed
+    void Reset() {
+        Close();
+        OpenFailed = false;
+        PublishedVersion = UINT_MAX;
+        for (auto& levels : Levels) levels.clear();
+        SubgraphFilledSize = 0;
+    }
+
+    float GetSlotPrice(int type, int slot) const {
+        return slot < static_cast<int>(Levels[type].size()) ? Levels[type][slot].Price : 0.0f;
+    }
+};
+
+// NEW: Writes the published levels into the level subgraphs: new bars get the current values, and after a
+// change the last bar does too, so each array is the history of what was published while the chart ran.
+// A full recalculation fills every bar with the current levels.
+void FillLevelSubgraphs(SCStudyInterfaceRef sc, s_LevelPublisher& publisher, bool levelsChanged) {
+    int startIndex = publisher.SubgraphFilledSize;
+    if (sc.IsFullRecalculation || startIndex > sc.ArraySize) startIndex = 0;
+    if (levelsChanged) startIndex = std::min(startIndex, std::max(0, sc.ArraySize - 1));
+    for (int type = 0; type < LEVEL_TYPE_COUNT; ++type) {
+        for (int slot = 0; slot < LEVEL_SUBGRAPH_SLOTS; ++slot) {
+            SCSubgraphRef subgraph = sc.Subgraph[type * LEVEL_SUBGRAPH_SLOTS + slot];
+            float price = publisher.GetSlotPrice(type, slot);
+            for (int barIndex = startIndex; barIndex < sc.ArraySize; ++barIndex) subgraph[barIndex] = price;
+        }
+    }
+    publisher.SubgraphFilledSize = sc.ArraySize;
+}
+
+// --- Level Index ---
+// NEW: Every live level in one array sorted by price, so nearest-level and crossing questions are binary
+// searches instead of walks over the BA, PBAL and probe vectors. The index is merged with the collected levels
+// only when the state changes; a level that survives the merge keeps its alert state.
+//
+// Crossing alerts use a band of Hysteresis around each level: a level flips to "price above" once price trades
+// at least Hysteresis over it, and back to "price below" once price trades at least Hysteresis under it, so
+// chop around a level raises one alert rather than one per tick. Between updates every level more than
+// Hysteresis below price is already "above" and every level more than Hysteresis above price is "below", so
+// a move only has to look at the levels within the band it swept: O(log n + k) for k levels in that band.
+
+struct s_IndexedLevel {
+    float Price = 0.0f;
+    uint8_t Type = LEVEL_ACTIVE_VAH;    // e_PublishedLevelType
+    int8_t Side = 0;                    // +1 price confirmed above the level, -1 confirmed below
+    int32_t SinceBarIndex = -1;         // Activation, cut BA activation or probe bar; tells equal prices apart
+
+    bool operator<(const s_IndexedLevel& other) const {
+        if (Price != other.Price) return Price < other.Price;
+        if (Type != other.Type) return Type < other.Type;
+        return SinceBarIndex < other.SinceBarIndex;
+    }
+    bool SameLevel(const s_IndexedLevel& other) const {
+        return Price == other.Price && Type == other.Type && SinceBarIndex == other.SinceBarIndex;
+    }
+};
+
+struct s_LevelCrossing {
+    s_IndexedLevel Level;
+    int Direction = 0;                  // +1 crossed upwards, -1 downwards
+};
+
+struct s_LevelIndex {
+    std::vector<s_IndexedLevel> Levels;     // Sorted by price, then type and bar
+    std::vector<s_IndexedLevel> Incoming;   // Reused for each merge
+    std::vector<s_IndexedLevel> Merged;
+    std::vector<s_LevelCrossing> Crossings; // Filled by Advance
+    unsigned int IndexedVersion = UINT_MAX; // StateVersion the levels were last merged for
+    float LastPrice = 0.0f;
+    float Hysteresis = 0.0f;
+    bool HasPrice = false;
+
+    // Merges the current levels into the index. Levels already indexed keep their side, so a following Advance
+    // still reports them; new ones take the side price is on and never alert for where they were created.
+    // Changing the hysteresis resets every side.
+    void Update(const std::vector<s_BalanceArea>& activeBAs, const std::vector<s_PBALDrawingInfo>& pbals, const std::vector<s_ProbeLineDrawingInfo>& probes,
+                float price, float hysteresis) {
+        auto add = [this](float levelPrice, int type, int barIndex) {
+            s_IndexedLevel level;
+            level.Price = levelPrice;
+            level.Type = static_cast<uint8_t>(type);
+            level.SinceBarIndex = barIndex;
+            Incoming.push_back(level);
+        };
+        Incoming.clear();
+        for (const auto& ba : activeBAs) {
+            if (!ba.IsExtending) continue;
+            add(ba.ValueAreaHigh, LEVEL_ACTIVE_VAH, ba.ActivationBarIndex);
+            add(ba.ValueAreaLow, LEVEL_ACTIVE_VAL, ba.ActivationBarIndex);
+        }
+        for (const auto& pbal : pbals) add(pbal.Price, pbal.IsHigh ? LEVEL_PBAH : LEVEL_PBAL, pbal.StartBarIndex);
+        for (const auto& probe : probes) add(probe.Price, probe.IsHighProbe ? LEVEL_PROBE_HIGH : LEVEL_PROBE_LOW, probe.StartBarIndex);
+        std::sort(Incoming.begin(), Incoming.end());
+
+        const bool keepSides = HasPrice && hysteresis == Hysteresis;
+        Merged.clear();
+        size_t old = 0;
+        for (s_IndexedLevel level : Incoming) {
+            while (old < Levels.size() && Levels[old] < level) ++old;
+            bool known = keepSides && old < Levels.size() && Levels[old].SameLevel(level);
+            level.Side = known ? Levels[old].Side : (price >= level.Price ? 1 : -1);
+            Merged.push_back(level);
+        }
+        Levels.swap(Merged);
+        Crossings.reserve(Levels.size()); // Advance never allocates
+        Hysteresis = hysteresis;
+        if (!keepSides) {
+            LastPrice = price;
+            HasPrice = true;
+        }
+    }
+
+    // Moves the index to price and fills Crossings with the levels whose side flipped, in the order price met them
+    void Advance(float price) {
+        Crossings.clear();
+        if (!HasPrice) {
+            LastPrice = price;
+            HasPrice = true;
+            return;
+        }
+        if (price > LastPrice) { // Levels in (LastPrice - H, price - H] can flip to above
+            auto it = std::lower_bound(Levels.begin(), Levels.end(), LastPrice - Hysteresis, [](const s_IndexedLevel& level, float value) { return level.Price < value; });
+            for (; it != Levels.end() && it->Price <= price - Hysteresis; ++it) {
+                if (it->Side >= 0) continue;
+                it->Side = 1;
+                Crossings.push_back(s_LevelCrossing{ *it, 1 });
+            }
+        } else if (price < LastPrice) { // Levels in [price + H, LastPrice + H) can flip to below, met from the top
+            auto it = std::upper_bound(Levels.begin(), Levels.end(), LastPrice + Hysteresis, [](float value, const s_IndexedLevel& level) { return value < level.Price; });
+            while (it != Levels.begin() && (it - 1)->Price >= price + Hysteresis) {
+                --it;
+                if (it->Side <= 0) continue;
+                it->Side = -1;
+                Crossings.push_back(s_LevelCrossing{ *it, -1 });
+            }
+        }
+        LastPrice = price;
+    }
+
+    // Lowest level strictly above price, or nullptr
+    const s_IndexedLevel* NearestAbove(float price) const {
+        auto it = std::upper_bound(Levels.begin(), Levels.end(), price, [](float value, const s_IndexedLevel& level) { return value < level.Price; });
+        return it != Levels.end() ? &*it : nullptr;
+    }
+
+    // Highest level at or below price, or nullptr
+    const s_IndexedLevel* NearestBelow(float price) const {
+        auto it = std::upper_bound(Levels.begin(), Levels.end(), price, [](float value, const s_IndexedLevel& level) { return value < level.Price; });
+        return it != Levels.begin() ? &*(it - 1) : nullptr;
+    }
+
+    // Levels priced within [low, high], as a range into Levels
+    std::pair<const s_IndexedLevel*, const s_IndexedLevel*> InRange(float low, float high) const {
+        const s_IndexedLevel* begin = Levels.data();
+        const s_IndexedLevel* end = begin + Levels.size();
+        const s_IndexedLevel* first = std::lower_bound(begin, end, low, [](const s_IndexedLevel& level, float value) { return level.Price < value; });
+        const s_IndexedLevel* last = std::upper_bound(first, end, high, [](float value, const s_IndexedLevel& level) { return value < level.Price; });
+        return std::make_pair(first, last);
+    }
+
+    void Reset() {
+        Levels.clear();
+        Crossings.clear();
+        IndexedVersion = UINT_MAX;
+        HasPrice = false;
+    }
+};
+
+// --- Trade Activation ---
+// NEW: Pending VAH/VAL breakout prices of the finalized BAs that have not activated, sorted so each new trade
+// is compared with one price per side: the lowest pending high trigger and the highest pending low trigger.
+// Triggers a trade passes are consumed from the front, so a call costs O(new trades + activations) however many
+// BAs are pending. Built again whenever the BA state changes.
+
+struct s_ActivationTrigger {
+    float Price = 0.0f;                 // VA edge plus/minus half a tick; a trade beyond it activates the BA
+    int BAIndex = -1;                   // Into FinalizedBalanceAreas
+};
+
+struct s_TradeActivationIndex {
+    std::vector<s_ActivationTrigger> HighTriggers;  // Ascending by price
+    std::vector<s_ActivationTrigger> LowTriggers;   // Descending by price
+    size_t NextHigh = 0;
+    size_t NextLow = 0;
+    unsigned int BuiltVersion = UINT_MAX;   // StateVersion the triggers were built for
+    uint32_t LastSequence = 0;              // Newest time and sales record already seen
+    bool HasSequence = false;
+
+    void Build(const std::vector<s_BalanceArea>& finalizedBAs, float TickSize) {
+        float tolerance = TickSize / 2.0f; // Same as FindBAActivationBar
+        HighTriggers.clear();
+        LowTriggers.clear();
+        for (size_t n = 0; n < finalizedBAs.size(); ++n) {
+            const s_BalanceArea& ba = finalizedBAs[n];
+            if (ba.IsActivated) continue;
+            HighTriggers.push_back(s_ActivationTrigger{ ba.ValueAreaHigh + tolerance, static_cast<int>(n) });
+            LowTriggers.push_back(s_ActivationTrigger{ ba.ValueAreaLow - tolerance, static_cast<int>(n) });
+        }
+        std::sort(HighTriggers.begin(), HighTriggers.end(), [](const s_ActivationTrigger& a, const s_ActivationTrigger& b) { return a.Price != b.Price ? a.Price < b.Price : a.BAIndex < b.BAIndex; });
+        std::sort(LowTriggers.begin(), LowTriggers.end(), [](const s_ActivationTrigger& a, const s_ActivationTrigger& b) { return a.Price != b.Price ? a.Price > b.Price : a.BAIndex < b.BAIndex; });
+        NextHigh = 0;
+        NextLow = 0;
+    }
+
+    // Calls activate(baIndex, breakHigh) for every pending trigger the trade price passes. A BA whose other
+    // edge fired first is still reported; the caller skips BAs that are already activated.
+    template <typename ActivateT>
+    void Match(float price, ActivateT&& activate) {
+        while (NextHigh < HighTriggers.size() && price > HighTriggers[NextHigh].Price) activate(HighTriggers[NextHigh++].BAIndex, true);
+        while (NextLow < LowTriggers.size() && price < LowTriggers[NextLow].Price) activate(LowTriggers[NextLow++].BAIndex, false);
+    }
+
+    void Reset() {
+        HighTriggers.clear();
+        LowTriggers.clear();
+        NextHigh = 0;
+        NextLow = 0;
+        BuiltVersion = UINT_MAX;
+        HasSequence = false;
+    }
+};
+
+// --- Event Journal ---
+// NEW: Append-only binary journal of the BA state transitions, next to the state snapshot as
+// <symbol>_c<chart>_s<study>.abjl. Events are found by comparing the current state with what replaying the
+// journal gives (State below) whenever StateVersion changes, so the formation, activation and cut code need no
+// hooks, and a replay always ends in the state last journaled. Records are encoded on the chart thread and
+// handed to a writer thread through a lock-free single-producer/single-consumer byte ring.
+//
+// Layout (little endian):
+//   Header  uint32 Magic "ABJL", uint32 Version (2), uint64 StateFingerprint (a journal of other inputs is set aside as .abjl.old)
+//   Record  uint8 Type, uint32 Sequence, uint32 PayloadSize, float64 RecordedDateTime (system time), payload,
+//           uint32 Check (FNV-1a of the record up to here, folded to 32 bits). A bad check ends the journal.
+// BAs are named by their start and end profile chrono indices (int32 each, "key" below); bars are stored as the
+// bar's DateTime (float64, -1 for none) and strings as a uint32 length and the bytes. Payloads by type:
+//   1 BA finalized          key, definition as in the state snapshot (dates, bars, POC, VA, range, volume, sessions, reason)
+//   2 BA retracted          key
+//   3 BA activated          key, uint8 high, float64 ActivationDateTime, bar, float32 price, float64 trade DateTime (0 = bars)
+//   4 BA deactivated        key
+//   5 BA cut                key, cutting BA key, bar
+//   6 BA uncut              key
+//   7 PBAL created          cut BA key, uint8 high, float32 price, start bar
+//   8 PBAL removed          cut BA key, uint8 high
+//   9 Probe added           start bar, profile end bar, float32 price, uint8 high, int32 BA start profile
+//  10 Probe removed         same as added
+//  11 Composite qualified   int32 first/second/third BA index, float64 start/end DateTime, start/end bar,
+//                           float32 high/low, reason
+//  12 Composite removed     int32 first/second/third BA index
+//  13 Checkpoint            uint32 session count, int32 resume index, float64 start DateTime of each session,
+//                           uint32 count and packed bits of the profiles formation used
+//  14 Sessions rolled       uint32 number of oldest sessions that left the window; every profile index and
+//                           composite member after it is relative to the new window (see RebaseBAState)
 
-// --- Data Structures ---
-struct s_PriceLevelVolume { 
-    float Price = 0.0f;
-    float TotalVolume = 0.0f; 
-    int NumberOfTrades = 0; 
+const uint32_t EVENT_JOURNAL_MAGIC = 0x4C4A4241; // "ABJL"
+const uint32_t EVENT_JOURNAL_VERSION = 2;
+const size_t EVENT_JOURNAL_HEADER_SIZE = 16;
+const size_t EVENT_JOURNAL_RECORD_OVERHEAD = 21; // Type, Sequence, PayloadSize, RecordedDateTime, Check
+const size_t EVENT_JOURNAL_RING_BYTES = 1 << 18;
+
+enum e_JournalEventType {
+    JOURNAL_BA_FINALIZED = 1,
+    JOURNAL_BA_RETRACTED,
+    JOURNAL_BA_ACTIVATED,
+    JOURNAL_BA_DEACTIVATED,
+    JOURNAL_BA_CUT,
+    JOURNAL_BA_UNCUT,
+    JOURNAL_PBAL_CREATED,
+    JOURNAL_PBAL_REMOVED,
+    JOURNAL_PROBE_ADDED,
+    JOURNAL_PROBE_REMOVED,
+    JOURNAL_COMPOSITE_QUALIFIED,
+    JOURNAL_COMPOSITE_REMOVED,
+    JOURNAL_CHECKPOINT,
+    JOURNAL_SESSIONS_ROLLED,
+    JOURNAL_EVENT_TYPE_END
 };
 
-using PriceVolumeMap = std::unordered_map<float, s_PriceLevelVolume>;
-
-struct s_SessionProfile { 
-    SCDateTime StartDateTime; 
-    SCDateTime EndDateTime; 
-    int BeginIndex; 
-    int EndIndex; 
-    float POC = 0.0f; 
-    float ValueAreaHigh = 0.0f;
-    float ValueAreaLow = 0.0f; 
-    float TotalVolume = 0.0f; 
-    float HighestPrice = -FLT_MAX; 
-    float LowestPrice = FLT_MAX; 
-    PriceVolumeMap PriceMap;
-    int ChronologicalIndex = -1; 
-    
-    float GetRange() const { 
-        if (HighestPrice <= -FLT_MAX || LowestPrice >= FLT_MAX || HighestPrice < LowestPrice) return 0.0f;
-        return HighestPrice - LowestPrice; 
-    } 
+// What the journal holds so far, in the study's own types
+struct s_JournalState {
+    std::vector<s_BalanceArea> FinalizedBalanceAreas;
+    std::vector<s_BalanceArea> ActiveBalanceAreas;      // In activation order
+    std::vector<s_ProbeLineDrawingInfo> ProbeLinesToDraw;
+    std::vector<s_PBALDrawingInfo> PBALsToDraw;
+    std::vector<s_CompositeBalanceArea> CompositeBAs;
+    bool HasCheckpoint = false;
+    std::vector<double> SessionStarts;
+    int ResumeIndex = 0;
+    std::vector<bool> ProfileUsed;
+    uint32_t NextSequence = 1;
 };
 
-// Enhanced Balance Area struct with activation tracking
-struct s_BalanceArea {
-    int StartProfileChronoIndex = -1;
-    int EndProfileChronoIndex = -1;
-    SCDateTime StartDateTime;
-    SCDateTime EndDateTime;
-    int StartBarIndex = -1;
-    int EndBarIndex = -1;
-    float POC = 0.0f;
-    float ValueAreaHigh = 0.0f;
-    float ValueAreaLow = 0.0f;
-    float HighestPrice = -FLT_MAX;
-    float LowestPrice = FLT_MAX;
-    float TotalVolume = 0.0f;
-    std::vector<int> IncludedProfileIndices;
-    std::string InitiationReason = "N/A";
-    
-    // NEW: Activation tracking
-    bool IsActivated = false;
-    SCDateTime ActivationDateTime;
-    int ActivationBarIndex = -1;
-    float ActivationPrice = 0.0f;
-    std::string ActivationType = ""; // "Break_High", "Break_Low"
-    bool ActivatedHigh = false;     // True if activated by breaking VA High
-    bool ActivatedLow = false;      // True if activated by breaking VA Low
-    
-    // NEW: Extension tracking for intersections
-    bool IsExtending = false;       // True when using extending rectangle
-    int ExtensionEndIndex = -1;     // Where extension ends (due to intersection or chart end)
-    std::string ExtensionEndReason = ""; // "Chart_End", "BA_Intersection", "Manual_Cutoff"
-	bool WasCut = false;            // True when extension was cut by intersection
-    
-    float GetRange() const {
-        if (HighestPrice <= -FLT_MAX || LowestPrice >= FLT_MAX || HighestPrice < LowestPrice) return 0.0f;
-        return HighestPrice - LowestPrice;
+struct s_EventJournal {
+    std::string Path;
+    uint64_t Fingerprint = 0;
+    s_JournalState State;                       // Chart thread only
+    unsigned int JournaledVersion = UINT_MAX;   // StateVersion the journal was last brought up to date for
+    std::vector<uint8_t> Overflow;              // Encoded bytes the ring had no room for yet; chart thread only
+    bool ReportedFailure = false;
+
+    // Byte ring: the chart thread only advances Tail, the writer thread only Head, so neither takes a lock
+    std::unique_ptr<uint8_t[]> Ring;
+    std::atomic<size_t> Head{0};
+    std::atomic<size_t> Tail{0};
+
+    std::thread Thread;
+    FILE* File = nullptr;                       // Written by the writer thread while it runs
+    std::mutex WakeMutex;                       // Only lets the idle writer sleep
+    std::condition_variable WorkAvailable;
+    std::atomic<bool> Stopping{false};
+    std::atomic<bool> WriteFailed{false};
+
+    s_EventJournal() = default;
+    s_EventJournal(const s_EventJournal&) = delete;
+    s_EventJournal& operator=(const s_EventJournal&) = delete;
+    ~s_EventJournal() { Stop(); }
+
+    bool IsRunning() const { return Thread.joinable(); }
+
+    // Replays the journal at path into State and starts appending to it (defined with the snapshot code)
+    bool Open(SCStudyInterfaceRef sc, const std::string& path, uint64_t fingerprint);
+    // Frames one event, queues it for the writer and applies it to State
+    void Append(SCStudyInterfaceRef sc, int type, const std::vector<uint8_t>& payload);
+
+    // Copies as much of data into the ring as fits and returns how much that was
+    size_t PushBytes(const uint8_t* data, size_t size) {
+        size_t tail = Tail.load(std::memory_order_relaxed);
+        size_t count = std::min(size, EVENT_JOURNAL_RING_BYTES - (tail - Head.load(std::memory_order_acquire)));
+        size_t offset = tail % EVENT_JOURNAL_RING_BYTES;
+        size_t first = std::min(count, EVENT_JOURNAL_RING_BYTES - offset);
+        if (first > 0) memcpy(Ring.get() + offset, data, first);
+        if (count > first) memcpy(Ring.get(), data + first, count - first);
+        Tail.store(tail + count, std::memory_order_release);
+        return count;
     }
-};
 
-struct s_ProbeLineDrawingInfo { 
-    int StartBarIndex = -1; 
-    int EndBarIndexOfProfile = -1;
-    float Price = 0.0f; 
-    bool IsHighProbe = false; 
-};
+    // Chart thread: queues bytes behind anything still waiting in Overflow
+    void Push(const uint8_t* data, size_t size) {
+        HandOver();
+        size_t pushed = Overflow.empty() ? PushBytes(data, size) : 0;
+        Overflow.insert(Overflow.end(), data + pushed, data + size);
+        WorkAvailable.notify_one();
+    }
 
-// PBAL struct
-struct s_PBALDrawingInfo {
-    int StartBarIndex = -1;
-    int EndBarIndex = -1;           // Chart end or cut point
-    float Price = 0.0f;
-    bool IsHigh = false;            // true for PBAH, false for PBAL
-    SCString OriginLabel;           // Original orange BA label
-    std::string EndReason = "Chart_End"; // "Chart_End" or "Intersection"
-    int OriginStartProfileIndex = -1;
-    int OriginEndProfileIndex = -1;
-    bool WasCut = false;
-};
+    // Chart thread: moves what fits of Overflow into the ring
+    void HandOver() {
+        if (Overflow.empty()) return;
+        size_t pushed = PushBytes(Overflow.data(), Overflow.size());
+        Overflow.erase(Overflow.begin(), Overflow.begin() + pushed);
+        WorkAvailable.notify_one();
+    }
 
-// Composite BA Struct
-struct s_CompositeBalanceArea {
-    int FirstBAIndex = -1;
-    int SecondBAIndex = -1; 
-    int ThirdBAIndex = -1;
-    SCDateTime StartDateTime; 
-    SCDateTime EndDateTime; 
-    int StartBarIndex = -1; 
-    int EndBarIndex = -1;
-    float HighestPrice = -FLT_MAX; 
-    float LowestPrice = FLT_MAX;
-    std::string QualificationReason = "N/A";
-    
-    float GetRange() const { 
-        if (HighestPrice <= -FLT_MAX || LowestPrice >= FLT_MAX || HighestPrice < LowestPrice) return 0.0f;
-        return HighestPrice - LowestPrice; 
+    void WriterLoop() {
+        for (;;) {
+            size_t head = Head.load(std::memory_order_relaxed);
+            size_t tail = Tail.load(std::memory_order_acquire);
+            if (head != tail) {
+                size_t offset = head % EVENT_JOURNAL_RING_BYTES;
+                size_t count = std::min(tail - head, EVENT_JOURNAL_RING_BYTES - offset);
+                if (fwrite(Ring.get() + offset, 1, count, File) != count) WriteFailed.store(true);
+                Head.store(head + count, std::memory_order_release);
+                if (Tail.load(std::memory_order_acquire) == head + count && fflush(File) != 0) WriteFailed.store(true);
+                continue;
+            }
+            // Stopping is set after the last push, so once it reads true that push is visible as well
+            if (Stopping.load(std::memory_order_acquire)) {
+                if (Tail.load(std::memory_order_acquire) != head) continue;
+                break;
+            }
+            std::unique_lock<std::mutex> lock(WakeMutex);
+            WorkAvailable.wait_for(lock, std::chrono::milliseconds(100)); // The timeout covers a notify that came just before the wait
+        }
+    }
+
+    // Writes out everything queued, then ends the thread and closes the file
+    void Stop() {
+        if (!IsRunning()) return;
+        while (!Overflow.empty()) {
+            HandOver();
+            if (!Overflow.empty()) std::this_thread::yield();
+        }
+        Stopping.store(true, std::memory_order_release);
+        WorkAvailable.notify_all();
+        Thread.join();
+        if (File != nullptr && fclose(File) != 0) WriteFailed.store(true);
+        File = nullptr;
     }
 };
 
-// NEW: Struct for Distribution Statistics
-struct s_DistributionStats {
-    float mean = 0.0f;
-    float stdDev = 0.0f;
-    float skewness = 0.0f;
-    float excessKurtosis = 0.0f; // Kurtosis - 3
-    bool sufficientData = false;
-    int numPriceLevelsWithVolume = 0;
+// --- Shared Profile Sets ---
+// NEW: Completed sessions and pair metrics shared by every AutoBAs instance in the process that loads the
+// same symbol with the same tick size, VbP tick multiplier and VA%. Both tables are copy-on-write: readers
+// take the current immutable version with one atomic load, writers publish a new version under WriteMutex.
+// Instances hold a shared_ptr to the set; the registry only a weak_ptr, so a set lives as long as its users.
+typedef std::map<std::pair<double, double>, std::shared_ptr<const s_SessionVolumeData>> SharedSessionMap;
+
+struct s_SharedProfileSet {
+    std::mutex WriteMutex;
+    std::shared_ptr<const SharedSessionMap> Sessions = std::make_shared<const SharedSessionMap>();       // Keyed by (start, end)
+    std::shared_ptr<const PairMetricsMemo> PairMetrics = std::make_shared<const PairMetricsMemo>();
+
+    std::shared_ptr<const SharedSessionMap> LoadSessions() const { return std::atomic_load(&Sessions); }
+    std::shared_ptr<const PairMetricsMemo> LoadPairMetrics() const { return std::atomic_load(&PairMetrics); }
+
+    void PublishSessions(const std::vector<std::pair<std::pair<double, double>, std::shared_ptr<const s_SessionVolumeData>>>& added) {
+        if (added.empty()) return;
+        std::lock_guard<std::mutex> lock(WriteMutex);
+        std::shared_ptr<SharedSessionMap> next = std::make_shared<SharedSessionMap>(*LoadSessions());
+        for (const auto& entry : added) next->insert(entry); // First writer wins; equal sessions hold equal data
+        std::atomic_store(&Sessions, std::shared_ptr<const SharedSessionMap>(next));
+    }
+
+    // Swaps in more compact versions of sessions that no instance uses any more (see ApplyProfileMemoryBudget),
+    // so the set does not keep their exact levels alive on its own
+    void ReplaceUnusedSessions(const std::vector<std::pair<std::pair<double, double>, std::shared_ptr<const s_SessionVolumeData>>>& compacted) {
+        if (compacted.empty()) return;
+        std::lock_guard<std::mutex> lock(WriteMutex);
+        std::shared_ptr<const SharedSessionMap> current = LoadSessions();
+        std::vector<size_t> unused;
+        for (size_t n = 0; n < compacted.size(); ++n) {
+            auto it = current->find(compacted[n].first);
+            if (it != current->end() && it->second->Tier < compacted[n].second->Tier && it->second.use_count() == 1) unused.push_back(n);
+        }
+        if (unused.empty()) return;
+        std::shared_ptr<SharedSessionMap> next = std::make_shared<SharedSessionMap>(*current);
+        for (size_t n : unused) (*next)[compacted[n].first] = compacted[n].second;
+        std::atomic_store(&Sessions, std::shared_ptr<const SharedSessionMap>(next));
+    }
+
+    void PublishPairMetrics(const PairMetricsMemo& updated) {
+        if (updated.empty()) return;
+        std::lock_guard<std::mutex> lock(WriteMutex);
+        std::shared_ptr<PairMetricsMemo> next = std::make_shared<PairMetricsMemo>(*LoadPairMetrics());
+        for (const auto& entry : updated) (*next)[entry.first] = entry.second;
+        std::atomic_store(&PairMetrics, std::shared_ptr<const PairMetricsMemo>(next));
+    }
 };
 
+std::shared_ptr<s_SharedProfileSet> AcquireSharedProfileSet(const std::string& key) {
+    static std::mutex registryMutex;
+    static std::map<std::string, std::weak_ptr<s_SharedProfileSet>> registry;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto it = registry.begin(); it != registry.end();) { // Drop sets whose last instance went away
+        if (it->second.expired()) it = registry.erase(it);
+        else ++it;
+    }
+    std::shared_ptr<s_SharedProfileSet> set = registry[key].lock();
+    if (!set) {
+        set = std::make_shared<s_SharedProfileSet>();
+        registry[key] = set;
+    }
+    return set;
+}
+
 // Enhanced Persistent Data Struct
 struct s_BAStudyPersistentData {
     std::vector<s_BalanceArea> FinalizedBalanceAreas;
@@ -149,6 +1568,7 @@ struct s_BAStudyPersistentData {
     int LastNumberOfSessions = 0; 
     int LastReferenceStudyID = 0;
     float LastVAPercentage = 0.0f;
+    int LastOverlapResolution = 1;
     float LastMinVolOverlap = 0.0f; 
     float LastMinVAOverlap = 0.0f;
     float LastRangeSimilarityPercent = 0.0f; 
@@ -173,6 +1593,8 @@ struct s_BAStudyPersistentData {
     // NEW: Track user-drawn status for manual adjustment capability
     bool LastAllowUserAdjustment = false;
 	bool LastDrawActiveBAs = false;
+    float LastPBALPierceThreshold = 0.0f;
+    bool LastBackgroundRecalc = false;
     
     // Track all drawings created by this study for proper cleanup
     std::vector<int> CreatedBADrawings;        // Track all BA drawing line numbers
@@ -183,602 +1605,1480 @@ struct s_BAStudyPersistentData {
     // Track which drawings have been manually adjusted by users
     std::set<int> UserAdjustedDrawings;        // Track any drawings that users have modified
 
+    // NEW: Memory-mapped cache of completed session profiles
+    s_ProfileDiskCache ProfileCache;
+
+    // NEW: Worker threads for per-session computation, shared with the other instances (AcquireSharedWorkerPool)
+    std::shared_ptr<s_WorkerPool> WorkerPool;
+    int WorkerPoolThreads = -1;                // Worker Threads input the pool was acquired for
+
+    // NEW: Formation bookkeeping and versioning for the persisted state snapshot
+    std::vector<bool> FormationProfileUsed;    // profileUsed flags from the last formation pass
+    std::vector<double> FormationSessionStarts; // StartDateTime of each profile the formation ran over
+    std::vector<int> FormationSessionBeginIndices; // BeginIndex of each profile, to catch bar index shifts on reload
+    int FormationResumeIndex = 0;              // First BA attempt that depended on the (still developing) last session
+    uint64_t StateFingerprint = 0;
+    unsigned int StateVersion = 0;             // Bumped whenever BA state changes
+    unsigned int SnapshotVersion = 0;          // StateVersion last written to disk
+
+    // NEW: Completed sessions and pair metrics, shared with other instances on the same symbol
+    std::shared_ptr<s_SharedProfileSet> SharedProfiles;
+    std::string SharedProfilesKey;
+    std::string SharedProfilesKeyScratch;      // This call's key, formatted here so live updates do not allocate
+
+    // NEW: Background / time-sliced recalculation
+    s_BackgroundFormation BackgroundFormation;
+    s_SlicedFormation SlicedFormation;
+    s_BackgroundSweep BackgroundSweep;         // NEW: Parameter sweep off the chart thread
+
+    // NEW: Sessions loaded on earlier calls; live updates only refresh the developing (last) one
+    std::vector<s_SessionProfile> LoadedSessions;
+    std::string LoadedSessionsKey;
+    std::string LoadedSessionsKeyScratch;      // This call's key, formatted here so live updates do not allocate
+
+    // NEW: Per-update work that only has to happen when something changed
+    bool CutCheckPending = false;              // A BA activated on the last bar; re-check cuts once more bars exist
+    int CutCheckArraySize = 0;                 // sc.ArraySize when cuts were last checked
+    unsigned int ActiveDrawnVersion = UINT_MAX; // StateVersion the active BA drawings were last emitted for
+
+    // NEW: Storage reused across live updates so a steady-state call does not allocate
+    std::shared_ptr<s_SessionVolumeData> DevelopingData; // Refilled in place while no background run holds it
+    std::string ProfileCachePath;              // Built when the shared profile key changes
+    std::string StateSnapshotPath;
+
+    // NEW: Sessions folded from the chart's bar volume at price (Profile Source = Chart Bar Volume at Price)
+    s_BarProfileBuilder BarProfiles;
+
+    // NEW: Tiered profile storage
+    int LastProfileMemoryBudget = 0;
+    size_t LastReportedProfileBytes = 0;
+
+    // NEW: Streaming export of the results (Export Results)
+    s_ResultExporter ResultExporter;
+    s_LevelPublisher LevelPublisher;
+    s_LevelIndex LevelIndex;               // NEW: Level crossing alerts
+    s_TradeActivationIndex TradeActivation; // NEW: Tick-Level Activation
+    s_EventJournal EventJournal;            // NEW: Event Journal
+
 };
 
-// --- Calculation Functions ---
+// --- Tiered Profile Storage ---
+// NEW: Older sessions are only read again when formation re-runs over them or a sweep evaluates them, so under a
+// memory budget their levels are re-encoded (compact) or dropped (summary) and brought back on demand.
 
-// NEW: Function to Calculate Volume Distribution Statistics
-s_DistributionStats CalculateVolumeDistributionStats(const PriceVolumeMap& priceMap, float tickSize) {
-   s_DistributionStats stats;
-   std::vector<std::pair<float, float>> pvm_vec; // price, volume
+void CopySessionSummary(s_SessionVolumeData& to, const s_SessionVolumeData& from) {
+   to.POC = from.POC;
+   to.ValueAreaHigh = from.ValueAreaHigh;
+   to.ValueAreaLow = from.ValueAreaLow;
+   to.TotalVolume = from.TotalVolume;
+   to.HighestPrice = from.HighestPrice;
+   to.LowestPrice = from.LowestPrice;
+   to.Moments = from.Moments;
+   to.NumPriceLevelsWithVolume = from.NumPriceLevelsWithVolume;
+}
 
-   if (priceMap.empty()) {
-       stats.sufficientData = false;
-       return stats;
-   }
+// Heap bytes held by one session's data (map nodes estimated as value plus next pointer and cached hash)
+size_t EstimateSessionVolumeDataBytes(const s_SessionVolumeData& data) {
+   size_t bytes = sizeof(s_SessionVolumeData);
+   bytes += data.PriceMap.size() * (sizeof(PriceVolumeMap::value_type) + 2 * sizeof(void*)) + data.PriceMap.bucket_count() * sizeof(void*);
+   bytes += data.Dense.Volume.capacity() * sizeof(float);
+   for (const auto& level : data.Pyramid.Levels) bytes += (level.Bins.Volume.capacity() + level.MaxTickVolume.capacity()) * sizeof(float);
+   bytes += (data.CompactTickDeltas.capacity() + data.CompactVolumes.capacity()) * sizeof(uint16_t);
+   return bytes;
+}
 
-   for (const auto& pair : priceMap) {
-       if (pair.second.TotalVolume > 0.00001f) { // Only consider levels with some volume
-           pvm_vec.push_back({pair.first, pair.second.TotalVolume});
-       }
+// Re-encodes exact data to a lower tier. Returns nullptr if the levels are too far apart for 16-bit tick deltas.
+std::shared_ptr<const s_SessionVolumeData> EncodeSessionVolumeData(const s_SessionVolumeData& exact, int tier, float tickSize, int tickMultiplier) {
+   std::shared_ptr<s_SessionVolumeData> encoded = std::make_shared<s_SessionVolumeData>();
+   CopySessionSummary(*encoded, exact);
+   encoded->Tier = tier;
+   if (tier != PROFILE_TIER_COMPACT) return encoded;
+
+   s_ScratchScope scratch;
+   ScratchVector<std::pair<int, float>> levels; // VbP tick, volume
+   levels.reserve(exact.PriceMap.size());
+   float maxVolume = 0.0f;
+   float levelSize = tickSize * tickMultiplier;
+   for (const auto& pair : exact.PriceMap) {
+       if (pair.second.TotalVolume <= 0.0f) continue;
+       levels.push_back(std::make_pair(static_cast<int>(std::lround(pair.first / levelSize)), pair.second.TotalVolume));
+       maxVolume = std::max(maxVolume, pair.second.TotalVolume);
    }
-   stats.numPriceLevelsWithVolume = static_cast<int>(pvm_vec.size());
-
-   if (stats.numPriceLevelsWithVolume < 3) { // Need at least 3 distinct price levels for meaningful skew/kurtosis
-       stats.sufficientData = false;
-       // Calculate mean/stdDev if possible for basic info, even if not "sufficient" for higher moments
-       if (stats.numPriceLevelsWithVolume > 0) {
-           double tempTotalVolume = 0.0; // Use double for intermediate sums
-           double sumPriceTimesVolume = 0.0;
-           for (const auto& pv : pvm_vec) {
-               tempTotalVolume += pv.second;
-               sumPriceTimesVolume += static_cast<double>(pv.first) * pv.second;
-           }
-           if (tempTotalVolume > 0.00001f) {
-               stats.mean = static_cast<float>(sumPriceTimesVolume / tempTotalVolume);
-               if (stats.numPriceLevelsWithVolume > 1) {
-                   double sumSquaredDevTimesVolume = 0.0;
-                   for (const auto& pv : pvm_vec) {
-                       double diff = static_cast<double>(pv.first) - stats.mean;
-                       sumSquaredDevTimesVolume += pv.second * diff * diff;
-                   }
-                   stats.stdDev = std::sqrt(static_cast<float>(sumSquaredDevTimesVolume / tempTotalVolume));
-               } else { // Single price level
-                    stats.stdDev = 0.0f;
-               }
-           }
-       }
-       return stats; // Not enough data for skew/kurtosis
+   std::sort(levels.begin(), levels.end());
+   encoded->CompactBaseTick = levels.empty() ? 0 : levels[0].first;
+   encoded->CompactVolumeStep = maxVolume / 65535.0f;
+   encoded->CompactTickDeltas.reserve(levels.size());
+   encoded->CompactVolumes.reserve(levels.size());
+   int previousTick = encoded->CompactBaseTick;
+   for (const auto& level : levels) {
+       int delta = level.first - previousTick;
+       if (delta > 65535) return nullptr;
+       long steps = std::lround(level.second / encoded->CompactVolumeStep);
+       encoded->CompactTickDeltas.push_back(static_cast<uint16_t>(delta));
+       encoded->CompactVolumes.push_back(static_cast<uint16_t>(std::max(1L, std::min(steps, 65535L))));
+       previousTick = level.first;
    }
+   return encoded;
+}
+
+// Appends the levels of a compact session, priced exactly as the VbP and cache loaders price them
+void StageCompactLevels(SCStudyInterfaceRef sc, const s_SessionVolumeData& compact, float tickSize, int tickMultiplier, ScratchVector<s_PriceLevelVolume>& levels) {
+   int priceInTicks = compact.CompactBaseTick;
+   for (size_t n = 0; n < compact.CompactVolumes.size(); ++n) {
+       priceInTicks += compact.CompactTickDeltas[n];
+       s_PriceLevelVolume plv;
+       plv.Price = sc.RoundToTickSize(static_cast<float>(priceInTicks * tickSize * tickMultiplier), tickSize);
+       plv.TotalVolume = compact.CompactVolumes[n] * compact.CompactVolumeStep;
+       levels.push_back(plv);
+   }
+}
 
-   double currentTotalVolume = 0.0;
-   double sumPriceTimesVolume = 0.0;
-   for (const auto& pv : pvm_vec) {
-       currentTotalVolume += pv.second;
-       sumPriceTimesVolume += static_cast<double>(pv.first) * pv.second;
+void StageCachedLevels(SCStudyInterfaceRef sc, const s_ProfileDiskCache& cache, const s_ProfileCacheIndexEntry& entry, float tickSize, int tickMultiplier, ScratchVector<s_PriceLevelVolume>& levels) {
+   const s_ProfileCacheLevel* cachedLevels = cache.GetLevels(entry);
+   for (uint32_t delta = 0; delta < entry.NumLevels; ++delta) {
+       if (cachedLevels[delta].Volume == 0) continue;
+       int priceInTicks = entry.BaseTick + static_cast<int>(delta);
+       s_PriceLevelVolume plv;
+       plv.Price = sc.RoundToTickSize(static_cast<float>(priceInTicks * tickSize * tickMultiplier), tickSize);
+       plv.TotalVolume = static_cast<float>(cachedLevels[delta].Volume);
+       plv.NumberOfTrades = static_cast<int>(cachedLevels[delta].NumberOfTrades);
+       levels.push_back(plv);
    }
+}
 
-   if (currentTotalVolume <= 0.00001f) { // Should be caught by pvm_vec.size check essentially
-       stats.sufficientData = false;
-       return stats;
+void StageBarProfileLevels(SCStudyInterfaceRef sc, const s_BarProfileSession& session, float tickSize, int tickMultiplier, ScratchVector<s_PriceLevelVolume>& levels) {
+   for (size_t delta = 0; delta < session.Levels.size(); ++delta) {
+       if (session.Levels[delta].Volume == 0) continue;
+       int priceInTicks = session.BaseTick + static_cast<int>(delta);
+       s_PriceLevelVolume plv;
+       plv.Price = sc.RoundToTickSize(static_cast<float>(priceInTicks * tickSize * tickMultiplier), tickSize);
+       plv.TotalVolume = static_cast<float>(session.Levels[delta].Volume);
+       plv.NumberOfTrades = static_cast<int>(session.Levels[delta].NumberOfTrades);
+       levels.push_back(plv);
    }
-   stats.mean = static_cast<float>(sumPriceTimesVolume / currentTotalVolume);
+}
 
-   double sumSquaredDevTimesVolume = 0.0;
-   for (const auto& pv : pvm_vec) {
-       double diff = static_cast<double>(pv.first) - stats.mean;
-       sumSquaredDevTimesVolume += pv.second * diff * diff;
+// Raw VbP levels are also collected into rawLevels when given, for the profile cache
+void StageStudyProfileLevels(SCStudyInterfaceRef sc, int referenceStudyID, int fetchIndex, float tickSize, int tickMultiplier, ScratchVector<s_PriceLevelVolume>& levels, std::vector<s_VolumeAtPriceV2>* rawLevels) {
+   int numPriceLevels = sc.GetNumPriceLevelsForStudyProfile(referenceStudyID, fetchIndex);
+   for (int priceIndex = 0; priceIndex < numPriceLevels; priceIndex++) {
+       s_VolumeAtPriceV2 vap;
+       if (sc.GetVolumeAtPriceDataForStudyProfile(referenceStudyID, fetchIndex, priceIndex, vap) == 1 && vap.Volume > 0) {
+           s_PriceLevelVolume plv;
+           plv.Price = sc.RoundToTickSize(static_cast<float>(vap.PriceInTicks * tickSize * tickMultiplier), tickSize);
+           plv.TotalVolume = static_cast<float>(vap.Volume);
+           plv.NumberOfTrades = vap.NumberOfTrades;
+           levels.push_back(plv);
+           if (rawLevels != nullptr) rawLevels->push_back(vap);
+       }
    }
-   stats.stdDev = std::sqrt(static_cast<float>(sumSquaredDevTimesVolume / currentTotalVolume));
-
-   // If standard deviation is very small, higher moments are numerically unstable or profile is too spike-like.
-   // Treat as a very peaked distribution (high kurtosis) and zero skewness.
-   if (stats.stdDev < (tickSize / 100.0f)) { // Adjusted threshold: e.g. 1% of a tick
-       stats.skewness = 0.0f;
-       stats.excessKurtosis = 10.0f; // Arbitrary high value for extreme peakedness
-       stats.sufficientData = true; // It's "sufficient" in the sense that it's a spike, higher moments are just defined this way.
-       return stats;
+}
+
+// Restores exact levels for sessions[first..] before a pass that reads them. The profile cache is used first when it
+// holds the session. Otherwise compact sessions are decoded (volumes within half a quantization step, no trade counts,
+// stored metrics kept), so Dense/Pyramid and the overlaps formation computes from them can differ slightly from the
+// exact session's; summary-only ones are read again from the profile source. Returns the number of sessions restored.
+int RehydrateSessionProfiles(SCStudyInterfaceRef sc, const s_BAStudyPersistentData* pData, const s_BarProfileBuilder* barProfiles, std::vector<s_SessionProfile>& sessions, int first, int numberOfSessions, int referenceStudyID, float valueAreaPercentage, float tickSize, int tickMultiplier) {
+   int restored = 0;
+   for (size_t profileIndex = static_cast<size_t>(std::max(0, first)); profileIndex < sessions.size(); ++profileIndex) {
+       s_SessionProfile& profile = sessions[profileIndex];
+       std::shared_ptr<const s_SessionVolumeData> stored = profile.Data;
+       if (stored->Tier == PROFILE_TIER_EXACT) continue;
+       s_ScratchScope scratch;
+       ScratchVector<s_PriceLevelVolume> levels;
+       bool decoded = false;
+       if (const s_ProfileCacheIndexEntry* cachedEntry = (barProfiles == nullptr) ? pData->ProfileCache.Find(profile.StartDateTime.GetAsDouble(), profile.EndDateTime.GetAsDouble()) : nullptr) {
+           StageCachedLevels(sc, pData->ProfileCache, *cachedEntry, tickSize, tickMultiplier, levels);
+       } else if (stored->Tier == PROFILE_TIER_COMPACT) {
+           StageCompactLevels(sc, *stored, tickSize, tickMultiplier, levels);
+           decoded = true;
+       } else {
+           int fetchIndex = numberOfSessions - 1 - profile.ChronologicalIndex;
+           n_ACSIL::s_StudyProfileInformation profileInfo;
+           if (GetSessionProfileInfo(sc, barProfiles, referenceStudyID, fetchIndex, profileInfo) && profileInfo.m_StartDateTime.GetAsDouble() == profile.StartDateTime.GetAsDouble()) {
+               if (barProfiles != nullptr) StageBarProfileLevels(sc, *barProfiles->FindSession(fetchIndex), tickSize, tickMultiplier, levels);
+               else StageStudyProfileLevels(sc, referenceStudyID, fetchIndex, tickSize, tickMultiplier, levels, nullptr);
+           }
+       }
+       if (levels.empty()) continue; // No longer available; passes only see the session's metrics
+       std::shared_ptr<s_SessionVolumeData> exact = std::make_shared<s_SessionVolumeData>();
+       exact->PriceMap.reserve(levels.size());
+       FillSessionVolumeData(*exact, levels.data(), levels.size(), valueAreaPercentage, tickSize);
+       if (decoded) CopySessionSummary(*exact, *stored); // Metrics stay the ones the session loaded with
+       AssignSessionVolumeData(profile, exact);
+       restored++;
    }
+   return restored;
+}
 
-   double sumCubedStdDevTimesVolume = 0.0;
-   double sumQuartStdDevTimesVolume = 0.0;
-   for (const auto& pv : pvm_vec) {
-       double standardizedDev = (static_cast<double>(pv.first) - stats.mean) / stats.stdDev;
-       sumCubedStdDevTimesVolume += pv.second * std::pow(standardizedDev, 3.0);
-       sumQuartStdDevTimesVolume += pv.second * std::pow(standardizedDev, 4.0);
+// Keeps the sessions' level storage within budgetBytes (0 = unlimited). Walking back from the newest session, each
+// keeps the richest tier that still fits: exact, compact, then summary only. Sessions from keepExactFrom on (the
+// developing one and any formation may still revisit) always stay exact. Tiers only go down here.
+void ApplyProfileMemoryBudget(std::vector<s_SessionProfile>& sessions, int keepExactFrom, size_t budgetBytes, float tickSize, int tickMultiplier, s_SharedProfileSet& shared) {
+   if (budgetBytes == 0) return;
+   std::vector<std::pair<std::pair<double, double>, std::shared_ptr<const s_SessionVolumeData>>> compacted;
+   size_t usedBytes = 0;
+   for (int profileIndex = static_cast<int>(sessions.size()) - 1; profileIndex >= 0; --profileIndex) {
+       s_SessionProfile& profile = sessions[profileIndex];
+       const s_SessionVolumeData& data = *profile.Data;
+       size_t bytes = EstimateSessionVolumeDataBytes(data);
+       if (profileIndex >= keepExactFrom || data.IsEmpty() || data.Tier == PROFILE_TIER_SUMMARY || usedBytes + bytes <= budgetBytes) {
+           usedBytes += bytes;
+           continue;
+       }
+       std::shared_ptr<const s_SessionVolumeData> encoded;
+       if (data.Tier == PROFILE_TIER_EXACT) {
+           size_t compactBytes = sizeof(s_SessionVolumeData) + data.PriceMap.size() * 2 * sizeof(uint16_t);
+           if (usedBytes + compactBytes <= budgetBytes) encoded = EncodeSessionVolumeData(data, PROFILE_TIER_COMPACT, tickSize, tickMultiplier);
+       }
+       if (!encoded) encoded = EncodeSessionVolumeData(data, PROFILE_TIER_SUMMARY, tickSize, tickMultiplier);
+       usedBytes += EstimateSessionVolumeDataBytes(*encoded);
+       profile.Data = encoded;
+       compacted.push_back(std::make_pair(std::make_pair(profile.StartDateTime.GetAsDouble(), profile.EndDateTime.GetAsDouble()), encoded));
    }
+   shared.ReplaceUnusedSessions(compacted);
+}
 
-   stats.skewness = static_cast<float>(sumCubedStdDevTimesVolume / currentTotalVolume);
-   float rawKurtosis = static_cast<float>(sumQuartStdDevTimesVolume / currentTotalVolume);
-   stats.excessKurtosis = rawKurtosis - 3.0f;
-   stats.sufficientData = true;
+struct s_ProfileMemoryUsage {
+   size_t Bytes = 0;
+   int NumSessions[3] = { 0, 0, 0 }; // Per e_ProfileTier
+};
 
-   return stats;
+s_ProfileMemoryUsage MeasureProfileMemory(const std::vector<s_SessionProfile>& sessions) {
+   s_ProfileMemoryUsage usage;
+   for (const auto& profile : sessions) {
+       usage.Bytes += sizeof(s_SessionProfile) + EstimateSessionVolumeDataBytes(*profile.Data);
+       usage.NumSessions[profile.Data->Tier]++;
+   }
+   return usage;
 }
 
-float CalculateVolumeProfileOverlap(const PriceVolumeMap& profile1, const PriceVolumeMap& profile2) { 
-   if (profile1.empty() || profile2.empty()) return 0.0f;
-   float overlapVolume = 0.0f;
-   float map1TotalVolume = 0.0f; 
-   for(const auto& p : profile1) map1TotalVolume += p.second.TotalVolume;
-   float map2TotalVolume = 0.0f; 
-   for(const auto& p : profile2) map2TotalVolume += p.second.TotalVolume;
+// NEW: Line numbers of a BA's active rectangle and PBAH/L rays. Finalized BAs never share sessions, so the
+// start profile alone identifies a BA and the numbers stay unique up to the 5,000 session limit.
+int ActiveBALineNumber(const s_BalanceArea& ba) {
+   return 50000 + ba.StartProfileChronoIndex;
+}
 
-   if (map1TotalVolume <= 0.0f && map2TotalVolume <= 0.0f) return 0.0f; // if both profiles are empty of volume.
+int PBALLineNumber(const s_PBALDrawingInfo& pbal) {
+   return 60000 + pbal.OriginStartProfileIndex * 2 + (pbal.IsHigh ? 1 : 0);
+}
 
-   std::set<float> allPrices;
-   for (const auto& pair : profile1) allPrices.insert(pair.first);
-   for (const auto& pair : profile2) allPrices.insert(pair.first);
+// NEW: Forget activations, extensions, cuts and PBALs so they are re-derived from the finalized BAs
+void ResetBAActivationState(s_BAStudyPersistentData* pData) {
+   for (auto& ba : pData->FinalizedBalanceAreas) ClearBAActivation(ba);
+   pData->ActiveBalanceAreas.clear();
+   pData->CreatedActiveBADrawings.clear();
+   pData->PBALsToDraw.clear();
+}
 
-   for (float price : allPrices) {
-       float vol1 = (profile1.count(price)) ? profile1.at(price).TotalVolume : 0.0f;
-       float vol2 = (profile2.count(price)) ? profile2.at(price).TotalVolume : 0.0f;
-       overlapVolume += std::min(vol1, vol2);
-   }
-   float unionVolume = map1TotalVolume + map2TotalVolume - overlapVolume;
-   return (unionVolume > 0.00001f) ? (overlapVolume / unionVolume) * 100.0f : 0.0f;
+// NEW: Publish a finished formation run as the study's BA state
+void ApplyBAFormationRun(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, s_BAFormationRun& run) {
+   pData->FinalizedBalanceAreas = std::move(run.Result.FinalizedBalanceAreas);
+   pData->ProbeLinesToDraw = std::move(run.Result.ProbeLinesToDraw);
+   pData->CompositeBAs = std::move(run.Result.CompositeBAs);
+   pData->FormationProfileUsed = std::move(run.Result.FormationProfileUsed);
+   pData->FormationResumeIndex = run.Result.FormationResumeIndex;
+   if (run.ResetActivationOnApply) ResetBAActivationState(pData); // Activations of the replaced BAs no longer apply
+   for (const auto& message : run.Result.LogMessages) sc.AddMessageToLog(message.c_str(), 0);
+   run.Result.LogMessages.clear();
+   pData->StateVersion++;
 }
 
-float CalculateValueAreaOverlap(float VAH1, float VAL1, float VAH2, float VAL2, float TickSize) { 
-   if (VAH1 < VAL1 || VAH2 < VAL2) return 0.0f;
-   float vaRange1 = VAH1 - VAL1; 
-   float vaRange2 = VAH2 - VAL2;
-   // If both ranges are effectively zero (single price level VA), consider 100% overlap if they are the same, 0% otherwise.
-   if (vaRange1 < TickSize / 2.0f && vaRange2 < TickSize / 2.0f) {
-       return (std::fabs(VAL1 - VAL2) < TickSize / 2.0f) ? 100.0f : 0.0f;
+// NEW: Marks ba activated at barIndex and adds it to the active BAs. tradeDateTime is the time of the trade
+// that activated it, or unset when the activation was found from bar highs/lows.
+void ActivateBalanceArea(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, s_BalanceArea& ba, int barIndex, bool breakHigh, float price, SCDateTime tradeDateTime) {
+   if (barIndex == sc.ArraySize - 1) pData->CutCheckPending = true; // Can only cut (or be cut) once a later bar exists
+
+   ba.IsActivated = true;
+   ba.ActivationDateTime = sc.BaseDateTimeIn[barIndex];
+   ba.ActivationTradeDateTime = tradeDateTime;
+   ba.ActivationBarIndex = barIndex;
+   ba.ActivationPrice = price;
+   if (breakHigh) {
+       ba.ActivationType = "Break_High";
+       ba.ActivatedHigh = true;
+   } else {
+       ba.ActivationType = "Break_Low";
+       ba.ActivatedLow = true;
    }
-   // If one range is zero and the other is not, no meaningful overlap.
-   if (vaRange1 < TickSize / 2.0f || vaRange2 < TickSize / 2.0f) return 0.0f;
-
-   float overlapStart = std::max(VAL1, VAL2);
-   float overlapEnd = std::min(VAH1, VAH2);
-   if (overlapStart >= overlapEnd - TickSize / 2.0f) return 0.0f; // No overlap or too small
-   float overlapLength = overlapEnd - overlapStart;
-   float unionStart = std::min(VAL1, VAL2); 
-   float unionEnd = std::max(VAH1, VAH2);
-   float unionLength = unionEnd - unionStart;
-   if (unionLength < TickSize / 2.0f) return 0.0f; // Union is too small
-   return (overlapLength / unionLength) * 100.0f;
-}
-
-float CalculateRangeSimilarityDiff(const s_SessionProfile& profileN, const s_SessionProfile& profileN1, float tickSize) { 
-   float rangeN = profileN.GetRange(); 
-   float rangeN1 = profileN1.GetRange();
-   if (rangeN <= tickSize / 2.0f && rangeN1 <= tickSize / 2.0f) return 0.0f; // Both effectively zero range
-   if (rangeN <= tickSize / 2.0f || rangeN1 <= tickSize / 2.0f) return 200.0f; // One is zero range, max difference
-   float avgRange = (rangeN + rangeN1) / 2.0f; 
-   if (avgRange <= 0.00001f) return 200.0f; // Avoid division by zero
-   return std::fabs(rangeN - rangeN1) / avgRange * 100.0f; 
-}
-
-bool CheckRangeSimilarity(float diffPercent, float thresholdPercent) { 
-   return diffPercent <= thresholdPercent;
-}
-
-float CalculateMaxAllowedHigh(float referenceHigh, float referenceRange, float tolerancePercent, float tickSize) { 
-   float rangeForTol = std::max(referenceRange, tickSize); // Ensure at least 1 tick for tolerance base
-   float toleranceValue = rangeForTol * (tolerancePercent / 100.0f); 
-   return referenceHigh + toleranceValue;
-}
-
-bool CheckHighPosition(float profileHigh, float maxAllowedHigh) { 
-   if (maxAllowedHigh <= -FLT_MAX) return false; 
-   return profileHigh <= maxAllowedHigh;
-}
-
-float CalculateMinAllowedLow(float referenceLow, float referenceRange, float tolerancePercent, float tickSize) { 
-   float rangeForTol = std::max(referenceRange, tickSize); // Ensure at least 1 tick for tolerance base
-   float toleranceValue = rangeForTol * (tolerancePercent / 100.0f); 
-   return referenceLow - toleranceValue;
-}
-
-bool CheckLowPosition(float profileLow, float minAllowedLow) { 
-   if (minAllowedLow >= FLT_MAX) return false; 
-   return profileLow >= minAllowedLow;
-}
-
-PriceVolumeMap MergeMultipleVolumeProfiles(const std::vector<std::reference_wrapper<const PriceVolumeMap>>& profileMapsToMerge) { 
-   PriceVolumeMap mergedProfile; 
-   if (profileMapsToMerge.empty()) return mergedProfile;
-   for(const auto& profileMapRef : profileMapsToMerge) { 
-       const PriceVolumeMap& profileMap = profileMapRef.get();
-       for (const auto& pairB : profileMap) { 
-           const float price = pairB.first; 
-           const s_PriceLevelVolume& volumeDataB = pairB.second;
-           auto it = mergedProfile.find(price); 
-           if (it != mergedProfile.end()) { 
-               it->second.TotalVolume += volumeDataB.TotalVolume; 
-               it->second.NumberOfTrades += volumeDataB.NumberOfTrades;
-           } else { 
-               mergedProfile[price] = volumeDataB; 
-           } 
-       } 
-   } 
-   return mergedProfile;
-}
-
-void CalculateProfileMetrics(const PriceVolumeMap& priceMap, float valueAreaPercentage, SCStudyInterfaceRef sc, float& poc, float& valueAreaHigh, float& valueAreaLow, float& highestPrice, float& lowestPrice, float& totalVolume) { 
-   poc = 0.0f;
-   valueAreaHigh = 0.0f; 
-   valueAreaLow = 0.0f; 
-   highestPrice = -FLT_MAX; 
-   lowestPrice = FLT_MAX; 
-   totalVolume = 0.0f; 
-   if (priceMap.empty()) return;
-   
-   float maxVolumeAtPOC = 0.0f; 
-   std::vector<std::pair<float, float>> priceVolPairs; 
-   priceVolPairs.reserve(priceMap.size()); 
-   for (const auto& pair : priceMap) { 
-       const float price = pair.first;
-       const float volume = pair.second.TotalVolume; 
-       if (volume > 0.00001f) { 
-           totalVolume += volume; 
-           priceVolPairs.push_back({price, volume});
-           if (volume > maxVolumeAtPOC) { 
-               maxVolumeAtPOC = volume; 
-               poc = price;
-           } else if (std::fabs(volume - maxVolumeAtPOC) < 0.00001f && price > poc) { 
-               poc = price; // Higher POC if volume is effectively same
-           } 
-           if (price > highestPrice) highestPrice = price; 
-           if (price < lowestPrice) lowestPrice = price;
-       } 
-   } 
-   
-   if (totalVolume <= 0.00001f || priceVolPairs.empty()) {
-       // If no volume, try to set H/L from map keys if they exist.
-       bool first = true;
-       if (!priceMap.empty()) {
-           for(const auto& pair : priceMap) { // This loop runs only if priceMap is not empty.
-               if (first) { 
-                   highestPrice = pair.first; 
-                   lowestPrice = pair.first; 
-                   first = false; 
-               } else { 
-                   if(pair.first > highestPrice) highestPrice = pair.first; 
-                   if(pair.first < lowestPrice) lowestPrice = pair.first; 
-               }
-           }
-       }
-       if(highestPrice > -FLT_MAX && lowestPrice < FLT_MAX && highestPrice >= lowestPrice) { // Check if any valid H/L was found
-           valueAreaHigh = highestPrice; 
-           valueAreaLow = lowestPrice;
-           poc = lowestPrice + (highestPrice - lowestPrice) / 2.0f; // Midpoint as POC
-       } else { // Reset if still invalid
-           highestPrice = -FLT_MAX; 
-           lowestPrice = FLT_MAX; 
-           poc = 0.0f; 
-           valueAreaHigh = 0.0f; 
-           valueAreaLow = 0.0f;
+
+   // Set up for extension
+   ba.IsExtending = true;
+   ba.ExtensionEndIndex = sc.ArraySize - 1; // Default to chart end
+   ba.ExtensionEndReason = "Chart_End";
+
+   // Add to active BAs list if not already there
+   bool alreadyInActiveList = false;
+   for (const auto& activeBa : pData->ActiveBalanceAreas) {
+       if (activeBa.StartProfileChronoIndex == ba.StartProfileChronoIndex &&
+           activeBa.EndProfileChronoIndex == ba.EndProfileChronoIndex) {
+           alreadyInActiveList = true;
+           break;
        }
-       return;
-   } 
-   
-   std::sort(priceVolPairs.begin(), priceVolPairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; }); 
-   size_t pocIndex = 0;
-   bool pocFoundInSortedList = false; 
-   for (size_t i = 0; i < priceVolPairs.size(); ++i) { 
-       if (std::fabs(priceVolPairs[i].first - poc) < sc.TickSize / 2.0f) { 
-           pocIndex = i; 
-           pocFoundInSortedList = true; 
-           break; 
-       } 
    }
-   
-   if (!pocFoundInSortedList && !priceVolPairs.empty()) { // Fallback if POC from initial scan wasn't in list (e.g. float precision issues)
-       maxVolumeAtPOC = 0.0f; 
-       pocIndex = 0; 
-       poc = priceVolPairs[0].first;
-       for(size_t i = 0; i < priceVolPairs.size(); ++i) {
-           if (priceVolPairs[i].second > maxVolumeAtPOC) { 
-               maxVolumeAtPOC = priceVolPairs[i].second; 
-               pocIndex = i; 
-               poc = priceVolPairs[i].first; 
-           } else if (std::fabs(priceVolPairs[i].second - maxVolumeAtPOC) < 0.00001f && priceVolPairs[i].first > poc) { 
-               pocIndex = i; 
-               poc = priceVolPairs[i].first;
-           }
-       }
-   } else if (priceVolPairs.empty()) return; // Should be caught by totalVolume check
-   
-   float targetVolume = totalVolume * (valueAreaPercentage / 100.0f); 
-   float currentVolumeInVA = 0.0f;
-   if (pocIndex < priceVolPairs.size()) { // Ensure pocIndex is valid before accessing
-       currentVolumeInVA = priceVolPairs[pocIndex].second;
-   } else if (!priceVolPairs.empty()) { // If pocIndex somehow invalid, default to first element
-       pocIndex = 0; 
-       currentVolumeInVA = priceVolPairs[pocIndex].second; 
-       poc = priceVolPairs[pocIndex].first;
-   } else return; // No data to process
-   
-   valueAreaHigh = poc; 
-   valueAreaLow = poc; 
-   size_t upperIndex = pocIndex; 
-   size_t lowerIndex = pocIndex;
-   
-   while (currentVolumeInVA < targetVolume) { 
-       bool canGoHigher = (upperIndex + 1 < priceVolPairs.size()); 
-       bool canGoLower = (lowerIndex > 0);
-       if (!canGoHigher && !canGoLower) break; 
-       float higherVol = canGoHigher ? priceVolPairs[upperIndex + 1].second : 0.0f; 
-       float lowerVol = canGoLower ? priceVolPairs[lowerIndex - 1].second : 0.0f;
-       
-       if (canGoHigher && canGoLower && higherVol > 0.00001f && std::fabs(higherVol - lowerVol) < 0.00001f) { 
-           currentVolumeInVA += (higherVol + lowerVol); 
-           valueAreaHigh = priceVolPairs[upperIndex + 1].first; 
-           valueAreaLow = priceVolPairs[lowerIndex - 1].first; 
-           upperIndex++; 
-           lowerIndex--;
-       } else if (canGoHigher && (!canGoLower || higherVol >= lowerVol)) { 
-           if(higherVol > 0.00001f) {
-               currentVolumeInVA += higherVol; 
-               valueAreaHigh = priceVolPairs[upperIndex + 1].first;
-           } 
-           upperIndex++;
-       } else if (canGoLower) { 
-           if(lowerVol > 0.00001f) {
-               currentVolumeInVA += lowerVol; 
-               valueAreaLow = priceVolPairs[lowerIndex - 1].first;
-           } 
-           lowerIndex--; 
-       } else break;
-       
-       if (lowerIndex > upperIndex && (lowerIndex !=0 || upperIndex != priceVolPairs.size()-1) ) break; 
-   } 
+   if (!alreadyInActiveList) {
+       pData->ActiveBalanceAreas.push_back(ba);
+   }
 }
 
-// NEW: Function to check for BA activation
-void CheckForBAActivation(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, float TickSize) {
-   if (pData->FinalizedBalanceAreas.empty()) return;
+bool CheckForBAActivation(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, float TickSize) {
+   if (pData->FinalizedBalanceAreas.empty()) return false;
+   bool anyActivated = false;
    
    // Check each finalized BA for activation
    for (auto& ba : pData->FinalizedBalanceAreas) {
        if (ba.IsActivated) continue; // Already activated
        
-       // Look for price breaking outside the Value Area
-       int checkStartIndex = ba.EndBarIndex + 1; // Start checking after BA formation ends
-       if (checkStartIndex >= sc.ArraySize) continue;
-       
-       float tolerance = TickSize / 2.0f;
-       
-       // Check bars after BA formation for breakout
-       for (int i = checkStartIndex; i < sc.ArraySize; ++i) {
-           bool activated = false;
-           
-           // Check for break above Value Area High
-           if (sc.High[i] > ba.ValueAreaHigh + tolerance) {
-               ba.IsActivated = true;
-               ba.ActivationDateTime = sc.BaseDateTimeIn[i];
-               ba.ActivationBarIndex = i;
-               ba.ActivationPrice = sc.High[i];
-               ba.ActivationType = "Break_High";
-               ba.ActivatedHigh = true;
-               activated = true;
-           }
-           // Check for break below Value Area Low
-           else if (sc.Low[i] < ba.ValueAreaLow - tolerance) {
-               ba.IsActivated = true;
-               ba.ActivationDateTime = sc.BaseDateTimeIn[i];
-               ba.ActivationBarIndex = i;
-               ba.ActivationPrice = sc.Low[i];
-               ba.ActivationType = "Break_Low";
-               ba.ActivatedLow = true;
-               activated = true;
-           }
-           
-           if (activated) {
-               // Set up for extension
-               ba.IsExtending = true;
-               ba.ExtensionEndIndex = sc.ArraySize - 1; // Default to chart end
-               ba.ExtensionEndReason = "Chart_End";
-               
-               // Add to active BAs list if not already there
-               bool alreadyInActiveList = false;
-               for (const auto& activeBa : pData->ActiveBalanceAreas) {
-                   if (activeBa.StartProfileChronoIndex == ba.StartProfileChronoIndex && 
-                       activeBa.EndProfileChronoIndex == ba.EndProfileChronoIndex) {
-                       alreadyInActiveList = true;
-                       break;
-                   }
-               }
-               if (!alreadyInActiveList) {
-                   pData->ActiveBalanceAreas.push_back(ba);
+       // Look for price breaking outside the Value Area after BA formation ends. Bars scanned on earlier
+       // calls are skipped, so a live update only looks at the last bar(s) instead of the BA's whole history.
+       bool breakHigh = false;
+       int i = FindBAActivationBar(ba, sc.High, sc.Low, ba.ActivationCheckedBarIndex, sc.ArraySize, TickSize, breakHigh);
+       if (i < 0) {
+           ba.ActivationCheckedBarIndex = sc.ArraySize - 1;
+           continue;
+       }
+       ActivateBalanceArea(sc, pData, ba, i, breakHigh, breakHigh ? sc.High[i] : sc.Low[i], SCDateTime());
+       anyActivated = true;
+   }
+   return anyActivated;
+}
+
+// NEW: Activations from the time and sales records added since the last call, each at the exact trade that
+// broke out. Records seen on a full recalculation or the first call only set the starting point: history is
+// left to CheckForBAActivation. Records are only marked seen once they were matched against current triggers,
+// so trades that arrive while the triggers are out of date are checked after the rebuild.
+bool CheckForTradeActivation(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData) {
+   s_TradeActivationIndex& triggers = pData->TradeActivation;
+   c_SCTimeAndSalesArray timeAndSales;
+   sc.GetTimeAndSales(timeAndSales);
+   int numRecords = timeAndSales.Size();
+   if (numRecords == 0) return false;
+   uint32_t newestSequence = timeAndSales[numRecords - 1].Sequence;
+   if (!triggers.HasSequence || sc.IsFullRecalculation) {
+       triggers.LastSequence = newestSequence;
+       triggers.HasSequence = true;
+       return false;
+   }
+
+   // Records are in sequence order: binary search for the first one not seen yet
+   int first = 0, last = numRecords;
+   while (first < last) {
+       int middle = first + (last - first) / 2;
+       if (timeAndSales[middle].Sequence <= triggers.LastSequence) first = middle + 1;
+       else last = middle;
+   }
+   if (triggers.BuiltVersion != pData->StateVersion) return false;
+
+   bool anyActivated = false;
+   for (int n = first; n < numRecords; ++n) {
+       const s_TimeAndSales& record = timeAndSales[n];
+       if (record.Type == SC_TS_BID || record.Type == SC_TS_ASK) { // Trades only, not quote updates
+           float price = record.Price * sc.RealTimePriceMultiplier;
+           size_t nextHigh = triggers.NextHigh, nextLow = triggers.NextLow;
+           bool barPending = false;
+           triggers.Match(price, [&](int baIndex, bool breakHigh) {
+               if (baIndex >= static_cast<int>(pData->FinalizedBalanceAreas.size())) return;
+               s_BalanceArea& ba = pData->FinalizedBalanceAreas[baIndex];
+               if (ba.IsActivated) return;
+               SCDateTime tradeDateTime = record.DateTime + sc.TimeScaleAdjustment; // Time and sales are in UTC
+               int barIndex = sc.GetContainingIndexForSCDateTime(sc.ChartNumber, tradeDateTime);
+               if (barIndex >= sc.ArraySize) {
+                   barPending = true;
+                   return;
                }
-               break; // Stop checking this BA
+               if (barIndex <= ba.EndBarIndex) return;
+               ActivateBalanceArea(sc, pData, ba, barIndex, breakHigh, price, tradeDateTime);
+               anyActivated = true;
+           });
+           if (barPending) { // The trade's bar is not on the chart yet: give its triggers back and match it again next call
+               triggers.NextHigh = nextHigh;
+               triggers.NextLow = nextLow;
+               break;
            }
        }
+       triggers.LastSequence = record.Sequence;
    }
+   return anyActivated;
 }
 
 void CheckForPBALCreation(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, 
                          const s_BalanceArea& cutBA, const s_BalanceArea& intersectingBA, 
                          float pierceThresholdPercent, float TickSize) {
     
-    float orangeBARange = cutBA.ValueAreaHigh - cutBA.ValueAreaLow;
-    if (orangeBARange <= 0.0f) return;
-    
-    float pierceThreshold = orangeBARange * (pierceThresholdPercent / 100.0f);
-    
-    // Check if orange BA's VALUE AREA HIGH pierces ABOVE the intersecting blue BA's ENTIRE RANGE HIGH by threshold
-    bool createHighPBAL = (cutBA.ValueAreaHigh > intersectingBA.HighestPrice + pierceThreshold);
-    
-    // Check if orange BA's VALUE AREA LOW pierces BELOW the intersecting blue BA's ENTIRE RANGE LOW by threshold  
-    bool createLowPBAL = (cutBA.ValueAreaLow < intersectingBA.LowestPrice - pierceThreshold);
+    bool createHighPBAL, createLowPBAL;
+    FindPBALPierces(cutBA, intersectingBA, pierceThresholdPercent, createHighPBAL, createLowPBAL);
     
-    // Create PBAH (high ray) only if high edge pierces above blue BA
-    if (createHighPBAL) {
-        s_PBALDrawingInfo pbalHigh;
-        pbalHigh.StartBarIndex = cutBA.ActivationBarIndex;
-        pbalHigh.EndBarIndex = sc.ArraySize - 1;
-        pbalHigh.Price = cutBA.ValueAreaHigh;
-        pbalHigh.IsHigh = true;
-        pbalHigh.EndReason = "Chart_End";
-        pbalHigh.OriginStartProfileIndex = cutBA.StartProfileChronoIndex;
-        pbalHigh.OriginEndProfileIndex = cutBA.EndProfileChronoIndex;
+    if (createHighPBAL) pData->PBALsToDraw.push_back(MakePBALDrawingInfo(cutBA, true, sc.ArraySize - 1));
+    if (createLowPBAL) pData->PBALsToDraw.push_back(MakePBALDrawingInfo(cutBA, false, sc.ArraySize - 1));
+}
+
+// NEW: Function to check for BA intersections and update extension endpoints
+// NEW: Function to check for BA intersections and update extension endpoints
+// Returns true if any active BA was cut during this call
+bool UpdateBAExtensions(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, float TickSize, float PBALPierceThreshold) {
+    bool anyCut = false;
+    // Sort active BAs by activation time for proper cutting logic
+    std::sort(pData->ActiveBalanceAreas.begin(), pData->ActiveBalanceAreas.end(), 
+              [](const s_BalanceArea& a, const s_BalanceArea& b) {
+                  return a.ActivationBarIndex < b.ActivationBarIndex;
+              });
+
+    // Check each active BA for intersections with newly formed BAs and other active BAs
+    for (size_t i = 0; i < pData->ActiveBalanceAreas.size(); ++i) {
+        auto& activeBa = pData->ActiveBalanceAreas[i];
+        if (!activeBa.IsExtending) continue;
         
-        // Create origin label
-        SCString dateStr;
-        if (!cutBA.StartDateTime.IsUnset()) {
-            int year = cutBA.StartDateTime.GetYear();
-            int month = cutBA.StartDateTime.GetMonth();
-            int day = cutBA.StartDateTime.GetDay();
-            dateStr.Format("%02d-%02d-%02d", month, day, year % 100);
-        } else {
-            dateStr = "N/A";
+        // Value areas intersecting a later-activated BA are cut at that BA's activation point
+        int earliestCutPoint = sc.ArraySize - 1; // Start with chart end
+        const s_BalanceArea* intersectingBA = FindBACut(activeBa, i, pData->FinalizedBalanceAreas, pData->ActiveBalanceAreas, TickSize, earliestCutPoint);
+
+        // Apply the cut if needed
+        if (intersectingBA && earliestCutPoint < activeBa.ExtensionEndIndex) {
+            activeBa.ExtensionEndIndex = earliestCutPoint;
+            activeBa.ExtensionEndReason = "BA_Intersection";
+            activeBa.WasCut = true;          // Mark as cut
+            activeBa.IsExtending = false;    // No longer extending
+            activeBa.CutByStartProfileIndex = intersectingBA->StartProfileChronoIndex;
+            activeBa.CutByEndProfileIndex = intersectingBA->EndProfileChronoIndex;
+            anyCut = true;
+
+            // Check for PBAL creation against the intersecting BA
+            CheckForPBALCreation(sc, pData, activeBa, *intersectingBA, PBALPierceThreshold, TickSize);
+        }
+    }
+    
+    // Update active BAs in the main list to reflect changes
+    std::map<std::pair<int, int>, const s_BalanceArea*> activeByProfiles;
+    for (const auto& activeBa : pData->ActiveBalanceAreas) {
+        activeByProfiles.emplace(std::make_pair(activeBa.StartProfileChronoIndex, activeBa.EndProfileChronoIndex), &activeBa);
+    }
+    for (size_t i = 0; i < pData->FinalizedBalanceAreas.size(); ++i) {
+        auto& finalizedBa = pData->FinalizedBalanceAreas[i];
+        if (!finalizedBa.IsActivated) continue;
+
+        // Find corresponding active BA and sync the data
+        auto found = activeByProfiles.find(std::make_pair(finalizedBa.StartProfileChronoIndex, finalizedBa.EndProfileChronoIndex));
+        if (found != activeByProfiles.end()) {
+            const s_BalanceArea& activeBa = *found->second;
+            finalizedBa.IsExtending = activeBa.IsExtending;
+            finalizedBa.ExtensionEndIndex = activeBa.ExtensionEndIndex;
+            finalizedBa.ExtensionEndReason = activeBa.ExtensionEndReason;
+            finalizedBa.WasCut = activeBa.WasCut;
+            finalizedBa.CutByStartProfileIndex = activeBa.CutByStartProfileIndex;
+            finalizedBa.CutByEndProfileIndex = activeBa.CutByEndProfileIndex;
+        }
+    }
+    return anyCut;
+}
+
+void s_BackgroundFormation::Start(std::shared_ptr<s_BAFormationRun> run, std::shared_ptr<const std::vector<s_SessionProfile>> sessions) {
+    Stop();
+    std::atomic_store(&Published, std::shared_ptr<s_BAFormationRun>()); // Drop a result nobody picked up yet
+    Cancel.store(false);
+    AwaitingResult = true;
+    Thread = std::thread([this, run, sessions]() {
+        auto cancelled = [this]() { return Cancel.load(std::memory_order_relaxed); };
+        if (AdvanceBAFormationRun(*run, *sessions, cancelled) && !cancelled()) std::atomic_store(&Published, run);
+    });
+}
+
+std::shared_ptr<s_BAFormationRun> s_SlicedFormation::Continue(int budgetMicroseconds) {
+    if (!Run) return nullptr;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budgetMicroseconds);
+    std::function<bool()> outOfTime;
+    if (budgetMicroseconds > 0) outOfTime = [deadline]() { return std::chrono::steady_clock::now() >= deadline; };
+    if (!AdvanceBAFormationRun(*Run, *Sessions, outOfTime)) return nullptr;
+    std::shared_ptr<s_BAFormationRun> finished = Run;
+    Cancel();
+    return finished;
+}
+
+void s_BackgroundSweep::Start(std::shared_ptr<s_WorkerPool> pool, std::shared_ptr<const std::vector<s_SessionProfile>> sessions, std::shared_ptr<const s_SweepBars> bars,
+                              std::vector<s_BAFormationParams> combinations, const std::string& path) {
+    Stop();
+    std::atomic_store(&Published, std::shared_ptr<s_SweepReport>()); // Drop a report nobody picked up yet
+    Cancel.store(false);
+    AwaitingResult = true;
+    Thread = std::thread([this, pool, sessions, bars, combinations = std::move(combinations), path]() {
+        auto sweepStart = std::chrono::steady_clock::now();
+        std::vector<s_SweepOutcome> outcomes = RunParameterSweep(*pool, *sessions, *bars, combinations, &Cancel);
+        if (Cancel.load()) return;
+        std::shared_ptr<s_SweepReport> report = std::make_shared<s_SweepReport>();
+        report->Combinations = static_cast<int>(outcomes.size());
+        report->Sessions = static_cast<int>(sessions->size());
+        report->Path = path;
+        report->Written = WriteSweepResults(path, outcomes);
+        report->ElapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - sweepStart).count();
+        std::atomic_store(&Published, report);
+    });
+}
+
+// --- BA State Snapshot ---
+// Versioned binary image of the computed BA state, written whenever StateVersion changes and read back on
+// chartbook load / full recalculation. Bar indices are stored as bar DateTimes so they survive a different
+// number of loaded bars.
+const uint32_t STATE_SNAPSHOT_MAGIC = 0x54534241; // "ABST"
+const uint32_t STATE_SNAPSHOT_VERSION = 2;
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size) { // FNV-1a
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+uint64_t HashValue(uint64_t hash, const T& value) {
+    return HashBytes(hash, &value, sizeof(T));
+}
+
+struct s_SnapshotWriter {
+    std::vector<uint8_t> Buffer;
+    SCStudyInterfaceRef sc;
+
+    explicit s_SnapshotWriter(SCStudyInterfaceRef studyRef) : sc(studyRef) {}
+
+    template <typename T>
+    void Put(const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        Buffer.insert(Buffer.end(), bytes, bytes + sizeof(T));
+    }
+    void PutString(const std::string& value) {
+        Put(static_cast<uint32_t>(value.size()));
+        Buffer.insert(Buffer.end(), value.begin(), value.end());
+    }
+    void PutDateTime(const SCDateTime& value) { Put(value.GetAsDouble()); }
+    void PutBarIndex(int barIndex) {
+        double barDateTime = (barIndex >= 0 && barIndex < sc.ArraySize) ? sc.BaseDateTimeIn[barIndex].GetAsDouble() : -1.0;
+        Put(barDateTime);
+    }
+};
+
+struct s_SnapshotReader {
+    const uint8_t* Data;
+    size_t Size;
+    size_t Offset = 0;
+    bool Ok = true;
+    SCStudyInterfaceRef sc;
+
+    s_SnapshotReader(const uint8_t* data, size_t size, SCStudyInterfaceRef studyRef) : Data(data), Size(size), sc(studyRef) {}
+
+    template <typename T>
+    T Get() {
+        T value = T();
+        if (!Ok || Offset + sizeof(T) > Size) { Ok = false; return value; }
+        memcpy(&value, Data + Offset, sizeof(T));
+        Offset += sizeof(T);
+        return value;
+    }
+    std::string GetString() {
+        uint32_t length = Get<uint32_t>();
+        if (!Ok || Offset + length > Size) { Ok = false; return std::string(); }
+        std::string value(reinterpret_cast<const char*>(Data + Offset), length);
+        Offset += length;
+        return value;
+    }
+    SCDateTime GetDateTime() { return SCDateTime(Get<double>()); }
+    int GetBarIndex() {
+        double barDateTime = Get<double>();
+        if (!Ok || barDateTime < 0.0) return -1;
+        return sc.GetContainingIndexForSCDateTime(sc.ChartNumber, SCDateTime(barDateTime));
+    }
+    // Guards element counts against truncated or corrupt files before any allocation
+    uint32_t GetCount(size_t minElementSize) {
+        uint32_t count = Get<uint32_t>();
+        if (Ok && (uint64_t)count * minElementSize > Size - Offset) Ok = false;
+        return Ok ? count : 0;
+    }
+};
+
+// What formation decided about a BA, without activation or cut state
+void WriteBADefinition(s_SnapshotWriter& out, const s_BalanceArea& ba) {
+    out.Put(ba.StartProfileChronoIndex);
+    out.Put(ba.EndProfileChronoIndex);
+    out.PutDateTime(ba.StartDateTime);
+    out.PutDateTime(ba.EndDateTime);
+    out.PutBarIndex(ba.StartBarIndex);
+    out.PutBarIndex(ba.EndBarIndex);
+    out.Put(ba.POC);
+    out.Put(ba.ValueAreaHigh);
+    out.Put(ba.ValueAreaLow);
+    out.Put(ba.HighestPrice);
+    out.Put(ba.LowestPrice);
+    out.Put(ba.TotalVolume);
+    out.Put(static_cast<uint32_t>(ba.IncludedProfileIndices.size()));
+    for (int profileIndex : ba.IncludedProfileIndices) out.Put(profileIndex);
+    out.PutString(ba.InitiationReason);
+}
+
+void WriteBalanceArea(s_SnapshotWriter& out, const s_BalanceArea& ba) {
+    WriteBADefinition(out, ba);
+    out.Put(static_cast<uint8_t>(ba.IsActivated));
+    out.PutDateTime(ba.ActivationDateTime);
+    out.PutBarIndex(ba.ActivationBarIndex);
+    out.Put(ba.ActivationPrice);
+    out.PutDateTime(ba.ActivationTradeDateTime);
+    out.PutString(ba.ActivationType);
+    out.Put(static_cast<uint8_t>(ba.ActivatedHigh));
+    out.Put(static_cast<uint8_t>(ba.ActivatedLow));
+    out.Put(static_cast<uint8_t>(ba.IsExtending));
+    out.PutBarIndex(ba.ExtensionEndIndex);
+    out.PutString(ba.ExtensionEndReason);
+    out.Put(static_cast<uint8_t>(ba.WasCut));
+    out.Put(ba.CutByStartProfileIndex);
+    out.Put(ba.CutByEndProfileIndex);
+}
+
+s_BalanceArea ReadBADefinition(s_SnapshotReader& in) {
+    s_BalanceArea ba;
+    ba.StartProfileChronoIndex = in.Get<int>();
+    ba.EndProfileChronoIndex = in.Get<int>();
+    ba.StartDateTime = in.GetDateTime();
+    ba.EndDateTime = in.GetDateTime();
+    ba.StartBarIndex = in.GetBarIndex();
+    ba.EndBarIndex = in.GetBarIndex();
+    ba.POC = in.Get<float>();
+    ba.ValueAreaHigh = in.Get<float>();
+    ba.ValueAreaLow = in.Get<float>();
+    ba.HighestPrice = in.Get<float>();
+    ba.LowestPrice = in.Get<float>();
+    ba.TotalVolume = in.Get<float>();
+    uint32_t numIncluded = in.GetCount(sizeof(int));
+    for (uint32_t i = 0; i < numIncluded; ++i) ba.IncludedProfileIndices.push_back(in.Get<int>());
+    ba.InitiationReason = in.GetString();
+    return ba;
+}
+
+s_BalanceArea ReadBalanceArea(s_SnapshotReader& in) {
+    s_BalanceArea ba = ReadBADefinition(in);
+    ba.IsActivated = in.Get<uint8_t>() != 0;
+    ba.ActivationDateTime = in.GetDateTime();
+    ba.ActivationBarIndex = in.GetBarIndex();
+    ba.ActivationPrice = in.Get<float>();
+    ba.ActivationTradeDateTime = in.GetDateTime();
+    ba.ActivationType = in.GetString();
+    ba.ActivatedHigh = in.Get<uint8_t>() != 0;
+    ba.ActivatedLow = in.Get<uint8_t>() != 0;
+    ba.IsExtending = in.Get<uint8_t>() != 0;
+    ba.ExtensionEndIndex = in.GetBarIndex();
+    ba.ExtensionEndReason = in.GetString();
+    ba.WasCut = in.Get<uint8_t>() != 0;
+    ba.CutByStartProfileIndex = in.Get<int>();
+    ba.CutByEndProfileIndex = in.Get<int>();
+    // Extensions that were still running end at the current chart end, not the one at save time
+    if (!ba.WasCut && ba.IsActivated) ba.ExtensionEndIndex = in.sc.ArraySize - 1;
+    return ba;
+}
+
+// Hash of everything the computed state depends on besides the session data itself
+uint64_t ComputeBAStateFingerprint(SCStudyInterfaceRef sc, std::initializer_list<float> algorithmInputs) {
+    uint64_t hash = 14695981039346656037ULL;
+    hash = HashValue(hash, STATE_SNAPSHOT_VERSION);
+    hash = HashBytes(hash, sc.Symbol.GetChars(), strlen(sc.Symbol.GetChars()));
+    hash = HashValue(hash, sc.TickSize);
+    for (float input : algorithmInputs) hash = HashValue(hash, input);
+    return hash;
+}
+
+std::string BuildStateSnapshotPath(SCStudyInterfaceRef sc) {
+    return BuildStudyFilePrefix(sc) + "_c" + std::to_string(sc.ChartNumber) + "_s" + std::to_string(sc.StudyGraphInstanceID) + ".abst";
+}
+
+std::string BuildEventJournalPath(SCStudyInterfaceRef sc) {
+    return BuildStudyFilePrefix(sc) + "_c" + std::to_string(sc.ChartNumber) + "_s" + std::to_string(sc.StudyGraphInstanceID) + ".abjl";
+}
+
+// Export files are this path plus "_<table>.csv" and ".abcx"
+std::string BuildResultExportPath(SCStudyInterfaceRef sc) {
+    return BuildStudyFilePrefix(sc) + "_c" + std::to_string(sc.ChartNumber) + "_s" + std::to_string(sc.StudyGraphInstanceID) + "_export";
+}
+
+std::string BuildLevelSegmentName(SCStudyInterfaceRef sc) {
+#ifdef _WIN32
+    const char* prefix = "Local\\AutoBAs_";
+#else
+    const char* prefix = "/AutoBAs_";
+#endif
+    return prefix + SafeSymbolName(sc) + "_c" + std::to_string(sc.ChartNumber) + "_s" + std::to_string(sc.StudyGraphInstanceID) + "_levels";
+}
+
+bool WriteBAStateSnapshot(SCStudyInterfaceRef sc, const s_BAStudyPersistentData* pData, const std::string& path) {
+    s_SnapshotWriter out(sc);
+    out.Put(STATE_SNAPSHOT_MAGIC);
+    out.Put(STATE_SNAPSHOT_VERSION);
+    out.Put(pData->StateFingerprint);
+    out.Put(static_cast<uint32_t>(pData->FormationSessionStarts.size()));
+    out.Put(pData->FormationResumeIndex);
+    for (double sessionStart : pData->FormationSessionStarts) out.Put(sessionStart);
+    for (size_t i = 0; i < pData->FormationSessionStarts.size(); ++i) {
+        bool used = i < pData->FormationProfileUsed.size() && pData->FormationProfileUsed[i];
+        out.Put(static_cast<uint8_t>(used));
+    }
+
+    out.Put(static_cast<uint32_t>(pData->FinalizedBalanceAreas.size()));
+    for (const auto& ba : pData->FinalizedBalanceAreas) WriteBalanceArea(out, ba);
+    out.Put(static_cast<uint32_t>(pData->ActiveBalanceAreas.size()));
+    for (const auto& ba : pData->ActiveBalanceAreas) WriteBalanceArea(out, ba);
+
+    out.Put(static_cast<uint32_t>(pData->ProbeLinesToDraw.size()));
+    for (const auto& probe : pData->ProbeLinesToDraw) {
+        out.PutBarIndex(probe.StartBarIndex);
+        out.PutBarIndex(probe.EndBarIndexOfProfile);
+        out.Put(probe.Price);
+        out.Put(static_cast<uint8_t>(probe.IsHighProbe));
+        out.Put(probe.BAStartProfileIndex);
+    }
+
+    out.Put(static_cast<uint32_t>(pData->PBALsToDraw.size()));
+    for (const auto& pbal : pData->PBALsToDraw) {
+        out.PutBarIndex(pbal.StartBarIndex);
+        out.Put(pbal.Price);
+        out.Put(static_cast<uint8_t>(pbal.IsHigh));
+        out.PutString(pbal.OriginLabel.GetChars());
+        out.PutString(pbal.EndReason);
+        out.Put(pbal.OriginStartProfileIndex);
+        out.Put(pbal.OriginEndProfileIndex);
+        out.Put(static_cast<uint8_t>(pbal.WasCut));
+    }
+
+    out.Put(static_cast<uint32_t>(pData->CompositeBAs.size()));
+    for (const auto& comp : pData->CompositeBAs) {
+        out.Put(comp.FirstBAIndex);
+        out.Put(comp.SecondBAIndex);
+        out.Put(comp.ThirdBAIndex);
+        out.PutDateTime(comp.StartDateTime);
+        out.PutDateTime(comp.EndDateTime);
+        out.PutBarIndex(comp.StartBarIndex);
+        out.PutBarIndex(comp.EndBarIndex);
+        out.Put(comp.HighestPrice);
+        out.Put(comp.LowestPrice);
+        out.PutString(comp.QualificationReason);
+    }
+
+    std::string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) return false;
+    bool ok = fwrite(out.Buffer.data(), 1, out.Buffer.size(), file) == out.Buffer.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return CommitTempFile(tempPath, path);
+}
+
+// NEW: How many of the saved window's oldest sessions have rolled out of the current one, or -1 if the rest of the
+// saved sessions are not where the current ones start. Current sessions older than anything saved would have to be
+// formed first, so those count as no match too.
+int FindDroppedSessions(const std::vector<double>& savedStarts, const std::vector<double>& sessionStarts) {
+    if (savedStarts.empty()) return 0;
+    if (sessionStarts.empty()) return -1;
+    auto first = std::lower_bound(savedStarts.begin(), savedStarts.end(), sessionStarts[0]);
+    if (first == savedStarts.end() || *first != sessionStarts[0]) return -1;
+    const size_t dropped = static_cast<size_t>(first - savedStarts.begin());
+    if (savedStarts.size() - dropped > sessionStarts.size()) return -1;
+    if (!std::equal(first, savedStarts.end(), sessionStarts.begin())) return -1;
+    return static_cast<int>(dropped);
+}
+
+// NEW: Whether state formed over savedStarts can be resumed over sessionStarts: every saved session must still be
+// loaded, in place. Once older sessions roll out, a BA that started in one of them no longer uses the sessions after
+// it, and formation from the new first session can find different BAs there, so only a cold run gives the same result.
+bool CanResumeBAState(const std::vector<double>& savedStarts, const std::vector<double>& sessionStarts) {
+    return !savedStarts.empty() && FindDroppedSessions(savedStarts, sessionStarts) == 0;
+}
+
+// The cut and the PBAL/PBAH it created go; the BA extends to the chart end again
+void RevertBACut(SCStudyInterfaceRef sc, s_BalanceArea& ba, std::vector<s_PBALDrawingInfo>& pbals) {
+    ba.WasCut = false;
+    ba.IsExtending = true;
+    ba.ExtensionEndIndex = sc.ArraySize - 1;
+    ba.ExtensionEndReason = "Chart_End";
+    ba.CutByStartProfileIndex = -1;
+    ba.CutByEndProfileIndex = -1;
+    pbals.erase(std::remove_if(pbals.begin(), pbals.end(), [&ba](const s_PBALDrawingInfo& pbal) {
+        return pbal.OriginStartProfileIndex == ba.StartProfileChronoIndex && pbal.OriginEndProfileIndex == ba.EndProfileChronoIndex;
+    }), pbals.end());
+}
+
+// NEW: Moves state formed over an older session window onto the current one, whose first droppedSessions sessions
+// have rolled out. Profile indices and composite members shift down; whatever involved a session that left goes,
+// the rest is kept as formed. Only the journal uses this, to keep its replayed state in the writer's indices: the
+// result can differ from formation over the remaining sessions, so restores never resume from it.
+void RebaseBAState(SCStudyInterfaceRef sc, int droppedSessions, std::vector<s_BalanceArea>& finalized, std::vector<s_BalanceArea>& active,
+                   std::vector<s_ProbeLineDrawingInfo>& probes, std::vector<s_PBALDrawingInfo>& pbals, std::vector<s_CompositeBalanceArea>& composites) {
+    if (droppedSessions <= 0) return;
+    auto isGone = [droppedSessions](int startProfileIndex) { return startProfileIndex < droppedSessions; };
+
+    std::vector<int> newBAIndex(finalized.size(), -1);
+    int keptBACount = 0;
+    for (size_t i = 0; i < finalized.size(); ++i) {
+        if (!isGone(finalized[i].StartProfileChronoIndex)) newBAIndex[i] = keptBACount++;
+    }
+    auto rebaseMember = [&newBAIndex](int& baIndex) {
+        baIndex = (baIndex >= 0 && baIndex < static_cast<int>(newBAIndex.size())) ? newBAIndex[baIndex] : -1;
+        return baIndex >= 0;
+    };
+    composites.erase(std::remove_if(composites.begin(), composites.end(), [&](s_CompositeBalanceArea& comp) {
+        bool first = rebaseMember(comp.FirstBAIndex), second = rebaseMember(comp.SecondBAIndex), third = rebaseMember(comp.ThirdBAIndex);
+        return !(first && second && third);
+    }), composites.end());
+
+    auto isGoneBA = [&](const s_BalanceArea& ba) { return isGone(ba.StartProfileChronoIndex); };
+    finalized.erase(std::remove_if(finalized.begin(), finalized.end(), isGoneBA), finalized.end());
+    active.erase(std::remove_if(active.begin(), active.end(), isGoneBA), active.end());
+    for (auto* list : { &active, &finalized }) {
+        for (auto& ba : *list) {
+            if (ba.WasCut && isGone(ba.CutByStartProfileIndex)) RevertBACut(sc, ba, pbals);
+        }
+    }
+    pbals.erase(std::remove_if(pbals.begin(), pbals.end(), [&](const s_PBALDrawingInfo& pbal) { return isGone(pbal.OriginStartProfileIndex); }), pbals.end());
+    probes.erase(std::remove_if(probes.begin(), probes.end(), [&](const s_ProbeLineDrawingInfo& probe) { return isGone(probe.BAStartProfileIndex); }), probes.end());
+
+    for (auto* list : { &finalized, &active }) {
+        for (auto& ba : *list) {
+            ba.StartProfileChronoIndex -= droppedSessions;
+            ba.EndProfileChronoIndex -= droppedSessions;
+            for (int& profileIndex : ba.IncludedProfileIndices) profileIndex -= droppedSessions;
+            if (ba.WasCut) {
+                ba.CutByStartProfileIndex -= droppedSessions;
+                ba.CutByEndProfileIndex -= droppedSessions;
+            }
+        }
+    }
+    for (auto& pbal : pbals) {
+        pbal.OriginStartProfileIndex -= droppedSessions;
+        pbal.OriginEndProfileIndex -= droppedSessions;
+    }
+    for (auto& probe : probes) probe.BAStartProfileIndex -= droppedSessions;
+}
+
+// Restored state was saved against an older chart end; extensions that were still running reach the current one.
+void ExtendRestoredBAsToChartEnd(SCStudyInterfaceRef sc, std::vector<s_BalanceArea>& finalized, std::vector<s_BalanceArea>& active, std::vector<s_PBALDrawingInfo>& pbals) {
+    for (auto* list : { &finalized, &active }) {
+        for (auto& ba : *list) {
+            if (ba.IsActivated && !ba.WasCut) ba.ExtensionEndIndex = sc.ArraySize - 1;
+        }
+    }
+    for (auto& pbal : pbals) pbal.EndBarIndex = sc.ArraySize - 1;
+}
+
+// Installs restored state computed over a prefix of the current sessions. Everything that depended on the
+// last (then still developing) session, from resumeIndex on, is dropped so formation can redo it.
+void ApplyRestoredBAState(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, int resumeIndex, std::vector<bool> profileUsed,
+                          std::vector<s_BalanceArea>& finalized, std::vector<s_BalanceArea>& active, std::vector<s_ProbeLineDrawingInfo>& probes,
+                          std::vector<s_PBALDrawingInfo>& pbals, std::vector<s_CompositeBalanceArea>& composites) {
+    auto isDropped = [resumeIndex](int startProfileIndex) { return startProfileIndex >= resumeIndex; };
+    auto revertCutByDropped = [&](s_BalanceArea& ba) {
+        if (ba.WasCut && isDropped(ba.CutByStartProfileIndex)) RevertBACut(sc, ba, pbals);
+    };
+    finalized.erase(std::remove_if(finalized.begin(), finalized.end(), [&](const s_BalanceArea& ba) { return isDropped(ba.StartProfileChronoIndex); }), finalized.end());
+    active.erase(std::remove_if(active.begin(), active.end(), [&](const s_BalanceArea& ba) { return isDropped(ba.StartProfileChronoIndex); }), active.end());
+    for (auto& ba : active) revertCutByDropped(ba);
+    for (auto& ba : finalized) revertCutByDropped(ba);
+    pbals.erase(std::remove_if(pbals.begin(), pbals.end(), [&](const s_PBALDrawingInfo& pbal) { return isDropped(pbal.OriginStartProfileIndex); }), pbals.end());
+    probes.erase(std::remove_if(probes.begin(), probes.end(), [&](const s_ProbeLineDrawingInfo& probe) { return isDropped(probe.BAStartProfileIndex); }), probes.end());
+    int keptBACount = static_cast<int>(finalized.size());
+    composites.erase(std::remove_if(composites.begin(), composites.end(), [keptBACount](const s_CompositeBalanceArea& comp) { return comp.ThirdBAIndex >= keptBACount; }), composites.end());
+
+    pData->FinalizedBalanceAreas = std::move(finalized);
+    pData->ActiveBalanceAreas = std::move(active);
+    pData->ProbeLinesToDraw = std::move(probes);
+    pData->PBALsToDraw = std::move(pbals);
+    pData->CompositeBAs = std::move(composites);
+    pData->FormationProfileUsed = std::move(profileUsed);
+}
+
+// Restores the snapshot if it was computed from the same inputs over sessions the current ones continue; everything
+// that depended on the snapshot's last (then still developing) session is dropped, and formationStartIndex tells the
+// caller where formation has to resume.
+bool RestoreBAStateSnapshot(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, const std::string& path, uint64_t fingerprint, const std::vector<double>& sessionStarts, int& formationStartIndex) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) return false;
+    std::vector<uint8_t> buffer;
+    uint8_t chunk[65536];
+    size_t bytesRead;
+    while ((bytesRead = fread(chunk, 1, sizeof(chunk), file)) > 0) buffer.insert(buffer.end(), chunk, chunk + bytesRead);
+    fclose(file);
+
+    s_SnapshotReader in(buffer.data(), buffer.size(), sc);
+    if (in.Get<uint32_t>() != STATE_SNAPSHOT_MAGIC || in.Get<uint32_t>() != STATE_SNAPSHOT_VERSION) return false;
+    if (in.Get<uint64_t>() != fingerprint) return false;
+    uint32_t sessionCount = in.Get<uint32_t>();
+    int resumeIndex = in.Get<int>();
+    if (!in.Ok || resumeIndex < 0 || resumeIndex > static_cast<int>(sessionCount) || (uint64_t)sessionCount * sizeof(double) > in.Size - in.Offset) return false;
+    std::vector<double> savedStarts(sessionCount);
+    for (double& sessionStart : savedStarts) sessionStart = in.Get<double>();
+    if (!CanResumeBAState(savedStarts, sessionStarts)) return false;
+    std::vector<bool> profileUsed(sessionStarts.size(), false);
+    for (uint32_t i = 0; i < sessionCount; ++i) {
+        bool used = in.Get<uint8_t>() != 0;
+        if (static_cast<int>(i) < resumeIndex) profileUsed[i] = used;
+    }
+
+    std::vector<s_BalanceArea> finalized, active;
+    uint32_t count = in.GetCount(1);
+    for (uint32_t i = 0; in.Ok && i < count; ++i) finalized.push_back(ReadBalanceArea(in));
+    count = in.GetCount(1);
+    for (uint32_t i = 0; in.Ok && i < count; ++i) active.push_back(ReadBalanceArea(in));
+
+    std::vector<s_ProbeLineDrawingInfo> probes;
+    count = in.GetCount(1);
+    for (uint32_t i = 0; in.Ok && i < count; ++i) {
+        s_ProbeLineDrawingInfo probe;
+        probe.StartBarIndex = in.GetBarIndex();
+        probe.EndBarIndexOfProfile = in.GetBarIndex();
+        probe.Price = in.Get<float>();
+        probe.IsHighProbe = in.Get<uint8_t>() != 0;
+        probe.BAStartProfileIndex = in.Get<int>();
+        probes.push_back(probe);
+    }
+
+    std::vector<s_PBALDrawingInfo> pbals;
+    count = in.GetCount(1);
+    for (uint32_t i = 0; in.Ok && i < count; ++i) {
+        s_PBALDrawingInfo pbal;
+        pbal.StartBarIndex = in.GetBarIndex();
+        pbal.EndBarIndex = sc.ArraySize - 1;
+        pbal.Price = in.Get<float>();
+        pbal.IsHigh = in.Get<uint8_t>() != 0;
+        pbal.OriginLabel = in.GetString().c_str();
+        pbal.EndReason = in.GetString();
+        pbal.OriginStartProfileIndex = in.Get<int>();
+        pbal.OriginEndProfileIndex = in.Get<int>();
+        pbal.WasCut = in.Get<uint8_t>() != 0;
+        pbals.push_back(pbal);
+    }
+
+    std::vector<s_CompositeBalanceArea> composites;
+    count = in.GetCount(1);
+    for (uint32_t i = 0; in.Ok && i < count; ++i) {
+        s_CompositeBalanceArea comp;
+        comp.FirstBAIndex = in.Get<int>();
+        comp.SecondBAIndex = in.Get<int>();
+        comp.ThirdBAIndex = in.Get<int>();
+        comp.StartDateTime = in.GetDateTime();
+        comp.EndDateTime = in.GetDateTime();
+        comp.StartBarIndex = in.GetBarIndex();
+        comp.EndBarIndex = in.GetBarIndex();
+        comp.HighestPrice = in.Get<float>();
+        comp.LowestPrice = in.Get<float>();
+        comp.QualificationReason = in.GetString();
+        composites.push_back(comp);
+    }
+    if (!in.Ok) return false;
+    ApplyRestoredBAState(sc, pData, resumeIndex, std::move(profileUsed), finalized, active, probes, pbals, composites);
+    formationStartIndex = resumeIndex;
+    return true;
+}
+
+// --- Event Journal Replay ---
+
+uint32_t JournalCheck(const uint8_t* data, size_t size) {
+    uint64_t hash = HashBytes(14695981039346656037ULL, data, size);
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+s_BalanceArea* FindJournalBA(std::vector<s_BalanceArea>& balanceAreas, int startProfileIndex, int endProfileIndex) {
+    for (auto it = balanceAreas.rbegin(); it != balanceAreas.rend(); ++it) { // Recent BAs change most
+        if (it->StartProfileChronoIndex == startProfileIndex && it->EndProfileChronoIndex == endProfileIndex) return &*it;
+    }
+    return nullptr;
+}
+
+// Applies one event to state. Returns false if the payload is malformed or names a BA state does not hold.
+bool ApplyJournalRecord(SCStudyInterfaceRef sc, s_JournalState& state, int type, const uint8_t* payload, size_t size) {
+    s_SnapshotReader in(payload, size, sc);
+    auto removeActive = [&state](int start, int end) {
+        state.ActiveBalanceAreas.erase(std::remove_if(state.ActiveBalanceAreas.begin(), state.ActiveBalanceAreas.end(), [start, end](const s_BalanceArea& ba) {
+            return ba.StartProfileChronoIndex == start && ba.EndProfileChronoIndex == end;
+        }), state.ActiveBalanceAreas.end());
+    };
+    auto sameProbe = [](const s_ProbeLineDrawingInfo& a, const s_ProbeLineDrawingInfo& b) {
+        return a.StartBarIndex == b.StartBarIndex && a.EndBarIndexOfProfile == b.EndBarIndexOfProfile && a.Price == b.Price &&
+               a.IsHighProbe == b.IsHighProbe && a.BAStartProfileIndex == b.BAStartProfileIndex;
+    };
+    auto readProbe = [&in]() {
+        s_ProbeLineDrawingInfo probe;
+        probe.StartBarIndex = in.GetBarIndex();
+        probe.EndBarIndexOfProfile = in.GetBarIndex();
+        probe.Price = in.Get<float>();
+        probe.IsHighProbe = in.Get<uint8_t>() != 0;
+        probe.BAStartProfileIndex = in.Get<int>();
+        return probe;
+    };
+
+    switch (type) {
+    case JOURNAL_BA_FINALIZED: {
+        s_BalanceArea ba = ReadBADefinition(in);
+        if (!in.Ok) return false;
+        state.FinalizedBalanceAreas.push_back(std::move(ba));
+        return true;
+    }
+    case JOURNAL_BA_RETRACTED:
+    case JOURNAL_BA_DEACTIVATED:
+    case JOURNAL_BA_UNCUT: {
+        int start = in.Get<int>(), end = in.Get<int>();
+        s_BalanceArea* ba = FindJournalBA(state.FinalizedBalanceAreas, start, end);
+        if (!in.Ok || ba == nullptr) return false;
+        if (type == JOURNAL_BA_UNCUT) {
+            for (s_BalanceArea* copy : { ba, FindJournalBA(state.ActiveBalanceAreas, start, end) }) {
+                if (copy == nullptr) continue;
+                copy->WasCut = false;
+                copy->IsExtending = true;
+                copy->ExtensionEndIndex = sc.ArraySize - 1;
+                copy->ExtensionEndReason = "Chart_End";
+                copy->CutByStartProfileIndex = -1;
+                copy->CutByEndProfileIndex = -1;
+            }
+            return true;
         }
-        float volumeInMillions = cutBA.TotalVolume / 1000000.0f;
-        int sessionCount = (int)cutBA.IncludedProfileIndices.size();
-        pbalHigh.OriginLabel.Format("PBAH %s %.2fM %dD", dateStr.GetChars(), volumeInMillions, sessionCount);
-        
-        pData->PBALsToDraw.push_back(pbalHigh);
+        removeActive(start, end);
+        if (type == JOURNAL_BA_DEACTIVATED) ClearBAActivation(*ba);
+        else state.FinalizedBalanceAreas.erase(state.FinalizedBalanceAreas.begin() + (ba - state.FinalizedBalanceAreas.data()));
+        return true;
     }
-    
-    // Create PBAL (low ray) only if low edge pierces below blue BA
-    if (createLowPBAL) {
-        s_PBALDrawingInfo pbalLow;
-        pbalLow.StartBarIndex = cutBA.ActivationBarIndex;
-        pbalLow.EndBarIndex = sc.ArraySize - 1;
-        pbalLow.Price = cutBA.ValueAreaLow;
-        pbalLow.IsHigh = false;
-        pbalLow.EndReason = "Chart_End";
-        pbalLow.OriginStartProfileIndex = cutBA.StartProfileChronoIndex;
-        pbalLow.OriginEndProfileIndex = cutBA.EndProfileChronoIndex;
-        
-        // Create origin label
-        SCString dateStr;
-        if (!cutBA.StartDateTime.IsUnset()) {
-            int year = cutBA.StartDateTime.GetYear();
-            int month = cutBA.StartDateTime.GetMonth();
-            int day = cutBA.StartDateTime.GetDay();
-            dateStr.Format("%02d-%02d-%02d", month, day, year % 100);
-        } else {
-            dateStr = "N/A";
+    case JOURNAL_BA_ACTIVATED: {
+        int start = in.Get<int>(), end = in.Get<int>();
+        bool breakHigh = in.Get<uint8_t>() != 0;
+        SCDateTime activationDateTime = in.GetDateTime();
+        int barIndex = in.GetBarIndex();
+        float price = in.Get<float>();
+        SCDateTime tradeDateTime = in.GetDateTime();
+        s_BalanceArea* ba = FindJournalBA(state.FinalizedBalanceAreas, start, end);
+        if (!in.Ok || ba == nullptr) return false;
+        ba->IsActivated = true;
+        ba->ActivationDateTime = activationDateTime;
+        ba->ActivationBarIndex = barIndex;
+        ba->ActivationPrice = price;
+        ba->ActivationTradeDateTime = tradeDateTime;
+        ba->ActivationType = breakHigh ? "Break_High" : "Break_Low";
+        ba->ActivatedHigh = breakHigh;
+        ba->ActivatedLow = !breakHigh;
+        ba->IsExtending = true;
+        ba->ExtensionEndIndex = sc.ArraySize - 1;
+        ba->ExtensionEndReason = "Chart_End";
+        removeActive(start, end);
+        state.ActiveBalanceAreas.push_back(*ba);
+        return true;
+    }
+    case JOURNAL_BA_CUT: {
+        int start = in.Get<int>(), end = in.Get<int>();
+        int cutByStart = in.Get<int>(), cutByEnd = in.Get<int>();
+        int barIndex = in.GetBarIndex();
+        s_BalanceArea* ba = FindJournalBA(state.FinalizedBalanceAreas, start, end);
+        if (!in.Ok || ba == nullptr) return false;
+        for (s_BalanceArea* copy : { ba, FindJournalBA(state.ActiveBalanceAreas, start, end) }) {
+            if (copy == nullptr) continue;
+            copy->WasCut = true;
+            copy->IsExtending = false;
+            copy->ExtensionEndIndex = barIndex;
+            copy->ExtensionEndReason = "BA_Intersection";
+            copy->CutByStartProfileIndex = cutByStart;
+            copy->CutByEndProfileIndex = cutByEnd;
         }
-        float volumeInMillions = cutBA.TotalVolume / 1000000.0f;
-        int sessionCount = (int)cutBA.IncludedProfileIndices.size();
-        pbalLow.OriginLabel.Format("PBAL %s %.2fM %dD", dateStr.GetChars(), volumeInMillions, sessionCount);
-        
-        pData->PBALsToDraw.push_back(pbalLow);
+        return true;
+    }
+    case JOURNAL_PBAL_CREATED: {
+        int start = in.Get<int>(), end = in.Get<int>();
+        bool isHigh = in.Get<uint8_t>() != 0;
+        float price = in.Get<float>();
+        int startBarIndex = in.GetBarIndex();
+        const s_BalanceArea* cutBA = FindJournalBA(state.FinalizedBalanceAreas, start, end);
+        if (!in.Ok || cutBA == nullptr) return false;
+        s_PBALDrawingInfo pbal = MakePBALDrawingInfo(*cutBA, isHigh, sc.ArraySize - 1);
+        pbal.StartBarIndex = startBarIndex;
+        pbal.Price = price;
+        state.PBALsToDraw.push_back(pbal);
+        return true;
+    }
+    case JOURNAL_PBAL_REMOVED: {
+        int start = in.Get<int>(), end = in.Get<int>();
+        bool isHigh = in.Get<uint8_t>() != 0;
+        if (!in.Ok) return false;
+        state.PBALsToDraw.erase(std::remove_if(state.PBALsToDraw.begin(), state.PBALsToDraw.end(), [&](const s_PBALDrawingInfo& pbal) {
+            return pbal.OriginStartProfileIndex == start && pbal.OriginEndProfileIndex == end && pbal.IsHigh == isHigh;
+        }), state.PBALsToDraw.end());
+        return true;
+    }
+    case JOURNAL_PROBE_ADDED:
+    case JOURNAL_PROBE_REMOVED: {
+        s_ProbeLineDrawingInfo probe = readProbe();
+        if (!in.Ok) return false;
+        if (type == JOURNAL_PROBE_ADDED) {
+            state.ProbeLinesToDraw.push_back(probe);
+            return true;
+        }
+        auto found = std::find_if(state.ProbeLinesToDraw.begin(), state.ProbeLinesToDraw.end(), [&](const s_ProbeLineDrawingInfo& other) { return sameProbe(probe, other); });
+        if (found != state.ProbeLinesToDraw.end()) state.ProbeLinesToDraw.erase(found);
+        return true;
+    }
+    case JOURNAL_COMPOSITE_QUALIFIED: {
+        s_CompositeBalanceArea comp;
+        comp.FirstBAIndex = in.Get<int>();
+        comp.SecondBAIndex = in.Get<int>();
+        comp.ThirdBAIndex = in.Get<int>();
+        comp.StartDateTime = in.GetDateTime();
+        comp.EndDateTime = in.GetDateTime();
+        comp.StartBarIndex = in.GetBarIndex();
+        comp.EndBarIndex = in.GetBarIndex();
+        comp.HighestPrice = in.Get<float>();
+        comp.LowestPrice = in.Get<float>();
+        comp.QualificationReason = in.GetString();
+        if (!in.Ok) return false;
+        state.CompositeBAs.push_back(comp);
+        return true;
+    }
+    case JOURNAL_COMPOSITE_REMOVED: {
+        int first = in.Get<int>(), second = in.Get<int>(), third = in.Get<int>();
+        if (!in.Ok) return false;
+        state.CompositeBAs.erase(std::remove_if(state.CompositeBAs.begin(), state.CompositeBAs.end(), [&](const s_CompositeBalanceArea& comp) {
+            return comp.FirstBAIndex == first && comp.SecondBAIndex == second && comp.ThirdBAIndex == third;
+        }), state.CompositeBAs.end());
+        return true;
+    }
+    case JOURNAL_CHECKPOINT: {
+        uint32_t sessionCount = in.GetCount(sizeof(double));
+        int resumeIndex = in.Get<int>();
+        std::vector<double> sessionStarts(sessionCount);
+        for (double& sessionStart : sessionStarts) sessionStart = in.Get<double>();
+        uint32_t usedCount = in.Get<uint32_t>();
+        if (!in.Ok || in.Offset + (usedCount + 7) / 8 > size) return false;
+        state.ProfileUsed.assign(usedCount, false);
+        for (uint32_t i = 0; i < usedCount; ++i) state.ProfileUsed[i] = (payload[in.Offset + i / 8] >> (i % 8)) & 1;
+        state.HasCheckpoint = true;
+        state.SessionStarts = std::move(sessionStarts);
+        state.ResumeIndex = resumeIndex;
+        return true;
+    }
+    case JOURNAL_SESSIONS_ROLLED: {
+        uint32_t droppedSessions = in.Get<uint32_t>();
+        if (!in.Ok || !state.HasCheckpoint || droppedSessions > state.SessionStarts.size()) return false;
+        RebaseBAState(sc, static_cast<int>(droppedSessions), state.FinalizedBalanceAreas, state.ActiveBalanceAreas, state.ProbeLinesToDraw, state.PBALsToDraw, state.CompositeBAs);
+        state.SessionStarts.erase(state.SessionStarts.begin(), state.SessionStarts.begin() + droppedSessions);
+        state.ProfileUsed.erase(state.ProfileUsed.begin(), state.ProfileUsed.begin() + std::min<size_t>(droppedSessions, state.ProfileUsed.size()));
+        state.ResumeIndex = std::max(0, state.ResumeIndex - static_cast<int>(droppedSessions));
+        return true;
+    }
+    default:
+        return false;
     }
 }
 
-// NEW: Function to check for BA intersections and update extension endpoints
-// NEW: Function to check for BA intersections and update extension endpoints
-void UpdateBAExtensions(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, float TickSize, float PBALPierceThreshold) {
-    // Sort active BAs by activation time for proper cutting logic
-    std::sort(pData->ActiveBalanceAreas.begin(), pData->ActiveBalanceAreas.end(), 
-              [](const s_BalanceArea& a, const s_BalanceArea& b) {
-                  return a.ActivationBarIndex < b.ActivationBarIndex;
-              });
+// Replays the records of a journal image into state. Returns the bytes up to the end of the last good record,
+// or 0 if the header does not match.
+size_t ReplayEventJournal(SCStudyInterfaceRef sc, const std::vector<uint8_t>& buffer, uint64_t fingerprint, s_JournalState& state) {
+    s_SnapshotReader header(buffer.data(), buffer.size(), sc);
+    if (header.Get<uint32_t>() != EVENT_JOURNAL_MAGIC || header.Get<uint32_t>() != EVENT_JOURNAL_VERSION || header.Get<uint64_t>() != fingerprint || !header.Ok) return 0;
+    size_t offset = EVENT_JOURNAL_HEADER_SIZE;
+    while (buffer.size() - offset >= EVENT_JOURNAL_RECORD_OVERHEAD) {
+        s_SnapshotReader record(buffer.data() + offset, buffer.size() - offset, sc);
+        int type = record.Get<uint8_t>();
+        uint32_t sequence = record.Get<uint32_t>();
+        uint32_t payloadSize = record.Get<uint32_t>();
+        record.Get<double>(); // RecordedDateTime is for audits only
+        if (payloadSize > buffer.size() - offset - EVENT_JOURNAL_RECORD_OVERHEAD) break;
+        const uint8_t* payload = buffer.data() + offset + record.Offset;
+        uint32_t check;
+        memcpy(&check, payload + payloadSize, sizeof(check));
+        if (check != JournalCheck(buffer.data() + offset, record.Offset + payloadSize)) break;
+        if (!ApplyJournalRecord(sc, state, type, payload, payloadSize)) break;
+        state.NextSequence = sequence + 1;
+        offset += EVENT_JOURNAL_RECORD_OVERHEAD + payloadSize;
+    }
+    return offset;
+}
 
-    // Check each active BA for intersections with newly formed BAs and other active BAs
-    for (size_t i = 0; i < pData->ActiveBalanceAreas.size(); ++i) {
-        auto& activeBa = pData->ActiveBalanceAreas[i];
-        if (!activeBa.IsExtending) continue;
-        
-        int earliestCutPoint = sc.ArraySize - 1; // Start with chart end
-        bool shouldCut = false;
-        s_BalanceArea intersectingBA;
-        bool foundIntersectingBA = false;
-        
-        // Check against ALL finalized BAs that have been activated after this one
-        for (const auto& newBa : pData->FinalizedBalanceAreas) {
-            // Only check BAs that were activated after this one was activated
-            if (!newBa.IsActivated || newBa.ActivationBarIndex <= activeBa.ActivationBarIndex) continue;
-            
-            // Check if the new activated BA's VALUE AREA range intersects with the active BA's VALUE AREA range
-            float overlapStart = std::max(activeBa.ValueAreaLow, newBa.ValueAreaLow);
-            float overlapEnd = std::min(activeBa.ValueAreaHigh, newBa.ValueAreaHigh);
-            
-            if (overlapEnd > overlapStart + TickSize / 2.0f) {
-                // Value Area ranges intersect - cut at the activation point of the intersecting BA
-                if (newBa.ActivationBarIndex > activeBa.ActivationBarIndex && 
-                    newBa.ActivationBarIndex < earliestCutPoint) {
-                    earliestCutPoint = newBa.ActivationBarIndex;
-                    shouldCut = true;
-                    intersectingBA = newBa;
-                    foundIntersectingBA = true;
-                }
-            }
+bool s_EventJournal::Open(SCStudyInterfaceRef sc, const std::string& path, uint64_t fingerprint) {
+    Stop();
+    Path = path;
+    Fingerprint = fingerprint;
+    State = s_JournalState();
+    JournaledVersion = UINT_MAX;
+    Overflow.clear();
+    ReportedFailure = false;
+    WriteFailed.store(false);
+    Stopping.store(false);
+    Head.store(0);
+    Tail.store(0);
+    if (!Ring) Ring.reset(new uint8_t[EVENT_JOURNAL_RING_BYTES]);
+
+    std::vector<uint8_t> buffer;
+    FILE* existing = fopen(path.c_str(), "rb");
+    if (existing != nullptr) {
+        uint8_t chunk[65536];
+        size_t bytesRead;
+        while ((bytesRead = fread(chunk, 1, sizeof(chunk), existing)) > 0) buffer.insert(buffer.end(), chunk, chunk + bytesRead);
+        fclose(existing);
+    }
+    size_t validBytes = buffer.empty() ? 0 : ReplayEventJournal(sc, buffer, fingerprint, State);
+    if (validBytes == 0) {
+        State = s_JournalState();
+        if (!buffer.empty()) { // Written for other inputs: kept for audits, and a fresh journal starts
+            std::string oldPath = path + ".old";
+            std::remove(oldPath.c_str());
+            std::rename(path.c_str(), oldPath.c_str());
         }
-        
-        // Check against other active BAs that activated later
-        for (size_t j = i + 1; j < pData->ActiveBalanceAreas.size(); ++j) {
-            const auto& laterActiveBa = pData->ActiveBalanceAreas[j];
-            
-            // Only check BAs that activated after this one
-            if (laterActiveBa.ActivationBarIndex <= activeBa.ActivationBarIndex) continue;
-            
-            // Check if their VALUE AREA ranges intersect
-            float overlapStart = std::max(activeBa.ValueAreaLow, laterActiveBa.ValueAreaLow);
-            float overlapEnd = std::min(activeBa.ValueAreaHigh, laterActiveBa.ValueAreaHigh);
-            
-            if (overlapEnd > overlapStart + TickSize / 2.0f) {
-                // Value Area ranges intersect - cut at the activation point of the later BA
-                if (laterActiveBa.ActivationBarIndex > activeBa.ActivationBarIndex && 
-                    laterActiveBa.ActivationBarIndex < earliestCutPoint) {
-                    earliestCutPoint = laterActiveBa.ActivationBarIndex;
-                    shouldCut = true;
-                    intersectingBA = laterActiveBa;
-                    foundIntersectingBA = true;
-                }
+        File = fopen(path.c_str(), "wb");
+        uint32_t header[2] = { EVENT_JOURNAL_MAGIC, EVENT_JOURNAL_VERSION };
+        if (File != nullptr && (fwrite(header, sizeof(header), 1, File) != 1 || fwrite(&fingerprint, sizeof(fingerprint), 1, File) != 1)) WriteFailed.store(true);
+    } else {
+        if (validBytes < buffer.size()) { // A write that was cut short: keep the records before it
+            std::string tempPath = path + ".tmp";
+            FILE* file = fopen(tempPath.c_str(), "wb");
+            bool ok = file != nullptr && fwrite(buffer.data(), 1, validBytes, file) == validBytes;
+            ok = (file != nullptr && fclose(file) == 0) && ok;
+            if (!ok || !CommitTempFile(tempPath, path)) {
+                std::remove(tempPath.c_str());
+                WriteFailed.store(true);
+                return false;
             }
         }
-        
-        // Apply the cut if needed
-        if (shouldCut && earliestCutPoint < activeBa.ExtensionEndIndex) {
-            activeBa.ExtensionEndIndex = earliestCutPoint;
-            activeBa.ExtensionEndReason = "BA_Intersection";
-            activeBa.WasCut = true;          // Mark as cut
-            activeBa.IsExtending = false;    // No longer extending
-            
-            // Check for PBAL creation if we found the intersecting BA
-            if (foundIntersectingBA) {
-                CheckForPBALCreation(sc, pData, activeBa, intersectingBA, PBALPierceThreshold, TickSize);
-            }
+        File = fopen(path.c_str(), "ab");
+    }
+    if (File == nullptr) {
+        WriteFailed.store(true);
+        return false;
+    }
+    Thread = std::thread([this]() { WriterLoop(); });
+    return true;
+}
+
+void s_EventJournal::Append(SCStudyInterfaceRef sc, int type, const std::vector<uint8_t>& payload) {
+    s_SnapshotWriter out(sc);
+    out.Put(static_cast<uint8_t>(type));
+    out.Put(State.NextSequence);
+    out.Put(static_cast<uint32_t>(payload.size()));
+    out.PutDateTime(sc.CurrentSystemDateTime);
+    out.Buffer.insert(out.Buffer.end(), payload.begin(), payload.end());
+    out.Put(JournalCheck(out.Buffer.data(), out.Buffer.size()));
+    Push(out.Buffer.data(), out.Buffer.size());
+    ApplyJournalRecord(sc, State, type, payload.data(), payload.size());
+    State.NextSequence++;
+}
+
+bool SameBADefinition(const s_BalanceArea& a, const s_BalanceArea& b) {
+    return a.StartProfileChronoIndex == b.StartProfileChronoIndex && a.EndProfileChronoIndex == b.EndProfileChronoIndex &&
+           a.StartDateTime == b.StartDateTime && a.EndDateTime == b.EndDateTime && a.StartBarIndex == b.StartBarIndex && a.EndBarIndex == b.EndBarIndex &&
+           a.POC == b.POC && a.ValueAreaHigh == b.ValueAreaHigh && a.ValueAreaLow == b.ValueAreaLow &&
+           a.HighestPrice == b.HighestPrice && a.LowestPrice == b.LowestPrice && a.TotalVolume == b.TotalVolume &&
+           a.IncludedProfileIndices == b.IncludedProfileIndices && a.InitiationReason == b.InitiationReason;
+}
+
+bool SameBAActivation(const s_BalanceArea& a, const s_BalanceArea& b) {
+    if (a.IsActivated != b.IsActivated) return false;
+    return !a.IsActivated || (a.ActivatedHigh == b.ActivatedHigh && a.ActivationDateTime == b.ActivationDateTime && a.ActivationBarIndex == b.ActivationBarIndex &&
+                              a.ActivationPrice == b.ActivationPrice && a.ActivationTradeDateTime == b.ActivationTradeDateTime);
+}
+
+bool SameBACut(const s_BalanceArea& a, const s_BalanceArea& b) {
+    if (a.WasCut != b.WasCut) return false;
+    return !a.WasCut || (a.CutByStartProfileIndex == b.CutByStartProfileIndex && a.CutByEndProfileIndex == b.CutByEndProfileIndex && a.ExtensionEndIndex == b.ExtensionEndIndex);
+}
+
+// NEW: Journals the transitions from what the journal holds to pData's state: first what went away, dependents
+// before the BAs they name, then what is new. Returns the number of events written.
+int RecordBAStateTransitions(SCStudyInterfaceRef sc, s_EventJournal& journal, const s_BAStudyPersistentData* pData) {
+    const s_JournalState& known = journal.State;
+    int events = 0;
+    auto append = [&](int type, const s_SnapshotWriter& payload) {
+        journal.Append(sc, type, payload.Buffer);
+        events++;
+    };
+    auto putKey = [](s_SnapshotWriter& out, const s_BalanceArea& ba) {
+        out.Put(ba.StartProfileChronoIndex);
+        out.Put(ba.EndProfileChronoIndex);
+    };
+    auto baEvent = [&](int type, const s_BalanceArea& ba) {
+        s_SnapshotWriter out(sc);
+        putKey(out, ba);
+        if (type == JOURNAL_BA_ACTIVATED) {
+            out.Put(static_cast<uint8_t>(ba.ActivatedHigh));
+            out.PutDateTime(ba.ActivationDateTime);
+            out.PutBarIndex(ba.ActivationBarIndex);
+            out.Put(ba.ActivationPrice);
+            out.PutDateTime(ba.ActivationTradeDateTime);
+        } else if (type == JOURNAL_BA_CUT) {
+            out.Put(ba.CutByStartProfileIndex);
+            out.Put(ba.CutByEndProfileIndex);
+            out.PutBarIndex(ba.ExtensionEndIndex);
+        }
+        append(type, out);
+    };
+    auto pbalEvent = [&](int type, const s_PBALDrawingInfo& pbal) {
+        s_SnapshotWriter out(sc);
+        out.Put(pbal.OriginStartProfileIndex);
+        out.Put(pbal.OriginEndProfileIndex);
+        out.Put(static_cast<uint8_t>(pbal.IsHigh));
+        if (type == JOURNAL_PBAL_CREATED) {
+            out.Put(pbal.Price);
+            out.PutBarIndex(pbal.StartBarIndex);
         }
+        append(type, out);
+    };
+    auto probeEvent = [&](int type, const s_ProbeLineDrawingInfo& probe) {
+        s_SnapshotWriter out(sc);
+        out.PutBarIndex(probe.StartBarIndex);
+        out.PutBarIndex(probe.EndBarIndexOfProfile);
+        out.Put(probe.Price);
+        out.Put(static_cast<uint8_t>(probe.IsHighProbe));
+        out.Put(probe.BAStartProfileIndex);
+        append(type, out);
+    };
+    auto compositeEvent = [&](int type, const s_CompositeBalanceArea& comp) {
+        s_SnapshotWriter out(sc);
+        out.Put(comp.FirstBAIndex);
+        out.Put(comp.SecondBAIndex);
+        out.Put(comp.ThirdBAIndex);
+        if (type == JOURNAL_COMPOSITE_QUALIFIED) {
+            out.PutDateTime(comp.StartDateTime);
+            out.PutDateTime(comp.EndDateTime);
+            out.PutBarIndex(comp.StartBarIndex);
+            out.PutBarIndex(comp.EndBarIndex);
+            out.Put(comp.HighestPrice);
+            out.Put(comp.LowestPrice);
+            out.PutString(comp.QualificationReason);
+        }
+        append(type, out);
+    };
+    typedef std::tuple<int, int, bool, float, int> PBALKey;
+    auto pbalKey = [](const s_PBALDrawingInfo& pbal) { return PBALKey(pbal.OriginStartProfileIndex, pbal.OriginEndProfileIndex, pbal.IsHigh, pbal.Price, pbal.StartBarIndex); };
+    typedef std::tuple<int, int, float, bool, int> ProbeKey;
+    auto probeKey = [](const s_ProbeLineDrawingInfo& probe) { return ProbeKey(probe.StartBarIndex, probe.EndBarIndexOfProfile, probe.Price, probe.IsHighProbe, probe.BAStartProfileIndex); };
+    auto sameComposite = [](const s_CompositeBalanceArea& a, const s_CompositeBalanceArea& b) {
+        return a.FirstBAIndex == b.FirstBAIndex && a.SecondBAIndex == b.SecondBAIndex && a.ThirdBAIndex == b.ThirdBAIndex &&
+               a.StartDateTime == b.StartDateTime && a.EndDateTime == b.EndDateTime && a.StartBarIndex == b.StartBarIndex && a.EndBarIndex == b.EndBarIndex &&
+               a.HighestPrice == b.HighestPrice && a.LowestPrice == b.LowestPrice && a.QualificationReason == b.QualificationReason;
+    };
+    auto containsComposite = [&](const std::vector<s_CompositeBalanceArea>& composites, const s_CompositeBalanceArea& comp) {
+        return std::any_of(composites.begin(), composites.end(), [&](const s_CompositeBalanceArea& other) { return sameComposite(comp, other); });
+    };
+    std::set<PBALKey> currentPBALs, knownPBALs;
+    for (const auto& pbal : pData->PBALsToDraw) currentPBALs.insert(pbalKey(pbal));
+    for (const auto& pbal : known.PBALsToDraw) knownPBALs.insert(pbalKey(pbal));
+    std::multiset<ProbeKey> currentProbes, knownProbes;
+    for (const auto& probe : pData->ProbeLinesToDraw) currentProbes.insert(probeKey(probe));
+    for (const auto& probe : known.ProbeLinesToDraw) knownProbes.insert(probeKey(probe));
+
+    // Sessions that rolled out of the window first, so the comparisons below see both sides in the same indices
+    const int droppedSessions = known.HasCheckpoint ? FindDroppedSessions(known.SessionStarts, pData->FormationSessionStarts) : 0;
+    if (droppedSessions > 0) {
+        s_SnapshotWriter out(sc);
+        out.Put(static_cast<uint32_t>(droppedSessions));
+        append(JOURNAL_SESSIONS_ROLLED, out);
     }
-    
-    // Update active BAs in the main list to reflect changes
-    for (size_t i = 0; i < pData->FinalizedBalanceAreas.size(); ++i) {
-        auto& finalizedBa = pData->FinalizedBalanceAreas[i];
-        if (!finalizedBa.IsActivated) continue;
-        
-        // Find corresponding active BA and sync the data
-        for (const auto& activeBa : pData->ActiveBalanceAreas) {
-            if (activeBa.StartProfileChronoIndex == finalizedBa.StartProfileChronoIndex && 
-                activeBa.EndProfileChronoIndex == finalizedBa.EndProfileChronoIndex) {
-                finalizedBa.IsExtending = activeBa.IsExtending;
-                finalizedBa.ExtensionEndIndex = activeBa.ExtensionEndIndex;
-                finalizedBa.ExtensionEndReason = activeBa.ExtensionEndReason;
-                finalizedBa.WasCut = activeBa.WasCut;
-                break;
-            }
+
+    // What went away. Events are applied to known as they are written, so work on copies where it changes.
+    std::vector<s_CompositeBalanceArea> knownComposites = known.CompositeBAs;
+    for (const auto& comp : knownComposites) {
+        if (!containsComposite(pData->CompositeBAs, comp)) compositeEvent(JOURNAL_COMPOSITE_REMOVED, comp);
+    }
+    std::vector<s_PBALDrawingInfo> knownPBALList = known.PBALsToDraw;
+    for (const auto& pbal : knownPBALList) {
+        if (!currentPBALs.count(pbalKey(pbal))) pbalEvent(JOURNAL_PBAL_REMOVED, pbal);
+    }
+    std::vector<s_ProbeLineDrawingInfo> knownProbeList = known.ProbeLinesToDraw;
+    std::multiset<ProbeKey> unmatchedProbes = currentProbes;
+    for (const auto& probe : knownProbeList) {
+        auto found = unmatchedProbes.find(probeKey(probe));
+        if (found != unmatchedProbes.end()) unmatchedProbes.erase(found);
+        else probeEvent(JOURNAL_PROBE_REMOVED, probe);
+    }
+    const std::vector<s_BalanceArea>& current = pData->FinalizedBalanceAreas;
+    size_t common = 0;
+    while (common < known.FinalizedBalanceAreas.size() && common < current.size() && SameBADefinition(known.FinalizedBalanceAreas[common], current[common])) ++common;
+    while (known.FinalizedBalanceAreas.size() > common) baEvent(JOURNAL_BA_RETRACTED, known.FinalizedBalanceAreas.back());
+    for (size_t i = 0; i < common; ++i) {
+        const s_BalanceArea& knownBa = known.FinalizedBalanceAreas[i];
+        if (!SameBAActivation(knownBa, current[i])) {
+            if (knownBa.IsActivated) baEvent(JOURNAL_BA_DEACTIVATED, knownBa);
+        } else if (!SameBACut(knownBa, current[i]) && knownBa.WasCut) {
+            baEvent(JOURNAL_BA_UNCUT, knownBa);
+        }
+    }
+
+    // What is new: BAs, then their activations, then cuts, which name the cutting BA
+    for (size_t i = common; i < current.size(); ++i) {
+        s_SnapshotWriter out(sc);
+        WriteBADefinition(out, current[i]);
+        append(JOURNAL_BA_FINALIZED, out);
+    }
+    for (size_t i = 0; i < current.size(); ++i) {
+        if (current[i].IsActivated && !known.FinalizedBalanceAreas[i].IsActivated) baEvent(JOURNAL_BA_ACTIVATED, current[i]);
+    }
+    for (size_t i = 0; i < current.size(); ++i) {
+        if (current[i].WasCut && !known.FinalizedBalanceAreas[i].WasCut) baEvent(JOURNAL_BA_CUT, current[i]);
+    }
+    for (const auto& pbal : pData->PBALsToDraw) {
+        if (!knownPBALs.count(pbalKey(pbal))) pbalEvent(JOURNAL_PBAL_CREATED, pbal);
+    }
+    std::multiset<ProbeKey> unmatchedKnownProbes = knownProbes;
+    for (const auto& probe : pData->ProbeLinesToDraw) {
+        auto found = unmatchedKnownProbes.find(probeKey(probe));
+        if (found != unmatchedKnownProbes.end()) unmatchedKnownProbes.erase(found);
+        else probeEvent(JOURNAL_PROBE_ADDED, probe);
+    }
+    for (const auto& comp : pData->CompositeBAs) {
+        if (!containsComposite(known.CompositeBAs, comp)) compositeEvent(JOURNAL_COMPOSITE_QUALIFIED, comp);
+    }
+
+    // Where formation would resume, so a restore can drop what depended on the developing session
+    if (!known.HasCheckpoint || known.SessionStarts != pData->FormationSessionStarts || known.ResumeIndex != pData->FormationResumeIndex ||
+        known.ProfileUsed != pData->FormationProfileUsed) {
+        s_SnapshotWriter out(sc);
+        out.Put(static_cast<uint32_t>(pData->FormationSessionStarts.size()));
+        out.Put(pData->FormationResumeIndex);
+        for (double sessionStart : pData->FormationSessionStarts) out.Put(sessionStart);
+        out.Put(static_cast<uint32_t>(pData->FormationProfileUsed.size()));
+        std::vector<uint8_t> bits((pData->FormationProfileUsed.size() + 7) / 8, 0);
+        for (size_t i = 0; i < pData->FormationProfileUsed.size(); ++i) {
+            if (pData->FormationProfileUsed[i]) bits[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
         }
+        out.Buffer.insert(out.Buffer.end(), bits.begin(), bits.end());
+        append(JOURNAL_CHECKPOINT, out);
     }
+    return events;
 }
 
-float CalculateRangeOverlapPercent_RelativeToSmaller(const s_BalanceArea& ba1, const s_BalanceArea& ba2, float TickSize) { 
-   if (ba1.HighestPrice <= -FLT_MAX || ba1.LowestPrice >= FLT_MAX || ba1.HighestPrice < ba1.LowestPrice || ba2.HighestPrice <= -FLT_MAX || ba2.LowestPrice >= FLT_MAX || ba2.HighestPrice < ba2.LowestPrice) return 0.0f;
-   float overlapStart = std::max(ba1.LowestPrice, ba2.LowestPrice); 
-   float overlapEnd = std::min(ba1.HighestPrice, ba2.HighestPrice); 
-   float intersectionLength = overlapEnd - overlapStart;
-   float tickTolerance = TickSize / 2.0f; 
-   if (intersectionLength < tickTolerance) return 0.0f; 
-   float range1 = ba1.GetRange(); 
-   float range2 = ba2.GetRange();
-   if (range1 < tickTolerance && range2 < tickTolerance) return 100.0f; // Both effectively zero-range and intersecting
-   float smallerRange = std::min(range1, range2); 
-   float referenceRange = std::max(smallerRange, TickSize); // Ensure reference is at least one tick
-   if (referenceRange < tickTolerance) return 100.0f; // If smaller range is zero, and there's intersection
-   float percentage = (intersectionLength / referenceRange) * 100.0f; 
-   return std::max(0.0f, std::min(100.0f, percentage));
-}
-
-int CheckTemporalProximity(const s_BalanceArea& ba1, const s_BalanceArea& ba3, const std::vector<s_SessionProfile>& allSessionProfiles, const std::vector<s_BalanceArea>& allFinalizedBAs, SCStudyInterfaceRef sc) { 
-   int endProfileIndexOfBA1 = ba1.EndProfileChronoIndex;
-   int startProfileIndexOfBA3 = ba3.StartProfileChronoIndex; 
-   if (startProfileIndexOfBA3 < 0 || endProfileIndexOfBA1 < 0 || startProfileIndexOfBA3 >= static_cast<int>(allSessionProfiles.size()) || endProfileIndexOfBA1 >= static_cast<int>(allSessionProfiles.size())) return -1;
-   if (startProfileIndexOfBA3 <= endProfileIndexOfBA1 + 1) return 0; 
-   std::set<int> allUsedProfileIndicesInBetween;
-   for (const auto& finalizedBA : allFinalizedBAs) {
-       if (&finalizedBA == &ba1 || &finalizedBA == &ba3) continue; // Don't check against self
-       //Only consider BAs that could potentially fall between ba1 and ba3
-       if (finalizedBA.StartProfileChronoIndex >= startProfileIndexOfBA3 || finalizedBA.EndProfileChronoIndex <= endProfileIndexOfBA1) continue;
-       for (int profileIndex : finalizedBA.IncludedProfileIndices) { 
-           if (profileIndex > endProfileIndexOfBA1 && profileIndex < startProfileIndexOfBA3) { 
-               allUsedProfileIndicesInBetween.insert(profileIndex); 
-           } 
-       } 
-   }
-   int unattributedGapCount = 0; 
-   for (int p = endProfileIndexOfBA1 + 1; p < startProfileIndexOfBA3; ++p) { 
-       if (allUsedProfileIndicesInBetween.count(p) == 0) { 
-           unattributedGapCount++; 
-       } 
-   } 
-   return unattributedGapCount; 
+// NEW: Restores the state replayed from the journal, under the same conditions as the snapshot: the current sessions
+// must continue the journal's (the fingerprint was checked when it was opened)
+bool RestoreBAStateFromJournal(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, const s_JournalState& state, const std::vector<double>& sessionStarts, int& formationStartIndex) {
+    if (!state.HasCheckpoint || state.ResumeIndex < 0 || state.ResumeIndex > static_cast<int>(state.SessionStarts.size())) return false;
+    if (!CanResumeBAState(state.SessionStarts, sessionStarts)) return false;
+    std::vector<bool> profileUsed(sessionStarts.size(), false);
+    for (int i = 0; i < state.ResumeIndex && i < static_cast<int>(state.ProfileUsed.size()); ++i) profileUsed[i] = state.ProfileUsed[i];
+
+    std::vector<s_BalanceArea> finalized = state.FinalizedBalanceAreas;
+    std::vector<s_BalanceArea> active = state.ActiveBalanceAreas;
+    std::vector<s_ProbeLineDrawingInfo> probes = state.ProbeLinesToDraw;
+    std::vector<s_PBALDrawingInfo> pbals = state.PBALsToDraw;
+    std::vector<s_CompositeBalanceArea> composites = state.CompositeBAs;
+    ExtendRestoredBAsToChartEnd(sc, finalized, active, pbals);
+    std::stable_sort(active.begin(), active.end(), [](const s_BalanceArea& a, const s_BalanceArea& b) { return a.ActivationBarIndex < b.ActivationBarIndex; });
+    ApplyRestoredBAState(sc, pData, state.ResumeIndex, std::move(profileUsed), finalized, active, probes, pbals, composites);
+    formationStartIndex = state.ResumeIndex;
+    return true;
+}
+
+// NEW: Resumes from the state this instance formed earlier, which is what its snapshot and journal hold, without
+// reading either back from disk. Same conditions as RestoreBAStateSnapshot.
+bool RestoreBAStateInMemory(SCStudyInterfaceRef sc, s_BAStudyPersistentData* pData, uint64_t fingerprint, const std::vector<double>& sessionStarts, int& formationStartIndex) {
+    if (pData->StateFingerprint != fingerprint || !CanResumeBAState(pData->FormationSessionStarts, sessionStarts)) return false;
+    const int resumeIndex = std::min(pData->FormationResumeIndex, static_cast<int>(pData->FormationSessionStarts.size()));
+    std::vector<bool> profileUsed(sessionStarts.size(), false);
+    for (int i = 0; i < resumeIndex && i < static_cast<int>(pData->FormationProfileUsed.size()); ++i) profileUsed[i] = pData->FormationProfileUsed[i];
+
+    std::vector<s_BalanceArea> finalized = std::move(pData->FinalizedBalanceAreas);
+    std::vector<s_BalanceArea> active = std::move(pData->ActiveBalanceAreas);
+    std::vector<s_ProbeLineDrawingInfo> probes = std::move(pData->ProbeLinesToDraw);
+    std::vector<s_PBALDrawingInfo> pbals = std::move(pData->PBALsToDraw);
+    std::vector<s_CompositeBalanceArea> composites = std::move(pData->CompositeBAs);
+    ExtendRestoredBAsToChartEnd(sc, finalized, active, pbals);
+    ApplyRestoredBAState(sc, pData, resumeIndex, std::move(profileUsed), finalized, active, probes, pbals, composites);
+    formationStartIndex = resumeIndex;
+    return true;
 }
 
 // --- Main Study Function ---
@@ -839,6 +3139,22 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
 	const int IN_ACTIVE_RECT_BORDER_WIDTH = 44;
 	const int IN_ACTIVE_SHOW_LABEL = 45;
 	const int IN_ACTIVE_LABEL_FONT_SIZE = 46;
+	const int IN_USE_PROFILE_CACHE = 47;
+	const int IN_USE_STATE_SNAPSHOT = 48;
+	const int IN_WORKER_THREADS = 49;
+	const int IN_BACKGROUND_RECALC = 50;
+	const int IN_RECALC_TIME_BUDGET = 51;
+	const int IN_SWEEP_GRID = 52;
+	const int IN_RUN_PARAMETER_SWEEP = 53;
+	const int IN_PROFILE_MEMORY_BUDGET = 55;
+	const int IN_OVERLAP_RESOLUTION = 56;
+	const int IN_PROFILE_SOURCE = 57;
+	const int IN_EXPORT_RESULTS = 58;
+	const int IN_PUBLISH_LEVELS = 59;
+	const int IN_LEVEL_ALERT_NUMBER = 60;
+	const int IN_LEVEL_ALERT_HYSTERESIS = 61;
+	const int IN_TICK_ACTIVATION = 62;
+	const int IN_EVENT_JOURNAL = 63;
 
    if (sc.SetDefaults) { 
        sc.GraphName = "Auto BAs";
@@ -851,7 +3167,7 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
        sc.Input[IN_VAP_STUDY_REF].SetStudyID(2);
        sc.Input[IN_NUM_SESSIONS].Name = "Number of Sessions to Track"; 
        sc.Input[IN_NUM_SESSIONS].SetInt(250); 
-       sc.Input[IN_NUM_SESSIONS].SetIntLimits(2, 500);
+       sc.Input[IN_NUM_SESSIONS].SetIntLimits(2, 5000);
        sc.Input[IN_MIN_VOL_OVERLAP].Name = "Minimum Volume Overlap % (Initiation/Extension)"; 
        sc.Input[IN_MIN_VOL_OVERLAP].SetFloat(25.0f); 
        sc.Input[IN_MIN_VOL_OVERLAP].SetFloatLimits(0.1f, 100.0f);
@@ -953,6 +3269,55 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
         sc.Input[IN_ACTIVE_LABEL_FONT_SIZE].Name = "Active BA Label Font Size";
         sc.Input[IN_ACTIVE_LABEL_FONT_SIZE].SetInt(9);
         sc.Input[IN_ACTIVE_LABEL_FONT_SIZE].SetIntLimits(7, 20);
+        sc.Input[IN_USE_PROFILE_CACHE].Name = "Use Profile Disk Cache";
+        sc.Input[IN_USE_PROFILE_CACHE].SetYesNo(1);
+        sc.Input[IN_USE_STATE_SNAPSHOT].Name = "Persist BA State Snapshot (Warm Restart)";
+        sc.Input[IN_USE_STATE_SNAPSHOT].SetYesNo(1);
+        sc.Input[IN_WORKER_THREADS].Name = "Worker Threads (0 = All Cores, 1 = Off)";
+        sc.Input[IN_WORKER_THREADS].SetInt(0);
+        sc.Input[IN_WORKER_THREADS].SetIntLimits(0, 64);
+        sc.Input[IN_BACKGROUND_RECALC].Name = "Background Recalculation";
+        sc.Input[IN_BACKGROUND_RECALC].SetYesNo(0);
+        sc.Input[IN_RECALC_TIME_BUDGET].Name = "Recalculation Budget per Call (us, 0 = Unlimited)";
+        sc.Input[IN_RECALC_TIME_BUDGET].SetInt(0);
+        sc.Input[IN_RECALC_TIME_BUDGET].SetIntLimits(0, 1000000);
+        sc.Input[IN_SWEEP_GRID].Name = "Parameter Sweep Grid";
+        sc.Input[IN_SWEEP_GRID].SetString("MinVolOverlap=40:80:10; MinVAOverlap=40:80:10; ValueAreaPercentage=68,70");
+        sc.Input[IN_RUN_PARAMETER_SWEEP].Name = "Run Parameter Sweep (Resets to No)";
+        sc.Input[IN_RUN_PARAMETER_SWEEP].SetYesNo(0);
+        sc.Input[IN_PROFILE_MEMORY_BUDGET].Name = "Profile Memory Budget (MB, 0 = Unlimited)";
+        sc.Input[IN_PROFILE_MEMORY_BUDGET].SetInt(0);
+        sc.Input[IN_PROFILE_MEMORY_BUDGET].SetIntLimits(0, 100000);
+        sc.Input[IN_OVERLAP_RESOLUTION].Name = "Volume Overlap Resolution";
+        sc.Input[IN_OVERLAP_RESOLUTION].SetCustomInputStrings("Exact;2 Ticks;4 Ticks;16 Ticks");
+        sc.Input[IN_OVERLAP_RESOLUTION].SetCustomInputIndex(0);
+        sc.Input[IN_PROFILE_SOURCE].Name = "Profile Source";
+        sc.Input[IN_PROFILE_SOURCE].SetCustomInputStrings("Volume by Price Study;Chart Bar Volume at Price");
+        sc.Input[IN_PROFILE_SOURCE].SetCustomInputIndex(PROFILE_SOURCE_VBP_STUDY);
+        sc.Input[IN_EXPORT_RESULTS].Name = "Export Results (CSV + Columnar)";
+        sc.Input[IN_EXPORT_RESULTS].SetYesNo(0);
+        sc.Input[IN_PUBLISH_LEVELS].Name = "Publish Levels (Subgraphs + Shared Memory)";
+        sc.Input[IN_PUBLISH_LEVELS].SetYesNo(0);
+        sc.Input[IN_LEVEL_ALERT_NUMBER].Name = "Level Crossing Alert Number (0 = Off)";
+        sc.Input[IN_LEVEL_ALERT_NUMBER].SetInt(0);
+        sc.Input[IN_LEVEL_ALERT_NUMBER].SetIntLimits(0, 150);
+        sc.Input[IN_LEVEL_ALERT_HYSTERESIS].Name = "Level Crossing Alert Hysteresis (Ticks)";
+        sc.Input[IN_LEVEL_ALERT_HYSTERESIS].SetInt(2);
+        sc.Input[IN_LEVEL_ALERT_HYSTERESIS].SetIntLimits(1, 1000);
+        sc.Input[IN_TICK_ACTIVATION].Name = "Tick-Level Activation (Time and Sales)";
+        sc.Input[IN_TICK_ACTIVATION].SetYesNo(0);
+        sc.Input[IN_EVENT_JOURNAL].Name = "Event Journal (Audit + Warm Restart)";
+        sc.Input[IN_EVENT_JOURNAL].SetYesNo(0);
+
+        // Level slots for other studies; not drawn, and only filled while Publish Levels is on
+        for (int type = 0; type < LEVEL_TYPE_COUNT; ++type) {
+            for (int slot = 0; slot < LEVEL_SUBGRAPH_SLOTS; ++slot) {
+                SCSubgraphRef subgraph = sc.Subgraph[type * LEVEL_SUBGRAPH_SLOTS + slot];
+                subgraph.Name.Format("%s %d", LEVEL_TYPE_NAMES[type], slot + 1);
+                subgraph.DrawStyle = DRAWSTYLE_IGNORE;
+                subgraph.DrawZeros = 0;
+            }
+        }
        return;
    }
    
@@ -999,26 +3364,35 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
     int ActiveRectBorderWidth = sc.Input[IN_ACTIVE_RECT_BORDER_WIDTH].GetInt();
     bool ActiveShowLabel = sc.Input[IN_ACTIVE_SHOW_LABEL].GetYesNo();
     int ActiveLabelFontSize = sc.Input[IN_ACTIVE_LABEL_FONT_SIZE].GetInt();
+    bool UseProfileCache = sc.Input[IN_USE_PROFILE_CACHE].GetYesNo();
+    bool UseStateSnapshot = sc.Input[IN_USE_STATE_SNAPSHOT].GetYesNo();
+    int WorkerThreads = sc.Input[IN_WORKER_THREADS].GetInt();
+    bool BackgroundRecalc = sc.Input[IN_BACKGROUND_RECALC].GetYesNo();
+    int RecalcTimeBudget = sc.Input[IN_RECALC_TIME_BUDGET].GetInt();
+    const char* SweepGrid = sc.Input[IN_SWEEP_GRID].GetString();
+    bool RunSweep = sc.Input[IN_RUN_PARAMETER_SWEEP].GetYesNo();
+    int ProfileMemoryBudget = sc.Input[IN_PROFILE_MEMORY_BUDGET].GetInt();
+    int OverlapResolutionIndex = std::max(0, std::min(sc.Input[IN_OVERLAP_RESOLUTION].GetIndex(), PROFILE_PYRAMID_LEVELS));
+    int OverlapResolution = (OverlapResolutionIndex == 0) ? 1 : PROFILE_PYRAMID_FACTORS[OverlapResolutionIndex - 1];
+    bool UseBarProfiles = sc.Input[IN_PROFILE_SOURCE].GetIndex() == PROFILE_SOURCE_BAR_VAP;
+    bool ExportResults = sc.Input[IN_EXPORT_RESULTS].GetYesNo();
+    bool PublishLevels = sc.Input[IN_PUBLISH_LEVELS].GetYesNo();
+    int LevelAlertNumber = sc.Input[IN_LEVEL_ALERT_NUMBER].GetInt();
+    int LevelAlertHysteresis = std::max(1, sc.Input[IN_LEVEL_ALERT_HYSTERESIS].GetInt());
+    bool TickActivation = sc.Input[IN_TICK_ACTIVATION].GetYesNo();
+    bool UseEventJournal = sc.Input[IN_EVENT_JOURNAL].GetYesNo();
 
    float TickSize = sc.TickSize; 
    SCString logMsg;
 
-   if (ReferenceStudyID <= 0) { 
-       sc.AddMessageToLog("Error: Set Volume by Price Study Reference", 1); 
-       return; 
-   }
-   if (TickSize <= 0.0f) { 
-       sc.AddMessageToLog("Error: TickSize is zero or negative.", 1); 
-       return; 
-   }
-
    s_BAStudyPersistentData* pData = reinterpret_cast<s_BAStudyPersistentData*>(sc.GetPersistentPointer(0));
    if (pData == nullptr) { 
        pData = new s_BAStudyPersistentData; 
        sc.SetPersistentPointer(0, pData); 
    }
 
-   // CRITICAL: Handle study removal (sc.LastCallToFunction) - MUST BE EARLY
+   // CRITICAL: Handle study removal (sc.LastCallToFunction) - MUST BE EARLY, ahead of the input checks, so the
+   // threads and files are released even when the study was never configured
    if (sc.LastCallToFunction) {
        // Delete all user-drawn drawings created by this study
        if (AllowUserAdjustment) {
@@ -1036,13 +3410,13 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
            }
             // Delete active BA drawings
             for (const auto& activeBa : pData->ActiveBalanceAreas) {
-                int extLineNum = 50000 + activeBa.StartProfileChronoIndex * 100 + activeBa.EndProfileChronoIndex;
+                int extLineNum = ActiveBALineNumber(activeBa);
                 sc.DeleteUserDrawnACSDrawing(sc.ChartNumber, extLineNum);
                 // No separate label deletion needed - embedded in rectangle
             }
             // Delete PBAL drawings
             for (const auto& pbal : pData->PBALsToDraw) {
-                int pbalLineNum = 60000 + pbal.OriginStartProfileIndex * 100 + pbal.OriginEndProfileIndex + (pbal.IsHigh ? 50 : 0);
+                int pbalLineNum = PBALLineNumber(pbal);
                 sc.DeleteUserDrawnACSDrawing(sc.ChartNumber, pbalLineNum);
             }
        }
@@ -1055,10 +3429,29 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
        pData->UserAdjustedDrawings.clear();
        pData->ActiveBalanceAreas.clear();
        pData->CreatedActiveBADrawings.clear();
-       
+       pData->ProfileCache.Close();
+       pData->WorkerPool.reset(); // The last instance to let go joins the threads, so they do not outlive the DLL
+       pData->BackgroundFormation.Stop();
+       pData->BackgroundSweep.Stop();
+       pData->ResultExporter.Stop(); // Writes out what is still queued
+       pData->LevelPublisher.Close();
+       pData->EventJournal.Stop(); // Writes out what is still queued
+       pData->SharedProfiles.reset(); // Release this instance's reference to the shared set
+
        return; // Exit early on study removal
    }
 
+   if (UseBarProfiles) {
+       sc.MaintainVolumeAtPriceData = 1; // Takes effect when Sierra Chart next reloads the chart data
+   } else if (ReferenceStudyID <= 0) { 
+       sc.AddMessageToLog("Error: Set Volume by Price Study Reference", 1); 
+       return; 
+   }
+   if (TickSize <= 0.0f) { 
+       sc.AddMessageToLog("Error: TickSize is zero or negative.", 1); 
+       return; 
+   }
+
    // Delete ACS chart drawings (for non-user drawn mode)
    sc.DeleteACSChartDrawing(sc.ChartNumber, TOOL_DELETE_ALL, BA_RECTANGLE_BASE);
    sc.DeleteACSChartDrawing(sc.ChartNumber, TOOL_DELETE_ALL, BA_VA_LINE_BASE);
@@ -1067,13 +3460,86 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
    sc.DeleteACSChartDrawing(sc.ChartNumber, TOOL_DELETE_ALL, COMP_BA_RECT_BASE);
 
    // Load session profiles
-   std::vector<s_SessionProfile> SessionProfiles; 
-   SessionProfiles.reserve(NumberOfSessions); 
+   std::vector<s_SessionProfile>& SessionProfiles = pData->LoadedSessions;
    bool profilesLoaded = false;
+
+   // With the bar source, sessions come from the chart's own volume at price; only the bars since the last call are folded in
+   const s_BarProfileBuilder* barProfiles = nullptr;
+   if (UseBarProfiles) {
+       pData->BarProfiles.Update(sc, PriceTickMultiplier);
+       barProfiles = &pData->BarProfiles;
+   } else if (!pData->BarProfiles.Sessions.empty()) {
+       pData->BarProfiles.Reset();
+   }
+
+   // Completed sessions (every fetchIndex except the current one at 0) are served from the mapped cache file when present
+   // Sessions are only written once the chart has finished downloading history, so partial profiles never get persisted.
+   // Bar-built sessions are folded in memory and skip the cache.
+   bool canWriteProfileCache = UseProfileCache && !UseBarProfiles && !pData->ProfileCache.WriteFailed && !sc.ChartIsDownloadingHistoricalData(sc.ChartNumber);
+   // Per-call temporaries come from the thread's scratch arena, which is rewound when the call returns
+   s_ScratchScope callScratch;
+   std::vector<s_ProfileCacheRecord> newCacheRecords;
+   std::vector<s_VolumeAtPriceV2> rawLevels;
+   // Levels are staged here on the study thread, one run per loaded profile; maps and metrics are built afterwards on the worker pool
+   ScratchVector<s_PriceLevelVolume> stagedLevels;
+   ScratchVector<size_t> stagedLevelStarts; // Indexed from firstLoadedIndex, plus a closing entry
+   // Completed sessions another instance (or an earlier call) already built are taken from the shared set.
+   // Keys are formatted in full into buffers kept in pData, so a long symbol cannot cut a key short and alias another
+   // configuration's set, and a live update does not allocate.
+   {
+       const std::string& sharedKey = pData->SharedProfilesKeyScratch;
+       FormatKey(pData->SharedProfilesKeyScratch, "%s|%g|%d|%g|%s", sc.Symbol.GetChars(), TickSize, PriceTickMultiplier, ValueAreaPercentage, UseBarProfiles ? "bars" : "vbp");
+       if (!pData->SharedProfiles || pData->SharedProfilesKey != sharedKey) {
+           pData->SharedProfilesKey = sharedKey;
+           pData->SharedProfiles = AcquireSharedProfileSet(pData->SharedProfilesKey);
+           // Both paths only depend on the symbol and tick multiplier
+           pData->ProfileCachePath = BuildProfileCachePath(sc, PriceTickMultiplier);
+           pData->StateSnapshotPath = BuildStateSnapshotPath(sc);
+       }
+   }
+   std::shared_ptr<const SharedSessionMap> sharedSessions = pData->SharedProfiles->LoadSessions();
+
+   // Completed sessions do not change between live updates: unless this is a full recalculation, the inputs
+   // changed or a new session started, only the developing session (fetchIndex 0) is fetched and rebuilt
+   const std::string& loadKey = pData->LoadedSessionsKeyScratch;
+   FormatKey(pData->LoadedSessionsKeyScratch, "%d|%d|%s", NumberOfSessions, ReferenceStudyID, pData->SharedProfilesKey.c_str());
+   n_ACSIL::s_StudyProfileInformation developingInfo;
+   bool refreshDevelopingOnly = !sc.IsFullRecalculation && !SessionProfiles.empty() && pData->LoadedSessionsKey == loadKey &&
+       GetSessionProfileInfo(sc, barProfiles, ReferenceStudyID, 0, developingInfo) &&
+       SessionProfiles.back().ChronologicalIndex == NumberOfSessions - 1 &&
+       SessionProfiles.back().StartDateTime.GetAsDouble() == developingInfo.m_StartDateTime.GetAsDouble();
+   if (refreshDevelopingOnly) {
+       SessionProfiles.pop_back();
+       profilesLoaded = !SessionProfiles.empty();
+   } else {
+       SessionProfiles.clear();
+       SessionProfiles.reserve(NumberOfSessions);
+       pData->LoadedSessionsKey = loadKey;
+   }
+   const int firstLoadedIndex = static_cast<int>(SessionProfiles.size()); // Profiles from here on are (re)loaded below
+   // The bar source knows how many sessions the chart holds, so it does not ask for the ones before the first
+   const int availableSessions = UseBarProfiles ? std::min(NumberOfSessions, static_cast<int>(pData->BarProfiles.Sessions.size())) : NumberOfSessions;
+   const int firstFetchIndex = refreshDevelopingOnly ? 0 : availableSessions - 1;
+   ScratchVector<bool> sessionIsShared;
+   sessionIsShared.reserve(firstFetchIndex + 1);
+   stagedLevelStarts.reserve(firstFetchIndex + 2);
+   const std::string& profileCachePath = pData->ProfileCachePath;
+   if (UseProfileCache) {
+       if (pData->ProfileCache.Path != profileCachePath) {
+           pData->ProfileCache.WriteFailed = false;
+           pData->ProfileCache.Path = profileCachePath;
+       }
+   } else if (!pData->ProfileCache.Path.empty()) {
+       pData->ProfileCache.Close();
+       pData->ProfileCache.Path.clear();
+   }
+   // Live updates of the developing session never read the cache, so they do not map it
+   s_ProfileCacheMapping profileCacheMapping(pData->ProfileCache, TickSize, PriceTickMultiplier, UseProfileCache && !UseBarProfiles);
+   if (firstFetchIndex > 0) profileCacheMapping.Map();
    
-   for (int fetchIndex = NumberOfSessions - 1; fetchIndex >= 0; --fetchIndex) {
+   for (int fetchIndex = firstFetchIndex; fetchIndex >= 0; --fetchIndex) {
        n_ACSIL::s_StudyProfileInformation profileInfo;
-       if (sc.GetStudyProfileInformation(ReferenceStudyID, fetchIndex, profileInfo)) {
+       if (GetSessionProfileInfo(sc, barProfiles, ReferenceStudyID, fetchIndex, profileInfo)) {
            s_SessionProfile sessionProfile;
            sessionProfile.StartDateTime = profileInfo.m_StartDateTime; 
            sessionProfile.EndDateTime = profileInfo.m_EndDateTime;
@@ -1084,77 +3550,159 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
            sessionProfile.HighestPrice = -FLT_MAX; 
            sessionProfile.LowestPrice = FLT_MAX;
 
-           int numPriceLevels = sc.GetNumPriceLevelsForStudyProfile(ReferenceStudyID, fetchIndex);
-           for (int priceIndex = 0; priceIndex < numPriceLevels; priceIndex++) {
-               s_VolumeAtPriceV2 vap;
-               if (sc.GetVolumeAtPriceDataForStudyProfile(ReferenceStudyID, fetchIndex, priceIndex, vap) == 1 && vap.Volume > 0) {
-                   s_PriceLevelVolume plv;
-                   float actualPrice = sc.RoundToTickSize(static_cast<float>(vap.PriceInTicks * TickSize * PriceTickMultiplier), TickSize);
-                   plv.Price = actualPrice; 
-                   plv.TotalVolume = static_cast<float>(vap.Volume); 
-                   plv.NumberOfTrades = vap.NumberOfTrades;
-                   auto it = sessionProfile.PriceMap.find(plv.Price);
-                   if (it != sessionProfile.PriceMap.end()) {
-                       it->second.TotalVolume += plv.TotalVolume; 
-                       it->second.NumberOfTrades += plv.NumberOfTrades;
-                   } else { 
-                       sessionProfile.PriceMap[plv.Price] = plv; 
-                   }
+           stagedLevelStarts.push_back(stagedLevels.size());
+           if (fetchIndex > 0) {
+               auto shared = sharedSessions->find(std::make_pair(profileInfo.m_StartDateTime.GetAsDouble(), profileInfo.m_EndDateTime.GetAsDouble()));
+               if (shared != sharedSessions->end()) {
+                   AssignSessionVolumeData(sessionProfile, shared->second);
+                   SessionProfiles.push_back(std::move(sessionProfile));
+                   sessionIsShared.push_back(true);
+                   profilesLoaded = true;
+                   continue;
                }
            }
-           
-           // Calculate metrics based on the populated PriceMap
-           if(!sessionProfile.PriceMap.empty()) {
-               float calcPOC, calcVAH, calcVAL, calcHigh, calcLow, calcVol;
-               CalculateProfileMetrics(sessionProfile.PriceMap, ValueAreaPercentage, sc, calcPOC, calcVAH, calcVAL, calcHigh, calcLow, calcVol);
-               sessionProfile.POC = calcPOC; 
-               sessionProfile.ValueAreaHigh = calcVAH; 
-               sessionProfile.ValueAreaLow = calcVAL;
-               sessionProfile.TotalVolume = calcVol; 
-               sessionProfile.HighestPrice = calcHigh; 
-               sessionProfile.LowestPrice = calcLow;
-           } else { // No volume data from profile, try to get H/L from chart bars
-               sessionProfile.POC = 0.0f; 
-               sessionProfile.ValueAreaHigh = 0.0f; 
-               sessionProfile.ValueAreaLow = 0.0f; 
-               sessionProfile.TotalVolume = 0.0f;
-               if (sessionProfile.BeginIndex >= 0 && sessionProfile.EndIndex >= sessionProfile.BeginIndex && sessionProfile.EndIndex < sc.ArraySize) {
-                   sessionProfile.HighestPrice = sc.GetHighest(sc.High, sessionProfile.BeginIndex, sessionProfile.EndIndex);
-                   sessionProfile.LowestPrice = sc.GetLowest(sc.Low, sessionProfile.BeginIndex, sessionProfile.EndIndex);
-                   if (sessionProfile.HighestPrice < sessionProfile.LowestPrice || sessionProfile.HighestPrice <= -FLT_MAX || sessionProfile.LowestPrice >= FLT_MAX) { // Invalid range
-                       sessionProfile.HighestPrice = -FLT_MAX; 
-                       sessionProfile.LowestPrice = FLT_MAX;
-                   }
-               } else { // Invalid bar indices
-                   sessionProfile.HighestPrice = -FLT_MAX; 
-                   sessionProfile.LowestPrice = FLT_MAX;
+           const s_ProfileCacheIndexEntry* cachedEntry = nullptr;
+           if (UseProfileCache && !UseBarProfiles && fetchIndex > 0) {
+               cachedEntry = pData->ProfileCache.Find(profileInfo.m_StartDateTime.GetAsDouble(), profileInfo.m_EndDateTime.GetAsDouble());
+           }
+
+           if (barProfiles != nullptr) {
+               StageBarProfileLevels(sc, *barProfiles->FindSession(fetchIndex), TickSize, PriceTickMultiplier, stagedLevels);
+           } else if (cachedEntry != nullptr) {
+               StageCachedLevels(sc, pData->ProfileCache, *cachedEntry, TickSize, PriceTickMultiplier, stagedLevels);
+           } else {
+               rawLevels.clear();
+               StageStudyProfileLevels(sc, ReferenceStudyID, fetchIndex, TickSize, PriceTickMultiplier, stagedLevels, (canWriteProfileCache && fetchIndex > 0) ? &rawLevels : nullptr);
+               s_ProfileCacheRecord record;
+               if (canWriteProfileCache && fetchIndex > 0 && BuildProfileCacheRecord(rawLevels, profileInfo.m_StartDateTime.GetAsDouble(), profileInfo.m_EndDateTime.GetAsDouble(), record)) {
+                   newCacheRecords.push_back(std::move(record));
                }
            }
-           SessionProfiles.push_back(sessionProfile); 
+           SessionProfiles.push_back(std::move(sessionProfile)); 
+           sessionIsShared.push_back(false);
            profilesLoaded = true;
        } else { 
            logMsg.Format("Failed to get Profile Info for fetchIndex %d.", fetchIndex); 
            sc.AddMessageToLog(logMsg, 1); 
        }
    }
+
+   stagedLevelStarts.push_back(stagedLevels.size());
+
+   // Sessions are independent: build maps, POC/VA/H/L, moments and dense histograms in parallel.
+   // Each task writes only its own slot, so SessionProfiles stays in chronological order.
+   ScratchVector<int> sessionsToBuild;
+   for (int profileIndex = firstLoadedIndex; profileIndex < static_cast<int>(SessionProfiles.size()); ++profileIndex) {
+       if (!sessionIsShared[profileIndex - firstLoadedIndex]) sessionsToBuild.push_back(profileIndex);
+   }
+   if (!pData->WorkerPool || pData->WorkerPoolThreads != WorkerThreads) {
+       pData->WorkerPoolThreads = WorkerThreads;
+       pData->WorkerPool = AcquireSharedWorkerPool(WorkerThreads);
+   }
+   pData->WorkerPool->ParallelFor(static_cast<int>(sessionsToBuild.size()), [&](int n) {
+       int profileIndex = sessionsToBuild[n];
+       size_t levelStart = stagedLevelStarts[profileIndex - firstLoadedIndex];
+       size_t numLevels = stagedLevelStarts[profileIndex - firstLoadedIndex + 1] - levelStart;
+       if (SessionProfiles[profileIndex].ChronologicalIndex == NumberOfSessions - 1) {
+           // The developing session is refilled in place, unless a background run or sweep still reads the last version
+           if (!pData->DevelopingData || pData->DevelopingData.use_count() > 1) pData->DevelopingData = std::make_shared<s_SessionVolumeData>();
+           FillSessionVolumeData(*pData->DevelopingData, stagedLevels.data() + levelStart, numLevels, ValueAreaPercentage, TickSize);
+           AssignSessionVolumeData(SessionProfiles[profileIndex], pData->DevelopingData);
+       } else {
+           AssignSessionVolumeData(SessionProfiles[profileIndex], BuildSessionVolumeData(stagedLevels.data() + levelStart, numLevels, ValueAreaPercentage, TickSize));
+       }
+   });
+   // Publish newly built completed sessions (all but the developing last one) for other instances
+   std::vector<std::pair<std::pair<double, double>, std::shared_ptr<const s_SessionVolumeData>>> sessionsToShare;
+   for (int profileIndex : sessionsToBuild) {
+       const s_SessionProfile& profile = SessionProfiles[profileIndex];
+       if (profile.ChronologicalIndex == NumberOfSessions - 1) continue;
+       sessionsToShare.push_back(std::make_pair(std::make_pair(profile.StartDateTime.GetAsDouble(), profile.EndDateTime.GetAsDouble()), profile.Data));
+   }
+   pData->SharedProfiles->PublishSessions(sessionsToShare);
+
+   for (int profileIndex = firstLoadedIndex; profileIndex < static_cast<int>(SessionProfiles.size()); ++profileIndex) {
+       s_SessionProfile& sessionProfile = SessionProfiles[profileIndex];
+       if (sessionProfile.Data->IsEmpty()) { // No volume data from profile, try to get H/L from chart bars
+           sessionProfile.POC = 0.0f; 
+           sessionProfile.ValueAreaHigh = 0.0f; 
+           sessionProfile.ValueAreaLow = 0.0f; 
+           sessionProfile.TotalVolume = 0.0f;
+           if (sessionProfile.BeginIndex >= 0 && sessionProfile.EndIndex >= sessionProfile.BeginIndex && sessionProfile.EndIndex < sc.ArraySize) {
+               sessionProfile.HighestPrice = sc.GetHighest(sc.High, sessionProfile.BeginIndex, sessionProfile.EndIndex);
+               sessionProfile.LowestPrice = sc.GetLowest(sc.Low, sessionProfile.BeginIndex, sessionProfile.EndIndex);
+               if (sessionProfile.HighestPrice < sessionProfile.LowestPrice || sessionProfile.HighestPrice <= -FLT_MAX || sessionProfile.LowestPrice >= FLT_MAX) { // Invalid range
+                   sessionProfile.HighestPrice = -FLT_MAX; 
+                   sessionProfile.LowestPrice = FLT_MAX;
+               }
+           } else { // Invalid bar indices
+               sessionProfile.HighestPrice = -FLT_MAX; 
+               sessionProfile.LowestPrice = FLT_MAX;
+           }
+       }
+   }
    
+   if (canWriteProfileCache && !newCacheRecords.empty()) {
+       std::string tempPath = profileCachePath + ".tmp" + std::to_string(sc.ChartNumber) + "_" + std::to_string(sc.StudyGraphInstanceID);
+       bool cacheBusy = false;
+       double keepFromDateTime = SessionProfiles.empty() ? 0.0 : SessionProfiles.front().StartDateTime.GetAsDouble();
+       if (!WriteProfileCacheFile(pData->ProfileCache, profileCachePath, tempPath, TickSize, PriceTickMultiplier, newCacheRecords, keepFromDateTime, cacheBusy)) {
+           if (cacheBusy) { // Another chart was loading from the file: the sessions are fetched again, and written, on a later load
+               logMsg.Format("Profile cache file %s is in use by another chart; new sessions will be written on a later load.", profileCachePath.c_str());
+           } else {
+               pData->ProfileCache.WriteFailed = true;
+               logMsg.Format("Warning: Could not write profile cache file %s.", profileCachePath.c_str());
+           }
+           sc.AddMessageToLog(logMsg, 0);
+       }
+   }
+
    if (!profilesLoaded && NumberOfSessions > 0) { 
        /* Only return if we expected profiles but got none */ 
        return; 
    }
    int numProfilesCollected = static_cast<int>(SessionProfiles.size());
 
-   // Check if recalculation is needed
-   bool needRecalculation = sc.IsFullRecalculation ||
-       pData->LastProfileCount != numProfilesCollected || 
+   // Identity of the computed state: algorithm inputs plus the sessions it was formed over
+   uint64_t stateFingerprint = ComputeBAStateFingerprint(sc, {
+       static_cast<float>(NumberOfSessions), static_cast<float>(ReferenceStudyID), static_cast<float>(PriceTickMultiplier),
+       ValueAreaPercentage, MinVolOverlap, MinVAOverlap, RangeSimilarityPercent, HighLowTolerancePercent, RangeContainmentPercent,
+       FilterByNormality ? 1.0f : 0.0f, MaxAbsSkewness, MinExcessKurtosis, MaxExcessKurtosis, PBALPierceThreshold,
+       static_cast<float>(OverlapResolution), UseBarProfiles ? 1.0f : 0.0f });
+   const std::string& stateSnapshotPath = pData->StateSnapshotPath;
+
+   // Work out which phases the changed inputs invalidate (see e_BAPhase)
+   // Only the profiles reloaded above can differ from the ones BAs were formed over
+   bool sessionsChanged = pData->LastProfileCount != numProfilesCollected ||
+       pData->FormationSessionStarts.size() != SessionProfiles.size() || pData->FormationSessionBeginIndices.size() != SessionProfiles.size();
+   for (size_t p = firstLoadedIndex; !sessionsChanged && p < SessionProfiles.size(); ++p) {
+       sessionsChanged = pData->FormationSessionStarts[p] != SessionProfiles[p].StartDateTime.GetAsDouble() ||
+           pData->FormationSessionBeginIndices[p] != SessionProfiles[p].BeginIndex;
+   }
+   int dirtyPhases = 0;
+   if (sessionsChanged ||
        pData->LastNumberOfSessions != NumberOfSessions ||
-       pData->LastReferenceStudyID != ReferenceStudyID ||
-       std::fabs(pData->LastVAPercentage - ValueAreaPercentage) > 0.001f ||
-       std::fabs(pData->LastMinVolOverlap - MinVolOverlap) > 0.001f ||
+       pData->LastReferenceStudyID != ReferenceStudyID)
+       dirtyPhases |= InvalidateBAPhase(BA_PHASE_LOAD);
+   if (std::fabs(pData->LastVAPercentage - ValueAreaPercentage) > 0.001f ||
+       pData->LastOverlapResolution != OverlapResolution)
+       dirtyPhases |= InvalidateBAPhase(BA_PHASE_METRICS);
+   if (std::fabs(pData->LastMinVolOverlap - MinVolOverlap) > 0.001f ||
        std::fabs(pData->LastMinVAOverlap - MinVAOverlap) > 0.001f ||
        std::fabs(pData->LastRangeSimilarityPercent - RangeSimilarityPercent) > 0.001f ||
        std::fabs(pData->LastHighLowTolerancePercent - HighLowTolerancePercent) > 0.001f ||
-       std::fabs(pData->LastRangeContPercent - RangeContainmentPercent) > 0.001f ||
+       pData->LastFilterByNormality != FilterByNormality ||
+       std::fabs(pData->LastMaxAbsSkewness - MaxAbsSkewness) > 0.001f ||
+       std::fabs(pData->LastMinExcessKurtosis - MinExcessKurtosis) > 0.001f ||
+       std::fabs(pData->LastMaxExcessKurtosis - MaxExcessKurtosis) > 0.001f ||
+       pData->LastBackgroundRecalc != BackgroundRecalc)
+       dirtyPhases |= InvalidateBAPhase(BA_PHASE_FORMATION);
+   if (std::fabs(pData->LastRangeContPercent - RangeContainmentPercent) > 0.001f)
+       dirtyPhases |= InvalidateBAPhase(BA_PHASE_COMPOSITE);
+   if (std::fabs(pData->LastPBALPierceThreshold - PBALPierceThreshold) > 0.001f)
+       dirtyPhases |= InvalidateBAPhase(BA_PHASE_ACTIVATION);
+   // Style-only inputs; a full recalculation also re-emits drawings since Sierra Chart may have reset them
+   if (sc.IsFullRecalculation ||
        pData->LastDrawProbeLines != DrawProbeLines || 
        pData->LastHighProbeColor != HighProbeColor || 
        pData->LastLowProbeColor != LowProbeColor ||
@@ -1162,17 +3710,45 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
        pData->LastProbeLineStyle != ProbeLineStyle || 
        pData->LastExtendProbeLines != ExtendProbeLines ||
        pData->LastDrawCompositeRect != DrawCompositeRect || 
-       pData->LastDebugCompositeBA != DebugCompositeBA || 
-       pData->LastDebugBAFormation != DebugBAFormation ||
-       pData->LastFilterByNormality != FilterByNormality ||
-       std::fabs(pData->LastMaxAbsSkewness - MaxAbsSkewness) > 0.001f ||
-       std::fabs(pData->LastMinExcessKurtosis - MinExcessKurtosis) > 0.001f ||
-       std::fabs(pData->LastMaxExcessKurtosis - MaxExcessKurtosis) > 0.001f ||
-       pData->LastAllowUserAdjustment != AllowUserAdjustment;
-        pData->LastAllowUserAdjustment != AllowUserAdjustment ||
-        pData->LastDrawActiveBAs != DrawActiveBAs;
+       pData->LastAllowUserAdjustment != AllowUserAdjustment ||
+       pData->LastDrawActiveBAs != DrawActiveBAs)
+       dirtyPhases |= InvalidateBAPhase(BA_PHASE_DRAWING);
+   // Debug flags only add logging and take effect on the next recomputation of their phase
+
+   // A run finished by the background thread (or the last slice of a time-sliced run) replaces the drawn
+   // BA state, unless a newer run starts below
+   std::shared_ptr<s_BAFormationRun> publishedRun = pData->BackgroundFormation.TakePublished();
+   if (!publishedRun && !(dirtyPhases & BA_PHASE_FORMATION) && pData->SlicedFormation.IsActive()) {
+       publishedRun = pData->SlicedFormation.Continue(RecalcTimeBudget);
+       if (!publishedRun && DebugBAFormation) {
+           logMsg.Format("DEBUG BA: Partial recalculation, formation suspended at profile %d of %d.", pData->SlicedFormation.Run->NextProfileIndex, numProfilesCollected);
+           sc.AddMessageToLog(logMsg, 0);
+       }
+   }
+   if (publishedRun && (dirtyPhases & BA_PHASE_FORMATION)) publishedRun.reset();
+   if (publishedRun) {
+       dirtyPhases |= InvalidateBAPhase(BA_PHASE_DRAWING);
+       if (std::fabs(publishedRun->Params.RangeContainmentPercent - RangeContainmentPercent) > 0.001f)
+           dirtyPhases |= InvalidateBAPhase(BA_PHASE_COMPOSITE); // Containment changed while the run was in flight
+   }
+
+   s_BAFormationParams formationParams;
+   formationParams.TickSize = TickSize;
+   formationParams.ValueAreaPercentage = ValueAreaPercentage;
+   formationParams.MinVolOverlap = MinVolOverlap;
+   formationParams.MinVAOverlap = MinVAOverlap;
+   formationParams.RangeSimilarityPercent = RangeSimilarityPercent;
+   formationParams.HighLowTolerancePercent = HighLowTolerancePercent;
+   formationParams.RangeContainmentPercent = RangeContainmentPercent;
+   formationParams.FilterByNormality = FilterByNormality;
+   formationParams.MaxAbsSkewness = MaxAbsSkewness;
+   formationParams.MinExcessKurtosis = MinExcessKurtosis;
+   formationParams.MaxExcessKurtosis = MaxExcessKurtosis;
+   formationParams.OverlapResolution = OverlapResolution;
+   formationParams.DebugBAFormation = DebugBAFormation;
+   formationParams.DebugCompositeBA = DebugCompositeBA;
 	   
-	if (needRecalculation) {
+	if (dirtyPhases & BA_PHASE_DRAWING) {
 		   // Delete all existing drawings (both user and non-user drawn)
 		   if (AllowUserAdjustment) {
 			   // Delete user-drawn drawings
@@ -1190,10 +3766,15 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
 			   }
 			   // Delete active BA drawings
 				for (const auto& activeBa : pData->ActiveBalanceAreas) {
-					int extLineNum = 50000 + activeBa.StartProfileChronoIndex * 100 + activeBa.EndProfileChronoIndex;
+					int extLineNum = ActiveBALineNumber(activeBa);
 					sc.DeleteUserDrawnACSDrawing(sc.ChartNumber, extLineNum);
 					// No separate label deletion needed - embedded in rectangle
 				}
+				// PBALs may be rebuilt with different origins when activation is re-derived
+				for (const auto& pbal : pData->PBALsToDraw) {
+					int pbalLineNum = PBALLineNumber(pbal);
+					sc.DeleteUserDrawnACSDrawing(sc.ChartNumber, pbalLineNum);
+				}
 		   } else {
 			   // Delete non-user drawn drawings
 			   sc.DeleteACSChartDrawing(sc.ChartNumber, TOOL_DELETE_ALL, 0);
@@ -1212,6 +3793,7 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
 		   pData->LastNumberOfSessions = NumberOfSessions; 
 		   pData->LastReferenceStudyID = ReferenceStudyID; 
 		   pData->LastVAPercentage = ValueAreaPercentage;
+		   pData->LastOverlapResolution = OverlapResolution;
 		   pData->LastMinVolOverlap = MinVolOverlap; 
 		   pData->LastMinVAOverlap = MinVAOverlap; 
 		   pData->LastRangeSimilarityPercent = RangeSimilarityPercent; 
@@ -1231,546 +3813,174 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
 		   pData->LastMinExcessKurtosis = MinExcessKurtosis; 
 		   pData->LastMaxExcessKurtosis = MaxExcessKurtosis;
            pData->LastDrawActiveBAs = DrawActiveBAs;
+           pData->LastPBALPierceThreshold = PBALPierceThreshold;
+           pData->LastBackgroundRecalc = BackgroundRecalc;
+	}
 
-		   pData->FinalizedBalanceAreas.clear();
-		   pData->ProbeLinesToDraw.clear();
-		   pData->CompositeBAs.clear();
-		   pData->ActiveBalanceAreas.clear();
-		   pData->CreatedActiveBADrawings.clear();
-		   pData->PBALsToDraw.clear();
-
-		   // Balance Area Formation Logic (original logic preserved)
-		   std::vector<bool> profileUsed(numProfilesCollected, false);
-		   for (int i = 0; i < numProfilesCollected; ++i) {
-			   if (profileUsed[i]) continue;
-			   if (i + 1 >= numProfilesCollected) break;
-			   const s_SessionProfile& profile_i = SessionProfiles[i];
-			   const s_SessionProfile& profile_i1 = SessionProfiles[i+1];
-			   
-			   // Check for valid H/L in profiles before using them
-			   if (profile_i.HighestPrice <= -FLT_MAX || profile_i.LowestPrice >= FLT_MAX || profile_i.HighestPrice < profile_i.LowestPrice ||
-				   profile_i1.HighestPrice <= -FLT_MAX || profile_i1.LowestPrice >= FLT_MAX || profile_i1.HighestPrice < profile_i1.LowestPrice ) {
-				   if (DebugBAFormation) {
-						logMsg.Format("DEBUG BA: Skipping initiation at profile %d. Invalid data in profile %d (H:%.2f L:%.2f R:%.2f) or %d (H:%.2f L:%.2f R:%.2f).", i, i, profile_i.HighestPrice, profile_i.LowestPrice, profile_i.GetRange(), i+1, profile_i1.HighestPrice, profile_i1.LowestPrice, profile_i1.GetRange());
-						sc.AddMessageToLog(logMsg,0);
-				   }
-				   continue;
-			   }
+	   if (publishedRun) ApplyBAFormationRun(sc, pData, *publishedRun);
+
+	   std::shared_ptr<s_BAFormationRun> formationRun;
+	   if (dirtyPhases & BA_PHASE_FORMATION) {
+		   // In background and time-sliced mode the previous BAs stay on the chart until the new run completes
+		   bool deferredRun = BackgroundRecalc || RecalcTimeBudget > 0;
+		   bool keepPublishedState = deferredRun && !pData->FinalizedBalanceAreas.empty();
+		   // The published state is complete unless a run that replaces it was still going
+		   bool stateInMemory = !pData->FormationSessionStarts.empty() && !pData->BackgroundFormation.AwaitingResult && !pData->SlicedFormation.IsActive();
+		   if (!BackgroundRecalc) pData->BackgroundFormation.Stop(); // Cancel a run from before the mode was switched off
+		   pData->SlicedFormation.Cancel(); // Superseded by the run started below
 
-			   bool startBA = false; 
-			   std::string initiationReason = "None";
-			   float volOverlap_i_i1 = CalculateVolumeProfileOverlap(profile_i.PriceMap, profile_i1.PriceMap);
-			   if (volOverlap_i_i1 >= MinVolOverlap) { 
-				   startBA = true; 
-				   initiationReason = "Volume Overlap"; 
+		   std::vector<double> sessionStarts;
+		   sessionStarts.reserve(SessionProfiles.size());
+		   for (const auto& profile : SessionProfiles) sessionStarts.push_back(profile.StartDateTime.GetAsDouble());
+
+		   // Warm restart: resume from the state formed earlier when it matches the current inputs and sessions. Once this
+		   // instance has formed a state it resumes from memory; the snapshot and journal are only read back after a reload.
+		   int formationStartIndex = 0;
+		   bool restoredFromSnapshot = false;
+		   if ((UseStateSnapshot || UseEventJournal) && !keepPublishedState && stateInMemory) {
+			   restoredFromSnapshot = RestoreBAStateInMemory(sc, pData, stateFingerprint, sessionStarts, formationStartIndex);
+			   if (restoredFromSnapshot && DebugBAFormation) {
+				   logMsg.Format("DEBUG BA: Kept %d BAs formed earlier. Resuming formation at profile %d of %d.", (int)pData->FinalizedBalanceAreas.size(), formationStartIndex, numProfilesCollected);
+				   sc.AddMessageToLog(logMsg, 0);
 			   }
-			   
-			   if (!startBA) {
-				   float vaOverlap_i_i1 = CalculateValueAreaOverlap(profile_i.ValueAreaHigh, profile_i.ValueAreaLow, profile_i1.ValueAreaHigh, profile_i1.ValueAreaLow, TickSize);
-				   if (vaOverlap_i_i1 >= MinVAOverlap) { 
-					   startBA = true; 
-					   initiationReason = "VA Overlap"; 
-				   }
+		   }
+		   if (!keepPublishedState) {
+			   if (!restoredFromSnapshot) {
+				   pData->FinalizedBalanceAreas.clear();
+				   pData->ProbeLinesToDraw.clear();
+				   pData->CompositeBAs.clear();
+				   pData->ActiveBalanceAreas.clear();
+				   pData->PBALsToDraw.clear();
 			   }
-			   
-			   if (!startBA) {
-				   float rangeDiffPercent = CalculateRangeSimilarityDiff(profile_i, profile_i1, TickSize);
-				   float maxAllowedHigh = CalculateMaxAllowedHigh(profile_i.HighestPrice, profile_i.GetRange(), HighLowTolerancePercent, TickSize);
-				   float minAllowedLow = CalculateMinAllowedLow(profile_i.LowestPrice, profile_i.GetRange(), HighLowTolerancePercent, TickSize);
-				   bool similarRange = CheckRangeSimilarity(rangeDiffPercent, RangeSimilarityPercent);
-				   bool controlledHigh = CheckHighPosition(profile_i1.HighestPrice, maxAllowedHigh);
-				   bool controlledLow = CheckLowPosition(profile_i1.LowestPrice, minAllowedLow);
-				   if (similarRange && controlledHigh && controlledLow) { 
-					   startBA = true; 
-					   initiationReason = "Geometric Proximity"; 
-				   }
+			   pData->CreatedActiveBADrawings.clear();
+		   }
+		   if (UseStateSnapshot && !keepPublishedState && !stateInMemory) {
+			   restoredFromSnapshot = RestoreBAStateSnapshot(sc, pData, stateSnapshotPath, stateFingerprint, sessionStarts, formationStartIndex);
+			   if (restoredFromSnapshot && DebugBAFormation) {
+				   logMsg.Format("DEBUG BA: Restored %d BAs from state snapshot. Resuming formation at profile %d of %d.", (int)pData->FinalizedBalanceAreas.size(), formationStartIndex, numProfilesCollected);
+				   sc.AddMessageToLog(logMsg, 0);
 			   }
-
-			   if (startBA) {
-				   s_BalanceArea currentBA;
-				   currentBA.StartProfileChronoIndex = i; 
-				   currentBA.EndProfileChronoIndex = i + 1;
-				   currentBA.StartDateTime = profile_i.StartDateTime; 
-				   currentBA.StartBarIndex = profile_i.BeginIndex;
-				   currentBA.EndDateTime = profile_i1.EndDateTime; 
-				   currentBA.EndBarIndex = profile_i1.EndIndex;
-				   currentBA.IncludedProfileIndices = {i, i+1}; 
-				   currentBA.InitiationReason = initiationReason;
-
-				   PriceVolumeMap currentMergedMap;
-				   std::vector<std::reference_wrapper<const PriceVolumeMap>> mapsToMerge = { std::cref(profile_i.PriceMap), std::cref(profile_i1.PriceMap) };
-				   currentMergedMap = MergeMultipleVolumeProfiles(mapsToMerge);
-				   float initialMergedHigh, initialMergedLow; // These will be set by CalculateProfileMetrics
-				   CalculateProfileMetrics(currentMergedMap, ValueAreaPercentage, sc, currentBA.POC, currentBA.ValueAreaHigh, currentBA.ValueAreaLow, initialMergedHigh, initialMergedLow, currentBA.TotalVolume);
-				   currentBA.HighestPrice = initialMergedHigh; 
-				   currentBA.LowestPrice = initialMergedLow;
-
-				   // Additional check for BA validity after merging first two profiles
-				   if (currentBA.HighestPrice <= -FLT_MAX || currentBA.LowestPrice >= FLT_MAX || currentBA.HighestPrice < currentBA.LowestPrice) {
-						if (DebugBAFormation) {
-						   logMsg.Format("DEBUG BA: BA initiated at %d with %d has invalid merged H/L (%.2f/%.2f) or zero range. Discarding.", i, i+1, currentBA.HighestPrice, currentBA.LowestPrice);
-						   sc.AddMessageToLog(logMsg,0);
-						}
-						continue; // Skip this BA if it's invalid from the start
-				   }
-
-				   profileUsed[i] = true; 
-				   profileUsed[i+1] = true;
-				   if (DebugBAFormation) { 
-					   logMsg.Format("DEBUG BA: Initiated BA at Profile %d with Profile %d. Reason: '%s'. Initial Range: %.2f-%.2f, VA: %.2f-%.2f, POC: %.2f", i, i + 1, initiationReason.c_str(), currentBA.LowestPrice, currentBA.HighestPrice, currentBA.ValueAreaLow, currentBA.ValueAreaHigh, currentBA.POC); 
-					   sc.AddMessageToLog(logMsg, 0); 
+		   }
+		   // Without a snapshot the journal replays to the same state; it is opened either way so later events append to it.
+		   // A journal already open for these inputs holds the state in memory and is not read again.
+		   if (UseEventJournal && !keepPublishedState) {
+			   std::string eventJournalPath = BuildEventJournalPath(sc);
+			   bool journalOpen = pData->EventJournal.IsRunning() && pData->EventJournal.Path == eventJournalPath && pData->EventJournal.Fingerprint == stateFingerprint;
+			   if (!journalOpen) pData->EventJournal.Open(sc, eventJournalPath, stateFingerprint);
+			   if (!restoredFromSnapshot && !stateInMemory) {
+				   restoredFromSnapshot = RestoreBAStateFromJournal(sc, pData, pData->EventJournal.State, sessionStarts, formationStartIndex);
+				   if (restoredFromSnapshot && DebugBAFormation) {
+					   logMsg.Format("DEBUG BA: Restored %d BAs from event journal (%u events). Resuming formation at profile %d of %d.", (int)pData->FinalizedBalanceAreas.size(),
+									 pData->EventJournal.State.NextSequence - 1, formationStartIndex, numProfilesCollected);
+					   sc.AddMessageToLog(logMsg, 0);
 				   }
+			   }
+		   }
+		   // Sessions formation reads again need their levels back if they were compacted under the memory budget
+		   profileCacheMapping.Map();
+		   int rehydratedSessions = RehydrateSessionProfiles(sc, pData, barProfiles, SessionProfiles, formationStartIndex, NumberOfSessions, ReferenceStudyID, ValueAreaPercentage, TickSize, PriceTickMultiplier);
+		   if (rehydratedSessions > 0 && DebugBAFormation) {
+			   logMsg.Format("DEBUG BA: Restored levels of %d compacted sessions for formation.", rehydratedSessions);
+			   sc.AddMessageToLog(logMsg, 0);
+		   }
+		   formationRun = std::make_shared<s_BAFormationRun>();
+		   formationRun->Params = formationParams;
+		   formationRun->NextProfileIndex = formationStartIndex;
+		   formationRun->ResetActivationOnApply = keepPublishedState;
+		   if (restoredFromSnapshot) {
+			   formationRun->Result.FinalizedBalanceAreas = pData->FinalizedBalanceAreas;
+			   formationRun->Result.ProbeLinesToDraw = pData->ProbeLinesToDraw;
+			   formationRun->Result.CompositeBAs = pData->CompositeBAs;
+			   formationRun->Result.FormationProfileUsed = pData->FormationProfileUsed;
+			   formationRun->CompositeStartIndex = static_cast<size_t>(std::max(0, static_cast<int>(pData->FinalizedBalanceAreas.size()) - 2));
+		   } else {
+			   formationRun->Result.FormationProfileUsed.assign(numProfilesCollected, false);
+		   }
+		   CaptureSessionBarData(sc.High, sc.Low, sc.Close, sc.ArraySize, SessionProfiles, TickSize);
+		   pData->StateFingerprint = stateFingerprint;
+		   pData->FormationSessionStarts = sessionStarts;
+		   pData->FormationSessionBeginIndices.clear();
+		   for (const auto& profile : SessionProfiles) pData->FormationSessionBeginIndices.push_back(profile.BeginIndex);
+		   // Earliest BA attempt that looked at the last (still developing) session; a later restore resumes there
+		   formationRun->Result.FormationResumeIndex = std::max(0, numProfilesCollected - 1);
 
-				   // Extension logic
-				   for (int k = i + 2; k < numProfilesCollected; ++k) {
-					   const s_SessionProfile& profile_k = SessionProfiles[k];
-					   if (profile_k.HighestPrice <= -FLT_MAX || profile_k.LowestPrice >= FLT_MAX || profile_k.HighestPrice < profile_k.LowestPrice) {
-							if (DebugBAFormation) { 
-								logMsg.Format("DEBUG BA: Eval Prof %d for extension - invalid profile data (H:%.2f L:%.2f). Stopping extension.", k, profile_k.HighestPrice, profile_k.LowestPrice); 
-								sc.AddMessageToLog(logMsg, 0); 
-							}
-							break; // Stop extension if current profile is invalid
-					   }
-
-					   bool extendBA = false; 
-					   std::string extensionReason = "None"; 
-					   bool geoHighOK_ext = false; 
-					   bool geoLowOK_ext = false;
-					   if (DebugBAFormation) { 
-						   logMsg.Format("DEBUG BA: Eval Prof %d for extension of BA [%d..%d] (Range: %.2f-%.2f, VA: %.2f-%.2f)", k, currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, currentBA.LowestPrice, currentBA.HighestPrice, currentBA.ValueAreaLow, currentBA.ValueAreaHigh); 
-						   sc.AddMessageToLog(logMsg, 0); 
-					   }
-
-					   float overlap_merged_k = CalculateVolumeProfileOverlap(currentMergedMap, profile_k.PriceMap);
-					   bool volOverlapPassed = (overlap_merged_k >= MinVolOverlap);
-					   if (DebugBAFormation) { 
-						   logMsg.Format("  > Vol Overlap Check: Merged BA vs Prof %d = %.1f%%. Threshold = %.1f%%. -> %s", k, overlap_merged_k, MinVolOverlap, (volOverlapPassed ? "PASS" : "FAIL") ); 
-						   sc.AddMessageToLog(logMsg, 0); 
-					   }
-					   if (volOverlapPassed) { 
-						   extendBA = true; 
-						   extensionReason = "Volume Overlap"; 
-					   }
-
-					   if (!extendBA) {
-						   float tickTolerance = TickSize / 2.0f;
-						   bool highContained = (profile_k.HighestPrice <= currentBA.HighestPrice + tickTolerance);
-						   bool lowContained = (profile_k.LowestPrice >= currentBA.LowestPrice - tickTolerance);
-						   bool isContained = highContained && lowContained;
-						   if (DebugBAFormation) { 
-							   logMsg.Format("  > Range Containment Check: Prof %d H=%.2f vs BA H=%.2f(+%.2f)=%s, L=%.2f vs BA L=%.2f(-%.2f)=%s -> %s", k, profile_k.HighestPrice, currentBA.HighestPrice, tickTolerance, (highContained ? "OK" : "X"), profile_k.LowestPrice, currentBA.LowestPrice, tickTolerance, (lowContained ? "OK" : "X"), (isContained ? "PASS" : "FAIL") ); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-						   if (isContained) { 
-							   extendBA = true; 
-							   extensionReason = "Range Containment"; 
-						   }
-					   } else if (DebugBAFormation) { 
-						   sc.AddMessageToLog("  > Range Containment Check: Skipped (Vol Overlap Passed)", 0); 
-					   }
-
-					   if (!extendBA) {
-						   float currentBARange = currentBA.GetRange();
-						   float baMaxAllowedHigh = CalculateMaxAllowedHigh(currentBA.HighestPrice, currentBARange, HighLowTolerancePercent, TickSize);
-						   float baMinAllowedLow = CalculateMinAllowedLow(currentBA.LowestPrice, currentBARange, HighLowTolerancePercent, TickSize);
-						   geoHighOK_ext = CheckHighPosition(profile_k.HighestPrice, baMaxAllowedHigh); 
-						   geoLowOK_ext = CheckLowPosition(profile_k.LowestPrice, baMinAllowedLow);
-						   bool geometricProximityLiteOK = geoHighOK_ext && geoLowOK_ext;
-						   if (DebugBAFormation) { 
-							   logMsg.Format("  > Geo Prox Lite Check (Tol=%.1f%%): Prof %d H=%.2f vs MaxAllowH=%.2f (%s), L=%.2f vs MinAllowL=%.2f (%s) -> %s", HighLowTolerancePercent, k, profile_k.HighestPrice, baMaxAllowedHigh, (geoHighOK_ext ? "OK" : "FAIL"), profile_k.LowestPrice, baMinAllowedLow, (geoLowOK_ext ? "OK" : "FAIL"), (geometricProximityLiteOK ? "PASS" : "FAIL") ); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-						   if (geometricProximityLiteOK) { 
-							   extendBA = true; 
-							   extensionReason = "Geometric Proximity Lite"; 
-						   }
-					   } else if (DebugBAFormation) { 
-						   sc.AddMessageToLog("  > Geo Prox Lite Check: Skipped (Previous Check Passed)", 0); 
-					   }
-
-					   if (!extendBA && (geoHighOK_ext != geoLowOK_ext)) {
-						   float closePrice = (profile_k.EndIndex >= 0 && profile_k.EndIndex < sc.ArraySize) ? sc.Close[profile_k.EndIndex] : -FLT_MAX;
-						   bool checkPassed = false; 
-						   std::string condCloseFailSide = "";
-						   if (closePrice > -FLT_MAX && currentBA.LowestPrice < FLT_MAX && currentBA.HighestPrice > -FLT_MAX && currentBA.HighestPrice > currentBA.LowestPrice) { // Ensure BA range is valid
-							   if (!geoLowOK_ext && geoHighOK_ext && (closePrice > currentBA.LowestPrice)) { 
-								   checkPassed = true; 
-								   extensionReason = "Close Above BA Low (Low Fail)"; 
-								   condCloseFailSide = "Low"; 
-							   } else if (!geoHighOK_ext && geoLowOK_ext && (closePrice < currentBA.HighestPrice)) { 
-								   checkPassed = true; 
-								   extensionReason = "Close Below BA High (High Fail)"; 
-								   condCloseFailSide = "High"; 
-							   }
-						   }
-						   if (DebugBAFormation) { 
-							   bool closeInRange = (closePrice > -FLT_MAX && closePrice >= currentBA.LowestPrice && closePrice <= currentBA.HighestPrice); 
-							   logMsg.Format("  > Cond. Close Check (Geo %s Fail): Prof %d Close=%.2f. BA Range=[%.2f, %.2f]. Close in Range? %s -> %s", condCloseFailSide.c_str(), k, closePrice, currentBA.LowestPrice, currentBA.HighestPrice, (closeInRange ? "Yes" : "No"), (checkPassed ? "PASS" : "FAIL") ); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-						   if (checkPassed) { 
-							   extendBA = true; 
-						   }
-					   }
-
-					   if (extendBA) {
-						   if (DebugBAFormation) { 
-							   logMsg.Format("DEBUG BA: ---> EXTENDED BA [%d..%d] with Profile %d. Reason: '%s'", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, k, extensionReason.c_str()); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-						   currentBA.IncludedProfileIndices.push_back(k); 
-						   currentBA.EndProfileChronoIndex = k;
-						   currentBA.EndDateTime = profile_k.EndDateTime; 
-						   currentBA.EndBarIndex = profile_k.EndIndex;
-						   profileUsed[k] = true;
-						   mapsToMerge.push_back(std::cref(profile_k.PriceMap));
-						   currentMergedMap = MergeMultipleVolumeProfiles(mapsToMerge);
-						   float tempPOC, tempVAH, tempVAL, tempVolume, mergedHigh, mergedLow;
-						   CalculateProfileMetrics(currentMergedMap, ValueAreaPercentage, sc, tempPOC, tempVAH, tempVAL, mergedHigh, mergedLow, tempVolume);
-						   currentBA.POC = tempPOC; 
-						   currentBA.ValueAreaHigh = tempVAH; 
-						   currentBA.ValueAreaLow = tempVAL; 
-						   currentBA.TotalVolume = tempVolume;
-						   
-						   // Check if the merged BA is still valid after adding profile_k
-						   if (mergedHigh <= -FLT_MAX || mergedLow >= FLT_MAX || mergedHigh < mergedLow) {
-								if (DebugBAFormation) {
-								   logMsg.Format("DEBUG BA: BA extended with %d resulted in invalid merged H/L (%.2f/%.2f). Reverting extension.", k, mergedHigh, mergedLow);
-								   sc.AddMessageToLog(logMsg,0);
-								}
-								profileUsed[k] = false; // Unmark as used as this extension failed
-								currentBA.IncludedProfileIndices.pop_back(); // Remove k
-								currentBA.EndProfileChronoIndex = (currentBA.IncludedProfileIndices.empty() ? -1 : currentBA.IncludedProfileIndices.back()); // Revert to previous last profile
-								if(currentBA.EndProfileChronoIndex != -1) {
-								   currentBA.EndDateTime = SessionProfiles[currentBA.EndProfileChronoIndex].EndDateTime;
-								   currentBA.EndBarIndex = SessionProfiles[currentBA.EndProfileChronoIndex].EndIndex;
-								} else { // Should not happen if BA started with 2 profiles
-								   currentBA.EndDateTime = 0; 
-								   currentBA.EndBarIndex = -1;
-								}
-								mapsToMerge.pop_back(); // Remove profile_k's map from merge list
-								currentMergedMap = MergeMultipleVolumeProfiles(mapsToMerge); // Re-merge without k
-								// Recalculate metrics for the BA without profile_k
-								CalculateProfileMetrics(currentMergedMap, ValueAreaPercentage, sc, currentBA.POC, currentBA.ValueAreaHigh, currentBA.ValueAreaLow, currentBA.HighestPrice, currentBA.LowestPrice, currentBA.TotalVolume);
-								break; // Stop extending with this invalid profile_k
-						   }
-
-						   bool isConditionalClose = (extensionReason == "Close Above BA Low (Low Fail)" || extensionReason == "Close Below BA High (High Fail)");
-						   if (isConditionalClose) {
-							   float tolerance = TickSize / 2.0f;
-							   if (profile_k.HighestPrice > currentBA.HighestPrice + tolerance) {
-								   int exactHighProbeBarIndex = -1;
-								   if (profile_k.BeginIndex >= 0 && profile_k.EndIndex >= profile_k.BeginIndex) {
-									   for (int j_idx = profile_k.BeginIndex; j_idx <= profile_k.EndIndex; ++j_idx) { 
-										   if (j_idx < 0 || j_idx >= sc.ArraySize) continue; 
-										   if (std::fabs(sc.High[j_idx] - profile_k.HighestPrice) < tolerance) { 
-											   exactHighProbeBarIndex = j_idx; 
-											   break; 
-										   } 
-									   }
-								   }
-								   if (exactHighProbeBarIndex != -1) { 
-									   s_ProbeLineDrawingInfo probeInfo = {exactHighProbeBarIndex, profile_k.EndIndex, profile_k.HighestPrice, true}; 
-									   pData->ProbeLinesToDraw.push_back(probeInfo); 
-									   if (DebugBAFormation) sc.AddMessageToLog("    * Probe Detected (High)", 0); 
-								   }
-							   }
-							   if (profile_k.LowestPrice < currentBA.LowestPrice - tolerance) {
-								   int exactLowProbeBarIndex = -1;
-								   if (profile_k.BeginIndex >= 0 && profile_k.EndIndex >= profile_k.BeginIndex) {
-									   for (int j_idx = profile_k.BeginIndex; j_idx <= profile_k.EndIndex; ++j_idx) { 
-										   if (j_idx < 0 || j_idx >= sc.ArraySize) continue; 
-										   if (std::fabs(sc.Low[j_idx] - profile_k.LowestPrice) < tolerance) { 
-											   exactLowProbeBarIndex = j_idx; 
-											   break; 
-										   } 
-									   }
-								   }
-								   if (exactLowProbeBarIndex != -1) { 
-									   s_ProbeLineDrawingInfo probeInfo = {exactLowProbeBarIndex, profile_k.EndIndex, profile_k.LowestPrice, false}; 
-									   pData->ProbeLinesToDraw.push_back(probeInfo); 
-									   if (DebugBAFormation) sc.AddMessageToLog("    * Probe Detected (Low)", 0); 
-								   }
-							   }
-						   } else { // Not a conditional close, update BA H/L with merged H/L
-							   currentBA.HighestPrice = mergedHigh; 
-							   currentBA.LowestPrice = mergedLow;
-						   }
-					   } else {
-						   if (DebugBAFormation) { 
-							   logMsg.Format("DEBUG BA: ---X STOPPED Extension of BA [%d..%d] at Profile %d. No criteria met.", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, k); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-						   break;
-					   }
-				   } // End k loop (extension)
-
-				   bool meetsNormalityCriteria = true;
-				   if (FilterByNormality) {
-					   s_DistributionStats distStats = CalculateVolumeDistributionStats(currentMergedMap, TickSize);
-					   if (!distStats.sufficientData) {
-						   meetsNormalityCriteria = false;
-						   if (DebugBAFormation) { 
-							   logMsg.Format("DEBUG BA: Normality Check for BA [%d..%d]: Insufficient data (Levels w/ Vol: %d). Filter FAILED.", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, distStats.numPriceLevelsWithVolume); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-					   } else {
-						   bool skewOK = std::fabs(distStats.skewness) <= MaxAbsSkewness;
-						   bool kurtOK = distStats.excessKurtosis >= MinExcessKurtosis && distStats.excessKurtosis <= MaxExcessKurtosis;
-						   meetsNormalityCriteria = skewOK && kurtOK;
-						   if (DebugBAFormation) { 
-							   logMsg.Format("DEBUG BA: Normality Check for BA [%d..%d]: Skew=%.2f (AbsLim=%.2f, OK=%d), Kurt=%.2f (Lims=[%.2f,%.2f], OK=%d). Levels=%d, Mean=%.2f, StdD=%.2f. Overall Pass: %d", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, distStats.skewness, MaxAbsSkewness, skewOK, distStats.excessKurtosis, MinExcessKurtosis, MaxExcessKurtosis, kurtOK, distStats.numPriceLevelsWithVolume, distStats.mean, distStats.stdDev, meetsNormalityCriteria); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-					   }
-				   }
+		   // Pair metrics depend only on the two sessions, so they are computed up front in parallel;
+		   // the sequential formation pass below only compares them against the thresholds.
+		   // Pairs seen in an earlier recalculation with the same sessions and VA% are reused from the memo.
+		   std::vector<s_SessionPairMetrics>& pairMetrics = formationRun->PairMetrics;
+		   pairMetrics.assign(std::max(0, numProfilesCollected - 1), s_SessionPairMetrics());
+		   const int firstPairIndex = std::min(formationStartIndex, static_cast<int>(pairMetrics.size()));
+		   std::shared_ptr<const PairMetricsMemo> pairMemo = pData->SharedProfiles->LoadPairMetrics();
+		   PairMetricsMemo updatedPairMemo;
+		   std::vector<int> pairsToCompute;
+		   for (int pairIndex = firstPairIndex; pairIndex < static_cast<int>(pairMetrics.size()); ++pairIndex) {
+			   const s_SessionProfile& profile_i = SessionProfiles[pairIndex];
+			   const s_SessionProfile& profile_i1 = SessionProfiles[pairIndex + 1];
+			   auto it = pairMemo->find(std::make_pair(profile_i.StartDateTime.GetAsDouble(), profile_i1.StartDateTime.GetAsDouble()));
+			   if (it != pairMemo->end() &&
+				   it->second.EndDateTime_i == profile_i.EndDateTime.GetAsDouble() && it->second.EndDateTime_i1 == profile_i1.EndDateTime.GetAsDouble() &&
+				   it->second.TotalVolume_i == profile_i.TotalVolume && it->second.TotalVolume_i1 == profile_i1.TotalVolume &&
+				   it->second.VAPercentage == ValueAreaPercentage && it->second.TickMultiplier == PriceTickMultiplier &&
+				   it->second.OverlapResolution == OverlapResolution) {
+				   pairMetrics[pairIndex] = it->second.Metrics;
+			   } else {
+				   pairsToCompute.push_back(pairIndex);
+			   }
+		   }
+		   pData->WorkerPool->ParallelFor(static_cast<int>(pairsToCompute.size()), [&](int n) {
+			   int pairIndex = pairsToCompute[n];
+			   pairMetrics[pairIndex] = CalculateSessionPairMetrics(SessionProfiles[pairIndex], SessionProfiles[pairIndex + 1], TickSize, OverlapResolution);
+		   });
+		   // Only new or changed pairs are published; the memo grows with the symbol's session history
+		   for (int pairIndex : pairsToCompute) {
+			   const s_SessionProfile& profile_i = SessionProfiles[pairIndex];
+			   const s_SessionProfile& profile_i1 = SessionProfiles[pairIndex + 1];
+			   s_PairMetricsMemoEntry& entry = updatedPairMemo[std::make_pair(profile_i.StartDateTime.GetAsDouble(), profile_i1.StartDateTime.GetAsDouble())];
+			   entry.EndDateTime_i = profile_i.EndDateTime.GetAsDouble();
+			   entry.EndDateTime_i1 = profile_i1.EndDateTime.GetAsDouble();
+			   entry.TotalVolume_i = profile_i.TotalVolume;
+			   entry.TotalVolume_i1 = profile_i1.TotalVolume;
+			   entry.VAPercentage = ValueAreaPercentage;
+			   entry.TickMultiplier = PriceTickMultiplier;
+			   entry.OverlapResolution = OverlapResolution;
+			   entry.Metrics = pairMetrics[pairIndex];
+		   }
+		   pData->SharedProfiles->PublishPairMetrics(updatedPairMemo);
 
-				   if (meetsNormalityCriteria) {
-					   // Final check for valid BA range before adding
-					   if (currentBA.HighestPrice > -FLT_MAX && currentBA.LowestPrice < FLT_MAX && currentBA.HighestPrice >= currentBA.LowestPrice && currentBA.GetRange() >= TickSize / 2.0f) {
-						   pData->FinalizedBalanceAreas.push_back(currentBA);
-						   if (DebugBAFormation) { 
-							   logMsg.Format("DEBUG BA: Finalized BA [%d..%d]. Total Profiles: %d. Range: %.2f-%.2f, VA: %.2f-%.2f, POC: %.2f", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, (int)currentBA.IncludedProfileIndices.size(), currentBA.LowestPrice, currentBA.HighestPrice, currentBA.ValueAreaLow, currentBA.ValueAreaHigh, currentBA.POC); 
-							   sc.AddMessageToLog(logMsg, 0); 
-						   }
-					   } else if (DebugBAFormation) {
-						   logMsg.Format("DEBUG BA: DISCARDED BA (after extension loop) [%d..%d] due to invalid H/L Range: %.2f-%.2f or too small range.", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, currentBA.LowestPrice, currentBA.HighestPrice);
-						   sc.AddMessageToLog(logMsg, 0);
-					   }
-				   } else {
-					   if (DebugBAFormation) { 
-						   logMsg.Format("DEBUG BA: DISCARDED BA [%d..%d] due to failing normality criteria. Total Profiles: %d", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, (int)currentBA.IncludedProfileIndices.size()); 
-						   sc.AddMessageToLog(logMsg, 0); 
-					   }
-				   }
-			   } // End if(startBA)
-		   } // End i loop (initiation)
-// Composite BA Logic (matches original structure)
-       if (pData->FinalizedBalanceAreas.size() >= 3) {
-           if (DebugCompositeBA) sc.AddMessageToLog("--- Starting Composite BA Detection ---", 0);
-           const float compositeOverlapThreshold = 30.0f; 
-           const float shiftMagnitudePercent = 20.0f; 
-           const int temporalGapLimit = 5;
-           std::vector<bool> baAttributed(pData->FinalizedBalanceAreas.size(), false);
-           for (size_t j = 0; j <= pData->FinalizedBalanceAreas.size() - 3; ++j) { // Use size_t for loop, ensure comparison is safe
-               bool skipped = false; 
-               std::string skipReason = "";
-               if (baAttributed[j]) { 
-                   skipped = true; 
-                   skipReason = "BA[" + std::to_string(j) + "] Attributed"; 
-               } else if (baAttributed[j+1]) { 
-                   skipped = true; 
-                   skipReason = "BA[" + std::to_string(j+1) + "] Attributed"; 
-               } else if (baAttributed[j+2]) { 
-                   skipped = true; 
-                   skipReason = "BA[" + std::to_string(j+2) + "] Attributed"; 
-               }
-               if (skipped) { 
-                   if (DebugCompositeBA) { 
-                       logMsg.Format("Comp Check BA[%zu..%zu]: Skipped (Reason: %s)", j, j+2, skipReason.c_str()); 
-                       sc.AddMessageToLog(logMsg, 0); 
-                   } 
-                   continue; 
-               }
+		   if (BackgroundRecalc) {
+			   pData->BackgroundFormation.Start(formationRun, std::make_shared<const std::vector<s_SessionProfile>>(SessionProfiles));
+			   formationRun.reset();
+			   // Composites, probes and activation follow when the run is published
+			   dirtyPhases &= ~(BA_PHASE_PROBES | BA_PHASE_COMPOSITE | BA_PHASE_ACTIVATION);
+		   } else if (RecalcTimeBudget > 0) {
+			   // First slice runs now; the rest continues on later calls (see SlicedFormation above)
+			   pData->SlicedFormation.Start(formationRun, std::make_shared<const std::vector<s_SessionProfile>>(SessionProfiles));
+			   std::shared_ptr<s_BAFormationRun> finishedRun = pData->SlicedFormation.Continue(RecalcTimeBudget);
+			   if (finishedRun) ApplyBAFormationRun(sc, pData, *finishedRun); // Composites included
+			   formationRun.reset();
+			   dirtyPhases &= ~(BA_PHASE_PROBES | BA_PHASE_COMPOSITE | BA_PHASE_ACTIVATION);
+		   } else {
+			   ContinueBAFormation(*formationRun, SessionProfiles, nullptr);
+			   ApplyBAFormationRun(sc, pData, *formationRun);
+		   }
+	   } // End if (BA_PHASE_FORMATION)
+	   else if (dirtyPhases & BA_PHASE_ACTIVATION) {
+		   ResetBAActivationState(pData); // Re-derived below by CheckForBAActivation/UpdateBAExtensions
+		   pData->StateVersion++;
+	   }
 
-               const s_BalanceArea& ba1 = pData->FinalizedBalanceAreas[j];
-               const s_BalanceArea& ba2 = pData->FinalizedBalanceAreas[j+1];
-               const s_BalanceArea& ba3 = pData->FinalizedBalanceAreas[j+2];
-               float overlap_12 = CalculateRangeOverlapPercent_RelativeToSmaller(ba1, ba2, TickSize); 
-               float overlap_13 = CalculateRangeOverlapPercent_RelativeToSmaller(ba1, ba3, TickSize); 
-               float overlap_23 = CalculateRangeOverlapPercent_RelativeToSmaller(ba2, ba3, TickSize);
-               bool hasOverlap_12 = overlap_12 > 0.0f; 
-               bool hasOverlap_13 = overlap_13 > 0.0f; 
-               bool hasOverlap_23 = overlap_23 > 0.0f;
-               bool meetsThreshold_12 = overlap_12 >= compositeOverlapThreshold; 
-               bool meetsThreshold_13 = overlap_13 >= compositeOverlapThreshold; 
-               bool meetsThreshold_23 = overlap_23 >= compositeOverlapThreshold;
-               int numThresholdMet = (meetsThreshold_12 ? 1 : 0) + (meetsThreshold_13 ? 1 : 0) + (meetsThreshold_23 ? 1 : 0);
-               int numAnyOverlap = (hasOverlap_12 ? 1 : 0) + (hasOverlap_13 ? 1 : 0) + (hasOverlap_23 ? 1 : 0);
-               std::string overlapType = "No Overlap"; 
-               if (numThresholdMet == 3) { 
-                   overlapType = "Strong Overlap"; 
-               } else if (numAnyOverlap == 3) { 
-                   overlapType = "Full Overlap"; 
-               } else if (numAnyOverlap == 2) { 
-                   overlapType = "Partial Overlap"; 
-               } else if (numAnyOverlap == 1) { 
-                   overlapType = "1 Overlap"; 
-               }
-               std::string patternType = "None"; 
-               bool is_HLH = false; 
-               bool is_LHL = false;
-               if (ba1.HighestPrice > -FLT_MAX && ba1.LowestPrice < FLT_MAX && ba2.HighestPrice > -FLT_MAX && ba2.LowestPrice < FLT_MAX && ba3.HighestPrice > -FLT_MAX && ba3.LowestPrice < FLT_MAX) {
-                   if ((ba2.HighestPrice < ba1.HighestPrice && ba2.LowestPrice < ba1.LowestPrice) && (ba3.HighestPrice > ba2.HighestPrice && ba3.LowestPrice > ba2.LowestPrice)) { 
-                       is_HLH = true; 
-                       patternType = "HLH"; 
-                   } else if ((ba2.HighestPrice > ba1.HighestPrice && ba2.LowestPrice > ba1.LowestPrice) && (ba3.HighestPrice < ba2.HighestPrice && ba3.LowestPrice < ba2.LowestPrice)) { 
-                       is_LHL = true; 
-                       patternType = "LHL"; 
-                   }
-               }
-               bool containmentPassed = true; 
-               bool shiftMagnitudePassed = true; 
-               bool ba1_ba2_GapCheckPassed = true;
-               std::string containmentResultStr = ""; 
-               std::string shiftResultStr = ""; 
-               std::string ba1_ba2_GapResultStr = "";
-               if (is_HLH || is_LHL) {
-                   containmentPassed = false; 
-                   float referenceRange = std::max(ba1.HighestPrice, ba2.HighestPrice) - std::min(ba1.LowestPrice, ba2.LowestPrice); 
-                   referenceRange = std::max(referenceRange, TickSize); 
-                   float toleranceValue = referenceRange * (RangeContainmentPercent / 100.0f); 
-                   float overshootAmount = 0.0f;
-                   if (is_HLH) { 
-                       float allowedHigh = ba1.HighestPrice + toleranceValue; 
-                       if (ba3.HighestPrice <= allowedHigh) containmentPassed = true; 
-                       else overshootAmount = ba3.HighestPrice - allowedHigh; 
-                   } else { 
-                       float allowedLow = ba1.LowestPrice - toleranceValue; 
-                       if (ba3.LowestPrice >= allowedLow) containmentPassed = true; 
-                       else overshootAmount = allowedLow - ba3.LowestPrice; 
-                   }
-                   if (containmentPassed) { 
-                       containmentResultStr = " (Containment Passed)"; 
-                   } else { 
-                       float overshootPercent = (referenceRange > TickSize / 2.0f) ? (overshootAmount / referenceRange) * 100.0f : 0.0f; 
-                       SCString failDetails; 
-                       failDetails.Format(" (Containment Failed: RefR=%.2f, Over=%.2f (%.1f%%))", referenceRange, overshootAmount, overshootPercent); 
-                       containmentResultStr = failDetails.GetChars(); 
-                   }
-                   shiftMagnitudePassed = false; 
-                   float ba2_range = std::max(ba2.GetRange(), TickSize); 
-                   float shift_threshold_amount = ba2_range * (shiftMagnitudePercent / 100.0f);
-                   if (is_HLH) { 
-                       if ((ba3.HighestPrice > ba2.HighestPrice + shift_threshold_amount) && (ba3.LowestPrice > ba2.LowestPrice + shift_threshold_amount)) { 
-                           shiftMagnitudePassed = true; 
-                       } 
-                   } else { 
-                       if ((ba3.HighestPrice < ba2.HighestPrice - shift_threshold_amount) && (ba3.LowestPrice < ba2.LowestPrice - shift_threshold_amount)) { 
-                           shiftMagnitudePassed = true; 
-                       } 
-                   }
-                   if (shiftMagnitudePassed) { 
-                       shiftResultStr = " (Shift Passed)"; 
-                   } else { 
-                       SCString shiftFailDetails; 
-                       shiftFailDetails.Format(" (Shift Failed: Req=%.2f)", shift_threshold_amount); 
-                       shiftResultStr = shiftFailDetails.GetChars(); 
-                   }
-                   ba1_ba2_GapCheckPassed = false; 
-                   float ba1_range = std::max(ba1.GetRange(), TickSize); // Range of BA1
-                   // Check if BA2 is not "too far" from BA1 relative to BA1's range (simplified gap check)
-                   if (is_HLH) { 
-                       if (ba2.HighestPrice > (ba1.LowestPrice - ba1_range)) ba1_ba2_GapCheckPassed = true;
-                   } else { 
-                       if (ba2.LowestPrice < (ba1.HighestPrice + ba1_range)) ba1_ba2_GapCheckPassed = true; 
-                   }
-                   if (ba1_ba2_GapCheckPassed) { 
-                       ba1_ba2_GapResultStr = " (Gap12 OK)"; 
-                   } else { 
-                       ba1_ba2_GapResultStr = " (Gap12 Failed)"; 
-                   }
-               }
-               int temporalGap = CheckTemporalProximity(ba1, ba3, SessionProfiles, pData->FinalizedBalanceAreas, sc); 
-               bool temporalPassed = (temporalGap != -1 && temporalGap <= temporalGapLimit);
-               std::string temporalGapStdStr = ""; 
-               SCString temporalGapSCStr; 
-               if (temporalGap != -1) { 
-                   temporalGapSCStr.Format(" (TemporalGap=%d)", temporalGap); 
-                   temporalGapStdStr = temporalGapSCStr.GetChars(); 
-               } else { 
-                   temporalGapStdStr = " (TemporalGap Error)"; 
-               }
-               bool qualifiesAsComposite = false; 
-               std::string finalReason = "N/A";
-               if (overlapType == "Strong Overlap") { 
-                   qualifiesAsComposite = true; 
-                   finalReason = "Strong Overlap"; 
-               } else if (overlapType == "Full Overlap" || overlapType == "Partial Overlap") { 
-                   if (is_HLH || is_LHL) { 
-                       if (containmentPassed) { 
-                           if (shiftMagnitudePassed) { 
-                               if (ba1_ba2_GapCheckPassed) { 
-                                   qualifiesAsComposite = true; 
-                                   finalReason = patternType + "+Contain+Shift+Gap12"; 
-                               } else { 
-                                   finalReason = "Gap12 Failed"; 
-                               }
-                           } else { 
-                               finalReason = "Shift Failed"; 
-                           }
-                       } else { 
-                           finalReason = "Containment Failed"; 
-                       }
-                   } else { 
-                       finalReason = "No Pattern"; 
-                   } 
-               } else if (overlapType == "1 Overlap") { 
-                   if (is_HLH || is_LHL) { 
-                       if (containmentPassed) { 
-                           if (shiftMagnitudePassed) { 
-                               if (ba1_ba2_GapCheckPassed) { 
-                                   if (temporalPassed) { 
-                                       qualifiesAsComposite = true; 
-                                       finalReason = patternType + "+Contain+Shift+Gap12+Temporal"; 
-                                   } else { 
-                                       finalReason = "Temporal Gap Too Large"; 
-                                   }
-                               } else { 
-                                   finalReason = "Gap12 Failed"; 
-                               }
-                           } else { 
-                               finalReason = "Shift Failed"; 
-                           }
-                       } else { 
-                           finalReason = "Containment Failed"; 
-                       }
-                   } else { 
-                       finalReason = "No Pattern"; 
-                   } 
-               } else { 
-                   finalReason = "No Overlap"; 
-               }
-               if (qualifiesAsComposite) {
-                   s_CompositeBalanceArea newComposite; 
-                   newComposite.FirstBAIndex = static_cast<int>(j); 
-                   newComposite.SecondBAIndex = static_cast<int>(j + 1); 
-                   newComposite.ThirdBAIndex = static_cast<int>(j + 2);
-                   newComposite.StartDateTime = ba1.StartDateTime; 
-                   newComposite.EndDateTime = ba3.EndDateTime; 
-                   newComposite.StartBarIndex = ba1.StartBarIndex; 
-                   newComposite.EndBarIndex = ba3.EndBarIndex;
-                   newComposite.HighestPrice = std::max({ba1.HighestPrice, ba2.HighestPrice, ba3.HighestPrice}); 
-                   newComposite.LowestPrice = std::min({ba1.LowestPrice, ba2.LowestPrice, ba3.LowestPrice});
-                   if (ba1.LowestPrice >= FLT_MAX || ba2.LowestPrice >= FLT_MAX || ba3.LowestPrice >= FLT_MAX) newComposite.LowestPrice = FLT_MAX;
-                   if (ba1.HighestPrice <= -FLT_MAX || ba2.HighestPrice <= -FLT_MAX || ba3.HighestPrice <= -FLT_MAX) newComposite.HighestPrice = -FLT_MAX;
-                   newComposite.QualificationReason = finalReason; 
-                   pData->CompositeBAs.push_back(newComposite);
-                   baAttributed[j] = true; 
-                   baAttributed[j+1] = true; 
-                   baAttributed[j+2] = true;
-               }
-               if (DebugCompositeBA) { 
-                   SCString detailedChecksStr; 
-                   if (is_HLH || is_LHL) { 
-                       detailedChecksStr.Format("%s%s%s", containmentResultStr.c_str(), shiftResultStr.c_str(), ba1_ba2_GapResultStr.c_str()); 
-                   } 
-                   SCString finalStatusStr; 
-                   if (qualifiesAsComposite) { 
-                       finalStatusStr.Format(" | Result=Qualified (Reason: %s)", finalReason.c_str()); 
-                   } else { 
-                       finalStatusStr.Format(" | Result=Rejected (Reason: %s)", finalReason.c_str()); 
-                   } 
-                   logMsg.Format("Comp Check BA[%zu](%d-%d)/BA[%zu](%d-%d)/BA[%zu](%d-%d): Overlap=%s (%.1f,%.1f,%.1f) Pattern=%s%s%s%s", j, ba1.StartProfileChronoIndex, ba1.EndProfileChronoIndex, j + 1, ba2.StartProfileChronoIndex, ba2.EndProfileChronoIndex, j + 2, ba3.StartProfileChronoIndex, ba3.EndProfileChronoIndex, overlapType.c_str(), overlap_12, overlap_13, overlap_23, patternType.c_str(), detailedChecksStr.GetChars(), temporalGapStdStr.c_str(), finalStatusStr.GetChars()); 
-                   sc.AddMessageToLog(logMsg, 0); 
-               }
-           } // End Composite BA loop (j)
-           if (DebugCompositeBA) sc.AddMessageToLog("--- Finished Composite BA Detection ---", 0);
-       } else if (DebugCompositeBA) { 
-           logMsg.Format("Not enough Finalized BAs (%zu) to perform Composite Check.", pData->FinalizedBalanceAreas.size()); 
-           sc.AddMessageToLog(logMsg, 0); 
-       }
+	   if (dirtyPhases & BA_PHASE_COMPOSITE) {
+       // After a fresh formation, composites restored with the snapshot are kept; otherwise the same BAs get new composite inputs
+       size_t compositeStartIndex = 0;
+       if (formationRun) compositeStartIndex = formationRun->CompositeStartIndex;
+       else pData->CompositeBAs.clear();
+       std::vector<std::string> compositeLog;
+       RunCompositeDetection(SessionProfiles, pData->FinalizedBalanceAreas, formationParams, compositeStartIndex, pData->CompositeBAs, compositeLog);
+       for (const auto& message : compositeLog) sc.AddMessageToLog(message.c_str(), 0);
+       pData->StateVersion++;
+	   } // End if (BA_PHASE_COMPOSITE)
 
+	   if (dirtyPhases & BA_PHASE_DRAWING) {
        // Drawing Formation Phase Rectangles and Labels (Only during recalculation)
        int baDrawCount = 0;
        for (const auto& ba : pData->FinalizedBalanceAreas) {
@@ -1918,17 +4128,192 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
                }
            }
        }
-   } // End if (needRecalculation)
+   } // End if (BA_PHASE_DRAWING)
+
+   // ALWAYS check for activations (every update, not just recalculation). Cuts only depend on activation
+   // points, so extensions are re-checked only after an activation, or once a bar follows a last-bar activation.
+   bool cutCheckDue = pData->CutCheckPending && sc.ArraySize != pData->CutCheckArraySize;
+   if (cutCheckDue) pData->CutCheckPending = false;
+   bool anyActivated = false;
+   if (TickActivation) { // Trades first, so a breakout in the last bar is stamped with its trade rather than the bar
+       s_TradeActivationIndex& triggers = pData->TradeActivation;
+       if (pData->StateVersion != triggers.BuiltVersion && !pData->BackgroundFormation.AwaitingResult && !pData->SlicedFormation.IsActive()) {
+           triggers.Build(pData->FinalizedBalanceAreas, TickSize);
+           triggers.BuiltVersion = pData->StateVersion;
+       }
+       anyActivated = CheckForTradeActivation(sc, pData);
+   } else if (pData->TradeActivation.HasSequence) {
+       pData->TradeActivation.Reset();
+   }
+   anyActivated = CheckForBAActivation(sc, pData, TickSize) || anyActivated;
+   if (anyActivated) pData->StateVersion++;
+   if (anyActivated || cutCheckDue || (dirtyPhases & BA_PHASE_ACTIVATION)) {
+       if (UpdateBAExtensions(sc, pData, TickSize, PBALPierceThreshold)) pData->StateVersion++;
+       pData->CutCheckArraySize = sc.ArraySize;
+   }
+
+   // Persist the state whenever it changed so the next chartbook load can warm start
+   // While a background or sliced run is pending the drawn BAs no longer match the recorded sessions, so wait for it
+   if (UseStateSnapshot && pData->StateVersion != pData->SnapshotVersion && !pData->BackgroundFormation.AwaitingResult && !pData->SlicedFormation.IsActive()) {
+       if (!WriteBAStateSnapshot(sc, pData, stateSnapshotPath)) {
+           logMsg.Format("Warning: Could not write BA state snapshot %s.", stateSnapshotPath.c_str());
+           sc.AddMessageToLog(logMsg, 0);
+       }
+       pData->SnapshotVersion = pData->StateVersion;
+   }
+
+   // Journal the transitions since the last journaled state; the writer thread does the file I/O
+   if (UseEventJournal) {
+       s_EventJournal& journal = pData->EventJournal;
+       if ((!journal.IsRunning() && !journal.WriteFailed.load()) || journal.Fingerprint != pData->StateFingerprint) {
+           journal.Open(sc, BuildEventJournalPath(sc), pData->StateFingerprint);
+       }
+       if (journal.IsRunning() && pData->StateVersion != journal.JournaledVersion && !pData->BackgroundFormation.AwaitingResult && !pData->SlicedFormation.IsActive()) {
+           int events = RecordBAStateTransitions(sc, journal, pData);
+           journal.JournaledVersion = pData->StateVersion;
+           if (events > 0 && DebugBAFormation) {
+               logMsg.Format("DEBUG BA: Journaled %d BA state events.", events);
+               sc.AddMessageToLog(logMsg, 0);
+           }
+       } else {
+           journal.HandOver(); // Events the writer was too busy to take last time
+       }
+       if (journal.WriteFailed.load() && !journal.ReportedFailure) {
+           journal.ReportedFailure = true;
+           logMsg.Format("Warning: Could not write event journal %s.", journal.Path.c_str());
+           sc.AddMessageToLog(logMsg, 0);
+       }
+   } else if (pData->EventJournal.IsRunning()) {
+       pData->EventJournal.Stop();
+   }
+
+   // Stream results that changed since the last export. Only the diff runs here; the writer thread does the file I/O.
+   if (ExportResults) {
+       s_ResultExporter& exporter = pData->ResultExporter;
+       if (!exporter.IsRunning()) exporter.Start(BuildResultExportPath(sc));
+       if (pData->StateVersion != exporter.ExportedVersion && !pData->BackgroundFormation.AwaitingResult && !pData->SlicedFormation.IsActive()) {
+           exporter.Export(pData->FinalizedBalanceAreas, pData->PBALsToDraw, pData->ProbeLinesToDraw, pData->CompositeBAs);
+           exporter.ExportedVersion = pData->StateVersion;
+       } else {
+           exporter.HandOver(); // Batches the writer was too busy to take last time
+       }
+       if (exporter.WriteFailed.load() && !exporter.ReportedFailure) {
+           exporter.ReportedFailure = true;
+           logMsg.Format("Warning: Could not write result export %s.", exporter.BasePath.c_str());
+           sc.AddMessageToLog(logMsg, 0);
+       }
+   } else if (pData->ResultExporter.IsRunning()) {
+       pData->ResultExporter.Stop();
+   }
+
+   // Publish the open levels to the level subgraphs and the shared memory segment, only when they changed
+   if (PublishLevels) {
+       s_LevelPublisher& publisher = pData->LevelPublisher;
+       if (!publisher.IsOpen() && !publisher.OpenFailed && !publisher.Open(BuildLevelSegmentName(sc))) {
+           publisher.OpenFailed = true;
+           logMsg.Format("Warning: Could not create shared memory segment %s for the levels.", publisher.SegmentName.c_str());
+           sc.AddMessageToLog(logMsg, 0);
+       }
+       bool levelsChanged = false;
+       if (pData->StateVersion != publisher.PublishedVersion && !pData->BackgroundFormation.AwaitingResult && !pData->SlicedFormation.IsActive()) {
+           levelsChanged = publisher.Update(pData->ActiveBalanceAreas, pData->PBALsToDraw, pData->ProbeLinesToDraw, sc.BaseDateTimeIn, sc.ArraySize);
+           publisher.PublishedVersion = pData->StateVersion;
+       }
+       FillLevelSubgraphs(sc, publisher, levelsChanged);
+   } else if (pData->LevelPublisher.SubgraphFilledSize > 0) { // Turned off: clear the slots and remove the segment
+       pData->LevelPublisher.Reset();
+       FillLevelSubgraphs(sc, pData->LevelPublisher, false);
+       pData->LevelPublisher.SubgraphFilledSize = 0;
+   }
+
+   // Alert when the last trade crosses a level. A tick only visits the levels between the previous price and
+   // this one; a level counts as crossed once price trades the hysteresis ticks through it.
+   if (LevelAlertNumber > 0 && sc.ArraySize > 0) {
+       s_LevelIndex& levelIndex = pData->LevelIndex;
+       float lastPrice = sc.Close[sc.ArraySize - 1];
+       float hysteresis = (LevelAlertHysteresis - 0.5f) * TickSize; // Half a tick short, so N ticks through always counts
+       if ((pData->StateVersion != levelIndex.IndexedVersion || hysteresis != levelIndex.Hysteresis) && !pData->BackgroundFormation.AwaitingResult && !pData->SlicedFormation.IsActive()) {
+           levelIndex.Update(pData->ActiveBalanceAreas, pData->PBALsToDraw, pData->ProbeLinesToDraw, lastPrice, hysteresis);
+           levelIndex.IndexedVersion = pData->StateVersion;
+       }
+       levelIndex.Advance(lastPrice);
+       if (!sc.IsFullRecalculation) { // Levels found on historical bars are not news
+           for (const s_LevelCrossing& crossing : levelIndex.Crossings) {
+               logMsg.Format("AutoBAs: Price crossed %s %s %.2f", crossing.Direction > 0 ? "above" : "below", LEVEL_TYPE_NAMES[crossing.Level.Type], crossing.Level.Price);
+               sc.SetAlert(LevelAlertNumber, logMsg);
+           }
+       }
+   } else if (pData->LevelIndex.HasPrice) {
+       pData->LevelIndex.Reset();
+   }
+
+   // Fit older sessions into the memory budget and report what stays resident. Live updates that only refreshed
+   // the developing session change neither, so the pass is skipped for them.
+   if (!refreshDevelopingOnly || dirtyPhases != 0 || pData->LastProfileMemoryBudget != ProfileMemoryBudget) {
+       pData->LastProfileMemoryBudget = ProfileMemoryBudget;
+       ApplyProfileMemoryBudget(SessionProfiles, pData->FormationResumeIndex, static_cast<size_t>(ProfileMemoryBudget) * 1024 * 1024, TickSize, PriceTickMultiplier, *pData->SharedProfiles);
+       s_ProfileMemoryUsage memoryUsage = MeasureProfileMemory(SessionProfiles);
+       if (memoryUsage.Bytes != pData->LastReportedProfileBytes) {
+           pData->LastReportedProfileBytes = memoryUsage.Bytes;
+           logMsg.Format("Profile memory: %.1f MB resident for %d sessions (%d exact, %d compact, %d summary only).",
+                         memoryUsage.Bytes / (1024.0 * 1024.0), numProfilesCollected,
+                         memoryUsage.NumSessions[PROFILE_TIER_EXACT], memoryUsage.NumSessions[PROFILE_TIER_COMPACT], memoryUsage.NumSessions[PROFILE_TIER_SUMMARY]);
+           sc.AddMessageToLog(logMsg, 0);
+       }
+   }
 
-   // ALWAYS check for activations and update extensions (every update, not just recalculation)
-   CheckForBAActivation(sc, pData, TickSize);
-   UpdateBAExtensions(sc, pData, TickSize, PBALPierceThreshold);
+   // Batch evaluation of the sweep grid over the loaded sessions. The combinations run on the sweep thread and the
+   // results go to a CSV in the Data folder; the chart thread only copies the inputs and reports when it is done.
+   if (pData->BackgroundSweep.AwaitingResult) {
+       std::shared_ptr<s_SweepReport> report = pData->BackgroundSweep.TakePublished();
+       if (report) {
+           if (report->Written) {
+               logMsg.Format("Parameter sweep: %d combinations over %d sessions in %lld ms, written to %s.", report->Combinations, report->Sessions, report->ElapsedMs, report->Path.c_str());
+           } else {
+               logMsg.Format("Parameter sweep: could not write %s.", report->Path.c_str());
+           }
+           sc.AddMessageToLog(logMsg, 0);
+       }
+   }
+   if (RunSweep) {
+       sc.Input[IN_RUN_PARAMETER_SWEEP].SetYesNo(0);
+       s_BAFormationParams sweepBase = formationParams;
+       sweepBase.DebugBAFormation = false;
+       sweepBase.DebugCompositeBA = false;
+       std::vector<s_BAFormationParams> combinations;
+       std::string gridError;
+       if (!ParseSweepGrid(SweepGrid, sweepBase, combinations, gridError)) {
+           logMsg.Format("Parameter sweep: invalid grid, %s.", gridError.c_str());
+           sc.AddMessageToLog(logMsg, 1);
+       } else if (!SessionProfiles.empty()) {
+           if (pData->BackgroundSweep.AwaitingResult) sc.AddMessageToLog("Parameter sweep: the sweep still running was cancelled and starts again with the current grid.", 0);
+           std::shared_ptr<std::vector<s_SessionProfile>> sweepSessions = std::make_shared<std::vector<s_SessionProfile>>(SessionProfiles);
+           profileCacheMapping.Map();
+           RehydrateSessionProfiles(sc, pData, barProfiles, *sweepSessions, 0, NumberOfSessions, ReferenceStudyID, ValueAreaPercentage, TickSize, PriceTickMultiplier);
+           CaptureSessionBarData(sc.High, sc.Low, sc.Close, sc.ArraySize, *sweepSessions, TickSize);
+           std::shared_ptr<s_SweepBars> sweepBars = std::make_shared<s_SweepBars>();
+           sweepBars->High.assign(sc.ArraySize, 0.0f);
+           sweepBars->Low.assign(sc.ArraySize, 0.0f);
+           for (int barIndex = 0; barIndex < sc.ArraySize; ++barIndex) {
+               sweepBars->High[barIndex] = sc.High[barIndex];
+               sweepBars->Low[barIndex] = sc.Low[barIndex];
+           }
+           std::string sweepPath = BuildStudyFilePrefix(sc) + "_c" + std::to_string(sc.ChartNumber) + "_s" + std::to_string(sc.StudyGraphInstanceID) + "_sweep.csv";
+           logMsg.Format("Parameter sweep: %d combinations over %d sessions started.", static_cast<int>(combinations.size()), numProfilesCollected);
+           pData->BackgroundSweep.Start(pData->WorkerPool, sweepSessions, sweepBars, std::move(combinations), sweepPath);
+           sc.AddMessageToLog(logMsg, 0);
+       }
+   }
 
-   // Force redraw of active BAs if any changes occurred
-   if (DrawActiveBAs) {
+   // Force redraw of active BAs if any changes occurred. User-drawn drawings persist between calls, so in that
+   // mode they are only re-emitted when the activation state changed; ACS drawings are re-added every call.
+   bool redrawActiveBAs = DrawActiveBAs &&
+       (!AllowUserAdjustment || pData->ActiveDrawnVersion != pData->StateVersion || (dirtyPhases & BA_PHASE_DRAWING));
+   if (redrawActiveBAs) pData->ActiveDrawnVersion = pData->StateVersion;
+   if (redrawActiveBAs) {
        // Delete existing active BA drawings to redraw with updated endpoints
        for (const auto& activeBa : pData->ActiveBalanceAreas) {
-           int extLineNum = 50000 + activeBa.StartProfileChronoIndex * 100 + activeBa.EndProfileChronoIndex;
+           int extLineNum = ActiveBALineNumber(activeBa);
            if (AllowUserAdjustment) {
                sc.DeleteUserDrawnACSDrawing(sc.ChartNumber, extLineNum);
            } else {
@@ -1938,7 +4323,7 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
        
        // Delete existing PBAL drawings to redraw
        for (const auto& pbal : pData->PBALsToDraw) {
-           int pbalLineNum = 60000 + pbal.OriginStartProfileIndex * 100 + pbal.OriginEndProfileIndex + (pbal.IsHigh ? 50 : 0);
+           int pbalLineNum = PBALLineNumber(pbal);
            if (AllowUserAdjustment) {
                sc.DeleteUserDrawnACSDrawing(sc.ChartNumber, pbalLineNum);
            } else {
@@ -1948,7 +4333,7 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
    }
 
     // ALWAYS draw active BA rectangles (extending or cut) - if enabled
-    if (DrawActiveBAs) {
+    if (redrawActiveBAs) {
         for (const auto& activeBa : pData->ActiveBalanceAreas) {
             if (activeBa.ActivationBarIndex < 0) continue;
         
@@ -1981,7 +4366,7 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
         }
         
         // Use unique line number based on original BA indices
-        activeRect.LineNumber = 50000 + activeBa.StartProfileChronoIndex * 100 + activeBa.EndProfileChronoIndex;
+        activeRect.LineNumber = ActiveBALineNumber(activeBa);
         
         sc.UseTool(activeRect);
        
@@ -2023,7 +4408,7 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
    }
    
     // Draw PBAL rays
-    if (DrawActiveBAs) {
+    if (redrawActiveBAs) {
         for (const auto& pbal : pData->PBALsToDraw) {
             if (pbal.StartBarIndex < 0 || pbal.StartBarIndex >= sc.ArraySize) continue;
             
@@ -2053,7 +4438,7 @@ SCSFExport scsf_BalanceAreaDetection(SCStudyInterfaceRef sc) {
             }
             
             // Use unique line number
-            pbalRay.LineNumber = 60000 + pbal.OriginStartProfileIndex * 100 + pbal.OriginEndProfileIndex + (pbal.IsHigh ? 50 : 0);
+            pbalRay.LineNumber = PBALLineNumber(pbal);
             
             sc.UseTool(pbalRay);
         }
@@ -0,0 +1,2188 @@
+// AutoBAs core: session profiles and their metrics, BA formation, activation and cut rules, the worker pool and
+// the parameter sweep. Shared by the study (AutoBAs.cpp) and the offline tools (offline/), so nothing here calls
+// sc. The only ACSIL types it uses are SCDateTime and SCString: the study gets them from sierrachart.h and the
+// offline tools from offline/ScHostTypes.h, included before this file. Functions are defined in this header,
+// so a program includes it from exactly one translation unit, as Sierra Chart does with the study.
+#pragma once
+#include <vector>
+#include <algorithm> // For std::max/std::min, std::sort
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <cmath>     // For std::fabs, std::sqrt, std::pow
+#include <cfloat>    // For FLT_MAX, FLT_MIN
+#include <climits>   // For INT_MAX, INT_MIN
+#include <string>    // For std::to_string, std::string
+#include <functional> // For std::reference_wrapper
+#include <numeric>   // For std::accumulate
+#include <cstdint>   // For fixed-width types in the profile cache file
+#include <cstdio>    // For FILE* (sweep results)
+#include <cstdlib>   // For std::strtof (parameter sweep grid)
+#include <thread>    // For the worker pool
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>    // For std::shared_ptr
+#include <chrono>
+
+// --- Data Structures ---
+struct s_PriceLevelVolume { 
+    float Price = 0.0f;
+    float TotalVolume = 0.0f; 
+    int NumberOfTrades = 0; 
+};
+
+using PriceVolumeMap = std::unordered_map<float, s_PriceLevelVolume>;
+
+// NEW: Volume-weighted central moment sums of a price distribution. Sums of separate profiles combine
+// exactly (pairwise update), so a BA's moments come from its sessions' without re-scanning merged levels.
+struct s_MomentSums {
+    double Weight = 0.0;
+    double Mean = 0.0;
+    double M2 = 0.0;
+    double M3 = 0.0;
+    double M4 = 0.0;
+};
+
+// NEW: Dense per-tick volume histogram of a session (index = tick - BaseTick)
+struct s_DenseProfile {
+    int BaseTick = 0;
+    std::vector<float> Volume;
+    float TotalVolume = 0.0f;
+    bool IsValid() const { return !Volume.empty(); }
+};
+
+// NEW: Coarser aggregations of a dense profile, for coarse-to-fine volume overlap screening
+const int PROFILE_PYRAMID_LEVELS = 3;
+const int PROFILE_PYRAMID_FACTORS[PROFILE_PYRAMID_LEVELS] = { 2, 4, 16 }; // Ticks per bin
+
+struct s_PyramidLevel {
+    s_DenseProfile Bins;              // Volume per bin (BaseTick = first bin); TotalVolume as in the dense profile
+    std::vector<float> MaxTickVolume; // Largest single-tick volume in each bin
+};
+
+struct s_ProfilePyramid {
+    s_PyramidLevel Levels[PROFILE_PYRAMID_LEVELS]; // Same order as PROFILE_PYRAMID_FACTORS
+    bool IsValid() const { return Levels[0].Bins.IsValid(); }
+};
+
+// NEW: How much of a session's levels is kept in memory (see ApplyProfileMemoryBudget)
+enum e_ProfileTier {
+    PROFILE_TIER_EXACT   = 0, // Price map and dense histogram
+    PROFILE_TIER_COMPACT = 1, // Tick deltas and 16-bit volumes relative to the largest level. Lossy: trade counts are
+                              // dropped and a decoded session's Dense/Pyramid come from quantized volumes, so formation
+                              // re-run over it (a cold run, a sweep) can differ from formation over the exact session
+    PROFILE_TIER_SUMMARY = 2  // Metrics and moment sums only
+};
+
+// NEW: A session's volume levels and everything derived from them alone. Immutable once built, so it is
+// shared between study calls, background runs and every AutoBAs instance on the same symbol.
+struct s_SessionVolumeData {
+    PriceVolumeMap PriceMap;
+    float POC = 0.0f;
+    float ValueAreaHigh = 0.0f;
+    float ValueAreaLow = 0.0f;
+    float TotalVolume = 0.0f;
+    float HighestPrice = -FLT_MAX;
+    float LowestPrice = FLT_MAX;
+    s_MomentSums Moments;
+    int NumPriceLevelsWithVolume = 0;
+    s_DenseProfile Dense;
+    s_ProfilePyramid Pyramid;
+
+    // NEW: Storage tier. PriceMap, Dense and Pyramid are only filled for exact data; the metrics above always are.
+    int Tier = PROFILE_TIER_EXACT;
+    int CompactBaseTick = 0;                 // First level, in VbP ticks (tick size x multiplier)
+    float CompactVolumeStep = 0.0f;          // Volume of one quantization step
+    std::vector<uint16_t> CompactTickDeltas; // Ticks from the previous level (0 for the first)
+    std::vector<uint16_t> CompactVolumes;    // Volume in quantization steps, at least 1
+
+    bool IsEmpty() const { return Tier == PROFILE_TIER_EXACT && PriceMap.empty(); }
+};
+
+const std::shared_ptr<const s_SessionVolumeData>& EmptySessionVolumeData() {
+    static const std::shared_ptr<const s_SessionVolumeData> empty = std::make_shared<const s_SessionVolumeData>();
+    return empty;
+}
+
+struct s_SessionProfile { 
+    SCDateTime StartDateTime; 
+    SCDateTime EndDateTime; 
+    int BeginIndex; 
+    int EndIndex; 
+    float POC = 0.0f; 
+    float ValueAreaHigh = 0.0f;
+    float ValueAreaLow = 0.0f; 
+    float TotalVolume = 0.0f; 
+    float HighestPrice = -FLT_MAX; 
+    float LowestPrice = FLT_MAX; 
+    int ChronologicalIndex = -1; 
+    
+    // NEW: Levels, moments and dense histogram; shared, never null
+    std::shared_ptr<const s_SessionVolumeData> Data = EmptySessionVolumeData();
+
+    // NEW: Bar data formation needs, captured at load so formation can run without sc
+    float ClosePrice = -FLT_MAX;    // Close of the session's last bar
+    int HighBarIndex = -1;          // First bar touching HighestPrice
+    int LowBarIndex = -1;           // First bar touching LowestPrice
+    
+    float GetRange() const { 
+        if (HighestPrice <= -FLT_MAX || LowestPrice >= FLT_MAX || HighestPrice < LowestPrice) return 0.0f;
+        return HighestPrice - LowestPrice; 
+    } 
+};
+
+// Enhanced Balance Area struct with activation tracking
+struct s_BalanceArea {
+    int StartProfileChronoIndex = -1;
+    int EndProfileChronoIndex = -1;
+    SCDateTime StartDateTime;
+    SCDateTime EndDateTime;
+    int StartBarIndex = -1;
+    int EndBarIndex = -1;
+    float POC = 0.0f;
+    float ValueAreaHigh = 0.0f;
+    float ValueAreaLow = 0.0f;
+    float HighestPrice = -FLT_MAX;
+    float LowestPrice = FLT_MAX;
+    float TotalVolume = 0.0f;
+    std::vector<int> IncludedProfileIndices;
+    std::string InitiationReason = "N/A";
+    
+    // NEW: Activation tracking
+    bool IsActivated = false;
+    SCDateTime ActivationDateTime;
+    int ActivationBarIndex = -1;
+    float ActivationPrice = 0.0f;
+    SCDateTime ActivationTradeDateTime; // NEW: Time of the activating trade (Tick-Level Activation), unset if found from bars
+    std::string ActivationType = ""; // "Break_High", "Break_Low"
+    bool ActivatedHigh = false;     // True if activated by breaking VA High
+    bool ActivatedLow = false;      // True if activated by breaking VA Low
+    int ActivationCheckedBarIndex = -1; // NEW: Breakout scan covered bars up to here (the last one may still be forming)
+    
+    // NEW: Extension tracking for intersections
+    bool IsExtending = false;       // True when using extending rectangle
+    int ExtensionEndIndex = -1;     // Where extension ends (due to intersection or chart end)
+    std::string ExtensionEndReason = ""; // "Chart_End", "BA_Intersection", "Manual_Cutoff"
+	bool WasCut = false;            // True when extension was cut by intersection
+    int CutByStartProfileIndex = -1; // Identity of the BA that cut this one (profile chrono indices)
+    int CutByEndProfileIndex = -1;
+    
+    float GetRange() const {
+        if (HighestPrice <= -FLT_MAX || LowestPrice >= FLT_MAX || HighestPrice < LowestPrice) return 0.0f;
+        return HighestPrice - LowestPrice;
+    }
+};
+
+struct s_ProbeLineDrawingInfo { 
+    int StartBarIndex = -1; 
+    int EndBarIndexOfProfile = -1;
+    float Price = 0.0f; 
+    bool IsHighProbe = false; 
+    int BAStartProfileIndex = -1;   // Start profile of the BA attempt that produced the probe
+};
+
+// PBAL struct
+struct s_PBALDrawingInfo {
+    int StartBarIndex = -1;
+    int EndBarIndex = -1;           // Chart end or cut point
+    float Price = 0.0f;
+    bool IsHigh = false;            // true for PBAH, false for PBAL
+    SCString OriginLabel;           // Original orange BA label
+    std::string EndReason = "Chart_End"; // "Chart_End" or "Intersection"
+    int OriginStartProfileIndex = -1;
+    int OriginEndProfileIndex = -1;
+    bool WasCut = false;
+};
+
+// Composite BA Struct
+struct s_CompositeBalanceArea {
+    int FirstBAIndex = -1;
+    int SecondBAIndex = -1; 
+    int ThirdBAIndex = -1;
+    SCDateTime StartDateTime; 
+    SCDateTime EndDateTime; 
+    int StartBarIndex = -1; 
+    int EndBarIndex = -1;
+    float HighestPrice = -FLT_MAX; 
+    float LowestPrice = FLT_MAX;
+    std::string QualificationReason = "N/A";
+    
+    float GetRange() const { 
+        if (HighestPrice <= -FLT_MAX || LowestPrice >= FLT_MAX || HighestPrice < LowestPrice) return 0.0f;
+        return HighestPrice - LowestPrice; 
+    }
+};
+
+// NEW: Struct for Distribution Statistics
+struct s_DistributionStats {
+    float mean = 0.0f;
+    float stdDev = 0.0f;
+    float skewness = 0.0f;
+    float excessKurtosis = 0.0f; // Kurtosis - 3
+    bool sufficientData = false;
+    int numPriceLevelsWithVolume = 0;
+};
+
+// NEW: On-disk session profile cache (one file per symbol and tick multiplier)
+// Layout: s_ProfileCacheHeader, SessionCount x s_ProfileCacheIndexEntry (sorted by StartDateTime),
+// then per session a dense array of s_ProfileCacheLevel indexed by (PriceInTicks - BaseTick).
+const uint32_t PROFILE_CACHE_MAGIC = 0x43504241; // "ABPC"
+const uint32_t PROFILE_CACHE_VERSION = 1;
+const uint32_t PROFILE_CACHE_MAX_LEVELS = 1000000; // Sanity cap on a single session's dense tick span
+
+#pragma pack(push, 1)
+struct s_ProfileCacheHeader {
+    uint32_t Magic = PROFILE_CACHE_MAGIC;
+    uint32_t Version = PROFILE_CACHE_VERSION;
+    float TickSize = 0.0f;
+    int32_t TickMultiplier = 1;
+    uint32_t SessionCount = 0;
+    uint32_t Reserved = 0;
+};
+
+struct s_ProfileCacheIndexEntry {
+    double StartDateTime = 0.0;
+    double EndDateTime = 0.0;
+    int32_t BaseTick = 0;      // Lowest PriceInTicks with volume
+    uint32_t NumLevels = 0;    // Dense span from BaseTick
+    uint64_t LevelOffset = 0;  // Byte offset of the level array from the start of the file
+};
+
+struct s_ProfileCacheLevel {
+    uint32_t Volume = 0;
+    uint32_t NumberOfTrades = 0;
+};
+#pragma pack(pop)
+
+int FloorDiv(int value, int divisor) {
+   return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+// NEW: Threshold-independent initiation metrics for an adjacent session pair (i, i+1)
+struct s_SessionPairMetrics {
+    bool IsValid = false;          // Both sessions have a usable high/low
+    float VolumeOverlap = 0.0f;    // Percent
+    float VAOverlap = 0.0f;        // Percent
+    float RangeDiffPercent = 0.0f; // Percent of average range
+};
+
+// NEW: Memoized pair metrics, keyed by the pair's session start times and validated against
+// everything else the metrics depend on, so threshold-only changes skip the histogram work
+struct s_PairMetricsMemoEntry {
+    double EndDateTime_i = 0.0;
+    double EndDateTime_i1 = 0.0;
+    float TotalVolume_i = 0.0f;     // Changes while a session is still developing
+    float TotalVolume_i1 = 0.0f;
+    float VAPercentage = 0.0f;
+    int TickMultiplier = 0;
+    int OverlapResolution = 0;
+    s_SessionPairMetrics Metrics;
+};
+typedef std::map<std::pair<double, double>, s_PairMetricsMemoEntry> PairMetricsMemo;
+
+// NEW: Inputs formation and composite detection depend on, captured once per run
+struct s_BAFormationParams {
+    float TickSize = 0.0f;
+    float ValueAreaPercentage = 0.0f;
+    float MinVolOverlap = 0.0f;
+    float MinVAOverlap = 0.0f;
+    float RangeSimilarityPercent = 0.0f;
+    float HighLowTolerancePercent = 0.0f;
+    float RangeContainmentPercent = 0.0f;
+    bool FilterByNormality = false;
+    float MaxAbsSkewness = 0.0f;
+    float MinExcessKurtosis = 0.0f;
+    float MaxExcessKurtosis = 0.0f;
+    int OverlapResolution = 1; // Ticks per bin for volume overlap (1 = exact, else a pyramid factor)
+    bool DebugBAFormation = false;
+    bool DebugCompositeBA = false;
+};
+
+// NEW: Output of a formation run; moved into the persistent data when the run is applied
+struct s_BAFormationResult {
+    std::vector<s_BalanceArea> FinalizedBalanceAreas;
+    std::vector<s_ProbeLineDrawingInfo> ProbeLinesToDraw;
+    std::vector<s_CompositeBalanceArea> CompositeBAs;
+    std::vector<bool> FormationProfileUsed;
+    int FormationResumeIndex = 0;
+    std::vector<std::string> LogMessages;  // Debug output, written to the message log on the study thread
+};
+
+// NEW: A formation run in progress. Everything the run reads is owned here, so it can continue
+// on another thread (or on a later study call) while the chart keeps the previous result.
+struct s_BAFormationRun {
+    s_BAFormationParams Params;
+    std::vector<s_SessionPairMetrics> PairMetrics;
+    int NextProfileIndex = 0;             // Next initiation candidate
+    size_t CompositeStartIndex = 0;       // Composites of earlier triples were restored with the BAs
+    bool ResetActivationOnApply = false;  // Run started from scratch while an older result was published
+    bool IsComplete = false;              // Formation and composites done; until then Result is partial
+    s_BAFormationResult Result;
+};
+
+// NEW: Fixed-size worker pool for data-parallel loops. The calling thread takes part in every ParallelFor,
+// so a pool with zero workers simply runs the loop serially.
+struct s_WorkerPool {
+    std::vector<std::thread> Threads;
+    std::mutex CallerMutex;                 // One ParallelFor at a time; other callers run theirs serially
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkDone;
+    std::function<void(int)> Job;
+    std::atomic<int> NextIndex{0};
+    int JobCount = 0;
+    int ActiveWorkers = 0;
+    unsigned int Generation = 0;
+    bool Stopping = false;
+
+    ~s_WorkerPool() { Stop(); }
+
+    int GetNumThreads() const { return static_cast<int>(Threads.size()); }
+
+    // Resizes the pool; requestedThreads <= 0 selects one worker per additional hardware thread
+    void EnsureThreads(int requestedThreads) {
+        int numWorkers = requestedThreads > 0 ? requestedThreads - 1 : static_cast<int>(std::thread::hardware_concurrency()) - 1;
+        numWorkers = std::max(0, std::min(numWorkers, 63));
+        if (numWorkers == GetNumThreads()) return;
+        Stop();
+        Stopping = false;
+        for (int t = 0; t < numWorkers; ++t) Threads.emplace_back([this]() { WorkerLoop(); });
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Stopping = true;
+        }
+        WorkAvailable.notify_all();
+        for (auto& thread : Threads) thread.join();
+        Threads.clear();
+    }
+
+    void RunIndices() {
+        for (;;) {
+            int index = NextIndex.fetch_add(1);
+            if (index >= JobCount) break;
+            Job(index);
+        }
+    }
+
+    void WorkerLoop() {
+        std::unique_lock<std::mutex> lock(Mutex);
+        unsigned int seenGeneration = Generation; // Threads started after a job must not pick it up
+        for (;;) {
+            WorkAvailable.wait(lock, [&]() { return Stopping || Generation != seenGeneration; });
+            if (Stopping) return;
+            seenGeneration = Generation;
+            ActiveWorkers++;
+            lock.unlock();
+            RunIndices();
+            lock.lock();
+            if (--ActiveWorkers == 0) WorkDone.notify_all();
+        }
+    }
+
+    // Runs job(0..count-1) across the pool and returns when every index has completed. The job is only
+    // referenced, not copied, so handing it to the workers does not allocate.
+    template <typename JobT>
+    void ParallelFor(int count, const JobT& job) {
+        std::unique_lock<std::mutex> caller(CallerMutex, std::defer_lock);
+        if (Threads.empty() || count < 2 || !caller.try_lock()) {
+            for (int i = 0; i < count; ++i) job(i);
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(Mutex);
+            WorkDone.wait(lock, [&]() { return ActiveWorkers == 0; }); // Late wakers from a previous job
+            Job = std::cref(job);
+            JobCount = count;
+            NextIndex.store(0);
+            Generation++;
+        }
+        WorkAvailable.notify_all();
+        RunIndices();
+        std::unique_lock<std::mutex> lock(Mutex);
+        WorkDone.wait(lock, [&]() { return ActiveWorkers == 0; });
+        Job = nullptr; // Drops the reference to the caller's job
+    }
+};
+
+// --- Scratch Arena ---
+// NEW: Per-thread bump allocator for temporaries that die within a study call or a worker task. A scope
+// rewinds it on exit and keeps its blocks, so once warmed up a call reuses the same memory instead of the heap.
+// Scratch containers must not outlive their scope and must only grow on the thread that created them.
+const size_t SCRATCH_ARENA_FIRST_BLOCK = 64 * 1024;
+const size_t SCRATCH_ARENA_MAX_RETAINED = 8 * 1024 * 1024; // A full recalculation may use more; the excess is freed
+
+struct s_ScratchArena {
+    std::vector<std::unique_ptr<char[]>> Blocks;
+    std::vector<size_t> BlockSizes;
+    size_t BlockIndex = 0; // Block currently allocated from
+    size_t Offset = 0;     // First free byte in it
+    int ScopeDepth = 0;
+
+    void* Allocate(size_t bytes, size_t alignment) {
+        for (;;) {
+            if (BlockIndex < Blocks.size()) {
+                uintptr_t base = reinterpret_cast<uintptr_t>(Blocks[BlockIndex].get());
+                size_t aligned = static_cast<size_t>(((base + Offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base);
+                if (aligned + bytes <= BlockSizes[BlockIndex]) {
+                    Offset = aligned + bytes;
+                    return Blocks[BlockIndex].get() + aligned;
+                }
+                if (BlockIndex + 1 < Blocks.size()) {
+                    BlockIndex++;
+                    Offset = 0;
+                    continue;
+                }
+            }
+            size_t size = std::max(bytes + alignment, Blocks.empty() ? SCRATCH_ARENA_FIRST_BLOCK : BlockSizes.back() * 2);
+            Blocks.emplace_back(new char[size]);
+            BlockSizes.push_back(size);
+            BlockIndex = Blocks.size() - 1;
+            Offset = 0;
+        }
+    }
+
+    // Outermost scope ended: fold the blocks into one so the next call of the same size fits without growing
+    void Reset() {
+        if (Blocks.size() > 1) {
+            size_t total = std::min(std::accumulate(BlockSizes.begin(), BlockSizes.end(), size_t(0)), SCRATCH_ARENA_MAX_RETAINED);
+            Blocks.clear();
+            BlockSizes.clear();
+            Blocks.emplace_back(new char[total]);
+            BlockSizes.push_back(total);
+        } else if (!Blocks.empty() && BlockSizes[0] > SCRATCH_ARENA_MAX_RETAINED) {
+            Blocks.clear();
+            BlockSizes.clear();
+        }
+        BlockIndex = 0;
+        Offset = 0;
+    }
+};
+
+s_ScratchArena& GetScratchArena() {
+    thread_local s_ScratchArena arena;
+    return arena;
+}
+
+// Everything allocated from the thread's arena while the scope is alive is released when it ends
+struct s_ScratchScope {
+    s_ScratchArena& Arena;
+    size_t SavedBlockIndex;
+    size_t SavedOffset;
+
+    s_ScratchScope() : Arena(GetScratchArena()), SavedBlockIndex(Arena.BlockIndex), SavedOffset(Arena.Offset) { Arena.ScopeDepth++; }
+    ~s_ScratchScope() {
+        if (--Arena.ScopeDepth == 0) {
+            Arena.Reset();
+        } else {
+            Arena.BlockIndex = SavedBlockIndex;
+            Arena.Offset = SavedOffset;
+        }
+    }
+    s_ScratchScope(const s_ScratchScope&) = delete;
+    s_ScratchScope& operator=(const s_ScratchScope&) = delete;
+};
+
+template <typename T>
+struct s_ScratchAllocator {
+    typedef T value_type;
+    s_ScratchArena* Arena;
+
+    s_ScratchAllocator() : Arena(&GetScratchArena()) {}
+    template <typename U> s_ScratchAllocator(const s_ScratchAllocator<U>& other) : Arena(other.Arena) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(Arena->Allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {} // Reclaimed when the enclosing scope ends
+
+    template <typename U> bool operator==(const s_ScratchAllocator<U>& other) const { return Arena == other.Arena; }
+    template <typename U> bool operator!=(const s_ScratchAllocator<U>& other) const { return Arena != other.Arena; }
+};
+
+template <typename T>
+using ScratchVector = std::vector<T, s_ScratchAllocator<T>>;
+
+// --- Calculation Functions ---
+
+// Returns true if the price was not in the map yet
+bool AddPriceLevelVolume(PriceVolumeMap& priceMap, float price, float volume, int numberOfTrades) {
+    auto it = priceMap.find(price);
+    if (it != priceMap.end()) {
+        it->second.TotalVolume += volume;
+        it->second.NumberOfTrades += numberOfTrades;
+        return false;
+    } else {
+        s_PriceLevelVolume plv;
+        plv.Price = price;
+        plv.TotalVolume = volume;
+        plv.NumberOfTrades = numberOfTrades;
+        priceMap[price] = plv;
+        return true;
+    }
+}
+
+// NEW: Moment sums of the levels with volume in a price map
+s_MomentSums CalculateMomentSums(const PriceVolumeMap& priceMap) {
+   s_MomentSums moments;
+   for (const auto& pair : priceMap) {
+       if (pair.second.TotalVolume > 0.00001f) {
+           moments.Weight += pair.second.TotalVolume;
+           moments.Mean += static_cast<double>(pair.first) * pair.second.TotalVolume;
+       }
+   }
+   if (moments.Weight <= 0.00001) return s_MomentSums();
+   moments.Mean /= moments.Weight;
+   for (const auto& pair : priceMap) {
+       if (pair.second.TotalVolume > 0.00001f) {
+           double diff = static_cast<double>(pair.first) - moments.Mean;
+           double diff2 = diff * diff;
+           moments.M2 += pair.second.TotalVolume * diff2;
+           moments.M3 += pair.second.TotalVolume * diff2 * diff;
+           moments.M4 += pair.second.TotalVolume * diff2 * diff2;
+       }
+   }
+   return moments;
+}
+
+// NEW: Folds b into a as if both distributions had been one
+void CombineMomentSums(s_MomentSums& a, const s_MomentSums& b) {
+   if (b.Weight <= 0.0) return;
+   if (a.Weight <= 0.0) { a = b; return; }
+   double nA = a.Weight;
+   double nB = b.Weight;
+   double n = nA + nB;
+   double delta = b.Mean - a.Mean;
+   double delta2 = delta * delta;
+   double m4 = a.M4 + b.M4 + delta2 * delta2 * nA * nB * (nA * nA - nA * nB + nB * nB) / (n * n * n)
+             + 6.0 * delta2 * (nA * nA * b.M2 + nB * nB * a.M2) / (n * n) + 4.0 * delta * (nA * b.M3 - nB * a.M3) / n;
+   double m3 = a.M3 + b.M3 + delta2 * delta * nA * nB * (nA - nB) / (n * n) + 3.0 * delta * (nA * b.M2 - nB * a.M2) / n;
+   a.M2 = a.M2 + b.M2 + delta2 * nA * nB / n;
+   a.M3 = m3;
+   a.M4 = m4;
+   a.Mean = a.Mean + delta * nB / n;
+   a.Weight = n;
+}
+
+int CountPriceLevelsWithVolume(const PriceVolumeMap& priceMap) {
+   int count = 0;
+   for (const auto& pair : priceMap) {
+       if (pair.second.TotalVolume > 0.00001f) count++;
+   }
+   return count;
+}
+
+// NEW: Skewness/kurtosis from moment sums. numPriceLevelsWithVolume gates the higher moments (need >= 3 levels).
+s_DistributionStats DistributionStatsFromMoments(const s_MomentSums& moments, int numPriceLevelsWithVolume, float tickSize) {
+   s_DistributionStats stats;
+   stats.numPriceLevelsWithVolume = numPriceLevelsWithVolume;
+   if (numPriceLevelsWithVolume == 0 || moments.Weight <= 0.00001) {
+       stats.sufficientData = false;
+       return stats;
+   }
+   stats.mean = static_cast<float>(moments.Mean);
+   stats.stdDev = (numPriceLevelsWithVolume > 1) ? std::sqrt(static_cast<float>(moments.M2 / moments.Weight)) : 0.0f;
+
+   if (numPriceLevelsWithVolume < 3) { // Need at least 3 distinct price levels for meaningful skew/kurtosis
+       stats.sufficientData = false;
+       return stats;
+   }
+
+   // If standard deviation is very small, higher moments are numerically unstable or profile is too spike-like.
+   // Treat as a very peaked distribution (high kurtosis) and zero skewness.
+   if (stats.stdDev < (tickSize / 100.0f)) { // Adjusted threshold: e.g. 1% of a tick
+       stats.skewness = 0.0f;
+       stats.excessKurtosis = 10.0f; // Arbitrary high value for extreme peakedness
+       stats.sufficientData = true; // It's "sufficient" in the sense that it's a spike, higher moments are just defined this way.
+       return stats;
+   }
+
+   double stdDev = stats.stdDev;
+   double stdDev2 = stdDev * stdDev;
+   stats.skewness = static_cast<float>(moments.M3 / moments.Weight / (stdDev2 * stdDev));
+   float rawKurtosis = static_cast<float>(moments.M4 / moments.Weight / (stdDev2 * stdDev2));
+   stats.excessKurtosis = rawKurtosis - 3.0f;
+   stats.sufficientData = true;
+   return stats;
+}
+
+// NEW: Function to Calculate Volume Distribution Statistics
+s_DistributionStats CalculateVolumeDistributionStats(const PriceVolumeMap& priceMap, float tickSize) {
+   return DistributionStatsFromMoments(CalculateMomentSums(priceMap), CountPriceLevelsWithVolume(priceMap), tickSize);
+}
+
+float CalculateVolumeProfileOverlap(const PriceVolumeMap& profile1, const PriceVolumeMap& profile2) { 
+   if (profile1.empty() || profile2.empty()) return 0.0f;
+   float overlapVolume = 0.0f;
+   float map1TotalVolume = 0.0f; 
+   for(const auto& p : profile1) map1TotalVolume += p.second.TotalVolume;
+   float map2TotalVolume = 0.0f; 
+   for(const auto& p : profile2) map2TotalVolume += p.second.TotalVolume;
+
+   if (map1TotalVolume <= 0.0f && map2TotalVolume <= 0.0f) return 0.0f; // if both profiles are empty of volume.
+
+   std::set<float> allPrices;
+   for (const auto& pair : profile1) allPrices.insert(pair.first);
+   for (const auto& pair : profile2) allPrices.insert(pair.first);
+
+   for (float price : allPrices) {
+       float vol1 = (profile1.count(price)) ? profile1.at(price).TotalVolume : 0.0f;
+       float vol2 = (profile2.count(price)) ? profile2.at(price).TotalVolume : 0.0f;
+       overlapVolume += std::min(vol1, vol2);
+   }
+   float unionVolume = map1TotalVolume + map2TotalVolume - overlapVolume;
+   return (unionVolume > 0.00001f) ? (overlapVolume / unionVolume) * 100.0f : 0.0f;
+}
+
+// NEW: Same measure as CalculateVolumeProfileOverlap, as a linear walk over two dense histograms
+float CalculateDenseVolumeOverlap(const s_DenseProfile& profile1, const s_DenseProfile& profile2) {
+   if (!profile1.IsValid() || !profile2.IsValid()) return 0.0f;
+   if (profile1.TotalVolume <= 0.0f && profile2.TotalVolume <= 0.0f) return 0.0f;
+   int firstTick = std::max(profile1.BaseTick, profile2.BaseTick);
+   int endTick = std::min(profile1.BaseTick + static_cast<int>(profile1.Volume.size()), profile2.BaseTick + static_cast<int>(profile2.Volume.size()));
+   float overlapVolume = 0.0f;
+   for (int tick = firstTick; tick < endTick; ++tick) {
+       overlapVolume += std::min(profile1.Volume[tick - profile1.BaseTick], profile2.Volume[tick - profile2.BaseTick]);
+   }
+   float unionVolume = profile1.TotalVolume + profile2.TotalVolume - overlapVolume;
+   return (unionVolume > 0.00001f) ? (overlapVolume / unionVolume) * 100.0f : 0.0f;
+}
+
+const int DENSE_PROFILE_MAX_TICKS = 1000000;
+
+// NEW: Fills pyramid from dense, reusing its storage
+void FillProfilePyramid(const s_DenseProfile& dense, s_ProfilePyramid& pyramid) {
+   for (int level = 0; level < PROFILE_PYRAMID_LEVELS; ++level) {
+       const int factor = PROFILE_PYRAMID_FACTORS[level];
+       s_PyramidLevel& out = pyramid.Levels[level];
+       out.Bins.BaseTick = 0;
+       out.Bins.Volume.clear();
+       out.Bins.TotalVolume = dense.TotalVolume;
+       out.MaxTickVolume.clear();
+       if (!dense.IsValid()) continue;
+       const int firstBin = FloorDiv(dense.BaseTick, factor);
+       const int lastBin = FloorDiv(dense.BaseTick + static_cast<int>(dense.Volume.size()) - 1, factor);
+       out.Bins.BaseTick = firstBin;
+       out.Bins.Volume.assign(static_cast<size_t>(lastBin - firstBin + 1), 0.0f);
+       out.MaxTickVolume.assign(out.Bins.Volume.size(), 0.0f);
+       for (size_t n = 0; n < dense.Volume.size(); ++n) {
+           int bin = FloorDiv(dense.BaseTick + static_cast<int>(n), factor) - firstBin;
+           out.Bins.Volume[bin] += dense.Volume[n];
+           out.MaxTickVolume[bin] = std::max(out.MaxTickVolume[bin], dense.Volume[n]);
+       }
+   }
+}
+
+// NEW: The histogram volume overlap is measured on at a given resolution (1 = the dense profile itself)
+const s_DenseProfile& DenseAtResolution(const s_DenseProfile& dense, const s_ProfilePyramid& pyramid, int resolution) {
+   for (int level = 0; level < PROFILE_PYRAMID_LEVELS; ++level) {
+       if (PROFILE_PYRAMID_FACTORS[level] == resolution && pyramid.IsValid()) return pyramid.Levels[level].Bins;
+   }
+   return dense;
+}
+
+float VolumeOverlapPercent(float overlapVolume, float totalVolume1, float totalVolume2) {
+   float unionVolume = totalVolume1 + totalVolume2 - overlapVolume;
+   return (unionVolume > 0.00001f) ? (overlapVolume / unionVolume) * 100.0f : 0.0f;
+}
+
+// NEW: Bounds on the tick-level overlap volume from one pyramid level. Taking min() per bin can only over-count,
+// and inside a bin two profiles overlap by at least both volumes minus factor x the largest single tick.
+void PyramidOverlapBounds(const s_PyramidLevel& level1, const s_PyramidLevel& level2, int factor, float& lowerVolume, float& upperVolume) {
+   lowerVolume = 0.0f;
+   upperVolume = 0.0f;
+   int firstBin = std::max(level1.Bins.BaseTick, level2.Bins.BaseTick);
+   int endBin = std::min(level1.Bins.BaseTick + static_cast<int>(level1.Bins.Volume.size()), level2.Bins.BaseTick + static_cast<int>(level2.Bins.Volume.size()));
+   for (int bin = firstBin; bin < endBin; ++bin) {
+       const int n1 = bin - level1.Bins.BaseTick;
+       const int n2 = bin - level2.Bins.BaseTick;
+       const float volume1 = level1.Bins.Volume[n1];
+       const float volume2 = level2.Bins.Volume[n2];
+       upperVolume += std::min(volume1, volume2);
+       lowerVolume += std::max(0.0f, volume1 + volume2 - factor * std::max(level1.MaxTickVolume[n1], level2.MaxTickVolume[n2]));
+   }
+}
+
+// Keeps float rounding in the bounds from deciding a pair that sits on the threshold
+const float OVERLAP_SCREEN_MARGIN = 0.01f;
+
+// NEW: Whether the tick-level volume overlap of two dense profiles reaches thresholdPercent. Pyramid bounds settle
+// clear passes and fails from the coarsest level down; only borderline pairs are compared tick by tick.
+bool DenseVolumeOverlapAtLeast(const s_DenseProfile& profile1, const s_ProfilePyramid& pyramid1, const s_DenseProfile& profile2, const s_ProfilePyramid& pyramid2, float thresholdPercent) {
+   if (pyramid1.IsValid() && pyramid2.IsValid() && (profile1.TotalVolume > 0.0f || profile2.TotalVolume > 0.0f)) {
+       for (int level = PROFILE_PYRAMID_LEVELS - 1; level >= 0; --level) {
+           float lowerVolume, upperVolume;
+           PyramidOverlapBounds(pyramid1.Levels[level], pyramid2.Levels[level], PROFILE_PYRAMID_FACTORS[level], lowerVolume, upperVolume);
+           if (VolumeOverlapPercent(upperVolume, profile1.TotalVolume, profile2.TotalVolume) < thresholdPercent - OVERLAP_SCREEN_MARGIN) return false;
+           if (VolumeOverlapPercent(lowerVolume, profile1.TotalVolume, profile2.TotalVolume) >= thresholdPercent + OVERLAP_SCREEN_MARGIN) return true;
+       }
+   }
+   return CalculateDenseVolumeOverlap(profile1, profile2) >= thresholdPercent;
+}
+
+// NEW: Adds one histogram to a merged one, widening it as needed. The merge becomes invalid (callers fall back
+// to the price maps) if either side is invalid or the merged span gets too wide.
+void AddDenseProfileInto(s_DenseProfile& merged, const s_DenseProfile& profile) {
+   if (!merged.IsValid() || !profile.IsValid()) {
+       merged.Volume.clear();
+       merged.TotalVolume = 0.0f;
+       return;
+   }
+   const int mergedEnd = merged.BaseTick + static_cast<int>(merged.Volume.size());
+   const int firstTick = std::min(merged.BaseTick, profile.BaseTick);
+   const int endTick = std::max(mergedEnd, profile.BaseTick + static_cast<int>(profile.Volume.size()));
+   if (static_cast<int64_t>(endTick) - firstTick > DENSE_PROFILE_MAX_TICKS) {
+       merged.Volume.clear();
+       merged.TotalVolume = 0.0f;
+       return;
+   }
+   if (firstTick < merged.BaseTick) merged.Volume.insert(merged.Volume.begin(), static_cast<size_t>(merged.BaseTick - firstTick), 0.0f);
+   merged.Volume.resize(static_cast<size_t>(endTick - firstTick), 0.0f);
+   merged.BaseTick = firstTick;
+   for (size_t n = 0; n < profile.Volume.size(); ++n) merged.Volume[profile.BaseTick - firstTick + n] += profile.Volume[n];
+   merged.TotalVolume += profile.TotalVolume;
+}
+
+// NEW: Fills dense from priceMap, reusing its storage
+void FillDenseProfile(const PriceVolumeMap& priceMap, float tickSize, s_DenseProfile& dense) {
+   dense.BaseTick = 0;
+   dense.Volume.clear();
+   dense.TotalVolume = 0.0f;
+   if (priceMap.empty() || tickSize <= 0.0f) return;
+   int minTick = INT_MAX;
+   int maxTick = INT_MIN;
+   for (const auto& pair : priceMap) {
+       int tick = static_cast<int>(std::lround(pair.first / tickSize));
+       minTick = std::min(minTick, tick);
+       maxTick = std::max(maxTick, tick);
+   }
+   if (static_cast<int64_t>(maxTick) - minTick + 1 > DENSE_PROFILE_MAX_TICKS) return;
+   dense.BaseTick = minTick;
+   dense.Volume.assign(static_cast<size_t>(maxTick - minTick + 1), 0.0f);
+   for (const auto& pair : priceMap) {
+       int tick = static_cast<int>(std::lround(pair.first / tickSize));
+       dense.Volume[tick - minTick] += pair.second.TotalVolume;
+       dense.TotalVolume += pair.second.TotalVolume;
+   }
+}
+
+float CalculateValueAreaOverlap(float VAH1, float VAL1, float VAH2, float VAL2, float TickSize) { 
+   if (VAH1 < VAL1 || VAH2 < VAL2) return 0.0f;
+   float vaRange1 = VAH1 - VAL1; 
+   float vaRange2 = VAH2 - VAL2;
+   // If both ranges are effectively zero (single price level VA), consider 100% overlap if they are the same, 0% otherwise.
+   if (vaRange1 < TickSize / 2.0f && vaRange2 < TickSize / 2.0f) {
+       return (std::fabs(VAL1 - VAL2) < TickSize / 2.0f) ? 100.0f : 0.0f;
+   }
+   // If one range is zero and the other is not, no meaningful overlap.
+   if (vaRange1 < TickSize / 2.0f || vaRange2 < TickSize / 2.0f) return 0.0f;
+
+   float overlapStart = std::max(VAL1, VAL2);
+   float overlapEnd = std::min(VAH1, VAH2);
+   if (overlapStart >= overlapEnd - TickSize / 2.0f) return 0.0f; // No overlap or too small
+   float overlapLength = overlapEnd - overlapStart;
+   float unionStart = std::min(VAL1, VAL2); 
+   float unionEnd = std::max(VAH1, VAH2);
+   float unionLength = unionEnd - unionStart;
+   if (unionLength < TickSize / 2.0f) return 0.0f; // Union is too small
+   return (overlapLength / unionLength) * 100.0f;
+}
+
+float CalculateRangeSimilarityDiff(const s_SessionProfile& profileN, const s_SessionProfile& profileN1, float tickSize) { 
+   float rangeN = profileN.GetRange(); 
+   float rangeN1 = profileN1.GetRange();
+   if (rangeN <= tickSize / 2.0f && rangeN1 <= tickSize / 2.0f) return 0.0f; // Both effectively zero range
+   if (rangeN <= tickSize / 2.0f || rangeN1 <= tickSize / 2.0f) return 200.0f; // One is zero range, max difference
+   float avgRange = (rangeN + rangeN1) / 2.0f; 
+   if (avgRange <= 0.00001f) return 200.0f; // Avoid division by zero
+   return std::fabs(rangeN - rangeN1) / avgRange * 100.0f; 
+}
+
+bool CheckRangeSimilarity(float diffPercent, float thresholdPercent) { 
+   return diffPercent <= thresholdPercent;
+}
+
+float CalculateMaxAllowedHigh(float referenceHigh, float referenceRange, float tolerancePercent, float tickSize) { 
+   float rangeForTol = std::max(referenceRange, tickSize); // Ensure at least 1 tick for tolerance base
+   float toleranceValue = rangeForTol * (tolerancePercent / 100.0f); 
+   return referenceHigh + toleranceValue;
+}
+
+bool CheckHighPosition(float profileHigh, float maxAllowedHigh) { 
+   if (maxAllowedHigh <= -FLT_MAX) return false; 
+   return profileHigh <= maxAllowedHigh;
+}
+
+float CalculateMinAllowedLow(float referenceLow, float referenceRange, float tolerancePercent, float tickSize) { 
+   float rangeForTol = std::max(referenceRange, tickSize); // Ensure at least 1 tick for tolerance base
+   float toleranceValue = rangeForTol * (tolerancePercent / 100.0f); 
+   return referenceLow - toleranceValue;
+}
+
+bool CheckLowPosition(float profileLow, float minAllowedLow) { 
+   if (minAllowedLow >= FLT_MAX) return false; 
+   return profileLow >= minAllowedLow;
+}
+
+bool HasValidHighLow(const s_SessionProfile& profile) {
+    return !(profile.HighestPrice <= -FLT_MAX || profile.LowestPrice >= FLT_MAX || profile.HighestPrice < profile.LowestPrice);
+}
+
+s_SessionPairMetrics CalculateSessionPairMetrics(const s_SessionProfile& profile_i, const s_SessionProfile& profile_i1, float tickSize, int overlapResolution) {
+    s_SessionPairMetrics metrics;
+    if (!HasValidHighLow(profile_i) || !HasValidHighLow(profile_i1)) return metrics;
+    metrics.IsValid = true;
+    const s_SessionVolumeData& data_i = *profile_i.Data;
+    const s_SessionVolumeData& data_i1 = *profile_i1.Data;
+    metrics.VolumeOverlap = (data_i.Dense.IsValid() && data_i1.Dense.IsValid())
+        ? CalculateDenseVolumeOverlap(DenseAtResolution(data_i.Dense, data_i.Pyramid, overlapResolution), DenseAtResolution(data_i1.Dense, data_i1.Pyramid, overlapResolution))
+        : CalculateVolumeProfileOverlap(data_i.PriceMap, data_i1.PriceMap);
+    metrics.VAOverlap = CalculateValueAreaOverlap(profile_i.ValueAreaHigh, profile_i.ValueAreaLow, profile_i1.ValueAreaHigh, profile_i1.ValueAreaLow, tickSize);
+    metrics.RangeDiffPercent = CalculateRangeSimilarityDiff(profile_i, profile_i1, tickSize);
+    return metrics;
+}
+
+// NEW: Adds one profile's levels to a merged profile. Merging map by map gives the same sums as
+// MergeMultipleVolumeProfiles over the whole list, so a growing BA extends its merged map in place.
+void MergeVolumeProfileInto(PriceVolumeMap& mergedProfile, const PriceVolumeMap& profileMap) {
+   for (const auto& pairB : profileMap) {
+       const float price = pairB.first;
+       const s_PriceLevelVolume& volumeDataB = pairB.second;
+       auto it = mergedProfile.find(price);
+       if (it != mergedProfile.end()) {
+           it->second.TotalVolume += volumeDataB.TotalVolume;
+           it->second.NumberOfTrades += volumeDataB.NumberOfTrades;
+       } else {
+           mergedProfile[price] = volumeDataB;
+       }
+   }
+}
+
+PriceVolumeMap MergeMultipleVolumeProfiles(const std::vector<std::reference_wrapper<const PriceVolumeMap>>& profileMapsToMerge) {
+   PriceVolumeMap mergedProfile;
+   if (profileMapsToMerge.empty()) return mergedProfile;
+   for(const auto& profileMapRef : profileMapsToMerge) {
+       MergeVolumeProfileInto(mergedProfile, profileMapRef.get());
+   }
+   return mergedProfile;
+}
+
+void CalculateProfileMetrics(const PriceVolumeMap& priceMap, float valueAreaPercentage, float tickSize, float& poc, float& valueAreaHigh, float& valueAreaLow, float& highestPrice, float& lowestPrice, float& totalVolume) { 
+   poc = 0.0f;
+   valueAreaHigh = 0.0f; 
+   valueAreaLow = 0.0f; 
+   highestPrice = -FLT_MAX; 
+   lowestPrice = FLT_MAX; 
+   totalVolume = 0.0f; 
+   if (priceMap.empty()) return;
+   
+   float maxVolumeAtPOC = 0.0f; 
+   s_ScratchScope scratch; // Sorted levels only live for this call
+   ScratchVector<std::pair<float, float>> priceVolPairs; 
+   priceVolPairs.reserve(priceMap.size()); 
+   for (const auto& pair : priceMap) { 
+       const float price = pair.first;
+       const float volume = pair.second.TotalVolume; 
+       if (volume > 0.00001f) { 
+           totalVolume += volume; 
+           priceVolPairs.push_back({price, volume});
+           if (volume > maxVolumeAtPOC) { 
+               maxVolumeAtPOC = volume; 
+               poc = price;
+           } else if (std::fabs(volume - maxVolumeAtPOC) < 0.00001f && price > poc) { 
+               poc = price; // Higher POC if volume is effectively same
+           } 
+           if (price > highestPrice) highestPrice = price; 
+           if (price < lowestPrice) lowestPrice = price;
+       } 
+   } 
+   
+   if (totalVolume <= 0.00001f || priceVolPairs.empty()) {
+       // If no volume, try to set H/L from map keys if they exist.
+       bool first = true;
+       if (!priceMap.empty()) {
+           for(const auto& pair : priceMap) { // This loop runs only if priceMap is not empty.
+               if (first) { 
+                   highestPrice = pair.first; 
+                   lowestPrice = pair.first; 
+                   first = false; 
+               } else { 
+                   if(pair.first > highestPrice) highestPrice = pair.first; 
+                   if(pair.first < lowestPrice) lowestPrice = pair.first; 
+               }
+           }
+       }
+       if(highestPrice > -FLT_MAX && lowestPrice < FLT_MAX && highestPrice >= lowestPrice) { // Check if any valid H/L was found
+           valueAreaHigh = highestPrice; 
+           valueAreaLow = lowestPrice;
+           poc = lowestPrice + (highestPrice - lowestPrice) / 2.0f; // Midpoint as POC
+       } else { // Reset if still invalid
+           highestPrice = -FLT_MAX; 
+           lowestPrice = FLT_MAX; 
+           poc = 0.0f; 
+           valueAreaHigh = 0.0f; 
+           valueAreaLow = 0.0f;
+       }
+       return;
+   } 
+   
+   std::sort(priceVolPairs.begin(), priceVolPairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; }); 
+   size_t pocIndex = 0;
+   bool pocFoundInSortedList = false; 
+   for (size_t i = 0; i < priceVolPairs.size(); ++i) { 
+       if (std::fabs(priceVolPairs[i].first - poc) < tickSize / 2.0f) { 
+           pocIndex = i; 
+           pocFoundInSortedList = true; 
+           break; 
+       } 
+   }
+   
+   if (!pocFoundInSortedList && !priceVolPairs.empty()) { // Fallback if POC from initial scan wasn't in list (e.g. float precision issues)
+       maxVolumeAtPOC = 0.0f; 
+       pocIndex = 0; 
+       poc = priceVolPairs[0].first;
+       for(size_t i = 0; i < priceVolPairs.size(); ++i) {
+           if (priceVolPairs[i].second > maxVolumeAtPOC) { 
+               maxVolumeAtPOC = priceVolPairs[i].second; 
+               pocIndex = i; 
+               poc = priceVolPairs[i].first; 
+           } else if (std::fabs(priceVolPairs[i].second - maxVolumeAtPOC) < 0.00001f && priceVolPairs[i].first > poc) { 
+               pocIndex = i; 
+               poc = priceVolPairs[i].first;
+           }
+       }
+   } else if (priceVolPairs.empty()) return; // Should be caught by totalVolume check
+   
+   float targetVolume = totalVolume * (valueAreaPercentage / 100.0f); 
+   float currentVolumeInVA = 0.0f;
+   if (pocIndex < priceVolPairs.size()) { // Ensure pocIndex is valid before accessing
+       currentVolumeInVA = priceVolPairs[pocIndex].second;
+   } else if (!priceVolPairs.empty()) { // If pocIndex somehow invalid, default to first element
+       pocIndex = 0; 
+       currentVolumeInVA = priceVolPairs[pocIndex].second; 
+       poc = priceVolPairs[pocIndex].first;
+   } else return; // No data to process
+   
+   valueAreaHigh = poc; 
+   valueAreaLow = poc; 
+   size_t upperIndex = pocIndex; 
+   size_t lowerIndex = pocIndex;
+   
+   while (currentVolumeInVA < targetVolume) { 
+       bool canGoHigher = (upperIndex + 1 < priceVolPairs.size()); 
+       bool canGoLower = (lowerIndex > 0);
+       if (!canGoHigher && !canGoLower) break; 
+       float higherVol = canGoHigher ? priceVolPairs[upperIndex + 1].second : 0.0f; 
+       float lowerVol = canGoLower ? priceVolPairs[lowerIndex - 1].second : 0.0f;
+       
+       if (canGoHigher && canGoLower && higherVol > 0.00001f && std::fabs(higherVol - lowerVol) < 0.00001f) { 
+           currentVolumeInVA += (higherVol + lowerVol); 
+           valueAreaHigh = priceVolPairs[upperIndex + 1].first; 
+           valueAreaLow = priceVolPairs[lowerIndex - 1].first; 
+           upperIndex++; 
+           lowerIndex--;
+       } else if (canGoHigher && (!canGoLower || higherVol >= lowerVol)) { 
+           if(higherVol > 0.00001f) {
+               currentVolumeInVA += higherVol; 
+               valueAreaHigh = priceVolPairs[upperIndex + 1].first;
+           } 
+           upperIndex++;
+       } else if (canGoLower) { 
+           if(lowerVol > 0.00001f) {
+               currentVolumeInVA += lowerVol; 
+               valueAreaLow = priceVolPairs[lowerIndex - 1].first;
+           } 
+           lowerIndex--; 
+       } else break;
+       
+       if (lowerIndex > upperIndex && (lowerIndex !=0 || upperIndex != priceVolPairs.size()-1) ) break; 
+   } 
+}
+
+// NEW: Everything about a session that only depends on its own levels; safe to run on a worker thread.
+// Existing prices are zeroed and re-accumulated instead of cleared, so refilling the developing session
+// keeps its map nodes and histogram storage. Returns the number of prices added to the map.
+int FillSessionVolumeData(s_SessionVolumeData& data, const s_PriceLevelVolume* levels, size_t numLevels, float valueAreaPercentage, float tickSize) {
+   for (auto& pair : data.PriceMap) {
+       pair.second.TotalVolume = 0.0f;
+       pair.second.NumberOfTrades = 0;
+   }
+   int addedPrices = 0;
+   for (size_t levelIndex = 0; levelIndex < numLevels; ++levelIndex) {
+       const s_PriceLevelVolume& level = levels[levelIndex];
+       if (AddPriceLevelVolume(data.PriceMap, level.Price, level.TotalVolume, level.NumberOfTrades)) addedPrices++;
+   }
+   for (auto it = data.PriceMap.begin(); it != data.PriceMap.end();) { // Staged levels always carry volume
+       if (it->second.TotalVolume == 0.0f && it->second.NumberOfTrades == 0) it = data.PriceMap.erase(it);
+       else ++it;
+   }
+   // An empty map resets every metric; the chart-bar fallback for H/L happens on the study thread
+   CalculateProfileMetrics(data.PriceMap, valueAreaPercentage, tickSize, data.POC, data.ValueAreaHigh, data.ValueAreaLow, data.HighestPrice, data.LowestPrice, data.TotalVolume);
+   data.Moments = CalculateMomentSums(data.PriceMap);
+   data.NumPriceLevelsWithVolume = CountPriceLevelsWithVolume(data.PriceMap);
+   FillDenseProfile(data.PriceMap, tickSize, data.Dense);
+   FillProfilePyramid(data.Dense, data.Pyramid);
+   return addedPrices;
+}
+
+std::shared_ptr<const s_SessionVolumeData> BuildSessionVolumeData(const s_PriceLevelVolume* levels, size_t numLevels, float valueAreaPercentage, float tickSize) {
+   std::shared_ptr<s_SessionVolumeData> data = std::make_shared<s_SessionVolumeData>();
+   data->PriceMap.reserve(numLevels);
+   FillSessionVolumeData(*data, levels, numLevels, valueAreaPercentage, tickSize);
+   return data;
+}
+
+void AssignSessionVolumeData(s_SessionProfile& sessionProfile, const std::shared_ptr<const s_SessionVolumeData>& data) {
+   sessionProfile.Data = data;
+   if (data->IsEmpty()) return;
+   sessionProfile.POC = data->POC;
+   sessionProfile.ValueAreaHigh = data->ValueAreaHigh;
+   sessionProfile.ValueAreaLow = data->ValueAreaLow;
+   sessionProfile.TotalVolume = data->TotalVolume;
+   sessionProfile.HighestPrice = data->HighestPrice;
+   sessionProfile.LowestPrice = data->LowestPrice;
+}
+
+// NEW: Function to check for BA activation
+// Returns true if any BA was activated during this call
+// NEW: Back to a BA that has not activated
+void ClearBAActivation(s_BalanceArea& ba) {
+   ba.IsActivated = false;
+   ba.ActivationDateTime = SCDateTime();
+   ba.ActivationBarIndex = -1;
+   ba.ActivationPrice = 0.0f;
+   ba.ActivationTradeDateTime = SCDateTime();
+   ba.ActivationType = "";
+   ba.ActivatedHigh = false;
+   ba.ActivatedLow = false;
+   ba.ActivationCheckedBarIndex = -1;
+   ba.IsExtending = false;
+   ba.ExtensionEndIndex = -1;
+   ba.ExtensionEndReason = "";
+   ba.WasCut = false;
+   ba.CutByStartProfileIndex = -1;
+   ba.CutByEndProfileIndex = -1;
+}
+
+// NEW: Bar data the formation pass reads instead of the sc arrays (close of the last bar, first bar at the high/low)
+template <typename ArrayT>
+void CaptureSessionBarData(ArrayT& high, ArrayT& low, ArrayT& close, int arraySize, std::vector<s_SessionProfile>& SessionProfiles, float TickSize) {
+   float tolerance = TickSize / 2.0f;
+   for (auto& profile : SessionProfiles) {
+       profile.ClosePrice = (profile.EndIndex >= 0 && profile.EndIndex < arraySize) ? close[profile.EndIndex] : -FLT_MAX;
+       profile.HighBarIndex = -1;
+       profile.LowBarIndex = -1;
+       if (profile.BeginIndex < 0 || profile.EndIndex < profile.BeginIndex) continue;
+       for (int barIndex = profile.BeginIndex; barIndex <= profile.EndIndex && barIndex < arraySize; ++barIndex) {
+           if (profile.HighBarIndex < 0 && std::fabs(high[barIndex] - profile.HighestPrice) < tolerance) profile.HighBarIndex = barIndex;
+           if (profile.LowBarIndex < 0 && std::fabs(low[barIndex] - profile.LowestPrice) < tolerance) profile.LowBarIndex = barIndex;
+           if (profile.HighBarIndex >= 0 && profile.LowBarIndex >= 0) break;
+       }
+   }
+}
+
+// NEW: First bar from startIndex (and after the BA's formation) that trades outside its value area, or -1.
+// Templated on the bar arrays so the study (sc.High/sc.Low) and the parameter sweep (captured copies) share the rule.
+template <typename ArrayT>
+int FindBAActivationBar(const s_BalanceArea& ba, ArrayT& high, ArrayT& low, int startIndex, int arraySize, float TickSize, bool& breakHigh) {
+   float tolerance = TickSize / 2.0f;
+   for (int i = std::max(ba.EndBarIndex + 1, startIndex); i < arraySize; ++i) {
+       if (high[i] > ba.ValueAreaHigh + tolerance) { breakHigh = true; return i; }
+       if (low[i] < ba.ValueAreaLow - tolerance) { breakHigh = false; return i; }
+   }
+   return -1;
+}
+
+// NEW: The BA (finalized, or active and later in activeBAs) whose value area intersects activeBa's and that
+// activated earliest after it. Returns nullptr if none activates before cutBarIndex, which is updated otherwise.
+const s_BalanceArea* FindBACut(const s_BalanceArea& activeBa, size_t activeIndex, const std::vector<s_BalanceArea>& finalizedBAs, const std::vector<s_BalanceArea>& activeBAs, float TickSize, int& cutBarIndex) {
+   const s_BalanceArea* intersectingBA = nullptr;
+   auto consider = [&](const s_BalanceArea& laterBa) {
+       if (laterBa.ActivationBarIndex <= activeBa.ActivationBarIndex || laterBa.ActivationBarIndex >= cutBarIndex) return;
+       float overlapStart = std::max(activeBa.ValueAreaLow, laterBa.ValueAreaLow);
+       float overlapEnd = std::min(activeBa.ValueAreaHigh, laterBa.ValueAreaHigh);
+       if (overlapEnd > overlapStart + TickSize / 2.0f) {
+           cutBarIndex = laterBa.ActivationBarIndex;
+           intersectingBA = &laterBa;
+       }
+   };
+   // Finalized BAs activated after this one, then later active BAs
+   for (const auto& newBa : finalizedBAs) {
+       if (newBa.IsActivated) consider(newBa);
+   }
+   for (size_t j = activeIndex + 1; j < activeBAs.size(); ++j) consider(activeBAs[j]);
+   return intersectingBA;
+}
+
+// NEW: Which value area edges of the cut BA pierce beyond the intersecting BA's range by the threshold
+void FindPBALPierces(const s_BalanceArea& cutBA, const s_BalanceArea& intersectingBA, float pierceThresholdPercent, bool& createHighPBAL, bool& createLowPBAL) {
+    createHighPBAL = false;
+    createLowPBAL = false;
+    float orangeBARange = cutBA.ValueAreaHigh - cutBA.ValueAreaLow;
+    if (orangeBARange <= 0.0f) return;
+    
+    float pierceThreshold = orangeBARange * (pierceThresholdPercent / 100.0f);
+    
+    // Check if orange BA's VALUE AREA HIGH pierces ABOVE the intersecting blue BA's ENTIRE RANGE HIGH by threshold
+    createHighPBAL = (cutBA.ValueAreaHigh > intersectingBA.HighestPrice + pierceThreshold);
+    
+    // Check if orange BA's VALUE AREA LOW pierces BELOW the intersecting blue BA's ENTIRE RANGE LOW by threshold  
+    createLowPBAL = (cutBA.ValueAreaLow < intersectingBA.LowestPrice - pierceThreshold);
+}
+
+// NEW: PBAH (high ray, at the VA high) or PBAL (low ray) left by a cut BA, labelled with the BA's origin
+s_PBALDrawingInfo MakePBALDrawingInfo(const s_BalanceArea& cutBA, bool isHigh, int endBarIndex) {
+    s_PBALDrawingInfo pbal;
+    pbal.StartBarIndex = cutBA.ActivationBarIndex;
+    pbal.EndBarIndex = endBarIndex;
+    pbal.Price = isHigh ? cutBA.ValueAreaHigh : cutBA.ValueAreaLow;
+    pbal.IsHigh = isHigh;
+    pbal.EndReason = "Chart_End";
+    pbal.OriginStartProfileIndex = cutBA.StartProfileChronoIndex;
+    pbal.OriginEndProfileIndex = cutBA.EndProfileChronoIndex;
+    
+    // Create origin label
+    SCString dateStr;
+    if (!cutBA.StartDateTime.IsUnset()) {
+        int year = cutBA.StartDateTime.GetYear();
+        int month = cutBA.StartDateTime.GetMonth();
+        int day = cutBA.StartDateTime.GetDay();
+        dateStr.Format("%02d-%02d-%02d", month, day, year % 100);
+    } else {
+        dateStr = "N/A";
+    }
+    float volumeInMillions = cutBA.TotalVolume / 1000000.0f;
+    int sessionCount = (int)cutBA.IncludedProfileIndices.size();
+    pbal.OriginLabel.Format("%s %s %.2fM %dD", isHigh ? "PBAH" : "PBAL", dateStr.GetChars(), volumeInMillions, sessionCount);
+    return pbal;
+}
+
+float CalculateRangeOverlapPercent_RelativeToSmaller(const s_BalanceArea& ba1, const s_BalanceArea& ba2, float TickSize) { 
+   if (ba1.HighestPrice <= -FLT_MAX || ba1.LowestPrice >= FLT_MAX || ba1.HighestPrice < ba1.LowestPrice || ba2.HighestPrice <= -FLT_MAX || ba2.LowestPrice >= FLT_MAX || ba2.HighestPrice < ba2.LowestPrice) return 0.0f;
+   float overlapStart = std::max(ba1.LowestPrice, ba2.LowestPrice); 
+   float overlapEnd = std::min(ba1.HighestPrice, ba2.HighestPrice); 
+   float intersectionLength = overlapEnd - overlapStart;
+   float tickTolerance = TickSize / 2.0f; 
+   if (intersectionLength < tickTolerance) return 0.0f; 
+   float range1 = ba1.GetRange(); 
+   float range2 = ba2.GetRange();
+   if (range1 < tickTolerance && range2 < tickTolerance) return 100.0f; // Both effectively zero-range and intersecting
+   float smallerRange = std::min(range1, range2); 
+   float referenceRange = std::max(smallerRange, TickSize); // Ensure reference is at least one tick
+   if (referenceRange < tickTolerance) return 100.0f; // If smaller range is zero, and there's intersection
+   float percentage = (intersectionLength / referenceRange) * 100.0f; 
+   return std::max(0.0f, std::min(100.0f, percentage));
+}
+
+// NEW: attributedBefore[p] = number of profiles before p that belong to some finalized BA (size = profiles + 1),
+// so the temporal proximity check is two lookups instead of a scan over every BA per triple
+std::vector<int> CountAttributedProfiles(const std::vector<s_BalanceArea>& allFinalizedBAs, int numProfiles) {
+   std::vector<char> attributed(numProfiles, 0);
+   for (const auto& finalizedBA : allFinalizedBAs) {
+       for (int profileIndex : finalizedBA.IncludedProfileIndices) {
+           if (profileIndex >= 0 && profileIndex < numProfiles) attributed[profileIndex] = 1;
+       }
+   }
+   std::vector<int> attributedBefore(numProfiles + 1, 0);
+   for (int p = 0; p < numProfiles; ++p) attributedBefore[p + 1] = attributedBefore[p] + attributed[p];
+   return attributedBefore;
+}
+
+// Sessions between ba1 and ba3 that no BA claimed (ba1 and ba3 hold none of them)
+int CheckTemporalProximity(const s_BalanceArea& ba1, const s_BalanceArea& ba3, const std::vector<int>& attributedBefore) {
+   const int numProfiles = static_cast<int>(attributedBefore.size()) - 1;
+   int endProfileIndexOfBA1 = ba1.EndProfileChronoIndex;
+   int startProfileIndexOfBA3 = ba3.StartProfileChronoIndex;
+   if (startProfileIndexOfBA3 < 0 || endProfileIndexOfBA1 < 0 || startProfileIndexOfBA3 >= numProfiles || endProfileIndexOfBA1 >= numProfiles) return -1;
+   if (startProfileIndexOfBA3 <= endProfileIndexOfBA1 + 1) return 0;
+   int gapLength = startProfileIndexOfBA3 - endProfileIndexOfBA1 - 1;
+   return gapLength - (attributedBefore[startProfileIndexOfBA3] - attributedBefore[endProfileIndexOfBA1 + 1]);
+}
+
+// --- Formation Pass ---
+
+// NEW: Initiation and extension criteria are OR-combined, so they are listed in their canonical order (which
+// decides the reason a pass is credited to) and evaluated cheapest first. The canonical reason is only worked out
+// when something depends on it: debug logging, or a criterion whose reason has effects beyond the pass.
+enum e_CriterionCost {
+    CRITERION_COST_CONSTANT  = 0, // A few comparisons on session, pair or BA metrics
+    CRITERION_COST_HISTOGRAM = 1  // Walks per-level volume data
+};
+
+template<typename CheckT>
+struct s_FormationCriterion {
+    int Cost;                    // e_CriterionCost
+    bool NeedsCanonicalReason;   // A pass credited here must first rule out the criteria listed before it
+    bool (*Test)(CheckT& check); // Sets check.Reason when it passes; logs when check.Debug
+    const char* SkippedLog;      // Debug line when an earlier criterion passed (nullptr = none)
+};
+
+// Returns the index of the criterion the pass is credited to, or -1 if none passes
+template<typename CheckT, size_t N>
+int EvaluateFormationCriteria(const s_FormationCriterion<CheckT> (&criteria)[N], CheckT& check) {
+   if (check.Debug) { // Canonical order, logging every check
+       for (size_t n = 0; n < N; ++n) {
+           if (!criteria[n].Test(check)) continue;
+           for (size_t skipped = n + 1; skipped < N; ++skipped) {
+               if (criteria[skipped].SkippedLog != nullptr) check.Log->push_back(criteria[skipped].SkippedLog);
+           }
+           return static_cast<int>(n);
+       }
+       return -1;
+   }
+   bool tested[N] = {};
+   int passed = -1;
+   for (int cost = CRITERION_COST_CONSTANT; cost <= CRITERION_COST_HISTOGRAM && passed < 0; ++cost) {
+       for (size_t n = 0; n < N && passed < 0; ++n) {
+           if (criteria[n].Cost != cost) continue;
+           tested[n] = true;
+           if (criteria[n].Test(check)) passed = static_cast<int>(n);
+       }
+   }
+   if (passed < 0 || !criteria[passed].NeedsCanonicalReason) return passed;
+   for (int n = 0; n < passed; ++n) { // Second pass over the skipped criteria that would take the reason
+       if (!tested[n] && criteria[n].Test(check)) return n;
+   }
+   return passed;
+}
+
+struct s_InitiationCheck {
+    const s_SessionProfile* Profile_i = nullptr;
+    const s_SessionProfile* Profile_i1 = nullptr;
+    const s_SessionPairMetrics* Pair = nullptr;
+    const s_BAFormationParams* Params = nullptr;
+    bool Debug = false;
+    std::vector<std::string>* Log = nullptr;
+    const char* Reason = "None";
+};
+
+bool InitiationVolumeOverlap(s_InitiationCheck& check) {
+   if (check.Pair->VolumeOverlap < check.Params->MinVolOverlap) return false;
+   check.Reason = "Volume Overlap";
+   return true;
+}
+
+bool InitiationVAOverlap(s_InitiationCheck& check) {
+   if (check.Pair->VAOverlap < check.Params->MinVAOverlap) return false;
+   check.Reason = "VA Overlap";
+   return true;
+}
+
+bool InitiationGeometricProximity(s_InitiationCheck& check) {
+   const s_SessionProfile& profile_i = *check.Profile_i;
+   const s_SessionProfile& profile_i1 = *check.Profile_i1;
+   const s_BAFormationParams& params = *check.Params;
+   float maxAllowedHigh = CalculateMaxAllowedHigh(profile_i.HighestPrice, profile_i.GetRange(), params.HighLowTolerancePercent, params.TickSize);
+   float minAllowedLow = CalculateMinAllowedLow(profile_i.LowestPrice, profile_i.GetRange(), params.HighLowTolerancePercent, params.TickSize);
+   bool similarRange = CheckRangeSimilarity(check.Pair->RangeDiffPercent, params.RangeSimilarityPercent);
+   bool controlledHigh = CheckHighPosition(profile_i1.HighestPrice, maxAllowedHigh);
+   bool controlledLow = CheckLowPosition(profile_i1.LowestPrice, minAllowedLow);
+   if (!(similarRange && controlledHigh && controlledLow)) return false;
+   check.Reason = "Geometric Proximity";
+   return true;
+}
+
+// Pair metrics are computed up front (in parallel, memoized), so every initiation criterion is a lookup.
+// The reason is saved with the BA, so it is always the canonical one.
+const s_FormationCriterion<s_InitiationCheck> INITIATION_CRITERIA[] = {
+    { CRITERION_COST_CONSTANT, true, InitiationVolumeOverlap, nullptr },
+    { CRITERION_COST_CONSTANT, true, InitiationVAOverlap, nullptr },
+    { CRITERION_COST_CONSTANT, true, InitiationGeometricProximity, nullptr }
+};
+
+struct s_ExtensionCheck {
+    const s_BalanceArea* BA = nullptr;
+    const s_SessionProfile* Profile = nullptr;
+    int ProfileIndex = 0;
+    const s_BAFormationParams* Params = nullptr;
+    const PriceVolumeMap* MergedMap = nullptr;
+    const s_DenseProfile* MergedDense = nullptr;
+    s_ProfilePyramid* MergedPyramid = nullptr; // Rebuilt from MergedDense on first use when stale
+    bool* MergedPyramidStale = nullptr;
+    bool Debug = false;
+    std::vector<std::string>* Log = nullptr;
+    bool GeoHighOK = false; // Set by ExtensionGeometricProximityLite
+    bool GeoLowOK = false;
+    const char* Reason = "None";
+};
+
+// Screened coarse to fine on the histograms when both have one; the exact value is only needed for the log
+bool ExtensionVolumeOverlap(s_ExtensionCheck& check) {
+   const s_SessionVolumeData& data_k = *check.Profile->Data;
+   const s_DenseProfile& mergedDense = *check.MergedDense;
+   const s_BAFormationParams& params = *check.Params;
+   bool volOverlapPassed;
+   float overlap_merged_k = 0.0f;
+   if (mergedDense.IsValid() && data_k.Dense.IsValid()) {
+       if (*check.MergedPyramidStale) {
+           FillProfilePyramid(mergedDense, *check.MergedPyramid);
+           *check.MergedPyramidStale = false;
+       }
+       if (params.OverlapResolution > 1 || check.Debug) {
+           overlap_merged_k = CalculateDenseVolumeOverlap(DenseAtResolution(mergedDense, *check.MergedPyramid, params.OverlapResolution), DenseAtResolution(data_k.Dense, data_k.Pyramid, params.OverlapResolution));
+           volOverlapPassed = (overlap_merged_k >= params.MinVolOverlap);
+       } else {
+           volOverlapPassed = DenseVolumeOverlapAtLeast(mergedDense, *check.MergedPyramid, data_k.Dense, data_k.Pyramid, params.MinVolOverlap);
+       }
+   } else {
+       overlap_merged_k = CalculateVolumeProfileOverlap(*check.MergedMap, data_k.PriceMap);
+       volOverlapPassed = (overlap_merged_k >= params.MinVolOverlap);
+   }
+   if (check.Debug) {
+       SCString logMsg;
+       logMsg.Format("  > Vol Overlap Check: Merged BA vs Prof %d = %.1f%%. Threshold = %.1f%%. -> %s", check.ProfileIndex, overlap_merged_k, params.MinVolOverlap, (volOverlapPassed ? "PASS" : "FAIL") );
+       check.Log->push_back(logMsg.GetChars());
+   }
+   if (!volOverlapPassed) return false;
+   check.Reason = "Volume Overlap";
+   return true;
+}
+
+bool ExtensionRangeContainment(s_ExtensionCheck& check) {
+   const s_BalanceArea& currentBA = *check.BA;
+   const s_SessionProfile& profile_k = *check.Profile;
+   float tickTolerance = check.Params->TickSize / 2.0f;
+   bool highContained = (profile_k.HighestPrice <= currentBA.HighestPrice + tickTolerance);
+   bool lowContained = (profile_k.LowestPrice >= currentBA.LowestPrice - tickTolerance);
+   bool isContained = highContained && lowContained;
+   if (check.Debug) {
+       SCString logMsg;
+       logMsg.Format("  > Range Containment Check: Prof %d H=%.2f vs BA H=%.2f(+%.2f)=%s, L=%.2f vs BA L=%.2f(-%.2f)=%s -> %s", check.ProfileIndex, profile_k.HighestPrice, currentBA.HighestPrice, tickTolerance, (highContained ? "OK" : "X"), profile_k.LowestPrice, currentBA.LowestPrice, tickTolerance, (lowContained ? "OK" : "X"), (isContained ? "PASS" : "FAIL") );
+       check.Log->push_back(logMsg.GetChars());
+   }
+   if (!isContained) return false;
+   check.Reason = "Range Containment";
+   return true;
+}
+
+bool ExtensionGeometricProximityLite(s_ExtensionCheck& check) {
+   const s_BalanceArea& currentBA = *check.BA;
+   const s_SessionProfile& profile_k = *check.Profile;
+   const s_BAFormationParams& params = *check.Params;
+   float currentBARange = currentBA.GetRange();
+   float baMaxAllowedHigh = CalculateMaxAllowedHigh(currentBA.HighestPrice, currentBARange, params.HighLowTolerancePercent, params.TickSize);
+   float baMinAllowedLow = CalculateMinAllowedLow(currentBA.LowestPrice, currentBARange, params.HighLowTolerancePercent, params.TickSize);
+   check.GeoHighOK = CheckHighPosition(profile_k.HighestPrice, baMaxAllowedHigh);
+   check.GeoLowOK = CheckLowPosition(profile_k.LowestPrice, baMinAllowedLow);
+   bool geometricProximityLiteOK = check.GeoHighOK && check.GeoLowOK;
+   if (check.Debug) {
+       SCString logMsg;
+       logMsg.Format("  > Geo Prox Lite Check (Tol=%.1f%%): Prof %d H=%.2f vs MaxAllowH=%.2f (%s), L=%.2f vs MinAllowL=%.2f (%s) -> %s", params.HighLowTolerancePercent, check.ProfileIndex, profile_k.HighestPrice, baMaxAllowedHigh, (check.GeoHighOK ? "OK" : "FAIL"), profile_k.LowestPrice, baMinAllowedLow, (check.GeoLowOK ? "OK" : "FAIL"), (geometricProximityLiteOK ? "PASS" : "FAIL") );
+       check.Log->push_back(logMsg.GetChars());
+   }
+   if (!geometricProximityLiteOK) return false;
+   check.Reason = "Geometric Proximity Lite";
+   return true;
+}
+
+// Only applies when exactly one side failed the geometric check, which always runs before it
+bool ExtensionConditionalClose(s_ExtensionCheck& check) {
+   if (check.GeoHighOK == check.GeoLowOK) return false;
+   const s_BalanceArea& currentBA = *check.BA;
+   float closePrice = check.Profile->ClosePrice;
+   bool checkPassed = false;
+   const char* condCloseFailSide = "";
+   if (closePrice > -FLT_MAX && currentBA.LowestPrice < FLT_MAX && currentBA.HighestPrice > -FLT_MAX && currentBA.HighestPrice > currentBA.LowestPrice) { // Ensure BA range is valid
+       if (!check.GeoLowOK && check.GeoHighOK && (closePrice > currentBA.LowestPrice)) {
+           checkPassed = true;
+           check.Reason = "Close Above BA Low (Low Fail)";
+           condCloseFailSide = "Low";
+       } else if (!check.GeoHighOK && check.GeoLowOK && (closePrice < currentBA.HighestPrice)) {
+           checkPassed = true;
+           check.Reason = "Close Below BA High (High Fail)";
+           condCloseFailSide = "High";
+       }
+   }
+   if (check.Debug) {
+       bool closeInRange = (closePrice > -FLT_MAX && closePrice >= currentBA.LowestPrice && closePrice <= currentBA.HighestPrice);
+       SCString logMsg;
+       logMsg.Format("  > Cond. Close Check (Geo %s Fail): Prof %d Close=%.2f. BA Range=[%.2f, %.2f]. Close in Range? %s -> %s", condCloseFailSide, check.ProfileIndex, closePrice, currentBA.LowestPrice, currentBA.HighestPrice, (closeInRange ? "Yes" : "No"), (checkPassed ? "PASS" : "FAIL") );
+       check.Log->push_back(logMsg.GetChars());
+   }
+   return checkPassed;
+}
+
+// A conditional-close extension also records probe lines, so it must first rule out a volume overlap pass;
+// the other reasons only show up in the debug log.
+const s_FormationCriterion<s_ExtensionCheck> EXTENSION_CRITERIA[] = {
+    { CRITERION_COST_HISTOGRAM, false, ExtensionVolumeOverlap, nullptr },
+    { CRITERION_COST_CONSTANT, false, ExtensionRangeContainment, "  > Range Containment Check: Skipped (Vol Overlap Passed)" },
+    { CRITERION_COST_CONSTANT, false, ExtensionGeometricProximityLite, "  > Geo Prox Lite Check: Skipped (Previous Check Passed)" },
+    { CRITERION_COST_CONSTANT, true, ExtensionConditionalClose, nullptr }
+};
+
+// NEW: BA formation over immutable session profiles. Needs no sc, so it can run on a background thread,
+// be split across study calls, or run offline. shouldYield is polled at each initiation candidate;
+// returns false when suspended (run.NextProfileIndex is where to continue) and true when finished.
+bool ContinueBAFormation(s_BAFormationRun& run, const std::vector<s_SessionProfile>& SessionProfiles, const std::function<bool()>& shouldYield) {
+   const s_BAFormationParams& params = run.Params;
+   const float TickSize = params.TickSize;
+   const float ValueAreaPercentage = params.ValueAreaPercentage;
+   const bool FilterByNormality = params.FilterByNormality;
+   const float MaxAbsSkewness = params.MaxAbsSkewness;
+   const float MinExcessKurtosis = params.MinExcessKurtosis;
+   const float MaxExcessKurtosis = params.MaxExcessKurtosis;
+   const bool DebugBAFormation = params.DebugBAFormation;
+   const int numProfilesCollected = static_cast<int>(SessionProfiles.size());
+   const int lastProfileIndex = numProfilesCollected - 1;
+   const std::vector<s_SessionPairMetrics>& pairMetrics = run.PairMetrics;
+   s_BAFormationResult& result = run.Result;
+   SCString logMsg;
+
+   // Balance Area Formation Logic (original logic preserved)
+   std::vector<bool>& profileUsed = result.FormationProfileUsed;
+   for (int i = run.NextProfileIndex; i < numProfilesCollected; ++i) {
+	   if (shouldYield && shouldYield()) { // Suspend at a session boundary
+		   run.NextProfileIndex = i;
+		   return false;
+	   }
+	   if (profileUsed[i]) continue;
+	   if (i + 1 >= numProfilesCollected) break;
+	   if (i + 1 == lastProfileIndex) result.FormationResumeIndex = std::min(result.FormationResumeIndex, i);
+	   const s_SessionProfile& profile_i = SessionProfiles[i];
+	   const s_SessionProfile& profile_i1 = SessionProfiles[i+1];
+	   const s_SessionPairMetrics& pair_i_i1 = pairMetrics[i];
+	   
+	   // Check for valid H/L in profiles before using them
+	   if (!pair_i_i1.IsValid) {
+		   if (DebugBAFormation) {
+				logMsg.Format("DEBUG BA: Skipping initiation at profile %d. Invalid data in profile %d (H:%.2f L:%.2f R:%.2f) or %d (H:%.2f L:%.2f R:%.2f).", i, i, profile_i.HighestPrice, profile_i.LowestPrice, profile_i.GetRange(), i+1, profile_i1.HighestPrice, profile_i1.LowestPrice, profile_i1.GetRange());
+				result.LogMessages.push_back(logMsg.GetChars());
+		   }
+		   continue;
+	   }
+
+	   s_InitiationCheck initiationCheck;
+	   initiationCheck.Profile_i = &profile_i;
+	   initiationCheck.Profile_i1 = &profile_i1;
+	   initiationCheck.Pair = &pair_i_i1;
+	   initiationCheck.Params = &params;
+	   initiationCheck.Debug = DebugBAFormation;
+	   initiationCheck.Log = &result.LogMessages;
+	   bool startBA = EvaluateFormationCriteria(INITIATION_CRITERIA, initiationCheck) >= 0;
+	   std::string initiationReason = initiationCheck.Reason;
+
+	   if (startBA) {
+		   s_BalanceArea currentBA;
+		   currentBA.StartProfileChronoIndex = i; 
+		   currentBA.EndProfileChronoIndex = i + 1;
+		   currentBA.StartDateTime = profile_i.StartDateTime; 
+		   currentBA.StartBarIndex = profile_i.BeginIndex;
+		   currentBA.EndDateTime = profile_i1.EndDateTime; 
+		   currentBA.EndBarIndex = profile_i1.EndIndex;
+		   currentBA.IncludedProfileIndices = {i, i+1}; 
+		   currentBA.InitiationReason = initiationReason;
+
+		   PriceVolumeMap currentMergedMap;
+		   std::vector<std::reference_wrapper<const PriceVolumeMap>> mapsToMerge = { std::cref(profile_i.Data->PriceMap), std::cref(profile_i1.Data->PriceMap) };
+		   currentMergedMap = MergeMultipleVolumeProfiles(mapsToMerge);
+		   // Histogram of the merged BA for the extension overlap checks; its pyramid is rebuilt when it grows
+		   s_DenseProfile mergedDense = profile_i.Data->Dense;
+		   AddDenseProfileInto(mergedDense, profile_i1.Data->Dense);
+		   s_ProfilePyramid mergedPyramid;
+		   bool mergedPyramidStale = true;
+		   float initialMergedHigh, initialMergedLow; // These will be set by CalculateProfileMetrics
+		   CalculateProfileMetrics(currentMergedMap, ValueAreaPercentage, TickSize, currentBA.POC, currentBA.ValueAreaHigh, currentBA.ValueAreaLow, initialMergedHigh, initialMergedLow, currentBA.TotalVolume);
+		   currentBA.HighestPrice = initialMergedHigh; 
+		   currentBA.LowestPrice = initialMergedLow;
+
+		   // Additional check for BA validity after merging first two profiles
+		   if (currentBA.HighestPrice <= -FLT_MAX || currentBA.LowestPrice >= FLT_MAX || currentBA.HighestPrice < currentBA.LowestPrice) {
+				if (DebugBAFormation) {
+				   logMsg.Format("DEBUG BA: BA initiated at %d with %d has invalid merged H/L (%.2f/%.2f) or zero range. Discarding.", i, i+1, currentBA.HighestPrice, currentBA.LowestPrice);
+				   result.LogMessages.push_back(logMsg.GetChars());
+				}
+				continue; // Skip this BA if it's invalid from the start
+		   }
+
+		   profileUsed[i] = true; 
+		   profileUsed[i+1] = true;
+		   if (DebugBAFormation) { 
+			   logMsg.Format("DEBUG BA: Initiated BA at Profile %d with Profile %d. Reason: '%s'. Initial Range: %.2f-%.2f, VA: %.2f-%.2f, POC: %.2f", i, i + 1, initiationReason.c_str(), currentBA.LowestPrice, currentBA.HighestPrice, currentBA.ValueAreaLow, currentBA.ValueAreaHigh, currentBA.POC); 
+			   result.LogMessages.push_back(logMsg.GetChars()); 
+		   }
+
+		   // Extension logic
+		   for (int k = i + 2; k < numProfilesCollected; ++k) {
+			   const s_SessionProfile& profile_k = SessionProfiles[k];
+			   if (k == lastProfileIndex) result.FormationResumeIndex = std::min(result.FormationResumeIndex, i);
+			   if (profile_k.HighestPrice <= -FLT_MAX || profile_k.LowestPrice >= FLT_MAX || profile_k.HighestPrice < profile_k.LowestPrice) {
+					if (DebugBAFormation) { 
+						logMsg.Format("DEBUG BA: Eval Prof %d for extension - invalid profile data (H:%.2f L:%.2f). Stopping extension.", k, profile_k.HighestPrice, profile_k.LowestPrice); 
+						result.LogMessages.push_back(logMsg.GetChars()); 
+					}
+					break; // Stop extension if current profile is invalid
+			   }
+
+			   if (DebugBAFormation) { 
+				   logMsg.Format("DEBUG BA: Eval Prof %d for extension of BA [%d..%d] (Range: %.2f-%.2f, VA: %.2f-%.2f)", k, currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, currentBA.LowestPrice, currentBA.HighestPrice, currentBA.ValueAreaLow, currentBA.ValueAreaHigh); 
+				   result.LogMessages.push_back(logMsg.GetChars()); 
+			   }
+
+			   s_ExtensionCheck extensionCheck;
+			   extensionCheck.BA = &currentBA;
+			   extensionCheck.Profile = &profile_k;
+			   extensionCheck.ProfileIndex = k;
+			   extensionCheck.Params = &params;
+			   extensionCheck.MergedMap = &currentMergedMap;
+			   extensionCheck.MergedDense = &mergedDense;
+			   extensionCheck.MergedPyramid = &mergedPyramid;
+			   extensionCheck.MergedPyramidStale = &mergedPyramidStale;
+			   extensionCheck.Debug = DebugBAFormation;
+			   extensionCheck.Log = &result.LogMessages;
+			   bool extendBA = EvaluateFormationCriteria(EXTENSION_CRITERIA, extensionCheck) >= 0;
+			   std::string extensionReason = extensionCheck.Reason;
+
+			   if (extendBA) {
+				   if (DebugBAFormation) { 
+					   logMsg.Format("DEBUG BA: ---> EXTENDED BA [%d..%d] with Profile %d. Reason: '%s'", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, k, extensionReason.c_str()); 
+					   result.LogMessages.push_back(logMsg.GetChars()); 
+				   }
+				   currentBA.IncludedProfileIndices.push_back(k); 
+				   currentBA.EndProfileChronoIndex = k;
+				   currentBA.EndDateTime = profile_k.EndDateTime; 
+				   currentBA.EndBarIndex = profile_k.EndIndex;
+				   profileUsed[k] = true;
+				   mapsToMerge.push_back(std::cref(profile_k.Data->PriceMap));
+				   MergeVolumeProfileInto(currentMergedMap, profile_k.Data->PriceMap); // Extend in place instead of re-merging every session
+				   AddDenseProfileInto(mergedDense, profile_k.Data->Dense);
+				   mergedPyramidStale = true;
+				   float tempPOC, tempVAH, tempVAL, tempVolume, mergedHigh, mergedLow;
+				   CalculateProfileMetrics(currentMergedMap, ValueAreaPercentage, TickSize, tempPOC, tempVAH, tempVAL, mergedHigh, mergedLow, tempVolume);
+				   currentBA.POC = tempPOC; 
+				   currentBA.ValueAreaHigh = tempVAH; 
+				   currentBA.ValueAreaLow = tempVAL; 
+				   currentBA.TotalVolume = tempVolume;
+				   
+				   // Check if the merged BA is still valid after adding profile_k
+				   if (mergedHigh <= -FLT_MAX || mergedLow >= FLT_MAX || mergedHigh < mergedLow) {
+						if (DebugBAFormation) {
+						   logMsg.Format("DEBUG BA: BA extended with %d resulted in invalid merged H/L (%.2f/%.2f). Reverting extension.", k, mergedHigh, mergedLow);
+						   result.LogMessages.push_back(logMsg.GetChars());
+						}
+						profileUsed[k] = false; // Unmark as used as this extension failed
+						currentBA.IncludedProfileIndices.pop_back(); // Remove k
+						currentBA.EndProfileChronoIndex = (currentBA.IncludedProfileIndices.empty() ? -1 : currentBA.IncludedProfileIndices.back()); // Revert to previous last profile
+						if(currentBA.EndProfileChronoIndex != -1) {
+						   currentBA.EndDateTime = SessionProfiles[currentBA.EndProfileChronoIndex].EndDateTime;
+						   currentBA.EndBarIndex = SessionProfiles[currentBA.EndProfileChronoIndex].EndIndex;
+						} else { // Should not happen if BA started with 2 profiles
+						   currentBA.EndDateTime = 0; 
+						   currentBA.EndBarIndex = -1;
+						}
+						mapsToMerge.pop_back(); // Remove profile_k's map from merge list
+						currentMergedMap = MergeMultipleVolumeProfiles(mapsToMerge); // Re-merge without k
+						mergedDense = SessionProfiles[currentBA.IncludedProfileIndices.front()].Data->Dense;
+						for (size_t n = 1; n < currentBA.IncludedProfileIndices.size(); ++n) AddDenseProfileInto(mergedDense, SessionProfiles[currentBA.IncludedProfileIndices[n]].Data->Dense);
+						mergedPyramidStale = true;
+						// Recalculate metrics for the BA without profile_k
+						CalculateProfileMetrics(currentMergedMap, ValueAreaPercentage, TickSize, currentBA.POC, currentBA.ValueAreaHigh, currentBA.ValueAreaLow, currentBA.HighestPrice, currentBA.LowestPrice, currentBA.TotalVolume);
+						break; // Stop extending with this invalid profile_k
+				   }
+
+				   bool isConditionalClose = (extensionReason == "Close Above BA Low (Low Fail)" || extensionReason == "Close Below BA High (High Fail)");
+				   if (isConditionalClose) {
+					   float tolerance = TickSize / 2.0f;
+					   if (profile_k.HighestPrice > currentBA.HighestPrice + tolerance) {
+						   int exactHighProbeBarIndex = profile_k.HighBarIndex;
+						   if (exactHighProbeBarIndex != -1) { 
+							   s_ProbeLineDrawingInfo probeInfo = {exactHighProbeBarIndex, profile_k.EndIndex, profile_k.HighestPrice, true, i}; 
+							   result.ProbeLinesToDraw.push_back(probeInfo); 
+							   if (DebugBAFormation) result.LogMessages.push_back("    * Probe Detected (High)"); 
+						   }
+					   }
+					   if (profile_k.LowestPrice < currentBA.LowestPrice - tolerance) {
+						   int exactLowProbeBarIndex = profile_k.LowBarIndex;
+						   if (exactLowProbeBarIndex != -1) { 
+							   s_ProbeLineDrawingInfo probeInfo = {exactLowProbeBarIndex, profile_k.EndIndex, profile_k.LowestPrice, false, i}; 
+							   result.ProbeLinesToDraw.push_back(probeInfo); 
+							   if (DebugBAFormation) result.LogMessages.push_back("    * Probe Detected (Low)"); 
+						   }
+					   }
+				   } else { // Not a conditional close, update BA H/L with merged H/L
+					   currentBA.HighestPrice = mergedHigh; 
+					   currentBA.LowestPrice = mergedLow;
+				   }
+			   } else {
+				   if (DebugBAFormation) { 
+					   logMsg.Format("DEBUG BA: ---X STOPPED Extension of BA [%d..%d] at Profile %d. No criteria met.", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, k); 
+					   result.LogMessages.push_back(logMsg.GetChars()); 
+				   }
+				   break;
+			   }
+		   } // End k loop (extension)
+
+		   bool meetsNormalityCriteria = true;
+		   if (FilterByNormality) {
+			   // BA moments are combined from the sessions' precomputed sums instead of re-scanning the merged map
+			   s_MomentSums baMoments;
+			   for (int profileIndex : currentBA.IncludedProfileIndices) CombineMomentSums(baMoments, SessionProfiles[profileIndex].Data->Moments);
+			   s_DistributionStats distStats = DistributionStatsFromMoments(baMoments, CountPriceLevelsWithVolume(currentMergedMap), TickSize);
+			   if (!distStats.sufficientData) {
+				   meetsNormalityCriteria = false;
+				   if (DebugBAFormation) { 
+					   logMsg.Format("DEBUG BA: Normality Check for BA [%d..%d]: Insufficient data (Levels w/ Vol: %d). Filter FAILED.", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, distStats.numPriceLevelsWithVolume); 
+					   result.LogMessages.push_back(logMsg.GetChars()); 
+				   }
+			   } else {
+				   bool skewOK = std::fabs(distStats.skewness) <= MaxAbsSkewness;
+				   bool kurtOK = distStats.excessKurtosis >= MinExcessKurtosis && distStats.excessKurtosis <= MaxExcessKurtosis;
+				   meetsNormalityCriteria = skewOK && kurtOK;
+				   if (DebugBAFormation) { 
+					   logMsg.Format("DEBUG BA: Normality Check for BA [%d..%d]: Skew=%.2f (AbsLim=%.2f, OK=%d), Kurt=%.2f (Lims=[%.2f,%.2f], OK=%d). Levels=%d, Mean=%.2f, StdD=%.2f. Overall Pass: %d", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, distStats.skewness, MaxAbsSkewness, skewOK, distStats.excessKurtosis, MinExcessKurtosis, MaxExcessKurtosis, kurtOK, distStats.numPriceLevelsWithVolume, distStats.mean, distStats.stdDev, meetsNormalityCriteria); 
+					   result.LogMessages.push_back(logMsg.GetChars()); 
+				   }
+			   }
+		   }
+
+		   if (meetsNormalityCriteria) {
+			   // Final check for valid BA range before adding
+			   if (currentBA.HighestPrice > -FLT_MAX && currentBA.LowestPrice < FLT_MAX && currentBA.HighestPrice >= currentBA.LowestPrice && currentBA.GetRange() >= TickSize / 2.0f) {
+				   result.FinalizedBalanceAreas.push_back(currentBA);
+				   if (DebugBAFormation) { 
+					   logMsg.Format("DEBUG BA: Finalized BA [%d..%d]. Total Profiles: %d. Range: %.2f-%.2f, VA: %.2f-%.2f, POC: %.2f", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, (int)currentBA.IncludedProfileIndices.size(), currentBA.LowestPrice, currentBA.HighestPrice, currentBA.ValueAreaLow, currentBA.ValueAreaHigh, currentBA.POC); 
+					   result.LogMessages.push_back(logMsg.GetChars()); 
+				   }
+			   } else if (DebugBAFormation) {
+				   logMsg.Format("DEBUG BA: DISCARDED BA (after extension loop) [%d..%d] due to invalid H/L Range: %.2f-%.2f or too small range.", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, currentBA.LowestPrice, currentBA.HighestPrice);
+				   result.LogMessages.push_back(logMsg.GetChars());
+			   }
+		   } else {
+			   if (DebugBAFormation) { 
+				   logMsg.Format("DEBUG BA: DISCARDED BA [%d..%d] due to failing normality criteria. Total Profiles: %d", currentBA.StartProfileChronoIndex, currentBA.EndProfileChronoIndex, (int)currentBA.IncludedProfileIndices.size()); 
+				   result.LogMessages.push_back(logMsg.GetChars()); 
+			   }
+		   }
+	   } // End if(startBA)
+   } // End i loop (initiation)
+   run.NextProfileIndex = numProfilesCollected;
+   return true;
+}
+
+// NEW: HLH/LHL composite detection over finalized BAs. Existing entries in compositeBAs (restored with
+// their BAs) keep their triples attributed; checking starts at compositeStartIndex.
+void RunCompositeDetection(const std::vector<s_SessionProfile>& SessionProfiles, const std::vector<s_BalanceArea>& FinalizedBalanceAreas,
+                           const s_BAFormationParams& params, size_t compositeStartIndex,
+                           std::vector<s_CompositeBalanceArea>& compositeBAs, std::vector<std::string>& logMessages) {
+   const float TickSize = params.TickSize;
+   const float RangeContainmentPercent = params.RangeContainmentPercent;
+   const bool DebugCompositeBA = params.DebugCompositeBA;
+   SCString logMsg;
+
+   if (FinalizedBalanceAreas.size() >= 3) {
+       if (DebugCompositeBA) logMessages.push_back("--- Starting Composite BA Detection ---");
+       const float compositeOverlapThreshold = 30.0f; 
+       const float shiftMagnitudePercent = 20.0f; 
+       const int temporalGapLimit = 5;
+       std::vector<bool> baAttributed(FinalizedBalanceAreas.size(), false);
+       const std::vector<int> attributedBefore = CountAttributedProfiles(FinalizedBalanceAreas, static_cast<int>(SessionProfiles.size()));
+       // Triples made only of restored BAs keep their restored composite decisions
+       for (const auto& comp : compositeBAs) {
+           baAttributed[comp.FirstBAIndex] = true;
+           baAttributed[comp.SecondBAIndex] = true;
+           baAttributed[comp.ThirdBAIndex] = true;
+       }
+for (size_t j = compositeStartIndex; j <= FinalizedBalanceAreas.size() - 3; ++j) { // Use size_t for loop, ensure comparison is safe
+           bool skipped = false; 
+           std::string skipReason = "";
+           if (baAttributed[j]) { 
+               skipped = true; 
+               skipReason = "BA[" + std::to_string(j) + "] Attributed"; 
+           } else if (baAttributed[j+1]) { 
+               skipped = true; 
+               skipReason = "BA[" + std::to_string(j+1) + "] Attributed"; 
+           } else if (baAttributed[j+2]) { 
+               skipped = true; 
+               skipReason = "BA[" + std::to_string(j+2) + "] Attributed"; 
+           }
+           if (skipped) { 
+               if (DebugCompositeBA) { 
+                   logMsg.Format("Comp Check BA[%zu..%zu]: Skipped (Reason: %s)", j, j+2, skipReason.c_str()); 
+                   logMessages.push_back(logMsg.GetChars()); 
+               } 
+               continue; 
+           }
+
+           const s_BalanceArea& ba1 = FinalizedBalanceAreas[j];
+           const s_BalanceArea& ba2 = FinalizedBalanceAreas[j+1];
+           const s_BalanceArea& ba3 = FinalizedBalanceAreas[j+2];
+           float overlap_12 = CalculateRangeOverlapPercent_RelativeToSmaller(ba1, ba2, TickSize); 
+           float overlap_13 = CalculateRangeOverlapPercent_RelativeToSmaller(ba1, ba3, TickSize); 
+           float overlap_23 = CalculateRangeOverlapPercent_RelativeToSmaller(ba2, ba3, TickSize);
+           bool hasOverlap_12 = overlap_12 > 0.0f; 
+           bool hasOverlap_13 = overlap_13 > 0.0f; 
+           bool hasOverlap_23 = overlap_23 > 0.0f;
+           bool meetsThreshold_12 = overlap_12 >= compositeOverlapThreshold; 
+           bool meetsThreshold_13 = overlap_13 >= compositeOverlapThreshold; 
+           bool meetsThreshold_23 = overlap_23 >= compositeOverlapThreshold;
+           int numThresholdMet = (meetsThreshold_12 ? 1 : 0) + (meetsThreshold_13 ? 1 : 0) + (meetsThreshold_23 ? 1 : 0);
+           int numAnyOverlap = (hasOverlap_12 ? 1 : 0) + (hasOverlap_13 ? 1 : 0) + (hasOverlap_23 ? 1 : 0);
+           std::string overlapType = "No Overlap"; 
+           if (numThresholdMet == 3) { 
+               overlapType = "Strong Overlap"; 
+           } else if (numAnyOverlap == 3) { 
+               overlapType = "Full Overlap"; 
+           } else if (numAnyOverlap == 2) { 
+               overlapType = "Partial Overlap"; 
+           } else if (numAnyOverlap == 1) { 
+               overlapType = "1 Overlap"; 
+           }
+           std::string patternType = "None"; 
+           bool is_HLH = false; 
+           bool is_LHL = false;
+           if (ba1.HighestPrice > -FLT_MAX && ba1.LowestPrice < FLT_MAX && ba2.HighestPrice > -FLT_MAX && ba2.LowestPrice < FLT_MAX && ba3.HighestPrice > -FLT_MAX && ba3.LowestPrice < FLT_MAX) {
+               if ((ba2.HighestPrice < ba1.HighestPrice && ba2.LowestPrice < ba1.LowestPrice) && (ba3.HighestPrice > ba2.HighestPrice && ba3.LowestPrice > ba2.LowestPrice)) { 
+                   is_HLH = true; 
+                   patternType = "HLH"; 
+               } else if ((ba2.HighestPrice > ba1.HighestPrice && ba2.LowestPrice > ba1.LowestPrice) && (ba3.HighestPrice < ba2.HighestPrice && ba3.LowestPrice < ba2.LowestPrice)) { 
+                   is_LHL = true; 
+                   patternType = "LHL"; 
+               }
+           }
+           bool containmentPassed = true; 
+           bool shiftMagnitudePassed = true; 
+           bool ba1_ba2_GapCheckPassed = true;
+           std::string containmentResultStr = ""; 
+           std::string shiftResultStr = ""; 
+           std::string ba1_ba2_GapResultStr = "";
+           if (is_HLH || is_LHL) {
+               containmentPassed = false; 
+               float referenceRange = std::max(ba1.HighestPrice, ba2.HighestPrice) - std::min(ba1.LowestPrice, ba2.LowestPrice); 
+               referenceRange = std::max(referenceRange, TickSize); 
+               float toleranceValue = referenceRange * (RangeContainmentPercent / 100.0f); 
+               float overshootAmount = 0.0f;
+               if (is_HLH) { 
+                   float allowedHigh = ba1.HighestPrice + toleranceValue; 
+                   if (ba3.HighestPrice <= allowedHigh) containmentPassed = true; 
+                   else overshootAmount = ba3.HighestPrice - allowedHigh; 
+               } else { 
+                   float allowedLow = ba1.LowestPrice - toleranceValue; 
+                   if (ba3.LowestPrice >= allowedLow) containmentPassed = true; 
+                   else overshootAmount = allowedLow - ba3.LowestPrice; 
+               }
+               if (containmentPassed) { 
+                   containmentResultStr = " (Containment Passed)"; 
+               } else { 
+                   float overshootPercent = (referenceRange > TickSize / 2.0f) ? (overshootAmount / referenceRange) * 100.0f : 0.0f; 
+                   SCString failDetails; 
+                   failDetails.Format(" (Containment Failed: RefR=%.2f, Over=%.2f (%.1f%%))", referenceRange, overshootAmount, overshootPercent); 
+                   containmentResultStr = failDetails.GetChars(); 
+               }
+               shiftMagnitudePassed = false; 
+               float ba2_range = std::max(ba2.GetRange(), TickSize); 
+               float shift_threshold_amount = ba2_range * (shiftMagnitudePercent / 100.0f);
+               if (is_HLH) { 
+                   if ((ba3.HighestPrice > ba2.HighestPrice + shift_threshold_amount) && (ba3.LowestPrice > ba2.LowestPrice + shift_threshold_amount)) { 
+                       shiftMagnitudePassed = true; 
+                   } 
+               } else { 
+                   if ((ba3.HighestPrice < ba2.HighestPrice - shift_threshold_amount) && (ba3.LowestPrice < ba2.LowestPrice - shift_threshold_amount)) { 
+                       shiftMagnitudePassed = true; 
+                   } 
+               }
+               if (shiftMagnitudePassed) { 
+                   shiftResultStr = " (Shift Passed)"; 
+               } else { 
+                   SCString shiftFailDetails; 
+                   shiftFailDetails.Format(" (Shift Failed: Req=%.2f)", shift_threshold_amount); 
+                   shiftResultStr = shiftFailDetails.GetChars(); 
+               }
+               ba1_ba2_GapCheckPassed = false; 
+               float ba1_range = std::max(ba1.GetRange(), TickSize); // Range of BA1
+               // Check if BA2 is not "too far" from BA1 relative to BA1's range (simplified gap check)
+               if (is_HLH) { 
+                   if (ba2.HighestPrice > (ba1.LowestPrice - ba1_range)) ba1_ba2_GapCheckPassed = true;
+               } else { 
+                   if (ba2.LowestPrice < (ba1.HighestPrice + ba1_range)) ba1_ba2_GapCheckPassed = true; 
+               }
+               if (ba1_ba2_GapCheckPassed) { 
+                   ba1_ba2_GapResultStr = " (Gap12 OK)"; 
+               } else { 
+                   ba1_ba2_GapResultStr = " (Gap12 Failed)"; 
+               }
+           }
+           int temporalGap = CheckTemporalProximity(ba1, ba3, attributedBefore); 
+           bool temporalPassed = (temporalGap != -1 && temporalGap <= temporalGapLimit);
+           std::string temporalGapStdStr = ""; 
+           SCString temporalGapSCStr; 
+           if (temporalGap != -1) { 
+               temporalGapSCStr.Format(" (TemporalGap=%d)", temporalGap); 
+               temporalGapStdStr = temporalGapSCStr.GetChars(); 
+           } else { 
+               temporalGapStdStr = " (TemporalGap Error)"; 
+           }
+           bool qualifiesAsComposite = false; 
+           std::string finalReason = "N/A";
+           if (overlapType == "Strong Overlap") { 
+               qualifiesAsComposite = true; 
+               finalReason = "Strong Overlap"; 
+           } else if (overlapType == "Full Overlap" || overlapType == "Partial Overlap") { 
+               if (is_HLH || is_LHL) { 
+                   if (containmentPassed) { 
+                       if (shiftMagnitudePassed) { 
+                           if (ba1_ba2_GapCheckPassed) { 
+                               qualifiesAsComposite = true; 
+                               finalReason = patternType + "+Contain+Shift+Gap12"; 
+                           } else { 
+                               finalReason = "Gap12 Failed"; 
+                           }
+                       } else { 
+                           finalReason = "Shift Failed"; 
+                       }
+                   } else { 
+                       finalReason = "Containment Failed"; 
+                   }
+               } else { 
+                   finalReason = "No Pattern"; 
+               } 
+           } else if (overlapType == "1 Overlap") { 
+               if (is_HLH || is_LHL) { 
+                   if (containmentPassed) { 
+                       if (shiftMagnitudePassed) { 
+                           if (ba1_ba2_GapCheckPassed) { 
+                               if (temporalPassed) { 
+                                   qualifiesAsComposite = true; 
+                                   finalReason = patternType + "+Contain+Shift+Gap12+Temporal"; 
+                               } else { 
+                                   finalReason = "Temporal Gap Too Large"; 
+                               }
+                           } else { 
+                               finalReason = "Gap12 Failed"; 
+                           }
+                       } else { 
+                           finalReason = "Shift Failed"; 
+                       }
+                   } else { 
+                       finalReason = "Containment Failed"; 
+                   }
+               } else { 
+                   finalReason = "No Pattern"; 
+               } 
+           } else { 
+               finalReason = "No Overlap"; 
+           }
+           if (qualifiesAsComposite) {
+               s_CompositeBalanceArea newComposite; 
+               newComposite.FirstBAIndex = static_cast<int>(j); 
+               newComposite.SecondBAIndex = static_cast<int>(j + 1); 
+               newComposite.ThirdBAIndex = static_cast<int>(j + 2);
+               newComposite.StartDateTime = ba1.StartDateTime; 
+               newComposite.EndDateTime = ba3.EndDateTime; 
+               newComposite.StartBarIndex = ba1.StartBarIndex; 
+               newComposite.EndBarIndex = ba3.EndBarIndex;
+               newComposite.HighestPrice = std::max({ba1.HighestPrice, ba2.HighestPrice, ba3.HighestPrice}); 
+               newComposite.LowestPrice = std::min({ba1.LowestPrice, ba2.LowestPrice, ba3.LowestPrice});
+               if (ba1.LowestPrice >= FLT_MAX || ba2.LowestPrice >= FLT_MAX || ba3.LowestPrice >= FLT_MAX) newComposite.LowestPrice = FLT_MAX;
+               if (ba1.HighestPrice <= -FLT_MAX || ba2.HighestPrice <= -FLT_MAX || ba3.HighestPrice <= -FLT_MAX) newComposite.HighestPrice = -FLT_MAX;
+               newComposite.QualificationReason = finalReason; 
+               compositeBAs.push_back(newComposite);
+               baAttributed[j] = true; 
+               baAttributed[j+1] = true; 
+               baAttributed[j+2] = true;
+           }
+           if (DebugCompositeBA) { 
+               SCString detailedChecksStr; 
+               if (is_HLH || is_LHL) { 
+                   detailedChecksStr.Format("%s%s%s", containmentResultStr.c_str(), shiftResultStr.c_str(), ba1_ba2_GapResultStr.c_str()); 
+               } 
+               SCString finalStatusStr; 
+               if (qualifiesAsComposite) { 
+                   finalStatusStr.Format(" | Result=Qualified (Reason: %s)", finalReason.c_str()); 
+               } else { 
+                   finalStatusStr.Format(" | Result=Rejected (Reason: %s)", finalReason.c_str()); 
+               } 
+               logMsg.Format("Comp Check BA[%zu](%d-%d)/BA[%zu](%d-%d)/BA[%zu](%d-%d): Overlap=%s (%.1f,%.1f,%.1f) Pattern=%s%s%s%s", j, ba1.StartProfileChronoIndex, ba1.EndProfileChronoIndex, j + 1, ba2.StartProfileChronoIndex, ba2.EndProfileChronoIndex, j + 2, ba3.StartProfileChronoIndex, ba3.EndProfileChronoIndex, overlapType.c_str(), overlap_12, overlap_13, overlap_23, patternType.c_str(), detailedChecksStr.GetChars(), temporalGapStdStr.c_str(), finalStatusStr.GetChars()); 
+               logMessages.push_back(logMsg.GetChars()); 
+           }
+       } // End Composite BA loop (j)
+       if (DebugCompositeBA) logMessages.push_back("--- Finished Composite BA Detection ---");
+   } else if (DebugCompositeBA) { 
+       logMsg.Format("Not enough Finalized BAs (%zu) to perform Composite Check.", FinalizedBalanceAreas.size()); 
+       logMessages.push_back(logMsg.GetChars()); 
+   }
+}
+
+// NEW: Advances a run through formation and then composite detection. Returns true once the run is complete.
+bool AdvanceBAFormationRun(s_BAFormationRun& run, const std::vector<s_SessionProfile>& sessions, const std::function<bool()>& shouldYield) {
+    if (run.IsComplete) return true;
+    if (!ContinueBAFormation(run, sessions, shouldYield)) return false;
+    RunCompositeDetection(sessions, run.Result.FinalizedBalanceAreas, run.Params, run.CompositeStartIndex, run.Result.CompositeBAs, run.Result.LogMessages);
+    run.IsComplete = true;
+    return true;
+}
+
+// --- Parameter Sweep ---
+
+// NEW: Chart bars the sweep replays activation and cuts against
+struct s_SweepBars {
+    std::vector<float> High;
+    std::vector<float> Low;
+    std::vector<float> Open;        // Open, Close and DateTime are only filled by the .scid replay
+    std::vector<float> Close;
+    std::vector<double> DateTime;   // Bar start, in days as SCDateTime
+};
+
+// NEW: BAs of a replay, with the activation and cut state the study would hold for them
+struct s_ReplayedBAs {
+    std::vector<s_BalanceArea> BalanceAreas;    // In formation order
+    std::vector<s_BalanceArea> ActiveBAs;       // Activated BAs by activation bar
+    int CutCount = 0;
+};
+
+// NEW: Summary of one parameter combination
+struct s_SweepOutcome {
+    s_BAFormationParams Params;
+    int BACount = 0;
+    double AverageSessions = 0.0;   // Sessions per BA
+    double AverageBars = 0.0;       // Bars from BA start to formation end
+    int ActivatedCount = 0;
+    int CutCount = 0;
+    float GetActivationRate() const { return BACount > 0 ? 100.0f * ActivatedCount / BACount : 0.0f; }
+};
+
+// NEW: Parameters the sweep grid may vary, by the names used in the grid specification
+const std::pair<const char*, float s_BAFormationParams::*> SWEEP_PARAMETERS[] = {
+    { "MinVolOverlap", &s_BAFormationParams::MinVolOverlap },
+    { "MinVAOverlap", &s_BAFormationParams::MinVAOverlap },
+    { "ValueAreaPercentage", &s_BAFormationParams::ValueAreaPercentage },
+    { "RangeSimilarityPercent", &s_BAFormationParams::RangeSimilarityPercent },
+    { "HighLowTolerancePercent", &s_BAFormationParams::HighLowTolerancePercent },
+    { "MaxAbsSkewness", &s_BAFormationParams::MaxAbsSkewness },
+    { "MinExcessKurtosis", &s_BAFormationParams::MinExcessKurtosis },
+    { "MaxExcessKurtosis", &s_BAFormationParams::MaxExcessKurtosis }
+};
+const int MAX_SWEEP_COMBINATIONS = 10000;
+
+std::string TrimSweepToken(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos) return std::string();
+    size_t last = text.find_last_not_of(" \t");
+    return text.substr(first, last - first + 1);
+}
+
+bool ParseSweepFloat(const std::string& text, float& value) {
+    std::string token = TrimSweepToken(text);
+    if (token.empty()) return false;
+    char* end = nullptr;
+    value = std::strtof(token.c_str(), &end);
+    return end && *end == '\0';
+}
+
+// NEW: Expands a grid such as "MinVolOverlap=40:80:10; ValueAreaPercentage=68,70" (ranges are
+// start:end:step, lists are comma separated) into combinations. Parameters not named keep base's value.
+bool ParseSweepGrid(const std::string& spec, const s_BAFormationParams& base, std::vector<s_BAFormationParams>& combinations, std::string& error) {
+    combinations.assign(1, base);
+    size_t position = 0;
+    while (position <= spec.size()) {
+        size_t separator = spec.find(';', position);
+        if (separator == std::string::npos) separator = spec.size();
+        std::string axis = TrimSweepToken(spec.substr(position, separator - position));
+        position = separator + 1;
+        if (axis.empty()) continue;
+
+        size_t equals = axis.find('=');
+        std::string name = TrimSweepToken(axis.substr(0, equals));
+        float s_BAFormationParams::* member = nullptr;
+        for (const auto& parameter : SWEEP_PARAMETERS) {
+            if (name == parameter.first) member = parameter.second;
+        }
+        if (equals == std::string::npos || !member) {
+            error = "unknown parameter '" + name + "'";
+            return false;
+        }
+
+        std::string valueText = axis.substr(equals + 1);
+        std::vector<float> values;
+        size_t firstColon = valueText.find(':');
+        if (firstColon != std::string::npos) {
+            size_t secondColon = valueText.find(':', firstColon + 1);
+            float start, end, step;
+            if (secondColon == std::string::npos ||
+                !ParseSweepFloat(valueText.substr(0, firstColon), start) ||
+                !ParseSweepFloat(valueText.substr(firstColon + 1, secondColon - firstColon - 1), end) ||
+                !ParseSweepFloat(valueText.substr(secondColon + 1), step) || step <= 0.0f || end < start) {
+                error = "bad range for '" + name + "' (expected start:end:step)";
+                return false;
+            }
+            int count = static_cast<int>(std::floor((end - start) / step + 1e-4f)) + 1;
+            if (count > MAX_SWEEP_COMBINATIONS) count = MAX_SWEEP_COMBINATIONS + 1; // Rejected below
+            for (int n = 0; n < count; ++n) values.push_back(start + n * step);
+        } else {
+            size_t valuePosition = 0;
+            while (valuePosition <= valueText.size()) {
+                size_t comma = valueText.find(',', valuePosition);
+                if (comma == std::string::npos) comma = valueText.size();
+                float value;
+                if (!ParseSweepFloat(valueText.substr(valuePosition, comma - valuePosition), value)) {
+                    error = "bad value list for '" + name + "'";
+                    return false;
+                }
+                values.push_back(value);
+                valuePosition = comma + 1;
+            }
+        }
+
+        if (combinations.size() * values.size() > static_cast<size_t>(MAX_SWEEP_COMBINATIONS)) {
+            error = "more than " + std::to_string(MAX_SWEEP_COMBINATIONS) + " combinations";
+            return false;
+        }
+        std::vector<s_BAFormationParams> expanded;
+        expanded.reserve(combinations.size() * values.size());
+        for (const auto& combination : combinations) {
+            for (float value : values) {
+                expanded.push_back(combination);
+                expanded.back().*member = value;
+            }
+        }
+        combinations.swap(expanded);
+    }
+    return true;
+}
+
+// NEW: Activation and cuts of replayed.BalanceAreas, all without sc. They follow CheckForBAActivation/
+// UpdateBAExtensions for a chart whose bars are all present at once.
+void ReplayActivationsAndCuts(const s_BAFormationParams& params, const s_SweepBars& bars, s_ReplayedBAs& replayed) {
+    replayed.ActiveBAs.clear();
+    replayed.CutCount = 0;
+
+    const int arraySize = static_cast<int>(bars.High.size());
+    for (auto& ba : replayed.BalanceAreas) {
+        bool breakHigh = false;
+        int activationBar = FindBAActivationBar(ba, bars.High, bars.Low, 0, arraySize, params.TickSize, breakHigh);
+        if (activationBar < 0) continue;
+        ba.IsActivated = true;
+        ba.ActivationBarIndex = activationBar;
+        ba.ActivatedHigh = breakHigh;
+        ba.ActivatedLow = !breakHigh;
+        ba.IsExtending = true;
+        ba.ExtensionEndIndex = arraySize - 1;
+        replayed.ActiveBAs.push_back(ba);
+    }
+    std::sort(replayed.ActiveBAs.begin(), replayed.ActiveBAs.end(), [](const s_BalanceArea& a, const s_BalanceArea& b) {
+        return a.ActivationBarIndex < b.ActivationBarIndex;
+    });
+    std::map<std::pair<int, int>, s_BalanceArea*> finalizedByProfiles;
+    for (auto& ba : replayed.BalanceAreas) {
+        if (ba.IsActivated) finalizedByProfiles.emplace(std::make_pair(ba.StartProfileChronoIndex, ba.EndProfileChronoIndex), &ba);
+    }
+    for (size_t i = 0; i < replayed.ActiveBAs.size(); ++i) {
+        s_BalanceArea& activeBa = replayed.ActiveBAs[i];
+        int cutBarIndex = arraySize - 1;
+        const s_BalanceArea* intersectingBA = FindBACut(activeBa, i, replayed.BalanceAreas, replayed.ActiveBAs, params.TickSize, cutBarIndex);
+        if (!intersectingBA) continue;
+        replayed.CutCount++;
+        activeBa.ExtensionEndIndex = cutBarIndex;
+        activeBa.WasCut = true;
+        activeBa.IsExtending = false;
+        activeBa.CutByStartProfileIndex = intersectingBA->StartProfileChronoIndex;
+        activeBa.CutByEndProfileIndex = intersectingBA->EndProfileChronoIndex;
+    }
+    for (const auto& activeBa : replayed.ActiveBAs) { // After all cuts, since FindBACut reads the finalized list
+        s_BalanceArea& finalizedBa = *finalizedByProfiles[std::make_pair(activeBa.StartProfileChronoIndex, activeBa.EndProfileChronoIndex)];
+        finalizedBa.IsExtending = activeBa.IsExtending;
+        finalizedBa.ExtensionEndIndex = activeBa.ExtensionEndIndex;
+        finalizedBa.WasCut = activeBa.WasCut;
+        finalizedBa.CutByStartProfileIndex = activeBa.CutByStartProfileIndex;
+        finalizedBa.CutByEndProfileIndex = activeBa.CutByEndProfileIndex;
+    }
+}
+
+// NEW: Formation, activation and cuts, all without sc
+void ReplayBAFormation(const s_BAFormationParams& params, const std::vector<s_SessionProfile>& sessions, const std::vector<s_SessionPairMetrics>& pairMetrics, const s_SweepBars& bars, s_ReplayedBAs& replayed) {
+    s_BAFormationRun run;
+    run.Params = params;
+    run.PairMetrics = pairMetrics;
+    run.Result.FormationProfileUsed.assign(sessions.size(), false);
+    run.Result.FormationResumeIndex = std::max(0, static_cast<int>(sessions.size()) - 1);
+    ContinueBAFormation(run, sessions, nullptr);
+    replayed.BalanceAreas = std::move(run.Result.FinalizedBalanceAreas);
+    ReplayActivationsAndCuts(params, bars, replayed);
+}
+
+// NEW: Summary of one combination's replay
+s_SweepOutcome EvaluateSweepCombination(const s_BAFormationParams& params, const std::vector<s_SessionProfile>& sessions, const std::vector<s_SessionPairMetrics>& pairMetrics, const s_SweepBars& bars) {
+    s_SweepOutcome outcome;
+    outcome.Params = params;
+    s_ReplayedBAs replayed;
+    ReplayBAFormation(params, sessions, pairMetrics, bars, replayed);
+    for (const auto& ba : replayed.BalanceAreas) {
+        outcome.AverageSessions += ba.IncludedProfileIndices.size();
+        if (ba.StartBarIndex >= 0 && ba.EndBarIndex >= ba.StartBarIndex) outcome.AverageBars += ba.EndBarIndex - ba.StartBarIndex + 1;
+    }
+    outcome.BACount = static_cast<int>(replayed.BalanceAreas.size());
+    outcome.ActivatedCount = static_cast<int>(replayed.ActiveBAs.size());
+    outcome.CutCount = replayed.CutCount;
+    if (outcome.BACount > 0) {
+        outcome.AverageSessions /= outcome.BACount;
+        outcome.AverageBars /= outcome.BACount;
+    }
+    return outcome;
+}
+
+// NEW: Evaluates every combination in parallel over one set of loaded sessions. Session maps, moments and
+// histograms are shared by all combinations; volume overlap and range metrics are computed once, and only
+// the value area (and with it VA overlap) is recomputed per distinct ValueAreaPercentage. Once cancel is set,
+// the combinations not started yet are skipped.
+std::vector<s_SweepOutcome> RunParameterSweep(s_WorkerPool& pool, const std::vector<s_SessionProfile>& sessions, const s_SweepBars& bars, const std::vector<s_BAFormationParams>& combinations,
+                                              const std::atomic<bool>* cancel = nullptr) {
+    const int numSessions = static_cast<int>(sessions.size());
+    const int numPairs = std::max(0, numSessions - 1);
+    const float tickSize = combinations.empty() ? 0.0f : combinations.front().TickSize;
+    const int overlapResolution = combinations.empty() ? 1 : combinations.front().OverlapResolution;
+
+    std::vector<s_SessionPairMetrics> basePairMetrics(numPairs);
+    pool.ParallelFor(numPairs, [&](int pairIndex) {
+        basePairMetrics[pairIndex] = CalculateSessionPairMetrics(sessions[pairIndex], sessions[pairIndex + 1], tickSize, overlapResolution);
+    });
+
+    // One session/pair variant per distinct value area percentage
+    std::map<float, int> vaGroupIndex;
+    for (const auto& combination : combinations) vaGroupIndex.emplace(combination.ValueAreaPercentage, 0);
+    std::vector<std::vector<s_SessionProfile>> groupSessions;
+    std::vector<std::vector<s_SessionPairMetrics>> groupPairMetrics;
+    for (auto& group : vaGroupIndex) {
+        group.second = static_cast<int>(groupSessions.size());
+        groupSessions.push_back(sessions);
+        std::vector<s_SessionProfile>& variant = groupSessions.back();
+        pool.ParallelFor(numSessions, [&](int profileIndex) {
+            s_SessionProfile& profile = variant[profileIndex];
+            if (profile.Data->PriceMap.empty()) return;
+            float poc, vah, val, high, low, volume;
+            CalculateProfileMetrics(profile.Data->PriceMap, group.first, tickSize, poc, vah, val, high, low, volume);
+            profile.POC = poc;
+            profile.ValueAreaHigh = vah;
+            profile.ValueAreaLow = val;
+        });
+        groupPairMetrics.push_back(basePairMetrics);
+        std::vector<s_SessionPairMetrics>& variantPairs = groupPairMetrics.back();
+        for (int pairIndex = 0; pairIndex < numPairs; ++pairIndex) {
+            if (!variantPairs[pairIndex].IsValid) continue;
+            const s_SessionProfile& profile_i = variant[pairIndex];
+            const s_SessionProfile& profile_i1 = variant[pairIndex + 1];
+            variantPairs[pairIndex].VAOverlap = CalculateValueAreaOverlap(profile_i.ValueAreaHigh, profile_i.ValueAreaLow, profile_i1.ValueAreaHigh, profile_i1.ValueAreaLow, tickSize);
+        }
+    }
+
+    std::vector<s_SweepOutcome> outcomes(combinations.size());
+    pool.ParallelFor(static_cast<int>(combinations.size()), [&](int n) {
+        if (cancel != nullptr && cancel->load(std::memory_order_relaxed)) return;
+        int group = vaGroupIndex[combinations[n].ValueAreaPercentage];
+        outcomes[n] = EvaluateSweepCombination(combinations[n], groupSessions[group], groupPairMetrics[group], bars);
+    });
+    return outcomes;
+}
+
+bool WriteSweepResults(const std::string& path, const std::vector<s_SweepOutcome>& outcomes) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) return false;
+    fprintf(file, "MinVolOverlap,MinVAOverlap,ValueAreaPercentage,RangeSimilarityPercent,HighLowTolerancePercent,MaxAbsSkewness,MinExcessKurtosis,MaxExcessKurtosis,BACount,AvgSessions,AvgBars,ActivationRatePercent,CutCount\n");
+    for (const auto& outcome : outcomes) {
+        const s_BAFormationParams& p = outcome.Params;
+        fprintf(file, "%g,%g,%g,%g,%g,%g,%g,%g,%d,%.2f,%.1f,%.1f,%d\n",
+                p.MinVolOverlap, p.MinVAOverlap, p.ValueAreaPercentage, p.RangeSimilarityPercent, p.HighLowTolerancePercent,
+                p.MaxAbsSkewness, p.MinExcessKurtosis, p.MaxExcessKurtosis,
+                outcome.BACount, outcome.AverageSessions, outcome.AverageBars, outcome.GetActivationRate(), outcome.CutCount);
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,1189 @@
+// AutoBAs offline tools: the synthetic scaling benchmark, .scid replay, walk-forward backtest, point-in-time
+// timeline and multi-symbol scanner. They run the formation, activation and cut rules of AutoBAsCore.h over
+// history read without Sierra Chart. Include sierrachart.h or ScHostTypes.h first; like the core, this file
+// defines its functions, so a program includes it from one translation unit.
+#pragma once
+#include "../AutoBAsCore.h"
+#include <cstring>   // For std::memcmp (.scid header)
+#include <random>    // For the synthetic scaling benchmark history
+
+#ifndef _WIN32
+#include <sys/mman.h> // For mmap/munmap (.scid files)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// --- Scaling Benchmark ---
+
+struct s_ScalingBenchmarkResult {
+    int Sessions = 0;
+    double FullRecalcMs = 0.0;  // Session summaries, pair metrics, formation, composites, activation and cuts
+    double UpdateUs = 0.0;      // Average live update: rebuild the developing session, scan for activations
+    int BACount = 0;
+};
+
+// NEW: Deterministic synthetic history: ~80 levels per session around a random walk with a regime shift
+// every few sessions (so BAs form and break), 20 bars per session
+void BuildBenchmarkHistory(int numSessions, float tickSize, std::vector<std::vector<s_PriceLevelVolume>>& sessionLevels, std::vector<s_SessionProfile>& sessions, s_SweepBars& bars) {
+    std::mt19937 rng(12345);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    const int barsPerSession = 20;
+    float center = 4000.0f;
+    sessionLevels.assign(numSessions, std::vector<s_PriceLevelVolume>());
+    sessions.assign(numSessions, s_SessionProfile());
+    bars.High.clear();
+    bars.Low.clear();
+    for (int s = 0; s < numSessions; ++s) {
+        float anchor = std::round(center / tickSize) * tickSize;
+        for (int k = -40; k <= 40; ++k) {
+            s_PriceLevelVolume level;
+            level.Price = anchor + k * tickSize;
+            level.TotalVolume = 1000.0f * std::exp(-k * k / 300.0f) + static_cast<float>(rng() % 50);
+            level.NumberOfTrades = 10;
+            sessionLevels[s].push_back(level);
+        }
+        s_SessionProfile& profile = sessions[s];
+        profile.ChronologicalIndex = s;
+        profile.StartDateTime = SCDateTime(45000.0 + s);
+        profile.EndDateTime = SCDateTime(45000.0 + s + 0.99);
+        profile.BeginIndex = s * barsPerSession;
+        profile.EndIndex = profile.BeginIndex + barsPerSession - 1;
+        profile.ClosePrice = anchor;
+        profile.HighBarIndex = profile.BeginIndex;
+        profile.LowBarIndex = profile.BeginIndex + 1;
+        for (int b = 0; b < barsPerSession; ++b) {
+            bars.High.push_back(anchor + (5.0f + 10.0f * noise(rng)) * tickSize);
+            bars.Low.push_back(anchor - (5.0f - 10.0f * noise(rng)) * tickSize);
+        }
+        center += 8.0f * tickSize * noise(rng) + ((s % 7 == 6) ? 120.0f * tickSize * ((rng() % 2) ? 1.0f : -1.0f) : 0.0f);
+    }
+}
+
+// NEW: Times a full recalculation and the average live update over synthetic history of the given length.
+// The update mirrors the study's per-call path: rebuild the developing session and scan new bars for activations.
+s_ScalingBenchmarkResult RunScalingBenchmark(s_WorkerPool& pool, int numSessions, float tickSize) {
+    s_ScalingBenchmarkResult result;
+    result.Sessions = numSessions;
+    std::vector<std::vector<s_PriceLevelVolume>> sessionLevels;
+    std::vector<s_SessionProfile> sessions;
+    s_SweepBars bars;
+    BuildBenchmarkHistory(numSessions, tickSize, sessionLevels, sessions, bars);
+
+    s_BAFormationParams params;
+    params.TickSize = tickSize;
+    params.ValueAreaPercentage = 70.0f;
+    params.MinVolOverlap = 50.0f;
+    params.MinVAOverlap = 50.0f;
+    params.RangeSimilarityPercent = 30.0f;
+    params.HighLowTolerancePercent = 20.0f;
+    params.RangeContainmentPercent = 80.0f;
+
+    auto fullStart = std::chrono::steady_clock::now();
+    pool.ParallelFor(numSessions, [&](int s) {
+        AssignSessionVolumeData(sessions[s], BuildSessionVolumeData(sessionLevels[s].data(), sessionLevels[s].size(), params.ValueAreaPercentage, tickSize));
+    });
+    s_BAFormationRun run;
+    run.Params = params;
+    run.PairMetrics.assign(std::max(0, numSessions - 1), s_SessionPairMetrics());
+    pool.ParallelFor(static_cast<int>(run.PairMetrics.size()), [&](int pairIndex) {
+        run.PairMetrics[pairIndex] = CalculateSessionPairMetrics(sessions[pairIndex], sessions[pairIndex + 1], tickSize, params.OverlapResolution);
+    });
+    run.Result.FormationProfileUsed.assign(numSessions, false);
+    run.Result.FormationResumeIndex = std::max(0, numSessions - 1);
+    AdvanceBAFormationRun(run, sessions, nullptr);
+    std::vector<s_BalanceArea>& balanceAreas = run.Result.FinalizedBalanceAreas;
+    int arraySize = static_cast<int>(bars.High.size());
+    std::vector<s_BalanceArea> activeBAs;
+    for (auto& ba : balanceAreas) {
+        bool breakHigh = false;
+        int activationBar = FindBAActivationBar(ba, bars.High, bars.Low, ba.ActivationCheckedBarIndex, arraySize, tickSize, breakHigh);
+        if (activationBar < 0) { ba.ActivationCheckedBarIndex = arraySize - 1; continue; }
+        ba.IsActivated = true;
+        ba.ActivationBarIndex = activationBar;
+        activeBAs.push_back(ba);
+    }
+    std::sort(activeBAs.begin(), activeBAs.end(), [](const s_BalanceArea& a, const s_BalanceArea& b) {
+        return a.ActivationBarIndex < b.ActivationBarIndex;
+    });
+    for (size_t i = 0; i < activeBAs.size(); ++i) {
+        int cutBarIndex = arraySize - 1;
+        FindBACut(activeBAs[i], i, balanceAreas, activeBAs, tickSize, cutBarIndex);
+    }
+    result.FullRecalcMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fullStart).count();
+    result.BACount = static_cast<int>(balanceAreas.size());
+
+    // Live updates: a new bar inside the developing session's range each time
+    const int numUpdates = 200;
+    std::vector<s_PriceLevelVolume>& developingLevels = sessionLevels.back();
+    s_SessionProfile& developing = sessions.back();
+    std::shared_ptr<s_SessionVolumeData> developingData = std::make_shared<s_SessionVolumeData>(*developing.Data);
+    bars.High.reserve(bars.High.size() + numUpdates);
+    bars.Low.reserve(bars.Low.size() + numUpdates);
+    auto updateStart = std::chrono::steady_clock::now();
+    for (int u = 0; u < numUpdates; ++u) {
+        developingLevels[u % developingLevels.size()].TotalVolume += 1.0f;
+        FillSessionVolumeData(*developingData, developingLevels.data(), developingLevels.size(), params.ValueAreaPercentage, tickSize); // As the study does
+        AssignSessionVolumeData(developing, developingData);
+        bars.High.push_back(developing.ValueAreaHigh);
+        bars.Low.push_back(developing.ValueAreaLow);
+        arraySize = static_cast<int>(bars.High.size());
+        for (auto& ba : balanceAreas) {
+            if (ba.IsActivated) continue;
+            bool breakHigh = false;
+            int activationBar = FindBAActivationBar(ba, bars.High, bars.Low, ba.ActivationCheckedBarIndex, arraySize, tickSize, breakHigh);
+            if (activationBar < 0) ba.ActivationCheckedBarIndex = arraySize - 1;
+            else { ba.IsActivated = true; ba.ActivationBarIndex = activationBar; }
+        }
+    }
+    result.UpdateUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - updateStart).count() / numUpdates;
+    return result;
+}
+
+// --- Offline .scid Replay ---
+// Runs formation, activation and cuts over a Sierra Chart intraday data (.scid) file without the chart, for
+// research over long tick histories. The file is memory mapped and records are read in place; sessions start
+// at a fixed time of day, and each session's profile and bars are built on the worker pool.
+
+// Documented .scid layout: a 56 byte header, then 40 byte records in time order. DateTime is microseconds
+// since 1899-12-30 (SCDateTimeMS, UTC). Tick records have Open == 0 or an unbundled trade marker and carry
+// the trade in Close (bid/ask in Low/High); bar records carry real OHLC.
+const int64_t SCID_MICROSECONDS_PER_DAY = 86400LL * 1000000LL;
+const float SCID_FIRST_SUB_TRADE_OF_UNBUNDLED_TRADE = -1.99900095e+37f;
+const float SCID_LAST_SUB_TRADE_OF_UNBUNDLED_TRADE = -1.99900197e+37f;
+
+#pragma pack(push, 1)
+struct s_ScidFileHeader {
+    char FileTypeUniqueHeaderID[4] = { 'S', 'C', 'I', 'D' };
+    uint32_t HeaderSize = 56;
+    uint32_t RecordSize = 40;
+    uint16_t Version = 1;
+    uint16_t Unused1 = 0;
+    uint32_t UTCStartIndex = 0;
+    char Reserve[36] = {};
+};
+
+struct s_ScidRecord {
+    int64_t DateTime = 0;
+    float Open = 0.0f;
+    float High = 0.0f;
+    float Low = 0.0f;
+    float Close = 0.0f;
+    uint32_t NumTrades = 0;
+    uint32_t TotalVolume = 0;
+    uint32_t BidVolume = 0;
+    uint32_t AskVolume = 0;
+};
+#pragma pack(pop)
+
+bool IsScidTradeRecord(const s_ScidRecord& record) {
+    return record.Open == 0.0f || record.Open == SCID_FIRST_SUB_TRADE_OF_UNBUNDLED_TRADE || record.Open == SCID_LAST_SUB_TRADE_OF_UNBUNDLED_TRADE;
+}
+
+// Read-only memory mapping of a .scid file; records are used straight from the mapping
+struct s_ScidFile {
+    std::string Path;
+    const uint8_t* Data = nullptr;
+    size_t Size = 0;
+#ifdef _WIN32
+    HANDLE FileHandle = INVALID_HANDLE_VALUE;
+    HANDLE MappingHandle = NULL;
+#endif
+
+    s_ScidFile() = default;
+    s_ScidFile(const s_ScidFile&) = delete;
+    s_ScidFile& operator=(const s_ScidFile&) = delete;
+    ~s_ScidFile() { Close(); }
+
+    bool IsOpen() const { return Data != nullptr; }
+
+    const s_ScidFileHeader* GetHeader() const {
+        return reinterpret_cast<const s_ScidFileHeader*>(Data);
+    }
+
+    const s_ScidRecord* GetRecords() const {
+        return reinterpret_cast<const s_ScidRecord*>(Data + GetHeader()->HeaderSize);
+    }
+
+    // A partly written last record (Sierra Chart still appending) is not counted
+    size_t GetRecordCount() const {
+        return IsOpen() ? (Size - GetHeader()->HeaderSize) / sizeof(s_ScidRecord) : 0;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (Data != nullptr) UnmapViewOfFile(Data);
+        if (MappingHandle != NULL) CloseHandle(MappingHandle);
+        if (FileHandle != INVALID_HANDLE_VALUE) CloseHandle(FileHandle);
+        MappingHandle = NULL;
+        FileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (Data != nullptr) munmap(const_cast<uint8_t*>(Data), Size);
+#endif
+        Data = nullptr;
+        Size = 0;
+    }
+
+    // Maps the file and checks the header. Returns false (and stays closed) if it is not a .scid file.
+    bool Open(const std::string& path) {
+        Close();
+        Path = path;
+#ifdef _WIN32
+        FileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (FileHandle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(FileHandle, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(s_ScidFileHeader)) { Close(); return false; }
+        MappingHandle = CreateFileMappingA(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (MappingHandle == NULL) { Close(); return false; }
+        Data = reinterpret_cast<const uint8_t*>(MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (Data == nullptr) { Close(); return false; }
+        Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(s_ScidFileHeader)) { close(fd); return false; }
+        void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) return false;
+        Data = reinterpret_cast<const uint8_t*>(mapped);
+        Size = static_cast<size_t>(st.st_size);
+#endif
+        const s_ScidFileHeader* header = GetHeader();
+        bool valid = std::memcmp(header->FileTypeUniqueHeaderID, "SCID", 4) == 0 &&
+                     header->HeaderSize >= sizeof(s_ScidFileHeader) && header->HeaderSize <= Size &&
+                     header->RecordSize == sizeof(s_ScidRecord);
+        if (!valid) { Close(); return false; }
+        return true;
+    }
+};
+
+// Writes records as a .scid file, e.g. a fixture to replay
+bool WriteScidFile(const std::string& path, const std::vector<s_ScidRecord>& records) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    s_ScidFileHeader header;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              (records.empty() || fwrite(records.data(), sizeof(s_ScidRecord), records.size(), file) == records.size());
+    return (fclose(file) == 0) && ok;
+}
+
+struct s_ScidReplayOptions {
+    float TickSize = 0.25f;
+    int TickMultiplier = 1;             // Profile price granularity, as the VbP study's tick multiplier
+    float ValueAreaPercentage = 70.0f;
+    double SessionStartTime = 0.0;      // Time of day each session starts, as a fraction of a day in the file's UTC times
+    int BarSeconds = 60;                // Bar interval from the session start; intervals without records get no bar
+};
+
+// Sessions and bars replayed from a .scid file, laid out as the study would see them on a chart
+struct s_ScidReplay {
+    std::vector<s_SessionProfile> Sessions;
+    s_SweepBars Bars;
+    size_t RecordCount = 0;
+};
+
+// One session built on a worker: profile plus bars indexed from 0
+struct s_ScidSessionBuild {
+    s_SessionProfile Profile;
+    s_SweepBars Bars;
+};
+
+// NEW: [first, last) record range of each session. Records are in time order, so each boundary is one binary search.
+std::vector<std::pair<size_t, size_t>> FindScidSessionChunks(const s_ScidRecord* records, size_t count, int64_t sessionStartOffset, std::vector<int64_t>& sessionStarts) {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    sessionStarts.clear();
+    size_t first = 0;
+    while (first < count) {
+        int64_t offset = records[first].DateTime - sessionStartOffset;
+        int64_t day = offset / SCID_MICROSECONDS_PER_DAY - ((offset % SCID_MICROSECONDS_PER_DAY) < 0 ? 1 : 0);
+        int64_t sessionStart = day * SCID_MICROSECONDS_PER_DAY + sessionStartOffset;
+        int64_t nextStart = sessionStart + SCID_MICROSECONDS_PER_DAY;
+        const s_ScidRecord* end = std::lower_bound(records + first, records + count, nextStart,
+            [](const s_ScidRecord& record, int64_t value) { return record.DateTime < value; });
+        size_t last = static_cast<size_t>(end - records);
+        chunks.emplace_back(first, last);
+        sessionStarts.push_back(sessionStart);
+        first = last;
+    }
+    return chunks;
+}
+
+// NEW: Builds one session's profile and bars from its records. Volume goes to the Close price at the profile
+// granularity (for bar records that is only an approximation), then the session gets the same data the study
+// builds from VbP levels.
+void BuildScidSession(const s_ScidRecord* records, size_t count, int64_t sessionStart, const s_ScidReplayOptions& options, s_ScidSessionBuild& build) {
+    const float tickSize = options.TickSize;
+    const int tickMultiplier = std::max(1, options.TickMultiplier);
+    int minTick = INT_MAX;
+    int maxTick = INT_MIN;
+    for (size_t n = 0; n < count; ++n) {
+        if (records[n].TotalVolume == 0) continue;
+        int tick = FloorDiv(static_cast<int>(std::lround(records[n].Close / tickSize)), tickMultiplier);
+        minTick = std::min(minTick, tick);
+        maxTick = std::max(maxTick, tick);
+    }
+    s_SessionProfile& profile = build.Profile;
+    int64_t span = static_cast<int64_t>(maxTick) - minTick + 1;
+    if (minTick <= maxTick && span <= PROFILE_CACHE_MAX_LEVELS) {
+        std::vector<s_ProfileCacheLevel> dense(static_cast<size_t>(span));
+        for (size_t n = 0; n < count; ++n) {
+            if (records[n].TotalVolume == 0) continue;
+            s_ProfileCacheLevel& level = dense[FloorDiv(static_cast<int>(std::lround(records[n].Close / tickSize)), tickMultiplier) - minTick];
+            level.Volume += records[n].TotalVolume;
+            level.NumberOfTrades += std::max<uint32_t>(1, records[n].NumTrades);
+        }
+        std::vector<s_PriceLevelVolume> levels;
+        for (size_t delta = 0; delta < dense.size(); ++delta) {
+            if (dense[delta].Volume == 0) continue;
+            s_PriceLevelVolume plv;
+            plv.Price = static_cast<float>((minTick + static_cast<int>(delta)) * tickSize * tickMultiplier);
+            plv.TotalVolume = static_cast<float>(dense[delta].Volume);
+            plv.NumberOfTrades = static_cast<int>(dense[delta].NumberOfTrades);
+            levels.push_back(plv);
+        }
+        AssignSessionVolumeData(profile, BuildSessionVolumeData(levels.data(), levels.size(), options.ValueAreaPercentage, tickSize));
+    }
+
+    const int64_t barLength = static_cast<int64_t>(std::max(1, options.BarSeconds)) * 1000000LL;
+    s_SweepBars& bars = build.Bars;
+    int64_t currentBar = -1;
+    for (size_t n = 0; n < count; ++n) {
+        const s_ScidRecord& record = records[n];
+        bool trade = IsScidTradeRecord(record);
+        float high = trade ? record.Close : record.High;
+        float low = trade ? record.Close : record.Low;
+        int64_t barNumber = (record.DateTime - sessionStart) / barLength;
+        if (barNumber != currentBar) {
+            currentBar = barNumber;
+            bars.Open.push_back(trade ? record.Close : record.Open);
+            bars.High.push_back(high);
+            bars.Low.push_back(low);
+            bars.Close.push_back(record.Close);
+            bars.DateTime.push_back(static_cast<double>(sessionStart + barNumber * barLength) / SCID_MICROSECONDS_PER_DAY);
+        } else {
+            bars.High.back() = std::max(bars.High.back(), high);
+            bars.Low.back() = std::min(bars.Low.back(), low);
+            bars.Close.back() = record.Close;
+        }
+    }
+    profile.StartDateTime = SCDateTime(static_cast<double>(sessionStart) / SCID_MICROSECONDS_PER_DAY);
+    profile.EndDateTime = SCDateTime(count > 0 ? static_cast<double>(records[count - 1].DateTime) / SCID_MICROSECONDS_PER_DAY : profile.StartDateTime.GetAsDouble());
+}
+
+// NEW: Splits the file into sessions, builds them in parallel and lays their bars out one after another as a
+// chart would. Sessions without volume (e.g. settlement-only records) are left out along with their bars.
+void LoadScidReplay(s_WorkerPool& pool, const s_ScidFile& file, const s_ScidReplayOptions& options, s_ScidReplay& replay) {
+    const s_ScidRecord* records = file.GetRecords();
+    replay.RecordCount = file.GetRecordCount();
+    std::vector<int64_t> sessionStarts;
+    int64_t sessionStartOffset = static_cast<int64_t>(std::llround(options.SessionStartTime * SCID_MICROSECONDS_PER_DAY));
+    std::vector<std::pair<size_t, size_t>> chunks = FindScidSessionChunks(records, replay.RecordCount, sessionStartOffset, sessionStarts);
+
+    std::vector<s_ScidSessionBuild> builds(chunks.size());
+    pool.ParallelFor(static_cast<int>(chunks.size()), [&](int chunkIndex) {
+        const auto& chunk = chunks[chunkIndex];
+        BuildScidSession(records + chunk.first, chunk.second - chunk.first, sessionStarts[chunkIndex], options, builds[chunkIndex]);
+    });
+
+    replay.Sessions.clear();
+    replay.Bars = s_SweepBars();
+    for (auto& build : builds) {
+        if (build.Profile.Data->IsEmpty() || build.Bars.High.empty()) continue;
+        s_SessionProfile& profile = build.Profile;
+        profile.ChronologicalIndex = static_cast<int>(replay.Sessions.size());
+        profile.BeginIndex = static_cast<int>(replay.Bars.High.size());
+        profile.EndIndex = profile.BeginIndex + static_cast<int>(build.Bars.High.size()) - 1;
+        replay.Bars.Open.insert(replay.Bars.Open.end(), build.Bars.Open.begin(), build.Bars.Open.end());
+        replay.Bars.High.insert(replay.Bars.High.end(), build.Bars.High.begin(), build.Bars.High.end());
+        replay.Bars.Low.insert(replay.Bars.Low.end(), build.Bars.Low.begin(), build.Bars.Low.end());
+        replay.Bars.Close.insert(replay.Bars.Close.end(), build.Bars.Close.begin(), build.Bars.Close.end());
+        replay.Bars.DateTime.insert(replay.Bars.DateTime.end(), build.Bars.DateTime.begin(), build.Bars.DateTime.end());
+        replay.Sessions.push_back(std::move(profile));
+    }
+    CaptureSessionBarData(replay.Bars.High, replay.Bars.Low, replay.Bars.Close, static_cast<int>(replay.Bars.High.size()), replay.Sessions, options.TickSize);
+}
+
+// NEW: Pair metrics on the pool, then the same replay the parameter sweep runs per combination.
+// params.ValueAreaPercentage should match the one the sessions were loaded with.
+void RunScidReplayDetection(s_WorkerPool& pool, const s_ScidReplay& replay, const s_BAFormationParams& params, s_ReplayedBAs& replayed) {
+    const int numPairs = std::max(0, static_cast<int>(replay.Sessions.size()) - 1);
+    std::vector<s_SessionPairMetrics> pairMetrics(numPairs);
+    pool.ParallelFor(numPairs, [&](int pairIndex) {
+        pairMetrics[pairIndex] = CalculateSessionPairMetrics(replay.Sessions[pairIndex], replay.Sessions[pairIndex + 1], params.TickSize, params.OverlapResolution);
+    });
+    ReplayBAFormation(params, replay.Sessions, pairMetrics, replay.Bars, replayed);
+}
+
+// NEW: Formation parameters at the study's input defaults, for the replay's tick size and VA%
+s_BAFormationParams DefaultReplayFormationParams(const s_ScidReplayOptions& options) {
+    s_BAFormationParams params;
+    params.TickSize = options.TickSize;
+    params.ValueAreaPercentage = options.ValueAreaPercentage;
+    params.MinVolOverlap = 50.0f;
+    params.MinVAOverlap = 50.0f;
+    params.RangeSimilarityPercent = 30.0f;
+    params.HighLowTolerancePercent = 20.0f;
+    params.RangeContainmentPercent = 80.0f;
+    return params;
+}
+
+// NEW: The synthetic benchmark history as .scid bar records: each bar carries the benchmark bar's high and low,
+// and the session's levels are spread over its bars as closes, so a replay sees the same profiles and bars.
+void BuildBenchmarkScidRecords(int numSessions, float tickSize, int barSeconds, std::vector<s_ScidRecord>& records) {
+    std::vector<std::vector<s_PriceLevelVolume>> sessionLevels;
+    std::vector<s_SessionProfile> sessions;
+    s_SweepBars bars;
+    BuildBenchmarkHistory(numSessions, tickSize, sessionLevels, sessions, bars);
+    records.clear();
+    for (int s = 0; s < numSessions; ++s) {
+        const int numBars = sessions[s].EndIndex - sessions[s].BeginIndex + 1;
+        const int64_t sessionStart = static_cast<int64_t>(std::llround(sessions[s].StartDateTime.GetAsDouble() * SCID_MICROSECONDS_PER_DAY));
+        for (int b = 0; b < numBars; ++b) {
+            const int barIndex = sessions[s].BeginIndex + b;
+            for (size_t levelIndex = b; levelIndex < sessionLevels[s].size(); levelIndex += numBars) {
+                const s_PriceLevelVolume& level = sessionLevels[s][levelIndex];
+                s_ScidRecord record;
+                record.DateTime = sessionStart + static_cast<int64_t>(b) * barSeconds * 1000000LL + static_cast<int64_t>(levelIndex);
+                record.Open = record.Close = level.Price;
+                record.High = bars.High[barIndex];
+                record.Low = bars.Low[barIndex];
+                record.NumTrades = static_cast<uint32_t>(level.NumberOfTrades);
+                record.TotalVolume = static_cast<uint32_t>(std::lround(level.TotalVolume));
+                records.push_back(record);
+            }
+        }
+    }
+}
+
+// --- Walk-Forward Backtest ---
+// Replays sessions and bars (e.g. from a .scid file) through formation, activation, cuts and PBAH/L creation,
+// then measures what price did after each event: touches of the event's level, time to the first touch, the
+// rejection away from it and whether price closed through it. Reactions are only measured from the bar at
+// which a live chart could know the event, so a BA confirmed after its breakout is not credited with it.
+
+struct s_BacktestOptions {
+    int ShardSessions = 250;            // Sessions per shard (about a year); results do not depend on it
+    int OverlapSessions = 40;           // Extra sessions a shard forms over to meet its neighbours
+    int HorizonBars = 1440;             // Bars after an event that its reaction is measured over
+    float TouchToleranceTicks = 0.0f;   // Added to the half tick every level comparison allows
+    float PBALPierceThreshold = 15.0f;
+};
+
+enum e_BacktestEventType {
+    BACKTEST_ACTIVATION = 0,            // Level: the broken VA edge; price is beyond it
+    BACKTEST_CUT,                       // Level: the cut BA's VA edge in the direction of the cutting breakout
+    BACKTEST_PBAH,
+    BACKTEST_PBAL,
+    BACKTEST_EVENT_TYPES
+};
+const char* const BACKTEST_EVENT_NAMES[BACKTEST_EVENT_TYPES] = { "Activation", "Cut", "PBAH", "PBAL" };
+
+struct s_BacktestEvent {
+    int Type = BACKTEST_ACTIVATION;
+    int BAIndex = -1;               // In the replayed BAs; the cut BA for cuts and PBAH/Ls
+    int EventBar = -1;              // Activation bar, or the cutting BA's activation bar
+    int KnownBar = -1;              // First bar at which a live chart has the event
+    float Level = 0.0f;
+    int Side = 1;                   // +1: price starts above the level, -1: below
+    int FirstTouchBar = -1;
+    int Touches = 0;                // Separate returns to the level
+    float Rejection = 0.0f;         // Largest move away from the level after the first touch, before a break
+    int BreakBar = -1;              // First close through the level
+    double MinutesToTouch = -1.0;
+};
+
+struct s_BacktestStats {
+    int Count = 0;
+    int Retroactive = 0;            // Events that happened before the chart could know them
+    int Touched = 0;
+    int Broken = 0;
+    double SumBarsToTouch = 0.0;
+    double SumMinutesToTouch = 0.0;
+    double SumTouches = 0.0;
+    double SumRejection = 0.0;
+    float MaxRejection = 0.0f;
+    float GetBreakThroughRate() const { return Touched > 0 ? 100.0f * Broken / Touched : 0.0f; }
+};
+
+struct s_BacktestResult {
+    s_ReplayedBAs BAs;
+    std::vector<s_ProbeLineDrawingInfo> Probes;
+    std::vector<s_BacktestEvent> Events;            // By KnownBar, then type, BA and level
+    s_BacktestStats Stats[BACKTEST_EVENT_TYPES];
+    int NumShards = 0;
+    int ReformedShards = 0;                         // Shards that had to be formed again from their neighbour's state
+};
+
+// NEW: Formation from startIndex over the sessions before endIndex, as the study would run it on a chart
+// holding only those sessions
+s_BAFormationResult FormBacktestShard(const s_BAFormationParams& params, const std::vector<s_SessionProfile>& sessions, const std::vector<s_SessionPairMetrics>& pairMetrics, int startIndex, int endIndex) {
+    std::vector<s_SessionProfile> window(sessions.begin(), sessions.begin() + endIndex);
+    s_BAFormationRun run;
+    run.Params = params;
+    run.PairMetrics.assign(pairMetrics.begin(), pairMetrics.begin() + std::max(0, endIndex - 1));
+    run.NextProfileIndex = startIndex;
+    run.Result.FormationProfileUsed.assign(endIndex, false);
+    run.Result.FormationResumeIndex = std::max(0, endIndex - 1);
+    ContinueBAFormation(run, window, nullptr);
+    return std::move(run.Result);
+}
+
+// NEW: Formation sharded by session ranges, with the same result as one pass over all sessions. Each shard forms
+// over its range plus an overlap. Formation only carries the next initiation candidate from one session to the
+// next, so once two neighbouring shards both tried (and failed) an initiation at the same session, they agree
+// from there on: BAs before that session come from the earlier shard and BAs from it on from the later one.
+// A shard that never meets its neighbour in the overlap is formed again from the last candidate its neighbour tried.
+void FormShardedBalanceAreas(s_WorkerPool& pool, const s_BAFormationParams& params, const std::vector<s_SessionProfile>& sessions, const std::vector<s_SessionPairMetrics>& pairMetrics,
+                             const s_BacktestOptions& options, std::vector<s_BalanceArea>& balanceAreas, std::vector<s_ProbeLineDrawingInfo>& probes, int& numShards, int& reformedShards) {
+    const int numSessions = static_cast<int>(sessions.size());
+    const int shardSessions = std::max(2, options.ShardSessions);
+    const int overlap = std::max(2, std::min(options.OverlapSessions, shardSessions / 2));
+    numShards = std::max(1, (numSessions + shardSessions - 1) / shardSessions);
+    reformedShards = 0;
+
+    std::vector<int> windowStarts(numShards), windowEnds(numShards);
+    std::vector<s_BAFormationResult> shards(numShards);
+    for (int shard = 0; shard < numShards; ++shard) {
+        windowStarts[shard] = std::max(0, shard * shardSessions - overlap);
+        windowEnds[shard] = std::min(numSessions, (shard + 1) * shardSessions + overlap);
+    }
+    pool.ParallelFor(numShards, [&](int shard) {
+        shards[shard] = FormBacktestShard(params, sessions, pairMetrics, windowStarts[shard], windowEnds[shard]);
+    });
+
+    // Session from which each shard's BAs are taken; shard 0 starts where a single pass does
+    std::vector<int> syncIndices(numShards + 1, numSessions);
+    syncIndices[0] = 0;
+    for (int shard = 1; shard < numShards; ++shard) {
+        const std::vector<bool>& previousUsed = shards[shard - 1].FormationProfileUsed;
+        const std::vector<bool>& used = shards[shard].FormationProfileUsed;
+        const int shardStart = shard * shardSessions;
+        const int searchEnd = windowEnds[shard - 1] - 2; // The previous shard could still try an initiation there
+        int syncIndex = -1;
+        for (int i = shardStart; i < searchEnd && syncIndex < 0; ++i) {
+            if (!previousUsed[i] && !used[i]) syncIndex = i;
+        }
+        if (syncIndex < 0) {
+            syncIndex = syncIndices[shard - 1];
+            for (int i = shardStart - 1; i > syncIndices[shard - 1]; --i) {
+                if (!previousUsed[i]) { syncIndex = i; break; }
+            }
+            shards[shard] = FormBacktestShard(params, sessions, pairMetrics, syncIndex, windowEnds[shard]);
+            reformedShards++;
+        }
+        syncIndices[shard] = syncIndex;
+    }
+
+    balanceAreas.clear();
+    probes.clear();
+    for (int shard = 0; shard < numShards; ++shard) {
+        const int first = syncIndices[shard];
+        const int last = syncIndices[shard + 1];
+        for (auto& ba : shards[shard].FinalizedBalanceAreas) {
+            if (ba.StartProfileChronoIndex >= first && ba.StartProfileChronoIndex < last) balanceAreas.push_back(std::move(ba));
+        }
+        for (const auto& probe : shards[shard].ProbeLinesToDraw) {
+            if (probe.BAStartProfileIndex >= first && probe.BAStartProfileIndex < last) probes.push_back(probe);
+        }
+    }
+}
+
+// NEW: First bar at which the BA exists on a live chart: the end of the session after its last one, which is
+// the session whose extension check failed
+int BacktestKnownBar(const s_BalanceArea& ba, const std::vector<s_SessionProfile>& sessions, int lastBar) {
+    int confirmingSession = ba.EndProfileChronoIndex + 1;
+    if (confirmingSession < 0 || confirmingSession >= static_cast<int>(sessions.size())) return lastBar;
+    return std::min(lastBar, sessions[confirmingSession].EndIndex);
+}
+
+// NEW: Touches, rejection and break of the event's level over the bars after KnownBar
+void MeasureLevelReaction(const s_SweepBars& bars, int horizonBars, float tolerance, s_BacktestEvent& event) {
+    const int lastBar = std::min(static_cast<int>(bars.High.size()) - 1, event.KnownBar + std::max(1, horizonBars));
+    const float level = event.Level;
+    bool wasTouching = false;
+    for (int barIndex = event.KnownBar + 1; barIndex <= lastBar; ++barIndex) {
+        const float high = bars.High[barIndex];
+        const float low = bars.Low[barIndex];
+        const float close = bars.Close.empty() ? (high + low) / 2.0f : bars.Close[barIndex];
+        bool touching = event.Side > 0 ? low <= level + tolerance : high >= level - tolerance;
+        if (touching && !wasTouching) {
+            event.Touches++;
+            if (event.FirstTouchBar < 0) event.FirstTouchBar = barIndex;
+        }
+        wasTouching = touching;
+        if (event.Side > 0 ? close < level - tolerance : close > level + tolerance) {
+            event.BreakBar = barIndex;
+            break;
+        }
+        if (event.FirstTouchBar >= 0) event.Rejection = std::max(event.Rejection, event.Side > 0 ? high - level : level - low);
+    }
+    if (event.FirstTouchBar >= 0 && !bars.DateTime.empty()) {
+        event.MinutesToTouch = (bars.DateTime[event.FirstTouchBar] - bars.DateTime[event.KnownBar]) * 1440.0;
+    }
+}
+
+// NEW: The full backtest. Sessions are formed in shards on the pool, activation, cuts and PBAH/L creation follow
+// CheckForBAActivation/UpdateBAExtensions/CheckForPBALCreation, and reactions are measured per event on the pool.
+// Events are ordered by the bar they became known at and totalled in that order, so the result does not depend
+// on the number of threads.
+void RunWalkForwardBacktest(s_WorkerPool& pool, const std::vector<s_SessionProfile>& sessions, const s_SweepBars& bars, const s_BAFormationParams& params,
+                            const s_BacktestOptions& options, s_BacktestResult& result) {
+    const int numPairs = std::max(0, static_cast<int>(sessions.size()) - 1);
+    std::vector<s_SessionPairMetrics> pairMetrics(numPairs);
+    pool.ParallelFor(numPairs, [&](int pairIndex) {
+        pairMetrics[pairIndex] = CalculateSessionPairMetrics(sessions[pairIndex], sessions[pairIndex + 1], params.TickSize, params.OverlapResolution);
+    });
+    FormShardedBalanceAreas(pool, params, sessions, pairMetrics, options, result.BAs.BalanceAreas, result.Probes, result.NumShards, result.ReformedShards);
+    ReplayActivationsAndCuts(params, bars, result.BAs);
+
+    const std::vector<s_BalanceArea>& balanceAreas = result.BAs.BalanceAreas;
+    const int lastBar = static_cast<int>(bars.High.size()) - 1;
+    std::map<std::pair<int, int>, int> indexByProfiles;
+    for (size_t n = 0; n < balanceAreas.size(); ++n) {
+        indexByProfiles.emplace(std::make_pair(balanceAreas[n].StartProfileChronoIndex, balanceAreas[n].EndProfileChronoIndex), static_cast<int>(n));
+    }
+    auto activationKnownBar = [&](const s_BalanceArea& ba) { return std::max(ba.ActivationBarIndex, BacktestKnownBar(ba, sessions, lastBar)); };
+
+    result.Events.clear();
+    for (size_t n = 0; n < balanceAreas.size(); ++n) {
+        const s_BalanceArea& ba = balanceAreas[n];
+        if (!ba.IsActivated) continue;
+        s_BacktestEvent event;
+        event.Type = BACKTEST_ACTIVATION;
+        event.BAIndex = static_cast<int>(n);
+        event.EventBar = ba.ActivationBarIndex;
+        event.KnownBar = activationKnownBar(ba);
+        event.Side = ba.ActivatedHigh ? 1 : -1;
+        event.Level = ba.ActivatedHigh ? ba.ValueAreaHigh : ba.ValueAreaLow;
+        result.Events.push_back(event);
+    }
+    for (const auto& cutBA : result.BAs.ActiveBAs) {
+        if (!cutBA.WasCut) continue;
+        auto cutter = indexByProfiles.find(std::make_pair(cutBA.CutByStartProfileIndex, cutBA.CutByEndProfileIndex));
+        auto cut = indexByProfiles.find(std::make_pair(cutBA.StartProfileChronoIndex, cutBA.EndProfileChronoIndex));
+        if (cutter == indexByProfiles.end() || cut == indexByProfiles.end()) continue;
+        const s_BalanceArea& intersectingBA = balanceAreas[cutter->second];
+        s_BacktestEvent event;
+        event.BAIndex = cut->second;
+        event.EventBar = cutBA.ExtensionEndIndex;
+        event.KnownBar = std::max(activationKnownBar(cutBA), activationKnownBar(intersectingBA));
+        event.Type = BACKTEST_CUT;
+        event.Side = intersectingBA.ActivatedHigh ? 1 : -1;
+        event.Level = intersectingBA.ActivatedHigh ? cutBA.ValueAreaHigh : cutBA.ValueAreaLow;
+        result.Events.push_back(event);
+
+        bool createHigh = false, createLow = false;
+        FindPBALPierces(cutBA, intersectingBA, options.PBALPierceThreshold, createHigh, createLow);
+        for (int high = 1; high >= 0; --high) {
+            if (high ? !createHigh : !createLow) continue;
+            event.Type = high ? BACKTEST_PBAH : BACKTEST_PBAL;
+            event.Level = high ? cutBA.ValueAreaHigh : cutBA.ValueAreaLow;
+            float close = bars.Close.empty() ? (bars.High[event.KnownBar] + bars.Low[event.KnownBar]) / 2.0f : bars.Close[event.KnownBar];
+            event.Side = (close > event.Level) ? 1 : (close < event.Level) ? -1 : (high ? -1 : 1);
+            result.Events.push_back(event);
+        }
+    }
+    std::sort(result.Events.begin(), result.Events.end(), [](const s_BacktestEvent& a, const s_BacktestEvent& b) {
+        if (a.KnownBar != b.KnownBar) return a.KnownBar < b.KnownBar;
+        if (a.Type != b.Type) return a.Type < b.Type;
+        if (a.BAIndex != b.BAIndex) return a.BAIndex < b.BAIndex;
+        return a.Level < b.Level;
+    });
+
+    const float tolerance = params.TickSize * (0.5f + options.TouchToleranceTicks);
+    pool.ParallelFor(static_cast<int>(result.Events.size()), [&](int n) {
+        MeasureLevelReaction(bars, options.HorizonBars, tolerance, result.Events[n]);
+    });
+
+    for (auto& stats : result.Stats) stats = s_BacktestStats();
+    for (const auto& event : result.Events) {
+        s_BacktestStats& stats = result.Stats[event.Type];
+        stats.Count++;
+        if (event.EventBar < event.KnownBar) stats.Retroactive++;
+        stats.SumTouches += event.Touches;
+        if (event.FirstTouchBar < 0) continue;
+        stats.Touched++;
+        if (event.BreakBar >= 0) stats.Broken++;
+        stats.SumBarsToTouch += event.FirstTouchBar - event.KnownBar;
+        if (event.MinutesToTouch >= 0.0) stats.SumMinutesToTouch += event.MinutesToTouch;
+        stats.SumRejection += event.Rejection;
+        stats.MaxRejection = std::max(stats.MaxRejection, event.Rejection);
+    }
+}
+
+bool WriteBacktestEvents(const std::string& path, const s_BacktestResult& result, const s_SweepBars& bars) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) return false;
+    fprintf(file, "Type,KnownDateTime,EventBar,KnownBar,Level,Side,BAStartProfile,BAEndProfile,Touches,FirstTouchBar,MinutesToTouch,Rejection,BreakBar\n");
+    for (const auto& event : result.Events) {
+        const s_BalanceArea& ba = result.BAs.BalanceAreas[event.BAIndex];
+        double knownDateTime = bars.DateTime.empty() ? 0.0 : bars.DateTime[event.KnownBar];
+        fprintf(file, "%s,%.8f,%d,%d,%g,%d,%d,%d,%d,%d,%.1f,%g,%d\n", BACKTEST_EVENT_NAMES[event.Type], knownDateTime, event.EventBar, event.KnownBar,
+                event.Level, event.Side, ba.StartProfileChronoIndex, ba.EndProfileChronoIndex, event.Touches, event.FirstTouchBar,
+                event.MinutesToTouch, event.Rejection, event.BreakBar);
+    }
+    return fclose(file) == 0;
+}
+
+// --- Point-in-Time Timeline ---
+
+// NEW: Persistent vector: a trie of WIDTH-wide nodes over shared, immutable items. A new version copies only
+// the nodes on the paths to its changed items and shares everything else with the version it was made from.
+template <typename T>
+struct s_PersistentVector {
+    static const int BITS = 4;
+    static const int WIDTH = 1 << BITS;
+    struct s_Node {
+        std::vector<std::shared_ptr<const s_Node>> Children;  // Inner nodes
+        std::vector<std::shared_ptr<const T>> Items;           // Leaves
+    };
+    typedef std::pair<int, std::shared_ptr<const T>> Change;
+
+    std::shared_ptr<const s_Node> Root;
+    int Size = 0;
+    int Shift = 0;  // BITS per inner level above the leaves
+
+    const T& operator[](int index) const {
+        const s_Node* node = Root.get();
+        for (int shift = Shift; shift > 0; shift -= BITS) node = node->Children[(index >> shift) & (WIDTH - 1)].get();
+        return *node->Items[index & (WIDTH - 1)];
+    }
+
+    // Version of size newSize with the changes (sorted by index) applied. Items past newSize stay in the shared
+    // nodes until a later change overwrites them.
+    s_PersistentVector WithChanges(const std::vector<Change>& changes, int newSize) const {
+        s_PersistentVector result = *this;
+        result.Size = newSize;
+        while (newSize > (WIDTH << result.Shift)) { // The old root becomes the first child of a new level
+            auto root = std::make_shared<s_Node>();
+            root->Children.resize(WIDTH);
+            root->Children[0] = result.Root;
+            result.Root = root;
+            result.Shift += BITS;
+        }
+        if (!changes.empty()) result.Root = Update(result.Root.get(), result.Shift, 0, changes.data(), changes.data() + changes.size());
+        return result;
+    }
+
+    static std::shared_ptr<const s_Node> Update(const s_Node* node, int shift, int base, const Change* begin, const Change* end) {
+        auto copy = node ? std::make_shared<s_Node>(*node) : std::make_shared<s_Node>();
+        if (shift == 0) {
+            copy->Items.resize(WIDTH);
+            for (const Change* change = begin; change != end; ++change) copy->Items[change->first - base] = change->second;
+            return copy;
+        }
+        copy->Children.resize(WIDTH);
+        while (begin != end) {
+            int slot = (begin->first - base) >> shift;
+            int childBase = base + (slot << shift);
+            const Change* childEnd = begin;
+            while (childEnd != end && childEnd->first < childBase + (1 << shift)) ++childEnd;
+            copy->Children[slot] = Update(copy->Children[slot].get(), shift - BITS, childBase, begin, childEnd);
+            begin = childEnd;
+        }
+        return copy;
+    }
+};
+
+// NEW: A PBAH/L and the bar it became known at, which is the bar of the cut that created it
+struct s_TimelinePBAL {
+    s_PBALDrawingInfo PBAL;
+    int KnownBarIndex = -1;
+};
+
+// NEW: BA state at a session close, as formation over the completed sessions produced it. Activations and cuts
+// are resolved up to the next version's bar and hidden by the query bar, so one version answers every bar
+// until the next. Extending BAs and PBAH/Ls are stored open ended (end -1), so time passing changes nothing.
+struct s_BATimelineVersion {
+    int AsOfBarIndex = -1;      // Last bar of the session whose close made this version
+    int SessionCount = 0;       // Sessions formation had seen
+    s_PersistentVector<s_BalanceArea> BalanceAreas;
+    s_PersistentVector<s_TimelinePBAL> PBALs;
+};
+
+struct s_BATimeline {
+    std::vector<s_BATimelineVersion> Versions;  // By AsOfBarIndex; a session close that changed nothing adds none
+    int SessionCount = 0;
+    size_t StoredBalanceAreas = 0;              // Records written over all versions
+    size_t StoredPBALs = 0;
+
+    int AsOf(int barIndex, std::vector<s_BalanceArea>& balanceAreas, std::vector<s_PBALDrawingInfo>& pbals) const;
+};
+
+// NEW: BAs and PBAH/Ls as they stood once bar barIndex had closed. Returns the bar of the version used,
+// or -1 (and nothing) before the first BA formed.
+int s_BATimeline::AsOf(int barIndex, std::vector<s_BalanceArea>& balanceAreas, std::vector<s_PBALDrawingInfo>& pbals) const {
+    balanceAreas.clear();
+    pbals.clear();
+    auto next = std::upper_bound(Versions.begin(), Versions.end(), barIndex, [](int bar, const s_BATimelineVersion& version) {
+        return bar < version.AsOfBarIndex;
+    });
+    if (next == Versions.begin()) return -1;
+    const s_BATimelineVersion& version = *(next - 1);
+
+    balanceAreas.reserve(version.BalanceAreas.Size);
+    for (int n = 0; n < version.BalanceAreas.Size; ++n) {
+        s_BalanceArea ba = version.BalanceAreas[n];
+        if (ba.IsActivated && ba.ActivationBarIndex > barIndex) { // Breaks out after the query bar
+            ba.IsActivated = false;
+            ba.ActivationBarIndex = -1;
+            ba.ActivatedHigh = false;
+            ba.ActivatedLow = false;
+            ba.IsExtending = false;
+            ba.WasCut = false;
+            ba.ExtensionEndIndex = -1;
+            ba.CutByStartProfileIndex = -1;
+            ba.CutByEndProfileIndex = -1;
+        } else if (ba.WasCut && ba.ExtensionEndIndex > barIndex) { // Cut after the query bar, so still extending
+            ba.WasCut = false;
+            ba.IsExtending = true;
+            ba.CutByStartProfileIndex = -1;
+            ba.CutByEndProfileIndex = -1;
+        }
+        if (ba.IsExtending) ba.ExtensionEndIndex = barIndex;
+        balanceAreas.push_back(std::move(ba));
+    }
+    for (int n = 0; n < version.PBALs.Size; ++n) {
+        const s_TimelinePBAL& entry = version.PBALs[n];
+        if (entry.KnownBarIndex > barIndex) continue;
+        pbals.push_back(entry.PBAL);
+        pbals.back().EndBarIndex = barIndex;
+    }
+    return version.AsOfBarIndex;
+}
+
+// NEW: Whether a stored record differs from the live BA in anything a query reads
+bool TimelineBAChanged(const s_BalanceArea& stored, const s_BalanceArea& ba) {
+    return stored.StartProfileChronoIndex != ba.StartProfileChronoIndex || stored.EndProfileChronoIndex != ba.EndProfileChronoIndex ||
+           stored.POC != ba.POC || stored.ValueAreaHigh != ba.ValueAreaHigh || stored.ValueAreaLow != ba.ValueAreaLow ||
+           stored.HighestPrice != ba.HighestPrice || stored.LowestPrice != ba.LowestPrice || stored.TotalVolume != ba.TotalVolume ||
+           stored.IsActivated != ba.IsActivated || stored.ActivationBarIndex != ba.ActivationBarIndex || stored.ActivatedHigh != ba.ActivatedHigh ||
+           stored.WasCut != ba.WasCut || stored.CutByStartProfileIndex != ba.CutByStartProfileIndex || stored.CutByEndProfileIndex != ba.CutByEndProfileIndex ||
+           stored.ExtensionEndIndex != (ba.IsExtending ? -1 : ba.ExtensionEndIndex);
+}
+
+bool TimelinePBALChanged(const s_TimelinePBAL& stored, const s_TimelinePBAL& entry) {
+    return stored.KnownBarIndex != entry.KnownBarIndex || stored.PBAL.IsHigh != entry.PBAL.IsHigh || stored.PBAL.Price != entry.PBAL.Price ||
+           stored.PBAL.StartBarIndex != entry.PBAL.StartBarIndex || stored.PBAL.OriginStartProfileIndex != entry.PBAL.OriginStartProfileIndex ||
+           stored.PBAL.OriginEndProfileIndex != entry.PBAL.OriginEndProfileIndex;
+}
+
+// NEW: Replays the history one session close at a time, the way a live chart would have seen it. Formation
+// resumes at the first BA attempt that read the previous last session, as on a live update; activation scans
+// resume where the previous version stopped; and only cuts that a new or re-formed BA could change are
+// looked for again. The developing session is not part of any version, so versions change at session closes
+// and at the activation and cut bars in between.
+void BuildBATimeline(s_WorkerPool& pool, const std::vector<s_SessionProfile>& sessions, const s_SweepBars& bars, const s_BAFormationParams& params,
+                     float pbalPierceThreshold, s_BATimeline& timeline) {
+    timeline = s_BATimeline();
+    const int numSessions = static_cast<int>(sessions.size());
+    const int arraySize = static_cast<int>(bars.High.size());
+    timeline.SessionCount = numSessions;
+    std::vector<s_SessionPairMetrics> pairMetrics(std::max(0, numSessions - 1));
+    pool.ParallelFor(static_cast<int>(pairMetrics.size()), [&](int pairIndex) {
+        pairMetrics[pairIndex] = CalculateSessionPairMetrics(sessions[pairIndex], sessions[pairIndex + 1], params.TickSize, params.OverlapResolution);
+    });
+
+    s_BAFormationRun run;
+    run.Params = params;
+    std::vector<s_SessionProfile> seenSessions;
+    seenSessions.reserve(numSessions);
+    std::vector<s_BalanceArea> current;      // Formed BAs with activation and cut state up to the window end
+    std::vector<s_BalanceArea> activeBAs;
+    std::vector<int> activeOrder;
+    std::vector<s_TimelinePBAL> pbals;
+    std::vector<s_PersistentVector<s_BalanceArea>::Change> baChanges;
+    std::vector<s_PersistentVector<s_TimelinePBAL>::Change> pbalChanges;
+    s_BATimelineVersion latest;
+
+    for (int k = 0; k < numSessions; ++k) {
+        seenSessions.push_back(sessions[k]);
+        if (k > 0) run.PairMetrics.push_back(pairMetrics[k - 1]);
+
+        // Drop what depended on the previous last session and form again from there
+        const int resumeIndex = run.Result.FormationResumeIndex;
+        std::vector<s_BalanceArea>& formed = run.Result.FinalizedBalanceAreas;
+        size_t keptBAs = 0;
+        while (keptBAs < formed.size() && formed[keptBAs].StartProfileChronoIndex < resumeIndex) ++keptBAs;
+        formed.erase(formed.begin() + keptBAs, formed.end());
+        auto& probes = run.Result.ProbeLinesToDraw;
+        probes.erase(std::remove_if(probes.begin(), probes.end(), [resumeIndex](const s_ProbeLineDrawingInfo& probe) { return probe.BAStartProfileIndex >= resumeIndex; }), probes.end());
+        std::vector<bool>& profileUsed = run.Result.FormationProfileUsed;
+        profileUsed.resize(k + 1, false);
+        std::fill(profileUsed.begin() + std::min(resumeIndex, k + 1), profileUsed.end(), false);
+        run.NextProfileIndex = resumeIndex;
+        run.Result.FormationResumeIndex = k;
+        ContinueBAFormation(run, seenSessions, nullptr);
+        run.Result.LogMessages.clear();
+
+        current.erase(current.begin() + keptBAs, current.end());
+        current.insert(current.end(), formed.begin() + keptBAs, formed.end());
+
+        // Bars this version answers for, plus the next version's first so a cut there is resolved here
+        const int windowEnd = (k + 1 < numSessions) ? std::min(arraySize, sessions[k + 1].EndIndex + 1) : arraySize;
+        int firstNewActivation = INT_MAX;
+        for (auto& ba : current) {
+            if (ba.IsActivated) continue;
+            bool breakHigh = false;
+            int activationBar = FindBAActivationBar(ba, bars.High, bars.Low, ba.ActivationCheckedBarIndex + 1, windowEnd, params.TickSize, breakHigh);
+            ba.ActivationCheckedBarIndex = windowEnd - 1;
+            if (activationBar < 0) continue;
+            ba.IsActivated = true;
+            ba.ActivationBarIndex = activationBar;
+            ba.ActivatedHigh = breakHigh;
+            ba.ActivatedLow = !breakHigh;
+            ba.IsExtending = true;
+            firstNewActivation = std::min(firstNewActivation, activationBar);
+        }
+
+        // Same order as ReplayActivationsAndCuts; a cut can only change if its cutter was re-formed or a new
+        // activation lands at or before it, and uncut BAs are checked against the longer window
+        activeOrder.clear();
+        for (size_t n = 0; n < current.size(); ++n) {
+            if (current[n].IsActivated) activeOrder.push_back(static_cast<int>(n));
+        }
+        std::sort(activeOrder.begin(), activeOrder.end(), [&current](int a, int b) { return current[a].ActivationBarIndex < current[b].ActivationBarIndex; });
+        activeBAs.clear();
+        for (int n : activeOrder) activeBAs.push_back(current[n]);
+        std::map<std::pair<int, int>, int> indexByProfiles;
+        for (size_t n = 0; n < current.size(); ++n) indexByProfiles.emplace(std::make_pair(current[n].StartProfileChronoIndex, current[n].EndProfileChronoIndex), static_cast<int>(n));
+        for (size_t i = 0; i < activeBAs.size(); ++i) {
+            s_BalanceArea& activeBa = activeBAs[i];
+            bool recheck = !activeBa.WasCut || activeBa.CutByStartProfileIndex >= resumeIndex || firstNewActivation <= activeBa.ExtensionEndIndex;
+            if (!recheck) continue;
+            int cutBarIndex = windowEnd - 1;
+            const s_BalanceArea* intersectingBA = FindBACut(activeBa, i, current, activeBAs, params.TickSize, cutBarIndex);
+            activeBa.WasCut = intersectingBA != nullptr;
+            activeBa.IsExtending = !activeBa.WasCut;
+            activeBa.ExtensionEndIndex = cutBarIndex;
+            activeBa.CutByStartProfileIndex = intersectingBA ? intersectingBA->StartProfileChronoIndex : -1;
+            activeBa.CutByEndProfileIndex = intersectingBA ? intersectingBA->EndProfileChronoIndex : -1;
+        }
+        pbals.clear();
+        for (size_t i = 0; i < activeBAs.size(); ++i) {
+            const s_BalanceArea& activeBa = activeBAs[i];
+            s_BalanceArea& ba = current[activeOrder[i]];
+            ba.IsExtending = activeBa.IsExtending;
+            ba.ExtensionEndIndex = activeBa.ExtensionEndIndex;
+            ba.WasCut = activeBa.WasCut;
+            ba.CutByStartProfileIndex = activeBa.CutByStartProfileIndex;
+            ba.CutByEndProfileIndex = activeBa.CutByEndProfileIndex;
+            if (!activeBa.WasCut) continue;
+            auto cutter = indexByProfiles.find(std::make_pair(activeBa.CutByStartProfileIndex, activeBa.CutByEndProfileIndex));
+            if (cutter == indexByProfiles.end()) continue;
+            bool createHigh = false, createLow = false;
+            FindPBALPierces(activeBa, current[cutter->second], pbalPierceThreshold, createHigh, createLow);
+            for (int high = 1; high >= 0; --high) {
+                if (high ? !createHigh : !createLow) continue;
+                s_TimelinePBAL entry;
+                entry.PBAL = MakePBALDrawingInfo(activeBa, high != 0, -1);
+                entry.KnownBarIndex = activeBa.ExtensionEndIndex;
+                pbals.push_back(entry);
+            }
+        }
+
+        // Store only the records that differ from the latest version
+        baChanges.clear();
+        for (size_t n = 0; n < current.size(); ++n) {
+            if (static_cast<int>(n) < latest.BalanceAreas.Size && !TimelineBAChanged(latest.BalanceAreas[static_cast<int>(n)], current[n])) continue;
+            auto record = std::make_shared<s_BalanceArea>(current[n]);
+            record->ActivationCheckedBarIndex = -1;
+            if (record->IsExtending) record->ExtensionEndIndex = -1;
+            baChanges.emplace_back(static_cast<int>(n), std::move(record));
+        }
+        pbalChanges.clear();
+        for (size_t n = 0; n < pbals.size(); ++n) {
+            if (static_cast<int>(n) < latest.PBALs.Size && !TimelinePBALChanged(latest.PBALs[static_cast<int>(n)], pbals[n])) continue;
+            pbalChanges.emplace_back(static_cast<int>(n), std::make_shared<s_TimelinePBAL>(pbals[n]));
+        }
+        if (baChanges.empty() && pbalChanges.empty() && latest.BalanceAreas.Size == static_cast<int>(current.size()) && latest.PBALs.Size == static_cast<int>(pbals.size())) continue;
+        latest.AsOfBarIndex = std::min(sessions[k].EndIndex, arraySize - 1);
+        latest.SessionCount = k + 1;
+        latest.BalanceAreas = latest.BalanceAreas.WithChanges(baChanges, static_cast<int>(current.size()));
+        latest.PBALs = latest.PBALs.WithChanges(pbalChanges, static_cast<int>(pbals.size()));
+        timeline.Versions.push_back(latest);
+        timeline.StoredBalanceAreas += baChanges.size();
+        timeline.StoredPBALs += pbalChanges.size();
+    }
+}
+
+// --- Multi-Symbol Scanner ---
+
+// NEW: One symbol of a scan list line: <file.scid> <tickSize> [sessionStartHour] [tickMultiplier]
+struct s_ScanSymbol {
+    std::string Path;
+    std::string Symbol;     // File name without directory and extension
+    s_ScidReplayOptions Options;
+};
+
+struct s_ScanOptions {
+    int BarSeconds = 60;
+    int RecentSessions = 5;         // Activations counted over this many most recent sessions
+    float PBALPierceThreshold = 15.0f;
+};
+
+// NEW: Where the last price stands against the symbol's open levels
+struct s_ScanRow {
+    std::string Symbol;
+    std::string Error;              // Set when the file could not be scanned
+    int Sessions = 0;
+    float LastPrice = 0.0f;
+    float NearestLevel = 0.0f;
+    const char* NearestType = "";   // VAH/VAL of an extending active BA, or PBAH/PBAL
+    float DistanceTicks = 0.0f;     // Level minus last price, so positive means the level is above
+    float DistancePercent = 0.0f;
+    int ActiveBAs = 0;              // Activated and not cut
+    int PBALs = 0;
+    int RecentActivations = 0;
+    int BarsSinceActivation = -1;
+    int OpenBASessions = 0;         // Sessions in the BA still forming at the last session, 0 if none
+    double ElapsedMs = 0.0;
+
+    bool HasLevel() const { return NearestType[0] != '\0'; }
+};
+
+bool ParseScanList(const std::string& path, std::vector<s_ScanSymbol>& symbols, std::string& error) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        error = "Could not open " + path;
+        return false;
+    }
+    char line[1024];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+        char scidPath[1024];
+        float tickSize = 0.0f;
+        double sessionStartHour = 0.0;
+        int tickMultiplier = 1;
+        if (line[0] == '#') continue;
+        int fields = sscanf(line, "%1023s %f %lf %d", scidPath, &tickSize, &sessionStartHour, &tickMultiplier);
+        if (fields <= 0) continue;
+        if (fields < 2 || tickSize <= 0.0f || tickMultiplier < 1) {
+            error = path + ":" + std::to_string(lineNumber) + ": expected <file.scid> <tickSize> [sessionStartHour] [tickMultiplier]";
+            fclose(file);
+            return false;
+        }
+        s_ScanSymbol symbol;
+        symbol.Path = scidPath;
+        std::string name = symbol.Path.substr(symbol.Path.find_last_of("/\\") + 1);
+        symbol.Symbol = name.substr(0, name.rfind('.'));
+        symbol.Options.TickSize = tickSize;
+        symbol.Options.SessionStartTime = sessionStartHour / 24.0;
+        symbol.Options.TickMultiplier = tickMultiplier;
+        symbols.push_back(symbol);
+    }
+    fclose(file);
+    return true;
+}
+
+long ScanFileSize(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+// NEW: Loads one symbol and runs detection serially on the calling thread; the scan parallelises over symbols
+void ScanSymbol(const s_ScanSymbol& symbol, const s_ScanOptions& options, s_ScanRow& row) {
+    auto start = std::chrono::steady_clock::now();
+    row = s_ScanRow();
+    row.Symbol = symbol.Symbol;
+    s_ScidFile file;
+    if (!file.Open(symbol.Path)) {
+        row.Error = "not a readable .scid file";
+        return;
+    }
+    s_WorkerPool serialPool;
+    s_ScidReplayOptions replayOptions = symbol.Options;
+    replayOptions.BarSeconds = options.BarSeconds;
+    s_ScidReplay replay;
+    LoadScidReplay(serialPool, file, replayOptions, replay);
+    file.Close();
+    if (replay.Sessions.size() < 2 || replay.Bars.Close.empty()) {
+        row.Error = "fewer than two sessions";
+        return;
+    }
+    s_ReplayedBAs replayed;
+    RunScidReplayDetection(serialPool, replay, DefaultReplayFormationParams(replayOptions), replayed);
+
+    const int numSessions = static_cast<int>(replay.Sessions.size());
+    const int lastBar = static_cast<int>(replay.Bars.Close.size()) - 1;
+    const float tickSize = replayOptions.TickSize;
+    row.Sessions = numSessions;
+    row.LastPrice = replay.Bars.Close[lastBar];
+    float nearestDistance = FLT_MAX;
+    auto considerLevel = [&](float level, const char* type) {
+        if (std::fabs(level - row.LastPrice) >= nearestDistance) return;
+        nearestDistance = std::fabs(level - row.LastPrice);
+        row.NearestLevel = level;
+        row.NearestType = type;
+    };
+
+    std::map<std::pair<int, int>, const s_BalanceArea*> baByProfiles;
+    for (const auto& ba : replayed.BalanceAreas) baByProfiles.emplace(std::make_pair(ba.StartProfileChronoIndex, ba.EndProfileChronoIndex), &ba);
+    const int recentStartBar = replay.Sessions[std::max(0, numSessions - options.RecentSessions)].BeginIndex;
+    for (const auto& activeBa : replayed.ActiveBAs) {
+        if (activeBa.ActivationBarIndex >= recentStartBar) row.RecentActivations++;
+        row.BarsSinceActivation = (row.BarsSinceActivation < 0) ? lastBar - activeBa.ActivationBarIndex : std::min(row.BarsSinceActivation, lastBar - activeBa.ActivationBarIndex);
+        if (!activeBa.WasCut) {
+            row.ActiveBAs++;
+            considerLevel(activeBa.ValueAreaHigh, "VAH");
+            considerLevel(activeBa.ValueAreaLow, "VAL");
+            continue;
+        }
+        auto cutter = baByProfiles.find(std::make_pair(activeBa.CutByStartProfileIndex, activeBa.CutByEndProfileIndex));
+        if (cutter == baByProfiles.end()) continue;
+        bool createHigh = false, createLow = false;
+        FindPBALPierces(activeBa, *cutter->second, options.PBALPierceThreshold, createHigh, createLow);
+        if (createHigh) considerLevel(activeBa.ValueAreaHigh, "PBAH");
+        if (createLow) considerLevel(activeBa.ValueAreaLow, "PBAL");
+        row.PBALs += (createHigh ? 1 : 0) + (createLow ? 1 : 0);
+    }
+    if (row.HasLevel()) {
+        row.DistanceTicks = (row.NearestLevel - row.LastPrice) / tickSize;
+        row.DistancePercent = row.LastPrice != 0.0f ? 100.0f * (row.NearestLevel - row.LastPrice) / row.LastPrice : 0.0f;
+    }
+    if (!replayed.BalanceAreas.empty() && replayed.BalanceAreas.back().EndProfileChronoIndex == numSessions - 1) {
+        row.OpenBASessions = static_cast<int>(replayed.BalanceAreas.back().IncludedProfileIndices.size());
+    }
+    row.ElapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// NEW: Scans every symbol on the pool and returns the rows ranked by distance to the nearest level, as a
+// percentage of price; symbols without an open level follow, then the ones that failed. Each worker claims
+// the next unscanned symbol as soon as it is free, and the largest files are handed out first, so a long
+// history starts early instead of holding up the end of the batch.
+void RunSymbolScan(s_WorkerPool& pool, const std::vector<s_ScanSymbol>& symbols, const s_ScanOptions& options, std::vector<s_ScanRow>& rows) {
+    std::vector<long> fileSizes(symbols.size());
+    for (size_t n = 0; n < symbols.size(); ++n) fileSizes[n] = ScanFileSize(symbols[n].Path);
+    std::vector<int> order(symbols.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&fileSizes](int a, int b) { return fileSizes[a] > fileSizes[b]; });
+
+    rows.assign(symbols.size(), s_ScanRow());
+    pool.ParallelFor(static_cast<int>(order.size()), [&](int n) {
+        ScanSymbol(symbols[order[n]], options, rows[order[n]]);
+    });
+    std::stable_sort(rows.begin(), rows.end(), [](const s_ScanRow& a, const s_ScanRow& b) {
+        int groupA = !a.Error.empty() ? 2 : a.HasLevel() ? 0 : 1;
+        int groupB = !b.Error.empty() ? 2 : b.HasLevel() ? 0 : 1;
+        if (groupA != groupB) return groupA < groupB;
+        return groupA == 0 && std::fabs(a.DistancePercent) < std::fabs(b.DistancePercent);
+    });
+}
+
+bool WriteScanRows(FILE* file, const std::vector<s_ScanRow>& rows) {
+    fprintf(file, "Rank,Symbol,Sessions,LastPrice,NearestLevel,NearestType,DistanceTicks,DistancePercent,ActiveBAs,PBAHLs,RecentActivations,BarsSinceActivation,OpenBASessions,Millis,Error\n");
+    for (size_t n = 0; n < rows.size(); ++n) {
+        const s_ScanRow& row = rows[n];
+        fprintf(file, "%zu,%s,%d,%g,%g,%s,%.1f,%.3f,%d,%d,%d,%d,%d,%.1f,%s\n", n + 1, row.Symbol.c_str(), row.Sessions, row.LastPrice,
+                row.NearestLevel, row.NearestType, row.DistanceTicks, row.DistancePercent, row.ActiveBAs, row.PBALs, row.RecentActivations,
+                row.BarsSinceActivation, row.OpenBASessions, row.ElapsedMs, row.Error.c_str());
+    }
+    return !ferror(file);
+}
@@ -0,0 +1,146 @@
+// Research driver for the offline tools, built by CMakeLists.txt as autobas_replay:
+//   autobas_replay replay <file.scid> <tickSize> [sessionStartHour] [barSeconds] [tickMultiplier]
+//     prints one line per BA with its sessions, value area, activation and cut bars
+//   autobas_replay backtest <file.scid> <tickSize> [sessionStartHour] [barSeconds] [tickMultiplier]
+//     runs the walk-forward backtest, prints reaction statistics per event type and writes every event
+//     to <file.scid>.backtest.csv
+//   autobas_replay timeline <file.scid> <tickSize> [sessionStartHour] [barSeconds] [tickMultiplier]
+//     builds the point-in-time timeline and prints the BA state each version left before the next one
+//   autobas_replay scan <list.txt> [barSeconds] [recentSessions]
+//     scans every symbol of the list (one "<file.scid> <tickSize> [sessionStartHour] [tickMultiplier]" per line)
+//     in parallel and prints them ranked by distance to the nearest open level, also written to <list.txt>.scan.csv
+//   autobas_replay fixture <file.scid> <sessions> <tickSize>
+//     writes the synthetic benchmark history as a .scid file
+//   autobas_replay benchmark [tickSize]
+//     times a full recalculation and a live update over synthetic histories of 500, 2,000 and 5,000 sessions
+#include "ScHostTypes.h"
+#include "AutoBAsOffline.h"
+
+int main(int argc, char** argv) {
+    if (argc >= 5 && std::strcmp(argv[1], "fixture") == 0) {
+        std::vector<s_ScidRecord> records;
+        BuildBenchmarkScidRecords(std::atoi(argv[3]), static_cast<float>(std::atof(argv[4])), 60, records);
+        if (!WriteScidFile(argv[2], records)) { fprintf(stderr, "Could not write %s\n", argv[2]); return 1; }
+        printf("Wrote %zu records to %s\n", records.size(), argv[2]);
+        return 0;
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "benchmark") == 0) {
+        float tickSize = argc > 2 ? static_cast<float>(std::atof(argv[2])) : 0.25f;
+        if (tickSize <= 0.0f) { fprintf(stderr, "Tick size must be positive\n"); return 2; }
+        s_WorkerPool pool;
+        pool.EnsureThreads(0);
+        for (int benchmarkSessions : { 500, 2000, 5000 }) {
+            s_ScalingBenchmarkResult benchmark = RunScalingBenchmark(pool, benchmarkSessions, tickSize);
+            printf("%d sessions: full recalculation %.1f ms (%.1f us/session), live update %.2f us, %d BAs\n",
+                   benchmark.Sessions, benchmark.FullRecalcMs, 1000.0 * benchmark.FullRecalcMs / benchmark.Sessions, benchmark.UpdateUs, benchmark.BACount);
+        }
+        return 0;
+    }
+    if (argc >= 3 && std::strcmp(argv[1], "scan") == 0) {
+        std::vector<s_ScanSymbol> symbols;
+        std::string error;
+        if (!ParseScanList(argv[2], symbols, error)) { fprintf(stderr, "%s\n", error.c_str()); return 1; }
+        s_ScanOptions scanOptions;
+        if (argc > 3) scanOptions.BarSeconds = std::atoi(argv[3]);
+        if (argc > 4) scanOptions.RecentSessions = std::max(1, std::atoi(argv[4]));
+        s_WorkerPool pool;
+        pool.EnsureThreads(0);
+        auto scanStart = std::chrono::steady_clock::now();
+        std::vector<s_ScanRow> rows;
+        RunSymbolScan(pool, symbols, scanOptions, rows);
+        double scanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanStart).count();
+        WriteScanRows(stdout, rows);
+        printf("%zu symbols scanned in %.1f ms on %d threads\n", rows.size(), scanMs, pool.GetNumThreads() + 1);
+        std::string scanPath = std::string(argv[2]) + ".scan.csv";
+        FILE* scanFile = fopen(scanPath.c_str(), "w");
+        if (!scanFile || !WriteScanRows(scanFile, rows) || fclose(scanFile) != 0) { fprintf(stderr, "Could not write %s\n", scanPath.c_str()); return 1; }
+        return 0;
+    }
+    bool backtest = argc >= 2 && std::strcmp(argv[1], "backtest") == 0;
+    bool timeline = argc >= 2 && std::strcmp(argv[1], "timeline") == 0;
+    if (argc < 4 || (!backtest && !timeline && std::strcmp(argv[1], "replay") != 0)) {
+        fprintf(stderr, "usage: %s replay|backtest|timeline <file.scid> <tickSize> [sessionStartHour] [barSeconds] [tickMultiplier]\n"
+                        "       %s scan <list.txt> [barSeconds] [recentSessions]\n"
+                        "       %s fixture <file.scid> <sessions> <tickSize>\n"
+                        "       %s benchmark [tickSize]\n", argv[0], argv[0], argv[0], argv[0]);
+        return 2;
+    }
+    s_ScidReplayOptions options;
+    options.TickSize = static_cast<float>(std::atof(argv[3]));
+    if (argc > 4) options.SessionStartTime = std::atof(argv[4]) / 24.0;
+    if (argc > 5) options.BarSeconds = std::atoi(argv[5]);
+    if (argc > 6) options.TickMultiplier = std::atoi(argv[6]);
+    if (options.TickSize <= 0.0f) { fprintf(stderr, "Tick size must be positive\n"); return 2; }
+
+    s_ScidFile file;
+    if (!file.Open(argv[2])) { fprintf(stderr, "Could not open %s as a .scid file\n", argv[2]); return 1; }
+    s_WorkerPool pool;
+    pool.EnsureThreads(0);
+    auto loadStart = std::chrono::steady_clock::now();
+    s_ScidReplay replay;
+    LoadScidReplay(pool, file, options, replay);
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+    s_BAFormationParams params = DefaultReplayFormationParams(options);
+
+    if (backtest) {
+        auto backtestStart = std::chrono::steady_clock::now();
+        s_BacktestOptions backtestOptions;
+        s_BacktestResult result;
+        RunWalkForwardBacktest(pool, replay.Sessions, replay.Bars, params, backtestOptions, result);
+        double backtestMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - backtestStart).count();
+        printf("%zu records, %zu sessions, %zu bars loaded in %.1f ms; backtest in %.1f ms over %d shards (%d formed again)\n",
+               replay.RecordCount, replay.Sessions.size(), replay.Bars.High.size(), loadMs, backtestMs, result.NumShards, result.ReformedShards);
+        printf("%zu BAs, %zu activated, %d cut\n", result.BAs.BalanceAreas.size(), result.BAs.ActiveBAs.size(), result.BAs.CutCount);
+        printf("Event,Count,Retroactive,TouchedPercent,AvgBarsToTouch,AvgMinutesToTouch,AvgTouches,AvgRejection,MaxRejection,BreakThroughPercent\n");
+        for (int type = 0; type < BACKTEST_EVENT_TYPES; ++type) {
+            const s_BacktestStats& stats = result.Stats[type];
+            double touched = std::max(1, stats.Touched);
+            printf("%s,%d,%d,%.1f,%.1f,%.1f,%.2f,%g,%g,%.1f\n", BACKTEST_EVENT_NAMES[type], stats.Count, stats.Retroactive,
+                   stats.Count > 0 ? 100.0 * stats.Touched / stats.Count : 0.0, stats.SumBarsToTouch / touched, stats.SumMinutesToTouch / touched,
+                   stats.Count > 0 ? stats.SumTouches / stats.Count : 0.0, stats.SumRejection / touched, stats.MaxRejection, stats.GetBreakThroughRate());
+        }
+        std::string eventsPath = std::string(argv[2]) + ".backtest.csv";
+        if (!WriteBacktestEvents(eventsPath, result, replay.Bars)) { fprintf(stderr, "Could not write %s\n", eventsPath.c_str()); return 1; }
+        return 0;
+    }
+
+    if (timeline) {
+        auto timelineStart = std::chrono::steady_clock::now();
+        s_BATimeline history;
+        BuildBATimeline(pool, replay.Sessions, replay.Bars, params, s_BacktestOptions().PBALPierceThreshold, history);
+        double timelineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timelineStart).count();
+        printf("%zu records, %zu sessions, %zu bars loaded in %.1f ms; timeline in %.1f ms: %zu versions storing %zu BA and %zu PBAH/L records\n",
+               replay.RecordCount, replay.Sessions.size(), replay.Bars.High.size(), loadMs, timelineMs, history.Versions.size(),
+               history.StoredBalanceAreas, history.StoredPBALs);
+        printf("AsOfBar,AsOfDateTime,Sessions,BAs,Activated,Cut,PBAHLs\n");
+        std::vector<s_BalanceArea> balanceAreas;
+        std::vector<s_PBALDrawingInfo> pbals;
+        const int lastBar = static_cast<int>(replay.Bars.High.size()) - 1;
+        for (size_t n = 0; n < history.Versions.size(); ++n) {
+            int barIndex = (n + 1 < history.Versions.size()) ? history.Versions[n + 1].AsOfBarIndex - 1 : lastBar;
+            history.AsOf(barIndex, balanceAreas, pbals);
+            int activated = 0, cut = 0;
+            for (const auto& ba : balanceAreas) {
+                activated += ba.IsActivated ? 1 : 0;
+                cut += ba.WasCut ? 1 : 0;
+            }
+            printf("%d,%.8f,%d,%zu,%d,%d,%zu\n", barIndex, replay.Bars.DateTime.empty() ? 0.0 : replay.Bars.DateTime[barIndex],
+                   history.Versions[n].SessionCount, balanceAreas.size(), activated, cut, pbals.size());
+        }
+        return 0;
+    }
+
+    s_ReplayedBAs replayed;
+    RunScidReplayDetection(pool, replay, params, replayed);
+
+    printf("%zu records, %zu sessions, %zu bars loaded in %.1f ms; %zu BAs, %zu activated, %d cut\n",
+           replay.RecordCount, replay.Sessions.size(), replay.Bars.High.size(), loadMs,
+           replayed.BalanceAreas.size(), replayed.ActiveBAs.size(), replayed.CutCount);
+    printf("StartSession,EndSession,ValueAreaLow,ValueAreaHigh,ActivationBar,CutBar\n");
+    for (const auto& ba : replayed.BalanceAreas) {
+        printf("%d,%d,%g,%g,%d,%d\n", ba.StartProfileChronoIndex, ba.EndProfileChronoIndex, ba.ValueAreaLow, ba.ValueAreaHigh,
+               ba.IsActivated ? ba.ActivationBarIndex : -1, ba.WasCut ? ba.ExtensionEndIndex : -1);
+    }
+    return 0;
+}
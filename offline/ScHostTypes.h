@@ -0,0 +1,79 @@
+// The few ACSIL types AutoBAsCore.h uses, for building the offline tools and tests without Sierra Chart.
+// Only the members the core and the offline tools call are provided, with the same meaning as in sierrachart.h.
+#pragma once
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h> // For the .scid file mapping
+#undef max
+#undef min
+#endif
+
+// Days since 1899-12-30 as a double, the fraction being the time of day
+class SCDateTime {
+public:
+    SCDateTime() = default;
+    SCDateTime(double dateTime) : m_DateTime(dateTime) {}
+
+    double GetAsDouble() const { return m_DateTime; }
+    bool IsUnset() const { return m_DateTime == 0.0; }
+
+    int GetYear() const { int year, month, day; GetDateParts(year, month, day); return year; }
+    int GetMonth() const { int year, month, day; GetDateParts(year, month, day); return month; }
+    int GetDay() const { int year, month, day; GetDateParts(year, month, day); return day; }
+
+    bool operator==(const SCDateTime& other) const { return m_DateTime == other.m_DateTime; }
+    bool operator!=(const SCDateTime& other) const { return m_DateTime != other.m_DateTime; }
+    bool operator<(const SCDateTime& other) const { return m_DateTime < other.m_DateTime; }
+    bool operator>(const SCDateTime& other) const { return m_DateTime > other.m_DateTime; }
+    bool operator<=(const SCDateTime& other) const { return m_DateTime <= other.m_DateTime; }
+    bool operator>=(const SCDateTime& other) const { return m_DateTime >= other.m_DateTime; }
+    SCDateTime operator+(const SCDateTime& other) const { return SCDateTime(m_DateTime + other.m_DateTime); }
+    SCDateTime operator-(const SCDateTime& other) const { return SCDateTime(m_DateTime - other.m_DateTime); }
+
+private:
+    // Civil date of the day number (proleptic Gregorian calendar)
+    void GetDateParts(int& year, int& month, int& day) const {
+        long long days = static_cast<long long>(std::floor(m_DateTime)) - 25569 + 719468; // 1899-12-30 to 1970-01-01, then to 0000-03-01
+        long long era = (days >= 0 ? days : days - 146096) / 146097;
+        long long dayOfEra = days - era * 146097;
+        long long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        long long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        long long monthIndex = (5 * dayOfYear + 2) / 153;
+        day = static_cast<int>(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+        month = static_cast<int>(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+        year = static_cast<int>(yearOfEra + era * 400 + (month <= 2 ? 1 : 0));
+    }
+
+    double m_DateTime = 0.0;
+};
+
+class SCString {
+public:
+    SCString() = default;
+    SCString(const char* text) : m_Text(text != nullptr ? text : "") {}
+
+    SCString& Format(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        va_list sizing;
+        va_copy(sizing, args);
+        int length = std::vsnprintf(nullptr, 0, format, sizing);
+        va_end(sizing);
+        m_Text.assign(length > 0 ? static_cast<size_t>(length) : 0, '\0');
+        if (length > 0) std::vsnprintf(&m_Text[0], m_Text.size() + 1, format, args);
+        va_end(args);
+        return *this;
+    }
+
+    const char* GetChars() const { return m_Text.c_str(); }
+    int GetLength() const { return static_cast<int>(m_Text.size()); }
+    bool IsEmpty() const { return m_Text.empty(); }
+    operator const char*() const { return m_Text.c_str(); }
+
+private:
+    std::string m_Text;
+};
@@ -0,0 +1,172 @@
+// Drives the study through a full recalculation and then a run of live updates, counting every heap
+// allocation the build makes. Updates that only add volume at prices the developing session already has
+// must not allocate. A new price adds a node to the developing session's price map, so that update may
+// allocate, but the updates after it must be back to none.
+#define AUTOBAS_COUNT_ALLOCATIONS
+#include "sierrachart.h"
+#include "../AutoBAs.cpp"
+#include "../offline/AutoBAsOffline.h"
+
+static int g_Failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); ++g_Failures; } } while (0)
+
+const int NUM_SESSIONS = 300;
+const int BARS_PER_SESSION = 20; // As built by BuildBenchmarkHistory
+const float TICK_SIZE = 0.25f;
+
+// Chart data: each session's VbP levels, oldest first, with the developing session last
+static std::vector<std::vector<s_PriceLevelVolume>> g_SessionLevels;
+static std::vector<s_SessionProfile> g_Sessions;
+static std::vector<s_TimeAndSales> g_TimeAndSales;
+
+s_VolumeAtPriceV2 ToVolumeAtPrice(const s_PriceLevelVolume& level) {
+    s_VolumeAtPriceV2 volumeAtPrice;
+    volumeAtPrice.PriceInTicks = static_cast<int>(std::lround(level.Price / TICK_SIZE));
+    volumeAtPrice.Volume = static_cast<unsigned int>(level.TotalVolume);
+    volumeAtPrice.NumberOfTrades = level.NumberOfTrades;
+    return volumeAtPrice;
+}
+
+int TestGetNumPriceLevelsForStudyProfile(int profileIndex) {
+    if (profileIndex >= NUM_SESSIONS) return 0;
+    return static_cast<int>(g_SessionLevels[NUM_SESSIONS - 1 - profileIndex].size());
+}
+
+int TestGetStudyProfileInformation(int profileIndex, n_ACSIL::s_StudyProfileInformation& information) {
+    if (profileIndex >= NUM_SESSIONS) return 0;
+    const s_SessionProfile& session = g_Sessions[NUM_SESSIONS - 1 - profileIndex];
+    information.m_StartDateTime = session.StartDateTime;
+    information.m_EndDateTime = session.EndDateTime;
+    information.m_BeginIndex = session.BeginIndex;
+    information.m_EndIndex = session.EndIndex;
+    return 1;
+}
+
+int TestGetVolumeAtPriceDataForStudyProfile(int profileIndex, int levelIndex, s_VolumeAtPriceV2& volumeAtPrice) {
+    volumeAtPrice = ToVolumeAtPrice(g_SessionLevels[NUM_SESSIONS - 1 - profileIndex][levelIndex]);
+    return 1;
+}
+
+// Per-bar volume at price: each bar of a completed session holds every 20th level, the developing session's last bar holds all of them
+int TestGetVAPSizeAtBarIndex(unsigned int barIndex) {
+    int session = static_cast<int>(barIndex) / BARS_PER_SESSION;
+    int bar = static_cast<int>(barIndex) % BARS_PER_SESSION;
+    if (session >= NUM_SESSIONS) return 0;
+    int numLevels = static_cast<int>(g_SessionLevels[session].size());
+    if (session == NUM_SESSIONS - 1) return bar == BARS_PER_SESSION - 1 ? numLevels : 0;
+    return numLevels > bar ? (numLevels - bar + BARS_PER_SESSION - 1) / BARS_PER_SESSION : 0;
+}
+
+bool TestGetVAPElementAtIndex(unsigned int barIndex, int index, s_VolumeAtPriceV2** volumeAtPrice) {
+    static s_VolumeAtPriceV2 element;
+    int session = static_cast<int>(barIndex) / BARS_PER_SESSION;
+    int bar = static_cast<int>(barIndex) % BARS_PER_SESSION;
+    int levelIndex = session == NUM_SESSIONS - 1 ? index : bar + BARS_PER_SESSION * index;
+    element = ToVolumeAtPrice(g_SessionLevels[session][levelIndex]);
+    *volumeAtPrice = &element;
+    return true;
+}
+
+const std::vector<s_TimeAndSales>* TestGetTimeAndSales() { return &g_TimeAndSales; }
+void TestAddMessageToLog(const char*) {}
+void TestSetAlert(int, const char*) {}
+
+int main() {
+    s_SweepBars bars;
+    BuildBenchmarkHistory(NUM_SESSIONS, TICK_SIZE, g_SessionLevels, g_Sessions, bars);
+    const int arraySize = static_cast<int>(bars.High.size());
+    std::vector<float> close(arraySize);
+    std::vector<SCDateTime> barDateTimes(arraySize);
+    for (int n = 0; n < arraySize; ++n) {
+        close[n] = (bars.High[n] + bars.Low[n]) / 2.0f;
+        barDateTimes[n] = SCDateTime(45000.0 + n / BARS_PER_SESSION + (n % BARS_PER_SESSION) * 0.01);
+    }
+
+    static s_sc sc; // Too large for the stack
+    static c_VAPContainer volumeAtPrice;
+    sc.Symbol = "ALLOCTEST";
+    sc.ChartNumber = 1;
+    sc.StudyGraphInstanceID = 2;
+    sc.TickSize = TICK_SIZE;
+    sc.High.Values = bars.High.data();
+    sc.Low.Values = bars.Low.data();
+    sc.Close.Values = close.data();
+    sc.BaseDateTimeIn.Values = barDateTimes.data();
+    sc.ArraySize = arraySize;
+    sc.VolumeAtPriceForBars = &volumeAtPrice;
+    for (SCSubgraph& subgraph : sc.Subgraph) subgraph.Values.assign(arraySize, 0.0f);
+
+    sc.SetDefaults = 1;
+    scsf_BalanceAreaDetection(sc);
+    sc.SetDefaults = 0;
+    sc.Input[0].SetStudyID(1);              // Volume by Price study
+    sc.Input[1].SetInt(NUM_SESSIONS);        // Number of sessions
+    sc.Input[47].SetYesNo(0);                // Profile cache file
+    sc.Input[48].SetYesNo(0);                // State snapshot file
+
+    g_TimeAndSales.reserve(1000);
+    const int lastBar = arraySize - 1;
+    auto addTrade = [&](float price) {
+        s_TimeAndSales record;
+        record.Type = SC_TS_ASK;
+        record.Price = price;
+        record.Volume = 1;
+        record.Sequence = static_cast<unsigned int>(g_TimeAndSales.size()) + 1;
+        record.DateTime = SCDateTime(barDateTimes[lastBar].GetAsDouble() + 1e-6 * g_TimeAndSales.size());
+        g_TimeAndSales.push_back(record);
+    };
+    for (int n = 0; n < 50; ++n) addTrade(close[lastBar]); // Trades before the first live update
+
+    sc.IsFullRecalculation = 1;
+    sc.UpdateStartIndex = 0;
+    scsf_BalanceAreaDetection(sc);
+    sc.IsFullRecalculation = 0;
+    sc.UpdateStartIndex = lastBar;
+    s_BAStudyPersistentData* pData = static_cast<s_BAStudyPersistentData*>(sc.GetPersistentPointer(0));
+    CHECK(pData != nullptr);
+    if (pData == nullptr) return 1;
+    CHECK(!pData->FinalizedBalanceAreas.empty());
+
+    std::vector<s_PriceLevelVolume>& developingLevels = g_SessionLevels.back();
+    // One live update: a trade at the last price, with its volume added at one price of the developing session
+    auto liveUpdate = [&](size_t levelIndex) {
+        developingLevels[levelIndex].TotalVolume += 1.0f;
+        developingLevels[levelIndex].NumberOfTrades += 1;
+        addTrade(close[lastBar]);
+        float volumeBefore = pData->LoadedSessions.back().Data->TotalVolume;
+        unsigned long long allocationsBefore = g_HeapAllocationCount.load();
+        scsf_BalanceAreaDetection(sc);
+        unsigned long long allocations = g_HeapAllocationCount.load() - allocationsBefore;
+        CHECK(pData->LoadedSessions.back().Data->TotalVolume == volumeBefore + 1.0f); // The update was taken in
+        return allocations;
+    };
+
+    unsigned long long knownPriceAllocations = 0;
+    for (int update = 0; update < 200; ++update) knownPriceAllocations += liveUpdate(update % developingLevels.size());
+    CHECK(knownPriceAllocations == 0);
+
+    // A price above the developing session's range
+    float highest = 0.0f;
+    for (const s_PriceLevelVolume& level : developingLevels) highest = std::max(highest, level.Price);
+    s_PriceLevelVolume newLevel;
+    newLevel.Price = highest + TICK_SIZE;
+    developingLevels.push_back(newLevel);
+    size_t newPrices = pData->LoadedSessions.back().Data->PriceMap.size();
+    unsigned long long newPriceAllocations = liveUpdate(developingLevels.size() - 1);
+    CHECK(pData->LoadedSessions.back().Data->PriceMap.size() == newPrices + 1);
+
+    unsigned long long afterNewPriceAllocations = 0;
+    for (int update = 0; update < 200; ++update) afterNewPriceAllocations += liveUpdate(developingLevels.size() - 1 - update % developingLevels.size());
+    CHECK(afterNewPriceAllocations == 0);
+
+    printf("live updates: %llu allocations at known prices, %llu for a new price, %llu after it\n",
+        knownPriceAllocations, newPriceAllocations, afterNewPriceAllocations);
+
+    sc.LastCallToFunction = 1;
+    scsf_BalanceAreaDetection(sc);
+    delete pData;
+    if (g_Failures > 0) fprintf(stderr, "%d check(s) failed\n", g_Failures);
+    return g_Failures == 0 ? 0 : 1;
+}
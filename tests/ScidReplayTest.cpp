@@ -0,0 +1,163 @@
+// Decodes a small .scid fixture written here and checks the records, session splits, per-session dense
+// volume and OHLC bars the offline replay builds from it.
+#include "ScHostTypes.h"
+#include "AutoBAsOffline.h"
+
+static int g_Failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); ++g_Failures; } } while (0)
+
+const int64_t MICROSECONDS_PER_MINUTE = 60LL * 1000000LL;
+
+int64_t ScidTime(int day, int minute, int second) {
+    return static_cast<int64_t>(day) * SCID_MICROSECONDS_PER_DAY + minute * MICROSECONDS_PER_MINUTE + second * 1000000LL;
+}
+
+s_ScidRecord TradeRecord(int64_t dateTime, float price, uint32_t volume, float open = 0.0f) {
+    s_ScidRecord record;
+    record.DateTime = dateTime;
+    record.Open = open;
+    record.High = price + 0.25f; // Ask
+    record.Low = price - 0.25f;  // Bid
+    record.Close = price;
+    record.NumTrades = 1;
+    record.TotalVolume = volume;
+    return record;
+}
+
+s_ScidRecord BarRecord(int64_t dateTime, float open, float high, float low, float close, uint32_t volume) {
+    s_ScidRecord record;
+    record.DateTime = dateTime;
+    record.Open = open;
+    record.High = high;
+    record.Low = low;
+    record.Close = close;
+    record.NumTrades = 7;
+    record.TotalVolume = volume;
+    return record;
+}
+
+void CheckDense(const s_SessionProfile& session, int baseTick, const std::vector<float>& volume) {
+    const s_DenseProfile& dense = session.Data->Dense;
+    CHECK(dense.BaseTick == baseTick);
+    CHECK(dense.Volume == volume);
+    CHECK(dense.TotalVolume == std::accumulate(volume.begin(), volume.end(), 0.0f));
+}
+
+void CheckBar(const s_SweepBars& bars, int index, float open, float high, float low, float close, double dateTime) {
+    CHECK(bars.Open[index] == open);
+    CHECK(bars.High[index] == high);
+    CHECK(bars.Low[index] == low);
+    CHECK(bars.Close[index] == close);
+    CHECK(std::fabs(bars.DateTime[index] - dateTime) < 1e-9);
+}
+
+int main() {
+    const int day = 45000;
+    std::vector<s_ScidRecord> records = {
+        // Session 1: trades over two one-minute bars
+        TradeRecord(ScidTime(day, 0, 10), 100.00f, 5),
+        TradeRecord(ScidTime(day, 0, 40), 100.50f, 3),
+        TradeRecord(ScidTime(day, 1, 5), 100.25f, 2),
+        TradeRecord(ScidTime(day, 1, 30), 99.75f, 4),
+        TradeRecord(ScidTime(day, 1, 50), 100.00f, 1),
+        // Session 2: a bar record and a trade in the same minute
+        BarRecord(ScidTime(day + 1, 5, 0), 101.00f, 101.50f, 100.75f, 101.25f, 10),
+        TradeRecord(ScidTime(day + 1, 5, 30), 101.00f, 6),
+        // Session 3: no volume, so it is left out with its bar
+        BarRecord(ScidTime(day + 2, 0, 0), 0.0f, 0.0f, 0.0f, 100.00f, 0),
+        // Session 4: one trade split into sub-trades
+        TradeRecord(ScidTime(day + 3, 0, 0), 102.00f, 1, SCID_FIRST_SUB_TRADE_OF_UNBUNDLED_TRADE),
+        TradeRecord(ScidTime(day + 3, 0, 0) + 1, 102.25f, 2, SCID_LAST_SUB_TRADE_OF_UNBUNDLED_TRADE),
+    };
+    const std::string path = "scid_replay_test.scid";
+    CHECK(WriteScidFile(path, records));
+
+    // Sierra Chart may be part way through appending a record
+    FILE* file = fopen(path.c_str(), "ab");
+    CHECK(file != nullptr);
+    if (file != nullptr) {
+        const char partial[20] = {};
+        CHECK(fwrite(partial, 1, sizeof(partial), file) == sizeof(partial));
+        fclose(file);
+    }
+
+    s_ScidFile scid;
+    CHECK(scid.Open(path));
+    CHECK(scid.GetRecordCount() == records.size());
+    if (!scid.IsOpen()) return 1;
+    CHECK(std::memcmp(scid.GetRecords(), records.data(), records.size() * sizeof(s_ScidRecord)) == 0);
+
+    std::vector<int64_t> sessionStarts;
+    std::vector<std::pair<size_t, size_t>> chunks = FindScidSessionChunks(scid.GetRecords(), scid.GetRecordCount(), 0, sessionStarts);
+    std::vector<std::pair<size_t, size_t>> expectedChunks = { { 0, 5 }, { 5, 7 }, { 7, 8 }, { 8, 10 } };
+    std::vector<int64_t> expectedStarts = { ScidTime(day, 0, 0), ScidTime(day + 1, 0, 0), ScidTime(day + 2, 0, 0), ScidTime(day + 3, 0, 0) };
+    CHECK(chunks == expectedChunks);
+    CHECK(sessionStarts == expectedStarts);
+
+    // Sessions starting at 00:01 move the first two trades into the day before and each midnight record back a day
+    chunks = FindScidSessionChunks(scid.GetRecords(), scid.GetRecordCount(), MICROSECONDS_PER_MINUTE, sessionStarts);
+    expectedChunks = { { 0, 2 }, { 2, 5 }, { 5, 8 }, { 8, 10 } };
+    expectedStarts = { ScidTime(day - 1, 1, 0), ScidTime(day, 1, 0), ScidTime(day + 1, 1, 0), ScidTime(day + 2, 1, 0) };
+    CHECK(chunks == expectedChunks);
+    CHECK(sessionStarts == expectedStarts);
+
+    s_WorkerPool pool;
+    pool.EnsureThreads(2);
+    s_ScidReplayOptions options;
+    options.TickSize = 0.25f;
+    options.BarSeconds = 60;
+    s_ScidReplay replay;
+    LoadScidReplay(pool, scid, options, replay);
+
+    CHECK(replay.RecordCount == records.size());
+    CHECK(replay.Sessions.size() == 3);
+    CHECK(replay.Bars.High.size() == 4);
+    if (replay.Sessions.size() != 3 || replay.Bars.High.size() != 4) {
+        fprintf(stderr, "%d check(s) failed\n", g_Failures);
+        return 1;
+    }
+
+    const s_SessionProfile& first = replay.Sessions[0];
+    CHECK(first.StartDateTime.GetAsDouble() == day);
+    CHECK(first.BeginIndex == 0 && first.EndIndex == 1);
+    CheckDense(first, 399, { 4.0f, 6.0f, 2.0f, 3.0f }); // 99.75 to 100.50
+    CHECK(first.POC == 100.00f);
+    CHECK(first.HighestPrice == 100.50f && first.LowestPrice == 99.75f);
+    CHECK(first.ClosePrice == 100.00f);
+
+    const s_SessionProfile& second = replay.Sessions[1];
+    CHECK(second.StartDateTime.GetAsDouble() == day + 1);
+    CHECK(second.BeginIndex == 2 && second.EndIndex == 2);
+    CheckDense(second, 404, { 6.0f, 10.0f }); // Bar record volume goes to its close
+    CHECK(second.ChronologicalIndex == 1);
+
+    const s_SessionProfile& fourth = replay.Sessions[2];
+    CHECK(fourth.StartDateTime.GetAsDouble() == day + 3);
+    CHECK(fourth.BeginIndex == 3 && fourth.EndIndex == 3);
+    CheckDense(fourth, 408, { 1.0f, 2.0f });
+    CHECK(fourth.ChronologicalIndex == 2);
+
+    CheckBar(replay.Bars, 0, 100.00f, 100.50f, 100.00f, 100.50f, day);
+    CheckBar(replay.Bars, 1, 100.25f, 100.25f, 99.75f, 100.00f, day + 1.0 / 1440.0);
+    CheckBar(replay.Bars, 2, 101.00f, 101.50f, 100.75f, 101.00f, day + 1 + 5.0 / 1440.0);
+    CheckBar(replay.Bars, 3, 102.00f, 102.25f, 102.00f, 102.25f, day + 3);
+
+    // Not a .scid file
+    FILE* other = fopen("scid_replay_test.bad", "wb");
+    CHECK(other != nullptr);
+    if (other != nullptr) {
+        char header[64] = "ABCD";
+        fwrite(header, 1, sizeof(header), other);
+        fclose(other);
+    }
+    s_ScidFile bad;
+    CHECK(!bad.Open("scid_replay_test.bad"));
+    CHECK(!bad.IsOpen());
+
+    std::remove(path.c_str());
+    std::remove("scid_replay_test.bad");
+    if (g_Failures > 0) fprintf(stderr, "%d check(s) failed\n", g_Failures);
+    return g_Failures == 0 ? 0 : 1;
+}
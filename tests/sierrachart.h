@@ -0,0 +1,204 @@
+// Test stand-in for the ACSIL header: just the parts of the interface AutoBAs.cpp uses, so the study can be
+// compiled and called on the host. Chart data comes from the Test* functions the test program defines.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "../offline/ScHostTypes.h"
+
+typedef uint32_t COLORREF;
+#define RGB(r, g, b) ((COLORREF)(((uint8_t)(r) | ((uint16_t)((uint8_t)(g)) << 8)) | (((uint32_t)(uint8_t)(b)) << 16)))
+#define DT_LEFT 0
+#define DT_RIGHT 2
+#define SCDLLName(name) extern "C" const char* scdllname() { return name; }
+#define SCSFExport extern "C" void
+
+template <class T> struct SCArray {
+    T* Values = nullptr;
+    int Size = 0;
+    T& operator[](int index) { return Values[index]; }
+    const T& operator[](int index) const { return Values[index]; }
+    int GetArraySize() const { return Size; }
+};
+typedef SCArray<float> SCFloatArray;
+typedef SCFloatArray& SCFloatArrayRef;
+typedef SCArray<SCDateTime> SCDateTimeArray;
+
+enum SubgraphLineStyles { LINESTYLE_SOLID, LINESTYLE_DASH, LINESTYLE_DOT, LINESTYLE_DASHDOT, LINESTYLE_DASHDOTDOT };
+enum DrawingTypeEnum { DRAWING_LINE = 1, DRAWING_RECTANGLEHIGHLIGHT, DRAWING_RECTANGLE_EXT_HIGHLIGHT, DRAWING_HORIZONTAL_RAY, DRAWING_TEXT, DRAWING_HORIZONTALLINE };
+enum { TOOL_DELETE_ALL = 0, TOOL_DELETE_CHARTDRAWING = 1 };
+enum { UTAM_ADD_ALWAYS = 0, UTAM_ADD_OR_ADJUST = 1 };
+enum { DRAWSTYLE_IGNORE = 0, DRAWSTYLE_LINE = 1, DRAWSTYLE_HIDDEN = 2, DRAWSTYLE_DASH = 3 };
+enum { SC_TS_BID = 1, SC_TS_ASK = 2, SC_TS_MARKER = 3, SC_TS_BIDASKVALUES = 4 };
+
+struct s_UseTool {
+    void Clear() { *this = s_UseTool(); }
+    int ChartNumber = 0;
+    int DrawingType = 0;
+    COLORREF Color = 0;
+    COLORREF SecondaryColor = 0;
+    int LineWidth = 0;
+    int TransparencyLevel = 0;
+    int AddMethod = 0;
+    int BeginIndex = 0;
+    int EndIndex = 0;
+    float BeginValue = 0.0f;
+    float EndValue = 0.0f;
+    SCString Text;
+    int TextAlignment = 0;
+    int FontSize = 0;
+    int TransparentLabelBackground = 0;
+    int ShowPrice = 0;
+    int AddAsUserDrawnDrawing = 0;
+    int AllowSaveToChartbook = 0;
+    int LineNumber = 0;
+    SubgraphLineStyles LineStyle = LINESTYLE_SOLID;
+};
+
+struct s_VolumeAtPriceV2 {
+    int PriceInTicks = 0;
+    unsigned int Volume = 0;
+    unsigned int BidVolume = 0;
+    unsigned int AskVolume = 0;
+    unsigned int NumberOfTrades = 0;
+};
+
+struct s_TimeAndSales {
+    int Type = 0;
+    float Price = 0.0f;
+    float Bid = 0.0f;
+    float Ask = 0.0f;
+    unsigned int Volume = 0;
+    SCDateTime DateTime;
+    unsigned int Sequence = 0;
+};
+
+namespace n_ACSIL {
+    struct s_StudyProfileInformation {
+        SCDateTime m_StartDateTime;
+        SCDateTime m_EndDateTime;
+        int m_BeginIndex = 0;
+        int m_EndIndex = 0;
+    };
+}
+
+// Chart data supplied by the test program. Profiles are numbered back from the current session (0).
+int TestGetNumPriceLevelsForStudyProfile(int profileIndex);
+int TestGetStudyProfileInformation(int profileIndex, n_ACSIL::s_StudyProfileInformation& information);
+int TestGetVolumeAtPriceDataForStudyProfile(int profileIndex, int levelIndex, s_VolumeAtPriceV2& volumeAtPrice);
+int TestGetVAPSizeAtBarIndex(unsigned int barIndex);
+bool TestGetVAPElementAtIndex(unsigned int barIndex, int index, s_VolumeAtPriceV2** volumeAtPrice);
+const std::vector<s_TimeAndSales>* TestGetTimeAndSales();
+void TestAddMessageToLog(const char* message);
+void TestSetAlert(int alertNumber, const char* message);
+
+struct c_VAPContainer {
+    int GetSizeAtBarIndex(unsigned int barIndex) { return TestGetVAPSizeAtBarIndex(barIndex); }
+    bool GetVAPElementAtIndex(unsigned int barIndex, int index, s_VolumeAtPriceV2** volumeAtPrice) { return TestGetVAPElementAtIndex(barIndex, index, volumeAtPrice); }
+};
+
+struct c_SCTimeAndSalesArray {
+    const std::vector<s_TimeAndSales>* Records = nullptr;
+    int Size() const { return Records != nullptr ? static_cast<int>(Records->size()) : 0; }
+    const s_TimeAndSales& operator[](int index) const { return (*Records)[index]; }
+};
+
+struct SCInput {
+    int IntValue = 0;
+    float FloatValue = 0.0f;
+    COLORREF ColorValue = 0;
+    const char* StringValue = "";
+    const char* Name = "";
+    void SetInt(int value) { IntValue = value; }
+    int GetInt() { return IntValue; }
+    void SetIntLimits(int, int) {}
+    void SetFloat(float value) { FloatValue = value; }
+    float GetFloat() { return FloatValue; }
+    void SetFloatLimits(float, float) {}
+    void SetYesNo(int value) { IntValue = value; }
+    int GetYesNo() { return IntValue; }
+    void SetColor(COLORREF value) { ColorValue = value; }
+    COLORREF GetColor() { return ColorValue; }
+    void SetStudyID(int value) { IntValue = value; }
+    int GetStudyID() { return IntValue; }
+    void SetCustomInputStrings(const char*) {}
+    void SetCustomInputIndex(int value) { IntValue = value; }
+    int GetIndex() { return IntValue; }
+    void SetString(const char* value) { StringValue = value; }
+    const char* GetString() { return StringValue; }
+};
+typedef SCInput& SCInputRef;
+
+struct SCSubgraph {
+    SCString Name;
+    int DrawStyle = 0;
+    COLORREF PrimaryColor = 0;
+    int LineWidth = 0;
+    int DrawZeros = 0;
+    SCFloatArray Data;
+    std::vector<float> Values; // Sized by the test to the chart's bars
+    float& operator[](int index) { return Values[index]; }
+};
+typedef SCSubgraph& SCSubgraphRef;
+
+struct s_sc {
+    int SetDefaults = 0;
+    int AutoLoop = 0;
+    int UpdateAlways = 0;
+    int GraphRegion = 0;
+    int ArraySize = 0;
+    int ChartNumber = 0;
+    int IsFullRecalculation = 0;
+    int LastCallToFunction = 0;
+    int MaintainVolumeAtPriceData = 0;
+    int UpdateStartIndex = 0;
+    int Index = 0;
+    int StudyGraphInstanceID = 0;
+    int ValueFormat = 0;
+    int FreeDLL = 0;
+    int DrawZeros = 0;
+    int DrawStudyUnderneathMainPriceGraph = 0;
+    float TickSize = 0.0f;
+    float RealTimePriceMultiplier = 1.0f;
+    SCDateTime TimeScaleAdjustment;
+    SCDateTime CurrentSystemDateTime;
+    SCString GraphName;
+    SCString StudyDescription;
+    SCString Symbol;
+    SCFloatArray High, Low, Close, Open, Volume;
+    SCDateTimeArray BaseDateTimeIn;
+    SCInput Input[128];
+    SCSubgraph Subgraph[60];
+    c_VAPContainer* VolumeAtPriceForBars = nullptr;
+    void* PersistentPointer = nullptr;
+    int PersistentInt = 0;
+    int NextLineNumber = 1;
+
+    void AddMessageToLog(const char* message, int) { TestAddMessageToLog(message); }
+    int SetAlert(int alertNumber, const char* message) { TestSetAlert(alertNumber, message); return 0; }
+    int DeleteACSChartDrawing(int, int, int) { return 0; }
+    int DeleteUserDrawnACSDrawing(int, int) { return 0; }
+    int UseTool(s_UseTool& tool) { if (tool.LineNumber == 0) tool.LineNumber = NextLineNumber++; return 1; }
+    float GetHighest(SCFloatArrayRef values, int begin, int end) { float highest = -3e38f; for (int n = begin; n <= end; ++n) highest = values[n] > highest ? values[n] : highest; return highest; }
+    float GetLowest(SCFloatArrayRef values, int begin, int end) { float lowest = 3e38f; for (int n = begin; n <= end; ++n) lowest = values[n] < lowest ? values[n] : lowest; return lowest; }
+    float RoundToTickSize(float value, float) { return value; }
+    int GetNumPriceLevelsForStudyProfile(int, int profileIndex) { return TestGetNumPriceLevelsForStudyProfile(profileIndex); }
+    int GetStudyProfileInformation(int, int profileIndex, n_ACSIL::s_StudyProfileInformation& information) { return TestGetStudyProfileInformation(profileIndex, information); }
+    int GetVolumeAtPriceDataForStudyProfile(int, int profileIndex, int levelIndex, s_VolumeAtPriceV2& volumeAtPrice) { return TestGetVolumeAtPriceDataForStudyProfile(profileIndex, levelIndex, volumeAtPrice); }
+    int GetStudyArrayUsingID(int, int, SCFloatArrayRef) { return 0; }
+    int GetTimeAndSales(c_SCTimeAndSalesArray& records) { records.Records = TestGetTimeAndSales(); return 1; }
+    void* GetPersistentPointer(int) { return PersistentPointer; }
+    void SetPersistentPointer(int, void* pointer) { PersistentPointer = pointer; }
+    int& GetPersistentInt(int) { return PersistentInt; }
+    SCString DataFilesFolder() { return SCString("."); }
+    int GetContainingIndexForSCDateTime(int, SCDateTime dateTime) {
+        int index = 0;
+        while (index + 1 < ArraySize && BaseDateTimeIn[index + 1] <= dateTime) ++index;
+        return index;
+    }
+    SCDateTime GetTradingDayStartDateTimeOfBar(SCDateTime dateTime) { return SCDateTime(std::floor(dateTime.GetAsDouble() + 1e-9)); }
+    int GetTradingDayDate(SCDateTime dateTime) { return static_cast<int>(dateTime.GetAsDouble()); }
+    SCDateTime GetCurrentDateTime() { return CurrentSystemDateTime; }
+    int ChartIsDownloadingHistoricalData(int) { return 0; }
+};
+typedef s_sc& SCStudyInterfaceRef;